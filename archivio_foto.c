@@ -0,0 +1,213 @@
+#include "archivio_foto.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Byte letti e scritti per volta durante la copia
+#define BLOCCO_COPIA (1024 * 1024)
+#define CARTELLA_MINIATURE "miniature"
+// Prefisso delle copie in corso, rinominate con l'hash a copia finita
+#define PREFISSO_TEMPORANEO ".aggiunta-"
+
+struct ArchivioFoto {
+    gchar *cartella;
+};
+
+ArchivioFoto *archivio_foto_apri(const gchar *cartella, char *errore, size_t dim_errore) {
+    if (g_mkdir_with_parents(cartella, 0755) != 0) {
+        snprintf(errore, dim_errore, "%s: %s", cartella, g_strerror(errno));
+        return NULL;
+    }
+    ArchivioFoto *archivio = g_new0(ArchivioFoto, 1);
+    archivio->cartella = g_strdup(cartella);
+    return archivio;
+}
+
+void archivio_foto_chiudi(ArchivioFoto *archivio) {
+    if (!archivio) {
+        return;
+    }
+    g_free(archivio->cartella);
+    g_free(archivio);
+}
+
+static gboolean hash_valido(const gchar *testo, gsize lunghezza) {
+    if (lunghezza != ARCHIVIO_FOTO_LUNGHEZZA_HASH) {
+        return FALSE;
+    }
+    for (gsize i = 0; i < lunghezza; i++) {
+        if (!g_ascii_isxdigit(testo[i]) || g_ascii_isupper(testo[i])) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// I file sono divisi in sottocartelle per le prime due cifre dell'hash,
+// così nessuna cartella diventa troppo grande
+gchar *archivio_foto_percorso(ArchivioFoto *archivio, const gchar *hash) {
+    gchar prefisso[3] = { hash[0], hash[0] ? hash[1] : '\0', '\0' };
+    return g_build_filename(archivio->cartella, prefisso, hash, NULL);
+}
+
+gchar *archivio_foto_percorso_miniatura(ArchivioFoto *archivio, const gchar *hash, gint lato) {
+    gchar prefisso[3] = { hash[0], hash[0] ? hash[1] : '\0', '\0' };
+    gchar *nome = g_strdup_printf("%s-%d.png", hash, lato);
+    gchar *percorso = g_build_filename(archivio->cartella, CARTELLA_MINIATURE, prefisso, nome, NULL);
+    g_free(nome);
+    return percorso;
+}
+
+static gboolean scrivi_tutto(int fd, const guchar *dati, gssize n) {
+    while (n > 0) {
+        gssize scritti = write(fd, dati, (size_t)n);
+        if (scritti < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+        dati += scritti;
+        n -= scritti;
+    }
+    return TRUE;
+}
+
+gchar *archivio_foto_aggiungi(ArchivioFoto *archivio, const gchar *percorso, gint64 *dimensione,
+                              char *errore, size_t dim_errore) {
+    int in = g_open(percorso, O_RDONLY, 0);
+    if (in < 0) {
+        snprintf(errore, dim_errore, "%s: %s", percorso, g_strerror(errno));
+        return NULL;
+    }
+    gchar *temporaneo = g_build_filename(archivio->cartella, PREFISSO_TEMPORANEO "XXXXXX", NULL);
+    int out = g_mkstemp(temporaneo);
+    if (out < 0) {
+        snprintf(errore, dim_errore, "%s: %s", archivio->cartella, g_strerror(errno));
+        close(in);
+        g_free(temporaneo);
+        return NULL;
+    }
+    fchmod(out, 0644);
+
+    // Una sola lettura del file: ogni blocco va sia all'hash sia alla copia
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    guchar *buffer = g_malloc(BLOCCO_COPIA);
+    gint64 totale = 0;
+    gboolean ok = TRUE;
+    for (;;) {
+        gssize letti = read(in, buffer, BLOCCO_COPIA);
+        if (letti < 0 && errno == EINTR) {
+            continue;
+        }
+        if (letti < 0) {
+            snprintf(errore, dim_errore, "%s: %s", percorso, g_strerror(errno));
+            ok = FALSE;
+            break;
+        }
+        if (letti == 0) {
+            break;
+        }
+        g_checksum_update(checksum, buffer, letti);
+        if (!scrivi_tutto(out, buffer, letti)) {
+            snprintf(errore, dim_errore, "%s: %s", temporaneo, g_strerror(errno));
+            ok = FALSE;
+            break;
+        }
+        totale += letti;
+    }
+    g_free(buffer);
+    close(in);
+    // Il file deve essere su disco prima che il database lo citi
+    if (ok && fsync(out) != 0) {
+        snprintf(errore, dim_errore, "%s: %s", temporaneo, g_strerror(errno));
+        ok = FALSE;
+    }
+    if (close(out) != 0 && ok) {
+        snprintf(errore, dim_errore, "%s: %s", temporaneo, g_strerror(errno));
+        ok = FALSE;
+    }
+
+    gchar *hash = ok ? g_strdup(g_checksum_get_string(checksum)) : NULL;
+    g_checksum_free(checksum);
+
+    if (hash) {
+        gchar *destinazione = archivio_foto_percorso(archivio, hash);
+        gchar *cartella = g_path_get_dirname(destinazione);
+        if (g_file_test(destinazione, G_FILE_TEST_EXISTS)) {
+            // Stesso contenuto già in archivio: basta collegarlo
+            g_unlink(temporaneo);
+        } else if (g_mkdir_with_parents(cartella, 0755) != 0 || g_rename(temporaneo, destinazione) != 0) {
+            snprintf(errore, dim_errore, "%s: %s", destinazione, g_strerror(errno));
+            g_clear_pointer(&hash, g_free);
+        }
+        g_free(cartella);
+        g_free(destinazione);
+    }
+    if (!hash) {
+        g_unlink(temporaneo);
+    } else if (dimensione) {
+        *dimensione = totale;
+    }
+    g_free(temporaneo);
+    return hash;
+}
+
+// Elimina dalla cartella i file "hash" o "hash-lato.png" il cui hash non è più usato
+static gint pulisci_cartella(const gchar *cartella, Repository *repo, gboolean miniature) {
+    GDir *dir = g_dir_open(cartella, 0, NULL);
+    if (!dir) {
+        return 0;
+    }
+    gint eliminati = 0;
+    const gchar *nome;
+    while ((nome = g_dir_read_name(dir))) {
+        gsize lunghezza = miniature ? strcspn(nome, "-") : strlen(nome);
+        if (!hash_valido(nome, lunghezza)) {
+            continue;
+        }
+        gchar *hash = g_strndup(nome, lunghezza);
+        if (repo_foto_usata(repo, hash) == 0) {
+            gchar *percorso = g_build_filename(cartella, nome, NULL);
+            if (g_unlink(percorso) == 0) {
+                eliminati++;
+            }
+            g_free(percorso);
+        }
+        g_free(hash);
+    }
+    g_dir_close(dir);
+    return eliminati;
+}
+
+gint archivio_foto_pulisci(ArchivioFoto *archivio, Repository *repo) {
+    gint eliminati = 0;
+    const gchar *radici[] = { archivio->cartella, NULL };
+    gchar *cartella_miniature = g_build_filename(archivio->cartella, CARTELLA_MINIATURE, NULL);
+    radici[1] = cartella_miniature;
+
+    for (int r = 0; r < 2; r++) {
+        GDir *dir = g_dir_open(radici[r], 0, NULL);
+        if (!dir) {
+            continue;
+        }
+        const gchar *nome;
+        while ((nome = g_dir_read_name(dir))) {
+            gchar *percorso = g_build_filename(radici[r], nome, NULL);
+            if (r == 0 && g_str_has_prefix(nome, PREFISSO_TEMPORANEO)) {
+                // Copia interrotta (es. chiusura durante un'aggiunta)
+                g_unlink(percorso);
+            } else if (strlen(nome) == 2 && g_ascii_isxdigit(nome[0]) && g_ascii_isxdigit(nome[1])) {
+                eliminati += pulisci_cartella(percorso, repo, r == 1);
+            }
+            g_free(percorso);
+        }
+        g_dir_close(dir);
+    }
+    g_free(cartella_miniature);
+    return eliminati;
+}
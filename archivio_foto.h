@@ -0,0 +1,48 @@
+#ifndef ARCHIVIO_FOTO_H
+#define ARCHIVIO_FOTO_H
+
+#include <glib.h>
+
+#include "repository.h"
+
+G_BEGIN_DECLS
+
+// Archivio delle foto degli articoli su disco, indirizzato per contenuto:
+// ogni file è salvato una sola volta con l'hash SHA-256 del contenuto come
+// nome, quindi la stessa immagine aggiunta a più articoli (o due volte)
+// occupa spazio una volta sola. Il database tiene solo il collegamento
+// articolo -> hash (tabella foto).
+//
+//   CARTELLA/ab/abcdef...                 originale
+//   CARTELLA/miniature/ab/abcdef...-64.png miniatura di lato 64
+//
+// I file non vengono mai modificati dopo la scrittura: un hash identifica
+// sempre lo stesso contenuto, e le miniature non vanno mai invalidate.
+
+#define ARCHIVIO_FOTO_LUNGHEZZA_HASH 64
+
+typedef struct ArchivioFoto ArchivioFoto;
+
+// Crea la cartella se manca; NULL con la descrizione in "errore" se non si può
+ArchivioFoto *archivio_foto_apri(const gchar *cartella, char *errore, size_t dim_errore);
+void archivio_foto_chiudi(ArchivioFoto *archivio);
+
+// Copia il file nell'archivio calcolandone l'hash in una sola lettura; se
+// il contenuto c'è già la copia viene scartata. Restituisce l'hash (da
+// liberare con g_free) e in *dimensione i byte del file, oppure NULL con la
+// descrizione in "errore".
+gchar *archivio_foto_aggiungi(ArchivioFoto *archivio, const gchar *percorso, gint64 *dimensione,
+                              char *errore, size_t dim_errore);
+
+// Percorso dell'originale e della miniatura di lato "lato" (da liberare con g_free)
+gchar *archivio_foto_percorso(ArchivioFoto *archivio, const gchar *hash);
+gchar *archivio_foto_percorso_miniatura(ArchivioFoto *archivio, const gchar *hash, gint lato);
+
+// Elimina originali e miniature che nessun articolo usa più (es. dopo
+// l'eliminazione di un articolo). Va eseguita dal thread di scrittura, così
+// non si sovrappone a un'aggiunta in corso. Restituisce i file eliminati.
+gint archivio_foto_pulisci(ArchivioFoto *archivio, Repository *repo);
+
+G_END_DECLS
+
+#endif
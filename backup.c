@@ -0,0 +1,127 @@
+#include "backup.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "traccia.h"
+
+// Rende permanente la rinomina: senza l'fsync della cartella, dopo un
+// blocco del sistema il file potrebbe tornare al nome temporaneo
+static void sincronizza_cartella(const char *percorso) {
+    const char *barra = strrchr(percorso, '/');
+    char cartella[1024];
+    if (!barra) {
+        snprintf(cartella, sizeof(cartella), ".");
+    } else {
+        snprintf(cartella, sizeof(cartella), "%.*s", barra == percorso ? 1 : (int)(barra - percorso), percorso);
+    }
+    int fd = open(cartella, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// Esegue la copia pagina per pagina; la transazione di lettura su
+// "origine" è già aperta
+static int copia_pagine(sqlite3 *origine, sqlite3 *copia, BackupProgresso progresso, void *user_data,
+                        int *pagine, char *errore, size_t dim_errore) {
+    sqlite3_backup *backup = sqlite3_backup_init(copia, "main", origine, "main");
+    if (!backup) {
+        snprintf(errore, dim_errore, "%s", sqlite3_errmsg(copia));
+        return sqlite3_errcode(copia);
+    }
+    int rc;
+    do {
+        uint64_t t = traccia_inizio();
+        rc = sqlite3_backup_step(backup, BACKUP_PAGINE_PER_PASSO);
+        traccia_fine("backup", "passo", t, BACKUP_PAGINE_PER_PASSO, 0);
+        int totali = sqlite3_backup_pagecount(backup);
+        *pagine = totali - sqlite3_backup_remaining(backup);
+        if ((rc == SQLITE_OK || rc == SQLITE_DONE) && progresso &&
+            !progresso(*pagine, totali, user_data)) {
+            rc = SQLITE_INTERRUPT;
+            break;
+        }
+        if (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            sqlite3_sleep(BACKUP_PAUSA_MS);
+        }
+    } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+
+    int rc_fine = sqlite3_backup_finish(backup);
+    if (rc == SQLITE_DONE) {
+        rc = rc_fine;
+    }
+    if (rc != SQLITE_OK && rc != SQLITE_INTERRUPT) {
+        snprintf(errore, dim_errore, "%s", sqlite3_errstr(rc));
+    }
+    return rc;
+}
+
+int backup_copia(sqlite3 *origine, const char *destinazione, BackupProgresso progresso,
+                 void *user_data, int *pagine, char *errore, size_t dim_errore) {
+    size_t lunghezza = strlen(destinazione);
+    char *temporaneo = malloc(lunghezza + 5);
+    if (!temporaneo) {
+        snprintf(errore, dim_errore, "Memoria esaurita");
+        return SQLITE_NOMEM;
+    }
+    memcpy(temporaneo, destinazione, lunghezza);
+    memcpy(temporaneo + lunghezza, ".tmp", 5);
+    unlink(temporaneo);
+
+    sqlite3 *copia = NULL;
+    int rc = sqlite3_open_v2(temporaneo, &copia, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, NULL);
+    if (rc != SQLITE_OK) {
+        snprintf(errore, dim_errore, "Impossibile creare %s: %s", temporaneo, sqlite3_errmsg(copia));
+        sqlite3_close(copia);
+        free(temporaneo);
+        return rc;
+    }
+
+    // La transazione di lettura fissa lo stato copiato: le scritture delle
+    // altre connessioni non fanno ripartire la copia. Se il chiamante ne ha
+    // già una aperta si usa quella.
+    int transazione = sqlite3_get_autocommit(origine);
+    if (transazione) {
+        rc = sqlite3_exec(origine, "BEGIN; SELECT COUNT(*) FROM sqlite_schema;", NULL, NULL, NULL);
+        if (rc != SQLITE_OK) {
+            snprintf(errore, dim_errore, "%s", sqlite3_errmsg(origine));
+            sqlite3_exec(origine, "ROLLBACK;", NULL, NULL, NULL);
+            transazione = 0;
+        }
+    }
+    int copiate = 0;
+    if (rc == SQLITE_OK) {
+        rc = copia_pagine(origine, copia, progresso, user_data, &copiate, errore, dim_errore);
+    }
+    if (transazione) {
+        sqlite3_exec(origine, "COMMIT;", NULL, NULL, NULL);
+    }
+    // Le pagine portano con sé la modalità WAL dell'originale
+    if (rc == SQLITE_OK && sqlite3_exec(copia, "PRAGMA journal_mode = DELETE;", NULL, NULL, NULL) != SQLITE_OK) {
+        snprintf(errore, dim_errore, "%s", sqlite3_errmsg(copia));
+        rc = sqlite3_errcode(copia);
+    }
+    if (sqlite3_close(copia) != SQLITE_OK && rc == SQLITE_OK) {
+        snprintf(errore, dim_errore, "Errore di chiusura di %s", temporaneo);
+        rc = SQLITE_IOERR;
+    }
+
+    if (rc == SQLITE_OK && rename(temporaneo, destinazione) != 0) {
+        snprintf(errore, dim_errore, "Impossibile rinominare %s in %s", temporaneo, destinazione);
+        rc = SQLITE_CANTOPEN;
+    }
+    if (rc == SQLITE_OK) {
+        sincronizza_cartella(destinazione);
+        if (pagine) {
+            *pagine = copiate;
+        }
+    } else {
+        unlink(temporaneo);
+    }
+    free(temporaneo);
+    return rc;
+}
@@ -0,0 +1,35 @@
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include <stddef.h>
+#include <sqlite3.h>
+
+// Copia del database mentre il programma lavora, con l'API di backup di
+// SQLite. La copia legge da una connessione qualsiasi (basta la sola
+// lettura) dentro una transazione di lettura: con il WAL le scritture degli
+// altri continuano e la copia è lo stato del database all'inizio, senza
+// ricominciare a ogni vendita. Le pagine vengono copiate a piccoli passi
+// con una breve pausa tra l'uno e l'altro, così le altre letture non
+// restano in attesa del disco.
+//
+// Il file viene scritto con un nome temporaneo e rinominato solo a copia
+// conclusa: un file con il nome scelto è sempre una copia completa. La
+// copia è in modalità journal DELETE, un solo file da spostare.
+
+// Pagine copiate per passo (con pagine da 4 KiB, 1 MiB) e pausa tra due passi
+#define BACKUP_PAGINE_PER_PASSO 256
+#define BACKUP_PAUSA_MS 2
+
+// Chiamata dopo ogni passo con le pagine copiate e quelle totali; se
+// restituisce 0 la copia si interrompe
+typedef int (*BackupProgresso)(int copiate, int totali, void *user_data);
+
+// Copia "origine" in "destinazione", sostituendola se esiste. Restituisce
+// SQLITE_OK e in *pagine (se non NULL) le pagine copiate, SQLITE_INTERRUPT
+// se interrotta da "progresso" (che può essere NULL), altrimenti un codice
+// SQLite con la descrizione in "errore". Se non riesce la destinazione non
+// viene toccata.
+int backup_copia(sqlite3 *origine, const char *destinazione, BackupProgresso progresso,
+                 void *user_data, int *pagine, char *errore, size_t dim_errore);
+
+#endif
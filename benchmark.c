@@ -0,0 +1,991 @@
+// Benchmark del magazzino senza interfaccia grafica. Riempie un database con
+// dati sintetici deterministici (stesso seme, stessi dati) e misura le
+// operazioni che l'applicazione esegue: apertura, caricamento della lista
+// anche ordinata per colonna e filtrata, inserimenti, vendite anche da più
+// scrittori insieme, eliminazioni, ricerca e report, e infine le stesse
+// vendite da più terminali attraverso il server di sincronizzazione su
+// 127.0.0.1 (vedi sincronizzazione.h), il backup mentre si vende e il
+// ripristino dal backup con il giornale delle modifiche. Ogni misura è una riga JSON su
+// stdout, facile da confrontare tra una versione e l'altra:
+//
+//   {"prova":"vendita","n":1000,"p50_ms":0.041,"p99_ms":0.210,"righe_s":21450.3}
+//
+// Uso: benchmark [--articoli N] [--db PERCORSO] [--seme N] [--scrittori N] [--riusa]
+//                 [--traccia FILE]
+// Con --traccia gli ultimi eventi di ogni thread (vedi traccia.h) vengono
+// salvati in FILE nel formato di Chrome. Si compila senza GTK, vedi README.
+
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "backup.h"
+#include "connessione.h"
+#include "esporta.h"
+#include "giornale.h"
+#include "repository.h"
+#include "schema.h"
+#include "sincronizzazione.h"
+#include "traccia.h"
+
+#define BENCH_DB_PREDEFINITO "benchmark.db"
+#define BENCH_ARTICOLI_PREDEFINITI 100000
+// Vendite generate per ogni articolo, in media
+#define BENCH_VENDITE_PER_ARTICOLO 0.5
+// Righe per transazione durante la generazione
+#define BENCH_BLOCCO 10000
+// Ripetizioni delle misure di latenza
+#define BENCH_RIPETIZIONI 1000
+#define BENCH_RIPETIZIONI_LENTE 100
+#define BENCH_SCRITTORI_PREDEFINITI 4
+#define BENCH_RIGHE_PAGINA 256
+
+// --- Generatore deterministico ---
+
+typedef struct {
+    uint64_t stato;
+} Generatore;
+
+// xorshift64*: veloce, con la stessa sequenza su ogni piattaforma
+static uint64_t casuale(Generatore *g) {
+    g->stato ^= g->stato >> 12;
+    g->stato ^= g->stato << 25;
+    g->stato ^= g->stato >> 27;
+    return g->stato * 0x2545F4914F6CDD1DULL;
+}
+
+static int casuale_fino(Generatore *g, int n) {
+    return (int)(casuale(g) % (uint64_t)n);
+}
+
+static const char *oggetti[] = {
+    "Vaso", "Dipinto", "Cassettone", "Specchiera", "Tavolo", "Sedia", "Scultura",
+    "Orologio", "Lampada", "Candelabro", "Cornice", "Arazzo", "Busto", "Cofanetto",
+    "Credenza", "Stampa", "Icona", "Scrittoio", "Poltrona", "Piatto",
+};
+static const char *materiali[] = {
+    "dorato", "intarsiato", "laccato", "in noce", "in bronzo", "in argento",
+    "dipinto a mano", "in marmo", "in ciliegio", "in porcellana", "in maiolica", "in vetro",
+};
+static const char *nomi_artisti[] = {
+    "Giovanni", "Antonio", "Francesco", "Giuseppe", "Luigi", "Maria", "Carlo",
+    "Pietro", "Angelo", "Domenico", "Teresa", "Paolo", "Lorenzo", "Giacomo",
+};
+static const char *cognomi_artisti[] = {
+    "Rossi", "Bianchi", "Ferrari", "Esposito", "Romano", "Colombo", "Ricci",
+    "Marino", "Greco", "Bruno", "Gallo", "Conti", "De Luca", "Mancini", "Costa",
+    "Giordano", "Rizzo", "Lombardi", "Moretti", "Barbieri",
+};
+static const char *periodi[] = {
+    "Rinascimento", "Seicento", "Barocco", "Settecento", "Rococò", "Luigi XVI",
+    "Impero", "Biedermeier", "Ottocento", "Liberty", "Art Déco", "Novecento",
+};
+// Testi cercati nella prova di ricerca: parole intere, prefissi e combinazioni
+static const char *ricerche[] = {
+    "vaso", "dip", "bronzo", "rossi", "settecento", "cassettone noce",
+    "gio", "art déco", "specchiera dorata", "maiolica", "lor mor", "impero",
+};
+
+#define N_ELEMENTI(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+// Data AAAA-MM-GG di "giorni" dopo il 1970-01-01 (calendario gregoriano)
+static void data_da_giorni(long giorni, char data[11]) {
+    giorni += 719468;
+    long era = giorni / 146097;
+    long giorno_era = giorni - era * 146097;
+    long anno_era = (giorno_era - giorno_era / 1460 + giorno_era / 36524 - giorno_era / 146096) / 365;
+    long anno = anno_era + era * 400;
+    long giorno_anno = giorno_era - (365 * anno_era + anno_era / 4 - anno_era / 100);
+    long mp = (5 * giorno_anno + 2) / 153;
+    long giorno = giorno_anno - (153 * mp + 2) / 5 + 1;
+    long mese = mp < 10 ? mp + 3 : mp - 9;
+    char testo[32];
+    snprintf(testo, sizeof(testo), "%04ld-%02ld-%02ld", anno + (mese <= 2), mese, giorno);
+    memcpy(data, testo, 10);
+    data[10] = '\0';
+}
+
+// Giorni dal 1970 al 2015-01-01: le date generate coprono dieci anni da lì
+#define BENCH_PRIMO_GIORNO 16436
+#define BENCH_GIORNI 3650
+
+// --- Misure ---
+
+typedef struct {
+    double *campioni;       // durate in secondi
+    int n;
+    int capacita;
+} Misure;
+
+static double adesso(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void misure_aggiungi(Misure *m, double durata) {
+    if (m->n == m->capacita) {
+        m->capacita = m->capacita ? m->capacita * 2 : 1024;
+        m->campioni = realloc(m->campioni, sizeof(double) * (size_t)m->capacita);
+        if (!m->campioni) {
+            fprintf(stderr, "Memoria esaurita\n");
+            exit(1);
+        }
+    }
+    m->campioni[m->n++] = durata;
+}
+
+static int confronta_durate(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const Misure *m, int p) {
+    if (m->n == 0) {
+        return 0;
+    }
+    int i = (int)((long)(m->n - 1) * p / 100);
+    return m->campioni[i];
+}
+
+// Stampa la riga JSON della prova; "righe" sono le righe elaborate in
+// "totale" secondi (tempo reale, che con più thread non è la somma dei campioni)
+static void riporta(const char *prova, Misure *m, long righe, double totale) {
+    qsort(m->campioni, (size_t)m->n, sizeof(double), confronta_durate);
+    printf("{\"prova\":\"%s\",\"n\":%d,\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"righe_s\":%.1f}\n",
+           prova, m->n, percentile(m, 50) * 1e3, percentile(m, 99) * 1e3,
+           totale > 0 ? righe / totale : 0);
+    fflush(stdout);
+    free(m->campioni);
+    memset(m, 0, sizeof(*m));
+}
+
+// --- Apertura ---
+
+static Repository *apri(const ConfigDB *config, int scrittura) {
+    sqlite3 *db = NULL;
+    int rc = scrittura ? db_apri_scrittura(config, &db) : db_apri_lettura(config, &db);
+    if (rc != SQLITE_OK || (scrittura && schema_aggiorna(db) != SQLITE_OK)) {
+        fprintf(stderr, "Impossibile aprire %s\n", config->percorso);
+        sqlite3_close(db);
+        return NULL;
+    }
+    Repository *repo = repo_apri(db);
+    if (!repo) {
+        sqlite3_close(db);
+    }
+    return repo;
+}
+
+static void chiudi(Repository *repo) {
+    sqlite3 *db = repo_db(repo);
+    repo_chiudi(repo);
+    sqlite3_close(db);
+}
+
+// --- Generazione ---
+
+static void genera_articolo(Generatore *g, char *nome, size_t dim_nome, char *artista, size_t dim_artista,
+                            char *misure, size_t dim_misure, char data[11], NuovoArticolo *articolo) {
+    snprintf(nome, dim_nome, "%s %s", oggetti[casuale_fino(g, N_ELEMENTI(oggetti))],
+             materiali[casuale_fino(g, N_ELEMENTI(materiali))]);
+    snprintf(artista, dim_artista, "%s %s", nomi_artisti[casuale_fino(g, N_ELEMENTI(nomi_artisti))],
+             cognomi_artisti[casuale_fino(g, N_ELEMENTI(cognomi_artisti))]);
+    snprintf(misure, dim_misure, "%dx%d cm", 10 + casuale_fino(g, 190), 10 + casuale_fino(g, 190));
+    data_da_giorni(BENCH_PRIMO_GIORNO + casuale_fino(g, BENCH_GIORNI), data);
+
+    articolo->nome = nome;
+    articolo->descrizione = casuale_fino(g, 4) == 0 ? NULL : "Provenienza da collezione privata, buono stato";
+    articolo->artista = casuale_fino(g, 5) == 0 ? NULL : artista;
+    articolo->periodo = periodi[casuale_fino(g, N_ELEMENTI(periodi))];
+    articolo->misure = misure;
+    articolo->data_acquisizione = data;
+    articolo->prezzo_acquisto = 50 + casuale_fino(g, 500000) / 100.0;
+    // La maggior parte dei pezzi è unica
+    articolo->quantita = casuale_fino(g, 10) < 7 ? 1 : 2 + casuale_fino(g, 4);
+}
+
+// Inserisce gli articoli a blocchi, come l'importazione; misura ogni blocco
+static int genera_articoli(Repository *repo, Generatore *g, long n) {
+    Misure m = {0};
+    double inizio = adesso();
+    char nome[128], artista[64], misure[32], data[11];
+    sqlite3_int64 ultimo_id;
+
+    for (long fatti = 0; fatti < n; ) {
+        double t = adesso();
+        if (repo_inizia_transazione(repo) != SQLITE_OK ||
+            schema_sospendi_ricerca(repo_db(repo), &ultimo_id) != SQLITE_OK) {
+            return -1;
+        }
+        long blocco = n - fatti < BENCH_BLOCCO ? n - fatti : BENCH_BLOCCO;
+        for (long i = 0; i < blocco; i++) {
+            NuovoArticolo articolo;
+            genera_articolo(g, nome, sizeof(nome), artista, sizeof(artista), misure, sizeof(misure), data, &articolo);
+            if (repo_insert_articolo(repo, &articolo, NULL) != SQLITE_OK) {
+                fprintf(stderr, "Errore inserimento: %s\n", repo_errmsg(repo));
+                repo_termina_transazione(repo, 0);
+                return -1;
+            }
+        }
+        int rc = schema_riprendi_ricerca(repo_db(repo), ultimo_id);
+        if (repo_termina_transazione(repo, rc == SQLITE_OK) != SQLITE_OK) {
+            return -1;
+        }
+        fatti += blocco;
+        misure_aggiungi(&m, adesso() - t);
+    }
+    riporta("genera_articoli_blocco", &m, n, adesso() - inizio);
+    return 0;
+}
+
+// Registra vendite giorno per giorno con il carrello, in ordine di data
+static int genera_vendite(Repository *repo, Generatore *g, long n_articoli) {
+    long n = (long)(n_articoli * BENCH_VENDITE_PER_ARTICOLO);
+    int per_giorno = (int)(n / BENCH_GIORNI) + 1;
+    RigaCarrello *carrello = calloc((size_t)per_giorno, sizeof(RigaCarrello));
+    if (!carrello) {
+        return -1;
+    }
+
+    Misure m = {0};
+    double inizio = adesso();
+    long registrate = 0;
+    char data[11];
+    for (long fatte = 0, giorno = 0; fatte < n; giorno++) {
+        int righe = n - fatte < per_giorno ? (int)(n - fatte) : per_giorno;
+        for (int i = 0; i < righe; i++) {
+            carrello[i].articolo_id = 1 + casuale_fino(g, (int)n_articoli);
+            carrello[i].prezzo_vendita = 100 + casuale_fino(g, 800000) / 100.0;
+            carrello[i].nome_cliente = casuale_fino(g, 3) == 0 ? NULL : "Cliente abituale";
+        }
+        data_da_giorni(BENCH_PRIMO_GIORNO + giorno % BENCH_GIORNI, data);
+        double t = adesso();
+        int vendute = repo_vendi_carrello(repo, carrello, righe, data);
+        if (vendute < 0) {
+            fprintf(stderr, "Errore vendita: %s\n", repo_errmsg(repo));
+            free(carrello);
+            return -1;
+        }
+        misure_aggiungi(&m, adesso() - t);
+        registrate += vendute;
+        fatte += righe;
+    }
+    riporta("genera_vendite_carrello", &m, registrate, adesso() - inizio);
+    free(carrello);
+    return 0;
+}
+
+// --- Prove ---
+
+static void prova_apertura(const ConfigDB *config) {
+    Misure m = {0};
+    for (int i = 0; i < BENCH_RIPETIZIONI_LENTE; i++) {
+        double t = adesso();
+        Repository *repo = apri(config, 1);
+        if (!repo) {
+            return;
+        }
+        chiudi(repo);
+        misure_aggiungi(&m, adesso() - t);
+    }
+    riporta("apertura", &m, 0, 0);
+}
+
+typedef struct {
+    long righe;
+    const CriteriLista *criteri;
+    CursoreLista cursore;   // ultima riga letta, da cui riparte la pagina seguente
+    char *testo;            // copia del testo del cursore
+    long fuori_ordine;      // righe che non seguono la precedente nell'ordine
+} Scorrimento;
+
+static void scorrimento_inizia(Scorrimento *s, const CriteriLista *criteri) {
+    memset(s, 0, sizeof(*s));
+    s->criteri = criteri;
+    s->cursore.inizio = 1;
+}
+
+// Confronta due righe come l'ordinamento dei criteri (testi come COLLATE NOCASE)
+static int confronta_cursori(const CriteriLista *criteri, const CursoreLista *a, const CursoreLista *b) {
+    int c = 0;
+    if (criteri->ordine != ORDINE_ID) {
+        if (a->testo) {
+            c = strcasecmp(a->testo, b->testo);
+        } else {
+            c = (a->numero > b->numero) - (a->numero < b->numero);
+        }
+    }
+    if (c == 0) {
+        c = (a->articolo_id > b->articolo_id) - (a->articolo_id < b->articolo_id);
+    }
+    return criteri->decrescente ? -c : c;
+}
+
+static void on_riga_lista(const RigaInventario *riga, void *user_data) {
+    Scorrimento *s = user_data;
+    CursoreLista cursore;
+    repo_cursore_riga(s->criteri, riga, &cursore);
+    if (!s->cursore.inizio && confronta_cursori(s->criteri, &s->cursore, &cursore) >= 0) {
+        s->fuori_ordine++;
+    }
+    free(s->testo);
+    s->testo = cursore.testo ? strdup(cursore.testo) : NULL;
+    cursore.testo = s->testo;
+    s->cursore = cursore;
+    s->righe++;
+}
+
+// Scorre la lista intera pagina per pagina, come con la barra di
+// scorrimento; 1 se le righe sono tutte in ordine e quante indica il conteggio
+static int scorri_lista(Repository *repo, const CriteriLista *criteri, Misure *m, long *righe) {
+    Scorrimento s;
+    scorrimento_inizia(&s, criteri);
+    for (;;) {
+        long prima = s.righe;
+        double t = adesso();
+        repo_query_page(repo, criteri, &s.cursore, 0, BENCH_RIGHE_PAGINA, on_riga_lista, &s);
+        misure_aggiungi(m, adesso() - t);
+        if (s.righe - prima < BENCH_RIGHE_PAGINA) {
+            break;
+        }
+    }
+    free(s.testo);
+    *righe += s.righe;
+    int attese = repo_conta_lista(repo, criteri);
+    if (s.fuori_ordine > 0 || s.righe != attese) {
+        fprintf(stderr, "Lista ordinata per %d%s: %ld righe su %d, %ld fuori ordine\n",
+                criteri->ordine, criteri->decrescente ? " decrescente" : "",
+                s.righe, attese, s.fuori_ordine);
+        return 0;
+    }
+    return 1;
+}
+
+// Caricamento della lista come all'avvio e ad "Aggiorna Lista": conteggio e
+// prima pagina; poi la lista intera pagina per pagina, come scorrendola
+static void prova_lista(Repository *repo) {
+    CriteriLista criteri;
+    repo_criteri_predefiniti(&criteri);
+    Misure m = {0};
+    double inizio = adesso();
+    long righe = 0;
+    for (int i = 0; i < BENCH_RIPETIZIONI; i++) {
+        Scorrimento s;
+        scorrimento_inizia(&s, &criteri);
+        double t = adesso();
+        repo_conta_articoli(repo);
+        repo_query_page(repo, &criteri, &s.cursore, 0, BENCH_RIGHE_PAGINA, on_riga_lista, &s);
+        misure_aggiungi(&m, adesso() - t);
+        free(s.testo);
+        righe += s.righe;
+    }
+    riporta("lista_prima_pagina", &m, righe, adesso() - inizio);
+
+    righe = 0;
+    inizio = adesso();
+    scorri_lista(repo, &criteri, &m, &righe);
+    riporta("lista_completa_pagina", &m, righe, adesso() - inizio);
+}
+
+// Filtri provati: stato, artista, periodo (scritto in minuscolo), prezzo e
+// una combinazione, ognuno con un ordinamento diverso
+static const CriteriLista filtri_prova[] = {
+    { ORDINE_STATO, 0, 0, NULL, NULL, -1, -1 },
+    { ORDINE_NOME, 0, -1, "Maria Rossi", NULL, -1, -1 },
+    { ORDINE_PREZZO, 1, -1, NULL, "barocco", -1, -1 },
+    { ORDINE_PREZZO, 0, -1, NULL, NULL, 100, 500 },
+    { ORDINE_ARTISTA, 0, 1, NULL, "Impero", 1000, -1 },
+};
+
+// Clic sull'intestazione di una colonna o su un filtro: conteggio e prima
+// pagina nel nuovo ordine, per ogni colonna nei due versi e per ogni
+// filtro; poi ogni ordinamento e filtro scorso per intero, controllando che
+// la paginazione per chiave non salti né ripeta righe. 0 se il controllo fallisce.
+static int prova_ordinamenti(Repository *repo) {
+    int ok = 1;
+    Misure m = {0};
+    long righe = 0;
+    double inizio = adesso();
+    for (int i = 0; i < BENCH_RIPETIZIONI_LENTE; i++) {
+        for (int ordine = 0; ordine < N_ORDINI * 2; ordine++) {
+            CriteriLista criteri;
+            repo_criteri_predefiniti(&criteri);
+            criteri.ordine = (OrdineLista)(ordine / 2);
+            criteri.decrescente = ordine % 2;
+            Scorrimento s;
+            scorrimento_inizia(&s, &criteri);
+            double t = adesso();
+            repo_conta_lista(repo, &criteri);
+            repo_query_page(repo, &criteri, &s.cursore, 0, BENCH_RIGHE_PAGINA, on_riga_lista, &s);
+            misure_aggiungi(&m, adesso() - t);
+            free(s.testo);
+            righe += s.righe;
+        }
+    }
+    riporta("lista_ordinata_prima_pagina", &m, righe, adesso() - inizio);
+
+    righe = 0;
+    inizio = adesso();
+    for (int i = 0; i < BENCH_RIPETIZIONI_LENTE; i++) {
+        const CriteriLista *criteri = &filtri_prova[i % N_ELEMENTI(filtri_prova)];
+        Scorrimento s;
+        scorrimento_inizia(&s, criteri);
+        double t = adesso();
+        repo_conta_lista(repo, criteri);
+        repo_query_page(repo, criteri, &s.cursore, 0, BENCH_RIGHE_PAGINA, on_riga_lista, &s);
+        misure_aggiungi(&m, adesso() - t);
+        free(s.testo);
+        righe += s.righe;
+    }
+    riporta("lista_filtrata_prima_pagina", &m, righe, adesso() - inizio);
+
+    righe = 0;
+    inizio = adesso();
+    for (int ordine = 0; ordine < N_ORDINI * 2; ordine++) {
+        CriteriLista criteri;
+        repo_criteri_predefiniti(&criteri);
+        criteri.ordine = (OrdineLista)(ordine / 2);
+        criteri.decrescente = ordine % 2;
+        ok &= scorri_lista(repo, &criteri, &m, &righe);
+    }
+    for (int i = 0; i < N_ELEMENTI(filtri_prova); i++) {
+        ok &= scorri_lista(repo, &filtri_prova[i], &m, &righe);
+    }
+    riporta("lista_ordinata_completa_pagina", &m, righe, adesso() - inizio);
+    return ok;
+}
+
+static void prova_inserimenti(Repository *repo, Generatore *g, int *primo_id, int *ultimo_id) {
+    Misure m = {0};
+    char nome[128], artista[64], misure[32], data[11];
+    double inizio = adesso();
+    for (int i = 0; i < BENCH_RIPETIZIONI; i++) {
+        NuovoArticolo articolo;
+        genera_articolo(g, nome, sizeof(nome), artista, sizeof(artista), misure, sizeof(misure), data, &articolo);
+        int id = 0;
+        double t = adesso();
+        if (repo_insert_articolo(repo, &articolo, &id) != SQLITE_OK) {
+            fprintf(stderr, "Errore inserimento: %s\n", repo_errmsg(repo));
+            break;
+        }
+        misure_aggiungi(&m, adesso() - t);
+        if (i == 0) {
+            *primo_id = id;
+        }
+        *ultimo_id = id;
+    }
+    riporta("inserimento", &m, m.n, adesso() - inizio);
+}
+
+static void prova_eliminazioni(Repository *repo, int primo_id, int ultimo_id) {
+    Misure m = {0};
+    double inizio = adesso();
+    for (int id = primo_id; id <= ultimo_id && id > 0; id++) {
+        double t = adesso();
+        repo_elimina_articolo(repo, id);
+        misure_aggiungi(&m, adesso() - t);
+    }
+    riporta("eliminazione", &m, m.n, adesso() - inizio);
+}
+
+// Data delle vendite registrate dalle prove, diversa da quelle generate
+#define BENCH_DATA_VENDITE "2025-06-30"
+#define BENCH_DATA_VENDITE_SYNC "2025-07-01"
+
+typedef struct {
+    const ConfigDB *config;
+    const char *server;     // indirizzo del server di sincronizzazione, NULL = DB diretto
+    uint64_t seme;
+    long n_articoli;
+    int operazioni;
+    Misure misure;
+    long vendute;
+    int errori;
+} Scrittore;
+
+// Ogni scrittore ha la propria connessione, come una seconda cassa; con il
+// server è un terminale senza copia locale
+static void *esegui_scrittore(void *dati) {
+    Scrittore *s = dati;
+    traccia_nome_thread("scrittore");
+    Repository *repo = NULL;
+    ClientSync *client = NULL;
+    if (s->server) {
+        client = client_sync_new(s->server);
+    } else {
+        repo = apri(s->config, 1);
+    }
+    if (!repo && !client) {
+        s->errori = s->operazioni;
+        return NULL;
+    }
+    Generatore g = { s->seme };
+    for (int i = 0; i < s->operazioni; i++) {
+        int id = 1 + casuale_fino(&g, (int)s->n_articoli);
+        double t = adesso();
+        EsitoVendita esito = client
+            ? client_sync_registra_vendita(client, NULL, id, 250.0, NULL, BENCH_DATA_VENDITE_SYNC)
+            : repo_registra_vendita(repo, id, 250.0, NULL, BENCH_DATA_VENDITE);
+        misure_aggiungi(&s->misure, adesso() - t);
+        if (esito == VENDITA_OK) {
+            s->vendute++;
+        } else if (esito == VENDITA_ERRORE) {
+            if (client && s->errori == 0) {
+                fprintf(stderr, "%s\n", client_sync_errmsg(client));
+            }
+            s->errori++;
+        }
+    }
+    if (client) {
+        client_sync_free(client);
+    } else {
+        chiudi(repo);
+    }
+    return NULL;
+}
+
+// Vendite da 1 e da n_scrittori scrittori insieme; restituisce le vendite
+// riuscite in tutto
+static long prova_vendite(const ConfigDB *config, const char *server, long n_articoli,
+                          uint64_t seme, int n_scrittori) {
+    long vendute_tutte = 0;
+    for (int scrittori = 1; scrittori <= n_scrittori; scrittori = scrittori == 1 ? n_scrittori : scrittori + 1) {
+        Scrittore *s = calloc((size_t)scrittori, sizeof(Scrittore));
+        pthread_t *thread = calloc((size_t)scrittori, sizeof(pthread_t));
+        if (!s || !thread) {
+            free(s);
+            free(thread);
+            return vendute_tutte;
+        }
+        double inizio = adesso();
+        for (int i = 0; i < scrittori; i++) {
+            s[i] = (Scrittore) { config, server, seme + 1000 * (uint64_t)(i + 1) + (uint64_t)scrittori,
+                                 n_articoli, BENCH_RIPETIZIONI / scrittori, {0}, 0, 0 };
+            pthread_create(&thread[i], NULL, esegui_scrittore, &s[i]);
+        }
+        Misure tutte = {0};
+        long vendute = 0;
+        int errori = 0;
+        for (int i = 0; i < scrittori; i++) {
+            pthread_join(thread[i], NULL);
+            for (int k = 0; k < s[i].misure.n; k++) {
+                misure_aggiungi(&tutte, s[i].misure.campioni[k]);
+            }
+            free(s[i].misure.campioni);
+            vendute += s[i].vendute;
+            errori += s[i].errori;
+        }
+        double totale = adesso() - inizio;
+        vendute_tutte += vendute;
+        char nome[64];
+        snprintf(nome, sizeof(nome), server ? "sync_vendita_%d_terminali" : "vendita_%d_scrittori", scrittori);
+        if (errori > 0) {
+            fprintf(stderr, "%s: %d vendite non riuscite\n", nome, errori);
+        }
+        riporta(nome, &tutte, tutte.n, totale);
+        free(s);
+        free(thread);
+        if (scrittori == n_scrittori) {
+            break;
+        }
+    }
+    return vendute_tutte;
+}
+
+static void on_riga_ricerca(const RigaInventario *riga, void *user_data) {
+    (void)riga;
+    (*(long *)user_data)++;
+}
+
+// Come la casella di ricerca: conteggio dei risultati e prima pagina
+static void prova_ricerca(Repository *repo) {
+    Misure m = {0};
+    long righe = 0;
+    CursoreLista dall_inizio = { .inizio = 1 };
+    double inizio = adesso();
+    for (int i = 0; i < BENCH_RIPETIZIONI_LENTE; i++) {
+        const char *testo = ricerche[i % N_ELEMENTI(ricerche)];
+        double t = adesso();
+        int trovati = repo_conta_ricerca(repo, testo, NULL);
+        repo_cerca_pagina(repo, testo, NULL, trovati <= 10000, &dall_inizio, 0, BENCH_RIGHE_PAGINA,
+                          on_riga_ricerca, &righe);
+        misure_aggiungi(&m, adesso() - t);
+    }
+    riporta("ricerca", &m, righe, adesso() - inizio);
+}
+
+static void on_riga_statistica(const RigaStatistica *riga, void *user_data) {
+    (void)riga;
+    (*(long *)user_data)++;
+}
+
+static void prova_report(Repository *repo, const char *percorso_db) {
+    Misure m = {0};
+    long righe = 0;
+    double inizio = adesso();
+    for (int i = 0; i < BENCH_RIPETIZIONI; i++) {
+        ValoreMagazzino valore;
+        double t = adesso();
+        repo_valore_magazzino(repo, &valore);
+        repo_leggi_statistiche(repo, (DimensioneStatistica)(i % 4), NULL, NULL, on_riga_statistica, &righe);
+        misure_aggiungi(&m, adesso() - t);
+    }
+    riporta("report_statistiche", &m, righe, adesso() - inizio);
+
+    // Esportazione di tutte le vendite, accanto al database
+    char percorso[1024];
+    snprintf(percorso, sizeof(percorso), "%s.esportazione", percorso_db);
+    const FormatoEsportazione formati[] = { ESPORTA_CSV, ESPORTA_COLONNE };
+    const char *nomi[] = { "esporta_vendite_csv", "esporta_vendite_colonne" };
+    for (int f = 0; f < 2; f++) {
+        long esportate = 0;
+        char errore[256];
+        double t = adesso();
+        if (esporta_file(repo, ESPORTA_VENDITE, formati[f], NULL, NULL, percorso,
+                         &esportate, errore, sizeof(errore)) != SQLITE_OK) {
+            fprintf(stderr, "%s: %s\n", nomi[f], errore);
+            continue;
+        }
+        misure_aggiungi(&m, adesso() - t);
+        riporta(nomi[f], &m, esportate, adesso() - t);
+        unlink(percorso);
+    }
+}
+
+// Valore intero di una query di controllo sul database
+static sqlite3_int64 conta(Repository *repo, const char *sql) {
+    sqlite3_stmt *stmt;
+    sqlite3_int64 n = -1;
+    if (sqlite3_prepare_v2(repo_db(repo), sql, -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            n = sqlite3_column_int64(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return n;
+}
+
+static void elimina_database(const char *percorso) {
+    char file[1100];
+    unlink(percorso);
+    snprintf(file, sizeof(file), "%s-wal", percorso);
+    unlink(file);
+    snprintf(file, sizeof(file), "%s-shm", percorso);
+    unlink(file);
+}
+
+// Server di sincronizzazione su 127.0.0.1: prima copia di un terminale,
+// vendite da un terminale con copia locale (ogni vendita porta con sé le
+// modifiche), vendite da più terminali senza copia e aggiornamento della
+// copia rimasta indietro. Controlla che nessun pezzo sia venduto due volte e
+// che la copia finale coincida con il server; restituisce 0 se non è così.
+static int prova_sincronizzazione(const ConfigDB *config, Repository *lettura, long n_articoli,
+                                  uint64_t seme, int n_scrittori) {
+    char errore[256];
+    ServerSync *server = server_sync_avvia(config, "127.0.0.1", 0, errore, sizeof(errore));
+    if (!server) {
+        fprintf(stderr, "%s\n", errore);
+        return 0;
+    }
+    char indirizzo[64];
+    snprintf(indirizzo, sizeof(indirizzo), "127.0.0.1:%d", server_sync_porta(server));
+
+    char percorso_replica[1024];
+    snprintf(percorso_replica, sizeof(percorso_replica), "%s.replica", config->percorso);
+    elimina_database(percorso_replica);
+    ConfigDB config_replica;
+    db_config_predefinita(&config_replica, percorso_replica);
+    Repository *replica = apri(&config_replica, 1);
+    ClientSync *client = client_sync_new(indirizzo);
+    int ok = replica && client;
+    const char *sql_vendite_prova =
+        "SELECT COUNT(*) FROM vendite WHERE data_vendita = '" BENCH_DATA_VENDITE_SYNC "';";
+    sqlite3_int64 prima = conta(lettura, sql_vendite_prova);
+
+    Misure m = {0};
+    long applicate = 0;
+    double t = adesso();
+    if (ok && client_sync_aggiorna(client, replica, &applicate) != SQLITE_OK) {
+        fprintf(stderr, "sync_replica_iniziale: %s\n", client_sync_errmsg(client));
+        ok = 0;
+    }
+    misure_aggiungi(&m, adesso() - t);
+    riporta("sync_replica_iniziale", &m, applicate, adesso() - t);
+
+    // Una cassa con la propria copia locale
+    Generatore g = { seme + 7 };
+    long vendute = 0;
+    double inizio = adesso();
+    for (int i = 0; ok && i < BENCH_RIPETIZIONI_LENTE; i++) {
+        int id = 1 + casuale_fino(&g, (int)n_articoli);
+        t = adesso();
+        EsitoVendita esito = client_sync_registra_vendita(client, replica, id, 250.0, NULL,
+                                                          BENCH_DATA_VENDITE_SYNC);
+        misure_aggiungi(&m, adesso() - t);
+        if (esito == VENDITA_OK) {
+            vendute++;
+        } else if (esito == VENDITA_ERRORE) {
+            fprintf(stderr, "sync_vendita_con_replica: %s\n", client_sync_errmsg(client));
+            ok = 0;
+        }
+    }
+    riporta("sync_vendita_con_replica", &m, m.n, adesso() - inizio);
+
+    // Le altre casse vendono: la copia locale resta indietro
+    if (ok) {
+        vendute += prova_vendite(config, indirizzo, n_articoli, seme, n_scrittori);
+    }
+    t = adesso();
+    if (ok && client_sync_aggiorna(client, replica, &applicate) != SQLITE_OK) {
+        fprintf(stderr, "sync_delta: %s\n", client_sync_errmsg(client));
+        ok = 0;
+    }
+    misure_aggiungi(&m, adesso() - t);
+    riporta("sync_delta", &m, applicate, adesso() - t);
+
+    if (ok) {
+        sqlite3_int64 registrate = conta(lettura, sql_vendite_prova) - prima;
+        sqlite3_int64 sotto_zero = conta(lettura, "SELECT COUNT(*) FROM articoli WHERE quantita < 0;");
+        if (registrate != vendute || sotto_zero != 0) {
+            fprintf(stderr, "sync: %lld vendite registrate, %ld riuscite, %lld articoli sotto zero\n",
+                    (long long)registrate, vendute, (long long)sotto_zero);
+            ok = 0;
+        }
+        const char *controlli[] = {
+            "SELECT COUNT(*) FROM vendite;",
+            "SELECT COUNT(*) FROM articoli;",
+            "SELECT TOTAL(quantita) FROM articoli;",
+            "SELECT TOTAL(articolo_id) FROM articoli;",
+        };
+        for (int i = 0; i < N_ELEMENTI(controlli); i++) {
+            if (conta(lettura, controlli[i]) != conta(replica, controlli[i])) {
+                fprintf(stderr, "sync: la copia locale non coincide con il server (%s)\n", controlli[i]);
+                ok = 0;
+            }
+        }
+    }
+
+    client_sync_free(client);
+    if (replica) {
+        chiudi(replica);
+    }
+    elimina_database(percorso_replica);
+    server_sync_ferma(server);
+    return ok;
+}
+
+typedef struct {
+    Misure misure;
+    double ultimo;
+} PassiBackup;
+
+static int on_passo_backup(int copiate, int totali, void *user_data) {
+    (void)copiate;
+    (void)totali;
+    PassiBackup *p = user_data;
+    double t = adesso();
+    misure_aggiungi(&p->misure, t - p->ultimo);
+    p->ultimo = t;
+    return 1;
+}
+
+// Trascrizione del giornale accumulato dalle prove precedenti, backup con
+// una cassa che vende nel frattempo (un campione per passo, pausa compresa),
+// controllo di integrità della copia e ripristino: copia più giornale deve
+// tornare identica al database. Restituisce 0 se qualcosa non coincide.
+static int prova_backup_giornale(const ConfigDB *config, Repository *lettura, long n_articoli, uint64_t seme) {
+    char errore[512];
+    char percorso_copia[1024], percorso_giornale[1024];
+    snprintf(percorso_copia, sizeof(percorso_copia), "%s.backup", config->percorso);
+    snprintf(percorso_giornale, sizeof(percorso_giornale), "%s%s", config->percorso, GIORNALE_ESTENSIONE);
+    elimina_database(percorso_copia);
+
+    Misure m = {0};
+    sqlite3_int64 voci = conta(lettura, "SELECT COUNT(*) FROM giornale;");
+    double t = adesso();
+    Giornale *giornale = giornale_avvia(config, errore, sizeof(errore));
+    if (!giornale) {
+        fprintf(stderr, "giornale: %s\n", errore);
+        return 0;
+    }
+    giornale_ferma(giornale);
+    misure_aggiungi(&m, adesso() - t);
+    riporta("giornale_trascrizione", &m, voci, adesso() - t);
+
+    int ok = 1;
+    giornale = giornale_avvia(config, errore, sizeof(errore));
+    if (!giornale) {
+        fprintf(stderr, "giornale: %s\n", errore);
+        return 0;
+    }
+    Scrittore cassa = { config, NULL, seme + 11, n_articoli, BENCH_RIPETIZIONI, {0}, 0, 0 };
+    pthread_t thread;
+    pthread_create(&thread, NULL, esegui_scrittore, &cassa);
+    PassiBackup passi = { {0}, adesso() };
+    double inizio = passi.ultimo;
+    int pagine = 0;
+    if (backup_copia(repo_db(lettura), percorso_copia, on_passo_backup, &passi, &pagine,
+                     errore, sizeof(errore)) != SQLITE_OK) {
+        fprintf(stderr, "backup: %s\n", errore);
+        ok = 0;
+    }
+    riporta("backup_passo", &passi.misure, pagine, adesso() - inizio);
+    pthread_join(thread, NULL);
+    riporta("vendita_durante_backup", &cassa.misure, cassa.misure.n, adesso() - inizio);
+    giornale_ferma(giornale);
+
+    ConfigDB config_copia;
+    db_config_predefinita(&config_copia, percorso_copia);
+    Repository *copia = ok ? apri(&config_copia, 1) : NULL;
+    if (copia) {
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(repo_db(copia), "PRAGMA quick_check;", -1, &stmt, NULL) != SQLITE_OK ||
+            sqlite3_step(stmt) != SQLITE_ROW || strcmp((const char *)sqlite3_column_text(stmt, 0), "ok") != 0) {
+            fprintf(stderr, "backup: la copia non supera quick_check\n");
+            ok = 0;
+        }
+        sqlite3_finalize(stmt);
+
+        long applicate = 0;
+        t = adesso();
+        if (giornale_riapplica(repo_db(copia), percorso_giornale, NULL, &applicate,
+                               errore, sizeof(errore)) != SQLITE_OK) {
+            fprintf(stderr, "ripristino: %s\n", errore);
+            ok = 0;
+        }
+        misure_aggiungi(&m, adesso() - t);
+        riporta("ripristino_giornale", &m, applicate, adesso() - t);
+
+        const char *controlli[] = {
+            "SELECT COUNT(*) FROM vendite;",
+            "SELECT TOTAL(prezzo_vendita) FROM vendite;",
+            "SELECT COUNT(*) FROM articoli;",
+            "SELECT TOTAL(quantita) FROM articoli;",
+            "SELECT TOTAL(articolo_id) FROM articoli;",
+            "SELECT COUNT(*) FROM foto;",
+        };
+        for (int i = 0; ok && i < N_ELEMENTI(controlli); i++) {
+            if (conta(lettura, controlli[i]) != conta(copia, controlli[i])) {
+                fprintf(stderr, "ripristino: il database ripristinato non coincide (%s)\n", controlli[i]);
+                ok = 0;
+            }
+        }
+        chiudi(copia);
+    } else {
+        ok = 0;
+    }
+    elimina_database(percorso_copia);
+    return ok;
+}
+
+// --- Avvio ---
+
+static void uso(const char *programma) {
+    fprintf(stderr,
+            "Uso: %s [--articoli N] [--db PERCORSO] [--seme N] [--scrittori N] [--riusa]\n"
+            "         [--traccia FILE]\n"
+            "Crea PERCORSO (predefinito %s) con N articoli (predefinito %d, es. 10000,\n"
+            "100000, 1000000) e stampa una riga JSON per ogni misura. Con --riusa usa\n"
+            "i dati già presenti invece di generarli; con --traccia salva i tempi delle\n"
+            "singole query in FILE, nel formato di Chrome.\n",
+            programma, BENCH_DB_PREDEFINITO, BENCH_ARTICOLI_PREDEFINITI);
+}
+
+int main(int argc, char **argv) {
+    const char *percorso = BENCH_DB_PREDEFINITO;
+    const char *traccia = NULL;
+    long n_articoli = BENCH_ARTICOLI_PREDEFINITI;
+    uint64_t seme = 42;
+    int scrittori = BENCH_SCRITTORI_PREDEFINITI;
+    int riusa = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--riusa") == 0) {
+            riusa = 1;
+        } else if (i + 1 < argc && strcmp(argv[i], "--traccia") == 0) {
+            traccia = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--db") == 0) {
+            percorso = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--articoli") == 0) {
+            n_articoli = atol(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--seme") == 0) {
+            seme = strtoull(argv[++i], NULL, 10);
+        } else if (i + 1 < argc && strcmp(argv[i], "--scrittori") == 0) {
+            scrittori = atoi(argv[++i]);
+        } else {
+            uso(argv[0]);
+            return 2;
+        }
+    }
+    if (n_articoli <= 0 || scrittori <= 0 || seme == 0) {
+        uso(argv[0]);
+        return 2;
+    }
+    // I dati di un database esistente non sono deterministici: non si
+    // sovrascrive e non si aggiunge niente senza richiesta esplicita
+    if (!riusa && access(percorso, F_OK) == 0) {
+        fprintf(stderr, "%s esiste già: eliminarlo o usare --riusa.\n", percorso);
+        return 1;
+    }
+
+    if (traccia) {
+        traccia_nome_thread("benchmark");
+        traccia_abilita(1);
+    }
+
+    ConfigDB config;
+    db_config_predefinita(&config, percorso);
+    Repository *scrittura = apri(&config, 1);
+    if (!scrittura) {
+        return 1;
+    }
+    Generatore g = { seme };
+    if (!riusa) {
+        if (genera_articoli(scrittura, &g, n_articoli) != 0 || genera_vendite(scrittura, &g, n_articoli) != 0) {
+            chiudi(scrittura);
+            return 1;
+        }
+    } else {
+        n_articoli = repo_conta_articoli(scrittura);
+    }
+    if (n_articoli <= 0) {
+        fprintf(stderr, "%s non contiene articoli.\n", percorso);
+        chiudi(scrittura);
+        return 1;
+    }
+
+    Repository *lettura = apri(&config, 0);
+    if (!lettura) {
+        chiudi(scrittura);
+        return 1;
+    }
+
+    prova_apertura(&config);
+    prova_lista(lettura);
+    int lista_ok = prova_ordinamenti(lettura);
+    int primo_id = 0, ultimo_id = 0;
+    prova_inserimenti(scrittura, &g, &primo_id, &ultimo_id);
+    prova_vendite(&config, NULL, n_articoli, seme, scrittori);
+    prova_eliminazioni(scrittura, primo_id, ultimo_id);
+    prova_ricerca(lettura);
+    prova_report(lettura, percorso);
+    int sync_ok = prova_sincronizzazione(&config, lettura, n_articoli, seme, scrittori);
+    int backup_ok = prova_backup_giornale(&config, lettura, n_articoli, seme);
+
+    chiudi(lettura);
+    chiudi(scrittura);
+
+    char errore[512];
+    if (traccia && traccia_scrivi_chrome(traccia, errore, sizeof(errore)) != 0) {
+        fprintf(stderr, "%s\n", errore);
+        return 1;
+    }
+    return lista_ok && sync_ok && backup_ok ? 0 : 1;
+}
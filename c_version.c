@@ -4,10 +4,48 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
-#include <unistd.h>
+
+#include "archivio_foto.h"
+#include "backup.h"
+#include "connessione.h"
+#include "diagnostica.h"
+#include "esporta.h"
+#include "giornale.h"
+#include "importa.h"
+#include "inventario_model.h"
+#include "lavori.h"
+#include "miniature.h"
+#include "repository.h"
+#include "riga_comando.h"
+#include "schema.h"
+#include "sincronizzazione.h"
+#include "traccia.h"
+#include "validazione.h"
 
 // Percorso del database SQLite
 #define DB_PATH "magazzino_arte.db"
+// Con GESTIONALE_SERVER=host[:porta] il programma è un terminale collegato
+// al server di sincronizzazione (vedi sincronizzazione.h) e lavora su una
+// copia locale del magazzino
+#define SERVER_ENV "GESTIONALE_SERVER"
+#define REPLICA_PATH "magazzino_arte_replica.db"
+// Ogni quanto il terminale chiede al server le modifiche degli altri
+#define INTERVALLO_SYNC_MS 1000
+// Giri del timer saltati al massimo dopo errori di collegamento consecutivi
+#define MAX_PAUSA_SYNC 30
+#define TITOLO_FINESTRA "Gestionale Magazzino Arte e Antiquariato"
+#define TITOLO_SCOLLEGATO TITOLO_FINESTRA " (server non raggiungibile)"
+// Cartella dell'archivio delle foto degli articoli
+#define FOTO_PATH "magazzino_arte_foto"
+// Connessioni in sola lettura per lista e report
+#define N_CONNESSIONI_LETTURA 4
+// Righe scartate elencate nel riepilogo dell'importazione
+#define MAX_SCARTATE_MOSTRATE 20
+// Istruzioni della VM di SQLite tra due controlli della chiusura durante l'importazione
+#define PASSI_CONTROLLO_CHIUSURA 1000
+// Lato in pixel delle miniature nella lista e miniature tenute in memoria
+#define LATO_MINIATURA 40
+#define MINIATURE_IN_MEMORIA 512
 
 // Struttura per tenere traccia dei widget e della connessione al DB
 typedef struct {
@@ -17,17 +55,90 @@ typedef struct {
     GtkWidget *btn_vendi;
     GtkWidget *btn_elimina;
     GtkWidget *btn_aggiorna;
-    sqlite3 *db;
+    GtkWidget *btn_importa;
+    GtkWidget *btn_esporta;
+    GtkWidget *btn_backup;
+    GtkWidget *btn_statistiche;
+    GtkWidget *btn_foto;
+    GtkWidget *entry_ricerca;
+    // Intestazioni ordinabili (NULL per le colonne senza indice) e filtri
+    GtkTreeViewColumn *colonne_ordine[N_ORDINI];
+    GtkWidget *filtro_disponibile;
+    GtkWidget *filtro_venduto;
+    GtkWidget *filtro_artista;
+    GtkWidget *filtro_periodo;
+    GtkWidget *filtro_prezzo_min;
+    GtkWidget *filtro_prezzo_max;
+    GtkWidget *spinner;
+    gint attivita;            // lavori sul DB in corso, per lo spinner
+    ConfigDB config;
+    sqlite3 *db;              // unica connessione di scrittura
+    Repository *repo;
+    PoolLetture *letture;     // connessioni in sola lettura
+    CodaLavori *coda;         // thread che eseguono le query fuori dal ciclo GTK
+    ArchivioFoto *archivio;   // NULL se la cartella delle foto non è utilizzabile
+    CacheMiniature *miniature;
+    Giornale *giornale;       // NULL sui terminali o se il file non è utilizzabile
+    ClientSync *sync;         // NULL se il database è locale; usato dal thread di scrittura
+    guint timer_sync;
+    gboolean sync_in_corso;
+    guint sync_errori;        // aggiornamenti falliti di fila
+    guint sync_pausa;         // giri del timer ancora da saltare
 } AppData;
 
+// Modifica al DB eseguita dal thread di scrittura. Le stringhe sono copiate
+// perché i campi del dialogo vengono distrutti prima che il lavoro finisca.
+typedef struct {
+    AppData *app;
+    GtkWidget *pulsante;      // disattivato finché il lavoro non è concluso
+    NuovoArticolo articolo;
+    gint articolo_id;
+    gdouble prezzo;
+    gchar *cliente;
+    gchar *data;
+    gint rc;                  // codice SQLite o EsitoVendita
+    gchar *errore;
+    gchar *percorso;          // file da importare, da esportare o copia del backup
+    EsitoImportazione importazione;
+    GString *scartate;        // prime righe scartate dall'importazione
+    DatiEsportazione esporta;
+    FormatoEsportazione formato;
+    gchar dal[11];            // intervallo di date da esportare, vuote = senza limite
+    gchar al[11];
+    glong righe;
+    gint pagine;              // pagine copiate dal backup
+    GSList *foto;             // percorsi delle immagini da aggiungere
+} OperazioneDB;
+
 // Prototipi delle funzioni
-static void crea_tabelle(sqlite3 *db);
-static int connetti_db(sqlite3 **db);
+static int connetti_db(AppData *app);
+static void chiudi_db(AppData *app);
 static void carica_dati(AppData *app);
+static void on_treeview_scroll(GtkAdjustment *adjustment, AppData *app);
+static void on_model_caricamento(InventarioModel *model, gboolean attivo, AppData *app);
+static void attivita_inizia(AppData *app);
+static void attivita_fine(AppData *app);
 static void on_btn_aggiorna_clicked(GtkButton *button, AppData *app);
+static void on_ricerca_cambiata(GtkSearchEntry *entry, AppData *app);
+static void on_intestazione_clicked(GtkTreeViewColumn *col, AppData *app);
+static void aggiorna_intestazioni(AppData *app);
+static GtkWidget *crea_filtro_testo(AppData *app, GtkWidget *box, const char *segnaposto, OrdineLista colonna);
+static GtkWidget *crea_filtro_prezzo(AppData *app, GtkWidget *box, const char *segnaposto);
+static void on_filtri_cambiati(GtkWidget *widget, AppData *app);
+static void on_btn_azzera_filtri_clicked(GtkButton *button, AppData *app);
 static void on_btn_elimina_clicked(GtkButton *button, AppData *app);
 static void on_btn_aggiungi_clicked(GtkButton *button, AppData *app);
 static void on_btn_vendi_clicked(GtkButton *button, AppData *app);
+static void on_btn_importa_clicked(GtkButton *button, AppData *app);
+static void on_btn_esporta_clicked(GtkButton *button, AppData *app);
+static void on_btn_backup_clicked(GtkButton *button, AppData *app);
+static void on_btn_statistiche_clicked(GtkButton *button, AppData *app);
+static void on_btn_foto_clicked(GtkButton *button, AppData *app);
+static void mostra_miniatura(GtkTreeViewColumn *col, GtkCellRenderer *renderer,
+                             GtkTreeModel *model, GtkTreeIter *iter, gpointer user_data);
+static void on_miniatura_pronta(gpointer user_data);
+static gpointer lavoro_pulisci_foto(Repository *repo, gpointer dati, GCancellable *annulla);
+static gboolean on_timer_sync(gpointer user_data);
 
 // Funzioni di supporto per dialoghi
 static GtkWidget* create_labeled_entry(const char *label_text, GtkWidget *grid, int row);
@@ -37,31 +148,39 @@ static void on_btn_salva_articolo_clicked(GtkButton *button, gpointer user_data)
 static void on_btn_registra_vendita_clicked(GtkButton *button, gpointer user_data);
 
 int main(int argc, char *argv[]) {
+    // Le operazioni da terminale non richiedono un display
+    if (riga_comando_richiesta(argc, argv)) {
+        return riga_comando_esegui(argc, argv, DB_PATH);
+    }
+
     gtk_init(&argc, &argv);
+    diagnostica_avvia();
 
     AppData app;
     memset(&app, 0, sizeof(AppData));
 
-    // Connessione al DB
-    if (access(DB_PATH, F_OK) != 0) {
-        // Il file non esiste, verrà creato
-        if (connetti_db(&app.db) == SQLITE_OK) {
-            crea_tabelle(app.db);
-            sqlite3_close(app.db);
-        }
+    // Connessione al DB, o alla copia locale se c'è un server
+    const gchar *server = g_getenv(SERVER_ENV);
+    if (server && *server) {
+        app.sync = client_sync_new(server);
     }
-
-    // Riapriamo la connessione per utilizzo generale
-    if (connetti_db(&app.db) != SQLITE_OK) {
+    db_config_predefinita(&app.config, app.sync ? REPLICA_PATH : DB_PATH);
+    guint64 inizio = traccia_inizio();
+    if (connetti_db(&app) != SQLITE_OK) {
         fprintf(stderr, "Impossibile connettersi al database.\n");
+        chiudi_db(&app);
         return 1;
     }
+    traccia_fine("avvio", "connessione", inizio, -1, 0);
 
     // Creazione della finestra principale
     app.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
-    gtk_window_set_title(GTK_WINDOW(app.window), "Gestionale Magazzino Arte e Antiquariato");
+    gtk_window_set_title(GTK_WINDOW(app.window), app.sync_errori > 0 ? TITOLO_SCOLLEGATO : TITOLO_FINESTRA);
     gtk_window_set_default_size(GTK_WINDOW(app.window), 1000, 600);
     g_signal_connect(app.window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
+    // Dopo la chiusura i lavori rimasti vengono completati senza finestra
+    g_signal_connect(app.window, "destroy", G_CALLBACK(gtk_widget_destroyed), &app.window);
+    diagnostica_installa(app.window);
 
     GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
     gtk_container_add(GTK_CONTAINER(app.window), vbox);
@@ -85,138 +204,1018 @@ int main(int argc, char *argv[]) {
     gtk_box_pack_start(GTK_BOX(hbox), app.btn_aggiorna, FALSE, FALSE, 5);
     g_signal_connect(app.btn_aggiorna, "clicked", G_CALLBACK(on_btn_aggiorna_clicked), &app);
 
-    // Creazione del TreeView
+    app.btn_importa = gtk_button_new_with_label("Importa");
+    gtk_box_pack_start(GTK_BOX(hbox), app.btn_importa, FALSE, FALSE, 5);
+    g_signal_connect(app.btn_importa, "clicked", G_CALLBACK(on_btn_importa_clicked), &app);
+    if (app.sync) {
+        // Le importazioni massive vanno eseguite sul computer del server
+        // (gestionale --importa), non una riga alla volta attraverso la rete
+        gtk_widget_set_sensitive(app.btn_importa, FALSE);
+        gtk_widget_set_tooltip_text(app.btn_importa, "Importazione disponibile solo sul computer del server");
+    }
+
+    app.btn_esporta = gtk_button_new_with_label("Esporta");
+    gtk_box_pack_start(GTK_BOX(hbox), app.btn_esporta, FALSE, FALSE, 5);
+    g_signal_connect(app.btn_esporta, "clicked", G_CALLBACK(on_btn_esporta_clicked), &app);
+
+    app.btn_backup = gtk_button_new_with_label("Backup");
+    gtk_box_pack_start(GTK_BOX(hbox), app.btn_backup, FALSE, FALSE, 5);
+    g_signal_connect(app.btn_backup, "clicked", G_CALLBACK(on_btn_backup_clicked), &app);
+    if (app.sync) {
+        // Il terminale ha solo una copia: il backup si fa sul server
+        gtk_widget_set_sensitive(app.btn_backup, FALSE);
+        gtk_widget_set_tooltip_text(app.btn_backup, "Backup disponibile solo sul computer del server");
+    }
+
+    app.btn_statistiche = gtk_button_new_with_label("Statistiche");
+    gtk_box_pack_start(GTK_BOX(hbox), app.btn_statistiche, FALSE, FALSE, 5);
+    g_signal_connect(app.btn_statistiche, "clicked", G_CALLBACK(on_btn_statistiche_clicked), &app);
+
+    app.btn_foto = gtk_button_new_with_label("Aggiungi Foto");
+    gtk_box_pack_start(GTK_BOX(hbox), app.btn_foto, FALSE, FALSE, 5);
+    g_signal_connect(app.btn_foto, "clicked", G_CALLBACK(on_btn_foto_clicked), &app);
+    gtk_widget_set_sensitive(app.btn_foto, app.archivio != NULL);
+    if (app.sync) {
+        // I file andrebbero nella cartella locale, mentre i collegamenti
+        // finiscono nel database del server: le foto si aggiungono sul server
+        gtk_widget_set_sensitive(app.btn_foto, FALSE);
+        gtk_widget_set_tooltip_text(app.btn_foto, "Foto disponibili solo sul computer del server");
+    }
+
+    // Indica che ci sono query in corso nei thread di lavoro
+    app.spinner = gtk_spinner_new();
+    g_signal_connect(app.spinner, "destroy", G_CALLBACK(gtk_widget_destroyed), &app.spinner);
+    gtk_box_pack_start(GTK_BOX(hbox), app.spinner, FALSE, FALSE, 5);
+
+    // Ricerca a testo pieno: "search-changed" arriva solo dopo una breve
+    // pausa nella digitazione, non a ogni tasto
+    app.entry_ricerca = gtk_search_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(app.entry_ricerca), "Cerca nome, descrizione, artista, periodo");
+    gtk_entry_set_width_chars(GTK_ENTRY(app.entry_ricerca), 40);
+    gtk_box_pack_end(GTK_BOX(hbox), app.entry_ricerca, FALSE, FALSE, 5);
+    g_signal_connect(app.entry_ricerca, "search-changed", G_CALLBACK(on_ricerca_cambiata), &app);
+
+    // Filtri della lista, applicati dal database insieme all'ordinamento:
+    // stato, artista e periodo (con i valori presenti come suggerimenti) e
+    // intervallo del prezzo d'acquisto
+    GtkWidget *barra_filtri = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_pack_start(GTK_BOX(vbox), barra_filtri, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(barra_filtri), gtk_label_new("Filtri:"), FALSE, FALSE, 5);
+
+    app.filtro_disponibile = gtk_toggle_button_new_with_label("Disponibile");
+    gtk_box_pack_start(GTK_BOX(barra_filtri), app.filtro_disponibile, FALSE, FALSE, 0);
+    g_signal_connect(app.filtro_disponibile, "toggled", G_CALLBACK(on_filtri_cambiati), &app);
+    app.filtro_venduto = gtk_toggle_button_new_with_label("Venduto");
+    gtk_box_pack_start(GTK_BOX(barra_filtri), app.filtro_venduto, FALSE, FALSE, 0);
+    g_signal_connect(app.filtro_venduto, "toggled", G_CALLBACK(on_filtri_cambiati), &app);
+
+    app.filtro_artista = crea_filtro_testo(&app, barra_filtri, "Artista", ORDINE_ARTISTA);
+    app.filtro_periodo = crea_filtro_testo(&app, barra_filtri, "Periodo", ORDINE_PERIODO);
+    app.filtro_prezzo_min = crea_filtro_prezzo(&app, barra_filtri, "Prezzo da");
+    app.filtro_prezzo_max = crea_filtro_prezzo(&app, barra_filtri, "Prezzo fino a");
+
+    GtkWidget *btn_azzera_filtri = gtk_button_new_with_label("Azzera filtri");
+    gtk_box_pack_start(GTK_BOX(barra_filtri), btn_azzera_filtri, FALSE, FALSE, 5);
+    g_signal_connect(btn_azzera_filtri, "clicked", G_CALLBACK(on_btn_azzera_filtri_clicked), &app);
+
+    // Creazione del TreeView dentro una finestra scorrevole
+    GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
+    gtk_box_pack_start(GTK_BOX(vbox), scrolled, TRUE, TRUE, 5);
     app.treeview = gtk_tree_view_new();
-    gtk_box_pack_start(GTK_BOX(vbox), app.treeview, TRUE, TRUE, 5);
+    gtk_container_add(GTK_CONTAINER(scrolled), app.treeview);
 
-    // Aggiunta delle colonne
-    GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+    // Aggiunta delle colonne (larghezza fissa: il TreeView misura solo le righe visibili)
+    GtkCellRenderer *renderer;
     GtkTreeViewColumn *col;
 
+    // Miniatura della foto principale: viene letta solo per le righe
+    // disegnate, e la dimensione fissa non richiede di caricarla per
+    // calcolare l'altezza delle righe
+    if (app.archivio) {
+        app.miniature = cache_miniature_new(app.archivio, LATO_MINIATURA, MINIATURE_IN_MEMORIA,
+                                            on_miniatura_pronta, &app);
+        renderer = gtk_cell_renderer_pixbuf_new();
+        gtk_cell_renderer_set_fixed_size(renderer, LATO_MINIATURA, LATO_MINIATURA);
+        col = gtk_tree_view_column_new();
+        gtk_tree_view_column_pack_start(col, renderer, FALSE);
+        gtk_tree_view_column_set_cell_data_func(col, renderer, mostra_miniatura, &app, NULL);
+        gtk_tree_view_column_set_sizing(col, GTK_TREE_VIEW_COLUMN_FIXED);
+        gtk_tree_view_column_set_fixed_width(col, LATO_MINIATURA + 8);
+        gtk_tree_view_append_column(GTK_TREE_VIEW(app.treeview), col);
+    }
+
+    renderer = gtk_cell_renderer_text_new();
     const char *columns[] = {"ID", "Nome", "Artista", "Periodo", "Misure", "Quantità", "Prezzo Acquisto", "Stato"};
+    const int larghezze[] = {60, 220, 160, 120, 100, 80, 120, 100};
+    // Ordinamento di ogni colonna (-1: le misure non hanno un indice)
+    const int ordini[] = {ORDINE_ID, ORDINE_NOME, ORDINE_ARTISTA, ORDINE_PERIODO, -1,
+                          ORDINE_QUANTITA, ORDINE_PREZZO, ORDINE_STATO};
     int i;
-    for (i = 0; i < 8; i++) {
+    for (i = 0; i < (int)G_N_ELEMENTS(columns); i++) {
         col = gtk_tree_view_column_new_with_attributes(columns[i], renderer, "text", i, NULL);
+        gtk_tree_view_column_set_sizing(col, GTK_TREE_VIEW_COLUMN_FIXED);
+        gtk_tree_view_column_set_fixed_width(col, larghezze[i]);
+        gtk_tree_view_column_set_resizable(col, TRUE);
+        if (ordini[i] >= 0) {
+            // Niente GtkTreeSortable: l'ordinamento lo esegue il database
+            gtk_tree_view_column_set_clickable(col, TRUE);
+            g_object_set_data(G_OBJECT(col), "ordine", GINT_TO_POINTER(ordini[i]));
+            g_signal_connect(col, "clicked", G_CALLBACK(on_intestazione_clicked), &app);
+            app.colonne_ordine[ordini[i]] = col;
+        }
         gtk_tree_view_append_column(GTK_TREE_VIEW(app.treeview), col);
     }
+    gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(app.treeview), TRUE);
 
-    // Creazione del model
-    GtkListStore *store = gtk_list_store_new(8, G_TYPE_INT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT, G_TYPE_DOUBLE, G_TYPE_STRING);
-    gtk_tree_view_set_model(GTK_TREE_VIEW(app.treeview), GTK_TREE_MODEL(store));
-    g_object_unref(store);
+    // Creazione del model virtuale: legge dal DB solo le pagine visibili,
+    // nei thread della coda
+    inizio = traccia_inizio();
+    InventarioModel *model = inventario_model_new(app.coda);
+    traccia_fine("avvio", "conteggio_lista", inizio,
+                 gtk_tree_model_iter_n_children(GTK_TREE_MODEL(model), NULL), 0);
+    g_signal_connect(model, "caricamento", G_CALLBACK(on_model_caricamento), &app);
+    gtk_tree_view_set_model(GTK_TREE_VIEW(app.treeview), GTK_TREE_MODEL(model));
+    g_object_unref(model);
+    aggiorna_intestazioni(&app);
 
-    carica_dati(&app);
+    GtkAdjustment *vadj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(app.treeview));
+    g_signal_connect(vadj, "value-changed", G_CALLBACK(on_treeview_scroll), &app);
+    g_signal_connect(vadj, "changed", G_CALLBACK(on_treeview_scroll), &app);
+
+    // Toglie dall'archivio le foto degli articoli eliminati, senza
+    // rallentare l'apertura della finestra
+    if (app.archivio) {
+        coda_lavori_scrivi(app.coda, lavoro_pulisci_foto, NULL, app.archivio);
+    }
+    if (app.sync) {
+        app.timer_sync = g_timeout_add(INTERVALLO_SYNC_MS, on_timer_sync, &app);
+    }
 
     gtk_widget_show_all(app.window);
     gtk_main();
 
-    sqlite3_close(app.db);
+    if (app.timer_sync) {
+        g_source_remove(app.timer_sync);
+    }
+    cache_miniature_free(app.miniature);
+    chiudi_db(&app);
+    diagnostica_termina();
     return 0;
 }
 
-// Funzione per connettersi al DB
-static int connetti_db(sqlite3 **db) {
-    int rc = sqlite3_open(DB_PATH, db);
+// Funzione per connettersi al DB: una connessione di scrittura per tutte le
+// modifiche e un pool in sola lettura, così le letture lunghe non bloccano
+// la registrazione delle vendite
+static int connetti_db(AppData *app) {
+    int rc = db_apri_scrittura(&app->config, &app->db);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Errore di connessione al DB: %s\n", sqlite3_errmsg(*db));
         return rc;
     }
+    // Crea le tabelle se il file è nuovo e applica le migrazioni in sospeso
+    rc = schema_aggiorna(app->db);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    schema_pota_registro(app->db);
+
+    // Tutte le query vengono preparate una volta sola all'avvio
+    app->repo = repo_apri(app->db);
+    app->letture = pool_letture_new(&app->config, N_CONNESSIONI_LETTURA);
+    if (!app->repo || !app->letture) {
+        return SQLITE_ERROR;
+    }
+    // Il terminale parte dalla copia locale aggiornata; se il server non
+    // risponde si lavora sull'ultima copia e il timer riprova
+    if (app->sync && client_sync_aggiorna(app->sync, app->repo, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Server non raggiungibile, uso la copia locale: %s\n",
+                client_sync_errmsg(app->sync));
+        app->sync_errori = 1;
+    }
+    // Da qui in poi il repository di scrittura è usato solo dal thread di scrittura
+    app->coda = coda_lavori_new(app->repo, app->letture, N_CONNESSIONI_LETTURA);
+
+    // Senza la cartella delle foto il programma funziona, ma senza miniature
+    char errore[512];
+    app->archivio = archivio_foto_apri(FOTO_PATH, errore, sizeof(errore));
+    if (!app->archivio) {
+        fprintf(stderr, "Archivio foto non disponibile: %s\n", errore);
+    }
+    // Il giornale delle modifiche lo tiene chi possiede il database: sui
+    // terminali le modifiche sono registrate dal server
+    if (!app->sync) {
+        app->giornale = giornale_avvia(&app->config, errore, sizeof(errore));
+        if (!app->giornale) {
+            fprintf(stderr, "Giornale delle modifiche non disponibile: %s\n", errore);
+        }
+    }
     return SQLITE_OK;
 }
 
-// Creazione delle tabelle
-static void crea_tabelle(sqlite3 *db) {
-    const char *sql_articoli =
-        "CREATE TABLE IF NOT EXISTS articoli ("
-        "articolo_id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "nome TEXT NOT NULL,"
-        "descrizione TEXT,"
-        "artista TEXT,"
-        "periodo TEXT,"
-        "misure TEXT,"
-        "data_acquisizione DATE,"
-        "prezzo_acquisto REAL,"
-        "quantita INTEGER DEFAULT 1"
-        ");";
-
-    const char *sql_vendite =
-        "CREATE TABLE IF NOT EXISTS vendite ("
-        "vendita_id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "articolo_id INTEGER,"
-        "data_vendita DATE,"
-        "prezzo_vendita REAL,"
-        "nome_cliente TEXT,"
-        "FOREIGN KEY (articolo_id) REFERENCES articoli(articolo_id)"
-        ");";
-
-    char *err_msg = NULL;
-    if (sqlite3_exec(db, sql_articoli, 0, 0, &err_msg) != SQLITE_OK) {
-        fprintf(stderr, "Errore creazione tabella articoli: %s\n", err_msg);
-        sqlite3_free(err_msg);
-    }
-    if (sqlite3_exec(db, sql_vendite, 0, 0, &err_msg) != SQLITE_OK) {
-        fprintf(stderr, "Errore creazione tabella vendite: %s\n", err_msg);
-        sqlite3_free(err_msg);
-    }
-}
-
-// Carica i dati nel TreeView
+static void chiudi_db(AppData *app) {
+    // Attende i lavori in corso prima di chiudere le connessioni
+    coda_lavori_free(app->coda);
+    giornale_ferma(app->giornale);
+    archivio_foto_chiudi(app->archivio);
+    pool_letture_free(app->letture);
+    repo_chiudi(app->repo);
+    sqlite3_close(app->db);
+    client_sync_free(app->sync);
+}
+
+// Aggiorna il TreeView: il model applica solo le righe cambiate dall'ultima
+// lettura e rilegge le pagine visibili
 static void carica_dati(AppData *app) {
-    GtkListStore *store = GTK_LIST_STORE(gtk_tree_view_get_model(GTK_TREE_VIEW(app->treeview)));
-    gtk_list_store_clear(store);
+    InventarioModel *model = INVENTARIO_MODEL(gtk_tree_view_get_model(GTK_TREE_VIEW(app->treeview)));
+    inventario_model_applica_modifiche(model);
+}
+
+// Lo spinner gira finché c'è almeno un lavoro sul DB in corso
+static void attivita_inizia(AppData *app) {
+    if (app->attivita++ == 0 && app->spinner) {
+        gtk_spinner_start(GTK_SPINNER(app->spinner));
+    }
+}
+
+static void attivita_fine(AppData *app) {
+    if (--app->attivita == 0 && app->spinner) {
+        gtk_spinner_stop(GTK_SPINNER(app->spinner));
+    }
+}
+
+static void on_model_caricamento(InventarioModel *model, gboolean attivo, AppData *app) {
+    if (attivo) {
+        attivita_inizia(app);
+    } else {
+        attivita_fine(app);
+    }
+}
+
+// Allo scorrimento precarica le righe visibili più un margine
+static void on_treeview_scroll(GtkAdjustment *adjustment, AppData *app) {
+    GtkTreePath *inizio, *fine;
+    if (!gtk_tree_view_get_visible_range(GTK_TREE_VIEW(app->treeview), &inizio, &fine)) {
+        return;
+    }
+    InventarioModel *model = INVENTARIO_MODEL(gtk_tree_view_get_model(GTK_TREE_VIEW(app->treeview)));
+    inventario_model_imposta_finestra(model,
+                                      gtk_tree_path_get_indices(inizio)[0],
+                                      gtk_tree_path_get_indices(fine)[0]);
+    gtk_tree_path_free(inizio);
+    gtk_tree_path_free(fine);
+}
+
+// --- Modifiche eseguite dal thread di scrittura ---
+
+static OperazioneDB *nuova_operazione(AppData *app, GtkWidget *pulsante) {
+    OperazioneDB *op = g_new0(OperazioneDB, 1);
+    op->app = app;
+    op->pulsante = pulsante;
+    gtk_widget_set_sensitive(pulsante, FALSE);
+    attivita_inizia(app);
+    return op;
+}
+
+// Chiude l'operazione nel thread principale: riattiva il pulsante,
+// aggiorna la lista se richiesto e libera la memoria. Se la finestra è già
+// stata chiusa libera soltanto.
+static void operazione_conclusa(OperazioneDB *op, gboolean aggiorna) {
+    AppData *app = op->app;
+    if (app->window) {
+        gtk_widget_set_sensitive(op->pulsante, TRUE);
+        attivita_fine(app);
+        if (aggiorna) {
+            carica_dati(app);
+        }
+    }
+
+    g_free((gchar *)op->articolo.nome);
+    g_free((gchar *)op->articolo.descrizione);
+    g_free((gchar *)op->articolo.artista);
+    g_free((gchar *)op->articolo.periodo);
+    g_free((gchar *)op->articolo.misure);
+    g_free((gchar *)op->articolo.data_acquisizione);
+    g_free(op->cliente);
+    g_free(op->data);
+    g_free(op->errore);
+    g_free(op->percorso);
+    if (op->scartate) {
+        g_string_free(op->scartate, TRUE);
+    }
+    g_slist_free_full(op->foto, g_free);
+    g_free(op);
+}
+
+static void mostra_messaggio(AppData *app, GtkMessageType tipo, const gchar *messaggio) {
+    if (!app->window) {
+        return;
+    }
+    GtkWidget *msg = gtk_message_dialog_new(GTK_WINDOW(app->window),
+                                            GTK_DIALOG_MODAL,
+                                            tipo,
+                                            GTK_BUTTONS_OK,
+                                            "%s", messaggio);
+    gtk_dialog_run(GTK_DIALOG(msg));
+    gtk_widget_destroy(msg);
+}
+
+// Il messaggio d'errore va copiato nel thread che ha eseguito la query
+static void salva_errore(OperazioneDB *op, Repository *repo) {
+    op->errore = g_strdup(op->app->sync ? client_sync_errmsg(op->app->sync) : repo_errmsg(repo));
+}
+
+// Da terminale le modifiche passano dal server, che poi rimanda le modifiche
+// risultanti alla copia locale "repo"
+static gpointer lavoro_elimina(Repository *repo, gpointer dati, GCancellable *annulla) {
+    OperazioneDB *op = dati;
+    ClientSync *sync = op->app->sync;
+    op->rc = sync ? client_sync_elimina_articolo(sync, repo, op->articolo_id)
+                  : repo_elimina_articolo(repo, op->articolo_id);
+    if (op->rc != SQLITE_OK) {
+        salva_errore(op, repo);
+    }
+    return op;
+}
+
+static void elimina_completato(gpointer risultato, gboolean annullato, gpointer dati) {
+    OperazioneDB *op = dati;
+    if (op->rc != SQLITE_OK) {
+        gchar *messaggio = g_strdup_printf("Errore durante l'eliminazione: %s", op->errore);
+        mostra_messaggio(op->app, GTK_MESSAGE_ERROR, messaggio);
+        g_free(messaggio);
+    } else {
+        mostra_messaggio(op->app, GTK_MESSAGE_INFO, "Articolo eliminato con successo.");
+    }
+    operazione_conclusa(op, op->rc == SQLITE_OK);
+}
+
+static gpointer lavoro_inserisci(Repository *repo, gpointer dati, GCancellable *annulla) {
+    OperazioneDB *op = dati;
+    ClientSync *sync = op->app->sync;
+    op->rc = sync ? client_sync_insert_articolo(sync, repo, &op->articolo, NULL)
+                  : repo_insert_articolo(repo, &op->articolo, NULL);
+    if (op->rc != SQLITE_OK) {
+        salva_errore(op, repo);
+    }
+    return op;
+}
+
+static void inserisci_completato(gpointer risultato, gboolean annullato, gpointer dati) {
+    OperazioneDB *op = dati;
+    if (op->rc == SQLITE_OK) {
+        mostra_messaggio(op->app, GTK_MESSAGE_INFO, "Articolo aggiunto con successo.");
+    } else {
+        gchar *messaggio = g_strdup_printf("Errore durante l'inserimento: %s", op->errore);
+        mostra_messaggio(op->app, GTK_MESSAGE_ERROR, messaggio);
+        g_free(messaggio);
+    }
+    operazione_conclusa(op, op->rc == SQLITE_OK);
+}
+
+static gpointer lavoro_vendi(Repository *repo, gpointer dati, GCancellable *annulla) {
+    OperazioneDB *op = dati;
+    ClientSync *sync = op->app->sync;
+    op->rc = sync ? client_sync_registra_vendita(sync, repo, op->articolo_id, op->prezzo, op->cliente, op->data)
+                  : repo_registra_vendita(repo, op->articolo_id, op->prezzo, op->cliente, op->data);
+    if (op->rc == VENDITA_ERRORE) {
+        salva_errore(op, repo);
+    }
+    return op;
+}
+
+static void vendi_completato(gpointer risultato, gboolean annullato, gpointer dati) {
+    OperazioneDB *op = dati;
+    GtkMessageType tipo = GTK_MESSAGE_ERROR;
+    gchar *messaggio = NULL;
+    switch ((EsitoVendita)op->rc) {
+    case VENDITA_OK:
+        tipo = GTK_MESSAGE_INFO;
+        messaggio = g_strdup("Vendita registrata con successo.");
+        break;
+    case VENDITA_ESAURITO:
+        tipo = GTK_MESSAGE_WARNING;
+        messaggio = g_strdup("L'articolo non è disponibile in magazzino.");
+        break;
+    case VENDITA_NON_TROVATO:
+        messaggio = g_strdup("Articolo non trovato.");
+        break;
+    case VENDITA_ERRORE:
+        messaggio = g_strdup_printf("Errore durante la registrazione: %s", op->errore);
+        break;
+    }
+
+    mostra_messaggio(op->app, tipo, messaggio);
+    g_free(messaggio);
+    operazione_conclusa(op, op->rc == VENDITA_OK);
+}
+
+// Chiamata dal thread di scrittura per ogni riga scartata
+static void on_riga_scartata(long riga, const char *messaggio, void *user_data) {
+    OperazioneDB *op = user_data;
+    if (op->importazione.righe_scartate <= MAX_SCARTATE_MOSTRATE) {
+        g_string_append_printf(op->scartate, "Riga %ld: %s\n", riga, messaggio);
+    }
+}
+
+static int importazione_annullata(void *annulla) {
+    return g_cancellable_is_cancelled(annulla);
+}
+
+static gpointer lavoro_importa(Repository *repo, gpointer dati, GCancellable *annulla) {
+    OperazioneDB *op = dati;
+    char errore[512];
+    op->scartate = g_string_new(NULL);
+    // Chiudendo il programma l'importazione si ferma: il blocco in corso
+    // viene annullato, quelli già confermati restano
+    sqlite3_progress_handler(repo_db(repo), PASSI_CONTROLLO_CHIUSURA, importazione_annullata, annulla);
+    op->rc = importa_file(repo, op->percorso, IMPORTA_AUTO, on_riga_scartata, op,
+                          &op->importazione, errore, sizeof(errore));
+    sqlite3_progress_handler(repo_db(repo), 0, NULL, NULL);
+    if (op->rc != SQLITE_OK) {
+        op->errore = g_strdup(errore);
+    }
+    return op;
+}
+
+static void importa_completato(gpointer risultato, gboolean annullato, gpointer dati) {
+    OperazioneDB *op = dati;
+    GString *messaggio = g_string_new(NULL);
+    if (op->rc != SQLITE_OK) {
+        g_string_append_printf(messaggio, "Importazione interrotta: %s\n\n", op->errore);
+    }
+    g_string_append_printf(messaggio, "Righe lette: %ld\nImportate: %ld\nScartate: %ld",
+                           op->importazione.righe_lette,
+                           op->importazione.righe_importate,
+                           op->importazione.righe_scartate);
+    if (op->importazione.righe_scartate > 0) {
+        g_string_append_printf(messaggio, "\n\n%s", op->scartate->str);
+        if (op->importazione.righe_scartate > MAX_SCARTATE_MOSTRATE) {
+            g_string_append(messaggio, "…");
+        }
+    }
+
+    GtkMessageType tipo = GTK_MESSAGE_INFO;
+    if (op->rc != SQLITE_OK) {
+        tipo = GTK_MESSAGE_ERROR;
+    } else if (op->importazione.righe_scartate > 0) {
+        tipo = GTK_MESSAGE_WARNING;
+    }
+    mostra_messaggio(op->app, tipo, messaggio->str);
+    g_string_free(messaggio, TRUE);
+    operazione_conclusa(op, op->importazione.righe_importate > 0);
+}
 
-    const char *sql =
-        "SELECT articolo_id, nome, artista, periodo, misure, quantita, prezzo_acquisto, "
-        "CASE WHEN quantita = 0 THEN 'Venduto' ELSE 'Disponibile' END AS stato "
-        "FROM articoli ORDER BY stato ASC;";
+// L'esportazione legge soltanto: gira in un thread di lettura e non ferma le vendite
+static gpointer lavoro_esporta(Repository *repo, gpointer dati, GCancellable *annulla) {
+    OperazioneDB *op = dati;
+    char errore[512];
+    op->rc = esporta_file(repo, op->esporta, op->formato,
+                          op->dal[0] ? op->dal : NULL, op->al[0] ? op->al : NULL,
+                          op->percorso, &op->righe, errore, sizeof(errore));
+    if (op->rc != SQLITE_OK) {
+        op->errore = g_strdup(errore);
+    }
+    return op;
+}
 
-    sqlite3_stmt *stmt;
-    if (sqlite3_prepare_v2(app->db, sql, -1, &stmt, NULL) != SQLITE_OK) {
-        fprintf(stderr, "Errore query: %s\n", sqlite3_errmsg(app->db));
+static void esporta_completato(gpointer risultato, gboolean annullato, gpointer dati) {
+    OperazioneDB *op = dati;
+    gchar *messaggio;
+    if (op->rc == SQLITE_OK) {
+        messaggio = g_strdup_printf("Esportate %ld righe in %s.", op->righe, op->percorso);
+    } else {
+        messaggio = g_strdup_printf("Errore durante l'esportazione: %s", op->errore);
+    }
+    mostra_messaggio(op->app, op->rc == SQLITE_OK ? GTK_MESSAGE_INFO : GTK_MESSAGE_ERROR, messaggio);
+    g_free(messaggio);
+    operazione_conclusa(op, FALSE);
+}
+
+// La copia gira su una connessione di lettura: vendite e modifiche
+// continuano mentre viene scritta
+static gpointer lavoro_backup(Repository *repo, gpointer dati, GCancellable *annulla) {
+    OperazioneDB *op = dati;
+    char errore[512];
+    op->rc = backup_copia(repo_db(repo), op->percorso, NULL, NULL, &op->pagine, errore, sizeof(errore));
+    if (op->rc != SQLITE_OK) {
+        op->errore = g_strdup(errore);
+    }
+    return op;
+}
+
+static void backup_completato(gpointer risultato, gboolean annullato, gpointer dati) {
+    OperazioneDB *op = dati;
+    gchar *messaggio;
+    if (op->rc == SQLITE_OK) {
+        messaggio = g_strdup_printf("Backup salvato in %s (%d pagine).\n"
+                                    "Le modifiche successive sono nel file %s%s.",
+                                    op->percorso, op->pagine, op->app->config.percorso, GIORNALE_ESTENSIONE);
+    } else {
+        messaggio = g_strdup_printf("Errore durante il backup: %s", op->errore);
+    }
+    mostra_messaggio(op->app, op->rc == SQLITE_OK ? GTK_MESSAGE_INFO : GTK_MESSAGE_ERROR, messaggio);
+    g_free(messaggio);
+    operazione_conclusa(op, FALSE);
+}
+
+// --- Sincronizzazione con il server ---
+
+typedef struct {
+    AppData *app;
+    gint rc;
+    glong applicate;
+    gchar *errore;
+} AggiornamentoSync;
+
+static gpointer lavoro_sync(Repository *repo, gpointer dati, GCancellable *annulla) {
+    AggiornamentoSync *aggiornamento = dati;
+    ClientSync *sync = aggiornamento->app->sync;
+    aggiornamento->rc = client_sync_aggiorna(sync, repo, &aggiornamento->applicate);
+    if (aggiornamento->rc != SQLITE_OK) {
+        aggiornamento->errore = g_strdup(client_sync_errmsg(sync));
+    }
+    return aggiornamento;
+}
+
+static void sync_completato(gpointer risultato, gboolean annullato, gpointer dati) {
+    AggiornamentoSync *aggiornamento = dati;
+    AppData *app = aggiornamento->app;
+    app->sync_in_corso = FALSE;
+    if (annullato) {
+        // Programma in chiusura
+    } else if (aggiornamento->rc == SQLITE_OK) {
+        if (app->sync_errori > 0) {
+            gtk_window_set_title(GTK_WINDOW(app->window), TITOLO_FINESTRA);
+        }
+        app->sync_errori = 0;
+        // Modifiche degli altri terminali: la lista applica solo le righe cambiate
+        if (aggiornamento->applicate > 0) {
+            carica_dati(app);
+        }
+    } else {
+        if (app->sync_errori == 0) {
+            fprintf(stderr, "Sincronizzazione non riuscita: %s\n", aggiornamento->errore);
+            gtk_window_set_title(GTK_WINDOW(app->window), TITOLO_SCOLLEGATO);
+        }
+        // Un server spento non deve tenere occupato il thread di scrittura
+        // a ogni giro: l'attesa raddoppia fino a MAX_PAUSA_SYNC giri
+        app->sync_errori++;
+        app->sync_pausa = MIN(1u << MIN(app->sync_errori, 5u), MAX_PAUSA_SYNC);
+    }
+    g_free(aggiornamento->errore);
+    g_free(aggiornamento);
+}
+
+static gboolean on_timer_sync(gpointer user_data) {
+    AppData *app = user_data;
+    if (app->sync_pausa > 0) {
+        app->sync_pausa--;
+    } else if (!app->sync_in_corso) {
+        AggiornamentoSync *aggiornamento = g_new0(AggiornamentoSync, 1);
+        aggiornamento->app = app;
+        app->sync_in_corso = TRUE;
+        coda_lavori_scrivi(app->coda, lavoro_sync, sync_completato, aggiornamento);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// --- Foto degli articoli ---
+
+// Copia le immagini nell'archivio e le collega all'articolo. Gira nel thread
+// di scrittura anche la copia dei file: così non si sovrappone alla pulizia
+// dell'archivio, che potrebbe togliere un file appena copiato.
+static gpointer lavoro_foto(Repository *repo, gpointer dati, GCancellable *annulla) {
+    OperazioneDB *op = dati;
+    op->scartate = g_string_new(NULL);
+    for (GSList *l = op->foto; l; l = l->next) {
+        const gchar *percorso = l->data;
+        gchar *nome = g_path_get_basename(percorso);
+        char errore[512];
+        gint64 dimensione = 0;
+        gchar *hash = NULL;
+        // Legge solo l'intestazione: un file che non è un'immagine non entra in archivio
+        if (!gdk_pixbuf_get_file_info(percorso, NULL, NULL)) {
+            g_string_append_printf(op->scartate, "%s: formato immagine non riconosciuto\n", nome);
+        } else if (!(hash = archivio_foto_aggiungi(op->app->archivio, percorso, &dimensione,
+                                                   errore, sizeof(errore)))) {
+            g_string_append_printf(op->scartate, "%s\n", errore);
+        } else if (repo_aggiungi_foto(repo, op->articolo_id, hash, dimensione) != SQLITE_OK) {
+            g_string_append_printf(op->scartate, "%s: %s\n", nome, repo_errmsg(repo));
+        } else {
+            op->righe++;
+        }
+        g_free(hash);
+        g_free(nome);
+    }
+    return op;
+}
+
+static void foto_completato(gpointer risultato, gboolean annullato, gpointer dati) {
+    OperazioneDB *op = dati;
+    GString *messaggio = g_string_new(NULL);
+    g_string_append_printf(messaggio, "Foto aggiunte all'articolo ID %d: %ld",
+                           op->articolo_id, op->righe);
+    if (op->scartate->len > 0) {
+        g_string_append_printf(messaggio, "\n\nNon aggiunte:\n%s", op->scartate->str);
+    }
+    mostra_messaggio(op->app, op->scartate->len > 0 ? GTK_MESSAGE_WARNING : GTK_MESSAGE_INFO,
+                     messaggio->str);
+    g_string_free(messaggio, TRUE);
+    // La nuova foto è registrata come modifica dell'articolo
+    operazione_conclusa(op, op->righe > 0);
+}
+
+static gpointer lavoro_pulisci_foto(Repository *repo, gpointer dati, GCancellable *annulla) {
+    gint eliminati = archivio_foto_pulisci(dati, repo);
+    if (eliminati > 0) {
+        fprintf(stderr, "Archivio foto: eliminati %d file non più usati.\n", eliminati);
+    }
+    return NULL;
+}
+
+// Sceglie una o più immagini da aggiungere all'articolo selezionato
+static void on_btn_foto_clicked(GtkButton *button, AppData *app) {
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(app->treeview));
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    int articolo_id = 0;
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        // Una riga non ancora caricata ha ID 0
+        gtk_tree_model_get(model, &iter, INV_COL_ID, &articolo_id, -1);
+    }
+    if (articolo_id <= 0) {
+        mostra_messaggio(app, GTK_MESSAGE_WARNING, "Seleziona un articolo a cui aggiungere le foto.");
         return;
     }
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        int articolo_id = sqlite3_column_int(stmt, 0);
-        const char *nome = (const char*)sqlite3_column_text(stmt, 1);
-        const char *artista = (const char*)sqlite3_column_text(stmt, 2);
-        const char *periodo = (const char*)sqlite3_column_text(stmt, 3);
-        const char *misure = (const char*)sqlite3_column_text(stmt, 4);
-        int quantita = sqlite3_column_int(stmt, 5);
-        double prezzo_acq = sqlite3_column_double(stmt, 6);
-        const char *stato = (const char*)sqlite3_column_text(stmt, 7);
+    GtkWidget *dialog = gtk_file_chooser_dialog_new("Aggiungi Foto",
+                                                    GTK_WINDOW(app->window),
+                                                    GTK_FILE_CHOOSER_ACTION_OPEN,
+                                                    "Annulla", GTK_RESPONSE_CANCEL,
+                                                    "Aggiungi", GTK_RESPONSE_ACCEPT,
+                                                    NULL);
+    gtk_file_chooser_set_select_multiple(GTK_FILE_CHOOSER(dialog), TRUE);
+    GtkFileFilter *filtro = gtk_file_filter_new();
+    gtk_file_filter_set_name(filtro, "Immagini");
+    gtk_file_filter_add_pixbuf_formats(filtro);
+    gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(dialog), filtro);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        OperazioneDB *op = nuova_operazione(app, app->btn_foto);
+        op->articolo_id = articolo_id;
+        op->foto = gtk_file_chooser_get_filenames(GTK_FILE_CHOOSER(dialog));
+        coda_lavori_scrivi(app->coda, lavoro_foto, foto_completato, op);
+    }
+
+    gtk_widget_destroy(dialog);
+}
+
+// Il TreeView chiede la miniatura di ogni riga che disegna: se non è in
+// memoria la cella resta vuota finché non arriva
+static void mostra_miniatura(GtkTreeViewColumn *col, GtkCellRenderer *renderer,
+                             GtkTreeModel *model, GtkTreeIter *iter, gpointer user_data) {
+    AppData *app = user_data;
+    gchar *hash = NULL;
+    gtk_tree_model_get(model, iter, INV_COL_FOTO, &hash, -1);
+    GdkPixbuf *pixbuf = hash ? cache_miniature_trova(app->miniature, hash) : NULL;
+    g_object_set(renderer, "pixbuf", pixbuf, NULL);
+    g_free(hash);
+}
+
+static void on_miniatura_pronta(gpointer user_data) {
+    AppData *app = user_data;
+    gtk_widget_queue_draw(app->treeview);
+}
+
+// --- Statistiche di vendita ---
+
+// Colonne della tabella delle statistiche
+enum {
+    STAT_COL_GRUPPO,
+    STAT_COL_PEZZI,
+    STAT_COL_RICAVO,
+    STAT_COL_COSTO,
+    STAT_COL_MARGINE,
+    STAT_COL_MARGINE_PERCENTO,
+    STAT_N_COLONNE
+};
+
+// Lettura dei riepiloghi: la finestra può essere chiusa prima che finisca,
+// quindi la richiesta tiene un riferimento a tabella ed etichetta
+typedef struct {
+    AppData *app;
+    GtkListStore *store;
+    GtkWidget *label_valore;
+    DimensioneStatistica dimensione;
+    GArray *righe;            // RigaStatistica con la chiave copiata
+    ValoreMagazzino valore;
+    gint rc;
+} RichiestaStatistiche;
+
+// Stato della finestra aperta, usato dal cambio di raggruppamento
+typedef struct {
+    AppData *app;
+    GtkListStore *store;
+    GtkWidget *label_valore;
+    GCancellable *annulla;    // lettura in corso, annullata dalla successiva
+} FinestraStatistiche;
+
+static void on_riga_statistica(const RigaStatistica *riga, void *user_data) {
+    RigaStatistica copia = *riga;
+    copia.chiave = g_strdup(riga->chiave);
+    g_array_append_val((GArray *)user_data, copia);
+}
+
+static gpointer lavoro_statistiche(Repository *repo, gpointer dati, GCancellable *annulla) {
+    RichiestaStatistiche *richiesta = dati;
+    richiesta->rc = repo_valore_magazzino(repo, &richiesta->valore);
+    if (richiesta->rc == SQLITE_OK &&
+        repo_leggi_statistiche(repo, richiesta->dimensione, NULL, NULL,
+                               on_riga_statistica, richiesta->righe) < 0) {
+        richiesta->rc = SQLITE_ERROR;
+    }
+    return richiesta;
+}
+
+static void statistiche_completate(gpointer risultato, gboolean annullato, gpointer dati) {
+    RichiestaStatistiche *richiesta = dati;
+    attivita_fine(richiesta->app);
+
+    if (!annullato && richiesta->rc == SQLITE_OK) {
+        gchar *testo = g_strdup_printf("In magazzino: %d articoli, %" G_GINT64_FORMAT " pezzi, "
+                                       "valore d'acquisto %.2f €",
+                                       richiesta->valore.articoli, (gint64)richiesta->valore.pezzi,
+                                       richiesta->valore.valore);
+        gtk_label_set_text(GTK_LABEL(richiesta->label_valore), testo);
+        g_free(testo);
+
+        guint64 inizio = traccia_inizio();
+        gtk_list_store_clear(richiesta->store);
+        for (guint i = 0; i < richiesta->righe->len; i++) {
+            const RigaStatistica *riga = &g_array_index(richiesta->righe, RigaStatistica, i);
+            gchar ricavo[32], costo[32], margine[32], percento[16];
+            g_snprintf(ricavo, sizeof(ricavo), "%.2f", riga->ricavo);
+            g_snprintf(costo, sizeof(costo), "%.2f", riga->costo);
+            g_snprintf(margine, sizeof(margine), "%.2f", riga->margine);
+            if (riga->ricavo != 0) {
+                g_snprintf(percento, sizeof(percento), "%.1f%%", 100.0 * riga->margine / riga->ricavo);
+            } else {
+                g_strlcpy(percento, "-", sizeof(percento));
+            }
+            gtk_list_store_insert_with_values(richiesta->store, NULL, -1,
+                                              STAT_COL_GRUPPO, riga->chiave[0] ? riga->chiave : "(nessuno)",
+                                              STAT_COL_PEZZI, riga->pezzi,
+                                              STAT_COL_RICAVO, ricavo,
+                                              STAT_COL_COSTO, costo,
+                                              STAT_COL_MARGINE, margine,
+                                              STAT_COL_MARGINE_PERCENTO, percento,
+                                              -1);
+        }
+        traccia_fine("ui", "statistiche_append", inizio, richiesta->righe->len, 0);
+    } else if (!annullato) {
+        gtk_label_set_text(GTK_LABEL(richiesta->label_valore), "Errore nella lettura delle statistiche.");
+    }
+
+    for (guint i = 0; i < richiesta->righe->len; i++) {
+        g_free((gchar *)g_array_index(richiesta->righe, RigaStatistica, i).chiave);
+    }
+    g_array_free(richiesta->righe, TRUE);
+    g_object_unref(richiesta->store);
+    g_object_unref(richiesta->label_valore);
+    g_free(richiesta);
+}
 
-        GtkTreeIter iter;
-        gtk_list_store_append(store, &iter);
-        gtk_list_store_set(store, &iter,
-                           0, articolo_id,
-                           1, nome ? nome : "",
-                           2, artista ? artista : "",
-                           3, periodo ? periodo : "",
-                           4, misure ? misure : "",
-                           5, quantita,
-                           6, prezzo_acq,
-                           7, stato ? stato : "",
-                           -1);
+static void on_dimensione_statistiche_cambiata(GtkComboBox *combo, FinestraStatistiche *finestra) {
+    if (finestra->annulla) {
+        g_cancellable_cancel(finestra->annulla);
+        g_object_unref(finestra->annulla);
     }
+    finestra->annulla = g_cancellable_new();
 
-    sqlite3_finalize(stmt);
+    RichiestaStatistiche *richiesta = g_new0(RichiestaStatistiche, 1);
+    richiesta->app = finestra->app;
+    richiesta->store = g_object_ref(finestra->store);
+    richiesta->label_valore = g_object_ref(finestra->label_valore);
+    richiesta->dimensione = (DimensioneStatistica)gtk_combo_box_get_active(combo);
+    richiesta->righe = g_array_new(FALSE, FALSE, sizeof(RigaStatistica));
+    attivita_inizia(finestra->app);
+    coda_lavori_leggi(finestra->app->coda, lavoro_statistiche, statistiche_completate,
+                      richiesta, finestra->annulla);
 }
 
-// Callback per aggiornare la lista
+// Callback per aggiornare la lista: un nuovo clic annulla l'aggiornamento
+// precedente ancora in corso
 static void on_btn_aggiorna_clicked(GtkButton *button, AppData *app) {
     carica_dati(app);
 }
 
+// Callback della casella di ricerca: una nuova ricerca annulla quella
+// precedente ancora in corso
+static void on_ricerca_cambiata(GtkSearchEntry *entry, AppData *app) {
+    InventarioModel *model = INVENTARIO_MODEL(gtk_tree_view_get_model(GTK_TREE_VIEW(app->treeview)));
+    inventario_model_imposta_ricerca(model, gtk_entry_get_text(GTK_ENTRY(entry)));
+}
+
+// --- Ordinamento e filtri della lista ---
+
+// Applica ordinamento e filtri e torna all'inizio della lista: il model
+// riconta e legge solo la prima pagina, con una ricerca sull'indice
+static void applica_criteri(AppData *app, const CriteriLista *criteri) {
+    InventarioModel *model = INVENTARIO_MODEL(gtk_tree_view_get_model(GTK_TREE_VIEW(app->treeview)));
+    inventario_model_imposta_criteri(model, criteri);
+    aggiorna_intestazioni(app);
+    gtk_tree_view_scroll_to_point(GTK_TREE_VIEW(app->treeview), -1, 0);
+}
+
+// Mostra la freccia dell'ordinamento sull'intestazione della colonna attiva
+static void aggiorna_intestazioni(AppData *app) {
+    InventarioModel *model = INVENTARIO_MODEL(gtk_tree_view_get_model(GTK_TREE_VIEW(app->treeview)));
+    const CriteriLista *criteri = inventario_model_criteri(model);
+    for (int i = 0; i < N_ORDINI; i++) {
+        GtkTreeViewColumn *col = app->colonne_ordine[i];
+        if (!col) {
+            continue;
+        }
+        gtk_tree_view_column_set_sort_indicator(col, (OrdineLista)i == criteri->ordine);
+        gtk_tree_view_column_set_sort_order(col, criteri->decrescente ? GTK_SORT_DESCENDING
+                                                                      : GTK_SORT_ASCENDING);
+    }
+}
+
+// Clic su un'intestazione: ordina per quella colonna, un nuovo clic
+// inverte il verso
+static void on_intestazione_clicked(GtkTreeViewColumn *col, AppData *app) {
+    InventarioModel *model = INVENTARIO_MODEL(gtk_tree_view_get_model(GTK_TREE_VIEW(app->treeview)));
+    OrdineLista ordine = (OrdineLista)GPOINTER_TO_INT(g_object_get_data(G_OBJECT(col), "ordine"));
+    CriteriLista criteri = *inventario_model_criteri(model);
+    criteri.decrescente = criteri.ordine == ordine ? !criteri.decrescente : 0;
+    criteri.ordine = ordine;
+    applica_criteri(app, &criteri);
+}
+
+// Testo di un filtro, NULL se il campo è vuoto
+static const gchar *testo_filtro(GtkWidget *entry) {
+    const gchar *testo = gtk_entry_get_text(GTK_ENTRY(entry));
+    return *testo ? testo : NULL;
+}
+
+// Legge un estremo del prezzo: -1 se il campo è vuoto, FALSE se non è valido
+static gboolean leggi_filtro_prezzo(AppData *app, GtkWidget *entry, double *prezzo) {
+    const gchar *testo = testo_filtro(entry);
+    const char *errore;
+    *prezzo = -1;
+    if (testo && !valida_prezzo(testo, prezzo, &errore)) {
+        mostra_messaggio(app, GTK_MESSAGE_WARNING, errore);
+        gtk_widget_grab_focus(entry);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Rilegge tutti i filtri dai campi, mantenendo l'ordinamento attuale
+static void on_filtri_cambiati(GtkWidget *widget, AppData *app) {
+    InventarioModel *model = INVENTARIO_MODEL(gtk_tree_view_get_model(GTK_TREE_VIEW(app->treeview)));
+    CriteriLista criteri = *inventario_model_criteri(model);
+
+    // Con entrambi o nessuno dei due stati si vedono tutti gli articoli
+    gboolean disponibile = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(app->filtro_disponibile));
+    gboolean venduto = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(app->filtro_venduto));
+    criteri.venduto = disponibile == venduto ? -1 : venduto;
+
+    criteri.artista = testo_filtro(app->filtro_artista);
+    criteri.periodo = testo_filtro(app->filtro_periodo);
+    if (!leggi_filtro_prezzo(app, app->filtro_prezzo_min, &criteri.prezzo_min) ||
+        !leggi_filtro_prezzo(app, app->filtro_prezzo_max, &criteri.prezzo_max)) {
+        return;
+    }
+    applica_criteri(app, &criteri);
+}
+
+// Un campo svuotato (anche con l'icona della casella) toglie subito il
+// filtro; il testo digitato si applica con Invio o scegliendo un suggerimento
+static void on_filtro_testo_cambiato(GtkSearchEntry *entry, AppData *app) {
+    if (!testo_filtro(GTK_WIDGET(entry))) {
+        on_filtri_cambiati(GTK_WIDGET(entry), app);
+    }
+}
+
+static gboolean on_suggerimento_scelto(GtkEntryCompletion *completion, GtkTreeModel *model,
+                                       GtkTreeIter *iter, AppData *app) {
+    gchar *valore;
+    gtk_tree_model_get(model, iter, 0, &valore, -1);
+    GtkWidget *entry = gtk_entry_completion_get_entry(completion);
+    gtk_entry_set_text(GTK_ENTRY(entry), valore);
+    g_free(valore);
+    on_filtri_cambiati(entry, app);
+    return TRUE;
+}
+
+typedef struct {
+    OrdineLista colonna;
+    GtkListStore *store;
+    GPtrArray *valori;
+} LetturaValori;
+
+static void on_valore_filtro(const char *valore, void *user_data) {
+    g_ptr_array_add(user_data, g_strdup(valore));
+}
+
+static gpointer lavoro_valori_filtro(Repository *repo, gpointer dati, GCancellable *annulla) {
+    LetturaValori *lettura = dati;
+    repo_valori_filtro(repo, lettura->colonna, on_valore_filtro, lettura->valori);
+    return lettura;
+}
+
+static void valori_filtro_letti(gpointer risultato, gboolean annullato, gpointer dati) {
+    LetturaValori *lettura = dati;
+    if (!annullato) {
+        gtk_list_store_clear(lettura->store);
+        for (guint i = 0; i < lettura->valori->len; i++) {
+            gtk_list_store_insert_with_values(lettura->store, NULL, -1,
+                                              0, g_ptr_array_index(lettura->valori, i), -1);
+        }
+    }
+    g_ptr_array_free(lettura->valori, TRUE);
+    g_object_unref(lettura->store);
+    g_free(lettura);
+}
+
+// I suggerimenti vengono riletti ogni volta che si entra nel campo, così
+// comprendono gli articoli aggiunti nel frattempo: la lettura scorre solo
+// l'indice della colonna
+static gboolean on_filtro_testo_focus(GtkWidget *entry, GdkEvent *evento, AppData *app) {
+    GtkEntryCompletion *completion = gtk_entry_get_completion(GTK_ENTRY(entry));
+    LetturaValori *lettura = g_new0(LetturaValori, 1);
+    lettura->colonna = (OrdineLista)GPOINTER_TO_INT(g_object_get_data(G_OBJECT(entry), "colonna"));
+    lettura->store = g_object_ref(GTK_LIST_STORE(gtk_entry_completion_get_model(completion)));
+    lettura->valori = g_ptr_array_new_with_free_func(g_free);
+    coda_lavori_leggi(app->coda, lavoro_valori_filtro, valori_filtro_letti, lettura, NULL);
+    return FALSE;
+}
+
+static GtkWidget *crea_filtro_testo(AppData *app, GtkWidget *box, const char *segnaposto, OrdineLista colonna) {
+    GtkWidget *entry = gtk_search_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(entry), segnaposto);
+    gtk_entry_set_width_chars(GTK_ENTRY(entry), 16);
+    g_object_set_data(G_OBJECT(entry), "colonna", GINT_TO_POINTER(colonna));
+    gtk_box_pack_start(GTK_BOX(box), entry, FALSE, FALSE, 0);
+
+    GtkListStore *store = gtk_list_store_new(1, G_TYPE_STRING);
+    GtkEntryCompletion *completion = gtk_entry_completion_new();
+    gtk_entry_completion_set_model(completion, GTK_TREE_MODEL(store));
+    gtk_entry_completion_set_text_column(completion, 0);
+    gtk_entry_set_completion(GTK_ENTRY(entry), completion);
+    g_object_unref(store);
+    g_object_unref(completion);
+
+    g_signal_connect(entry, "activate", G_CALLBACK(on_filtri_cambiati), app);
+    g_signal_connect(entry, "search-changed", G_CALLBACK(on_filtro_testo_cambiato), app);
+    g_signal_connect(entry, "focus-in-event", G_CALLBACK(on_filtro_testo_focus), app);
+    g_signal_connect(completion, "match-selected", G_CALLBACK(on_suggerimento_scelto), app);
+    return entry;
+}
+
+static GtkWidget *crea_filtro_prezzo(AppData *app, GtkWidget *box, const char *segnaposto) {
+    GtkWidget *entry = gtk_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(entry), segnaposto);
+    gtk_entry_set_width_chars(GTK_ENTRY(entry), 10);
+    gtk_box_pack_start(GTK_BOX(box), entry, FALSE, FALSE, 0);
+    g_signal_connect(entry, "activate", G_CALLBACK(on_filtri_cambiati), app);
+    return entry;
+}
+
+// Toglie tutti i filtri con una sola rilettura, mantenendo l'ordinamento
+static void on_btn_azzera_filtri_clicked(GtkButton *button, AppData *app) {
+    GtkWidget *campi[] = { app->filtro_disponibile, app->filtro_venduto, app->filtro_artista,
+                           app->filtro_periodo, app->filtro_prezzo_min, app->filtro_prezzo_max };
+    for (guint i = 0; i < G_N_ELEMENTS(campi); i++) {
+        g_signal_handlers_block_by_func(campi[i], on_filtri_cambiati, app);
+        g_signal_handlers_block_by_func(campi[i], on_filtro_testo_cambiato, app);
+    }
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app->filtro_disponibile), FALSE);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(app->filtro_venduto), FALSE);
+    gtk_entry_set_text(GTK_ENTRY(app->filtro_artista), "");
+    gtk_entry_set_text(GTK_ENTRY(app->filtro_periodo), "");
+    gtk_entry_set_text(GTK_ENTRY(app->filtro_prezzo_min), "");
+    gtk_entry_set_text(GTK_ENTRY(app->filtro_prezzo_max), "");
+    for (guint i = 0; i < G_N_ELEMENTS(campi); i++) {
+        g_signal_handlers_unblock_by_func(campi[i], on_filtri_cambiati, app);
+        g_signal_handlers_unblock_by_func(campi[i], on_filtro_testo_cambiato, app);
+    }
+    on_filtri_cambiati(GTK_WIDGET(button), app);
+}
+
 // Callback per eliminare un articolo
 static void on_btn_elimina_clicked(GtkButton *button, AppData *app) {
     GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(app->treeview));
     GtkTreeModel *model;
     GtkTreeIter iter;
+    int articolo_id = 0;
     if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        int articolo_id;
+        // Una riga non ancora caricata ha ID 0
         gtk_tree_model_get(model, &iter, 0, &articolo_id, -1);
+    }
 
+    if (articolo_id > 0) {
         // Chiede conferma
         GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
                                                    GTK_DIALOG_MODAL,
@@ -227,28 +1226,9 @@ static void on_btn_elimina_clicked(GtkButton *button, AppData *app) {
         gtk_widget_destroy(dialog);
 
         if (response == GTK_RESPONSE_YES) {
-            char sql[256];
-            snprintf(sql, sizeof(sql), "DELETE FROM articoli WHERE articolo_id = %d;", articolo_id);
-            char *err_msg = NULL;
-            if (sqlite3_exec(app->db, sql, 0, 0, &err_msg) != SQLITE_OK) {
-                GtkWidget *err_dialog = gtk_message_dialog_new(GTK_WINDOW(app->window),
-                                                               GTK_DIALOG_MODAL,
-                                                               GTK_MESSAGE_ERROR,
-                                                               GTK_BUTTONS_OK,
-                                                               "Errore durante l'eliminazione: %s", err_msg);
-                gtk_dialog_run(GTK_DIALOG(err_dialog));
-                gtk_widget_destroy(err_dialog);
-                sqlite3_free(err_msg);
-            } else {
-                GtkWidget *info = gtk_message_dialog_new(GTK_WINDOW(app->window),
-                                                         GTK_DIALOG_MODAL,
-                                                         GTK_MESSAGE_INFO,
-                                                         GTK_BUTTONS_OK,
-                                                         "Articolo eliminato con successo.");
-                gtk_dialog_run(GTK_DIALOG(info));
-                gtk_widget_destroy(info);
-                carica_dati(app);
-            }
+            OperazioneDB *op = nuova_operazione(app, app->btn_elimina);
+            op->articolo_id = articolo_id;
+            coda_lavori_scrivi(app->coda, lavoro_elimina, elimina_completato, op);
         }
     } else {
         GtkWidget *warn = gtk_message_dialog_new(GTK_WINDOW(app->window),
@@ -300,6 +1280,16 @@ static void on_btn_aggiungi_clicked(GtkButton *button, AppData *app) {
         const char *prezzo = gtk_entry_get_text(GTK_ENTRY(entry_prezzo));
         const char *quantita = gtk_entry_get_text(GTK_ENTRY(entry_quantita));
 
+        NuovoArticolo articolo = {
+            .nome = nome,
+            .descrizione = descrizione,
+            .artista = artista,
+            .periodo = periodo,
+            .misure = misure,
+        };
+        char data[11];
+        const char *errore = NULL;
+
         if (strlen(nome) == 0 || strlen(prezzo) == 0 || strlen(quantita) == 0) {
             GtkWidget *warn = gtk_message_dialog_new(GTK_WINDOW(app->window),
                                                      GTK_DIALOG_MODAL,
@@ -308,40 +1298,30 @@ static void on_btn_aggiungi_clicked(GtkButton *button, AppData *app) {
                                                      "Campi obbligatori mancanti.");
             gtk_dialog_run(GTK_DIALOG(warn));
             gtk_widget_destroy(warn);
+        } else if (!valida_prezzo(prezzo, &articolo.prezzo_acquisto, &errore) ||
+                   !valida_quantita(quantita, 0, &articolo.quantita, &errore) ||
+                   !valida_data(data_aq, data, &errore) ||
+                   !valida_articolo(&articolo, &errore)) {
+            GtkWidget *warn = gtk_message_dialog_new(GTK_WINDOW(app->window),
+                                                     GTK_DIALOG_MODAL,
+                                                     GTK_MESSAGE_WARNING,
+                                                     GTK_BUTTONS_OK,
+                                                     "Valore non valido: %s.", errore);
+            gtk_dialog_run(GTK_DIALOG(warn));
+            gtk_widget_destroy(warn);
         } else {
-            const char *sql = "INSERT INTO articoli (nome, descrizione, artista, periodo, misure, data_acquisizione, prezzo_acquisto, quantita) VALUES (?, ?, ?, ?, ?, ?, ?, ?);";
-            sqlite3_stmt *stmt;
-            if (sqlite3_prepare_v2(app->db, sql, -1, &stmt, NULL) == SQLITE_OK) {
-                sqlite3_bind_text(stmt, 1, nome, -1, SQLITE_TRANSIENT);
-                sqlite3_bind_text(stmt, 2, descrizione, -1, SQLITE_TRANSIENT);
-                sqlite3_bind_text(stmt, 3, artista, -1, SQLITE_TRANSIENT);
-                sqlite3_bind_text(stmt, 4, periodo, -1, SQLITE_TRANSIENT);
-                sqlite3_bind_text(stmt, 5, misure, -1, SQLITE_TRANSIENT);
-                sqlite3_bind_text(stmt, 6, data_aq, -1, SQLITE_TRANSIENT);
-                sqlite3_bind_double(stmt, 7, atof(prezzo));
-                sqlite3_bind_int(stmt, 8, atoi(quantita));
-
-                if (sqlite3_step(stmt) == SQLITE_DONE) {
-                    GtkWidget *info = gtk_message_dialog_new(GTK_WINDOW(app->window),
-                                                             GTK_DIALOG_MODAL,
-                                                             GTK_MESSAGE_INFO,
-                                                             GTK_BUTTONS_OK,
-                                                             "Articolo aggiunto con successo.");
-                    gtk_dialog_run(GTK_DIALOG(info));
-                    gtk_widget_destroy(info);
-                    carica_dati(app);
-                } else {
-                    GtkWidget *err = gtk_message_dialog_new(GTK_WINDOW(app->window),
-                                                            GTK_DIALOG_MODAL,
-                                                            GTK_MESSAGE_ERROR,
-                                                            GTK_BUTTONS_OK,
-                                                            "Errore durante l'inserimento: %s",
-                                                            sqlite3_errmsg(app->db));
-                    gtk_dialog_run(GTK_DIALOG(err));
-                    gtk_widget_destroy(err);
-                }
-                sqlite3_finalize(stmt);
-            }
+            OperazioneDB *op = nuova_operazione(app, app->btn_aggiungi);
+            op->articolo = (NuovoArticolo) {
+                .nome = g_strdup(nome),
+                .descrizione = g_strdup(descrizione),
+                .artista = g_strdup(artista),
+                .periodo = g_strdup(periodo),
+                .misure = g_strdup(misure),
+                .data_acquisizione = g_strdup(data),
+                .prezzo_acquisto = articolo.prezzo_acquisto,
+                .quantita = articolo.quantita,
+            };
+            coda_lavori_scrivi(app->coda, lavoro_inserisci, inserisci_completato, op);
         }
     }
 
@@ -375,6 +1355,15 @@ static void on_btn_vendi_clicked(GtkButton *button, AppData *app) {
         const char *id_str = gtk_entry_get_text(GTK_ENTRY(entry_id));
         const char *cliente = gtk_entry_get_text(GTK_ENTRY(entry_cliente));
         const char *prezzo_str = gtk_entry_get_text(GTK_ENTRY(entry_prezzo_v));
+        int articolo_id = 0;
+        double prezzo = 0;
+        const char *errore = NULL;
+        if (!valida_quantita(id_str, 0, &articolo_id, &errore) || articolo_id == 0) {
+            errore = "ID articolo non valido";
+        } else if (valida_prezzo(prezzo_str, &prezzo, &errore) && !valida_utf8(cliente)) {
+            errore = "nome cliente non valido";
+        }
+
         if (strlen(id_str) == 0 || strlen(prezzo_str) == 0) {
             GtkWidget *warn = gtk_message_dialog_new(GTK_WINDOW(app->window),
                                                      GTK_DIALOG_MODAL,
@@ -383,45 +1372,243 @@ static void on_btn_vendi_clicked(GtkButton *button, AppData *app) {
                                                      "ID Articolo e Prezzo Vendita sono obbligatori.");
             gtk_dialog_run(GTK_DIALOG(warn));
             gtk_widget_destroy(warn);
+        } else if (errore) {
+            GtkWidget *warn = gtk_message_dialog_new(GTK_WINDOW(app->window),
+                                                     GTK_DIALOG_MODAL,
+                                                     GTK_MESSAGE_WARNING,
+                                                     GTK_BUTTONS_OK,
+                                                     "Valore non valido: %s.", errore);
+            gtk_dialog_run(GTK_DIALOG(warn));
+            gtk_widget_destroy(warn);
         } else {
-            int articolo_id = atoi(id_str);
-
-            // Verifica quantità
-            const char *sql_check = "SELECT quantita FROM articoli WHERE articolo_id = ?;";
-            sqlite3_stmt *stmt_check;
-            if (sqlite3_prepare_v2(app->db, sql_check, -1, &stmt_check, NULL) == SQLITE_OK) {
-                sqlite3_bind_int(stmt_check, 1, articolo_id);
-                int step = sqlite3_step(stmt_check);
-                if (step == SQLITE_ROW) {
-                    int quantita = sqlite3_column_int(stmt_check, 0);
-                    sqlite3_finalize(stmt_check);
-
-                    if (quantita > 0) {
-                        // Aggiorna quantità
-                        const char *sql_upd = "UPDATE articoli SET quantita = quantita - 1 WHERE articolo_id = ?;";
-                        sqlite3_stmt *stmt_upd;
-                        if (sqlite3_prepare_v2(app->db, sql_upd, -1, &stmt_upd, NULL) == SQLITE_OK) {
-                            sqlite3_bind_int(stmt_upd, 1, articolo_id);
-                            sqlite3_step(stmt_upd);
-                            sqlite3_finalize(stmt_upd);
-                        }
-
-                        // Inserimento vendita
-                        const char *sql_vendita = "INSERT INTO vendite (articolo_id, data_vendita, prezzo_vendita, nome_cliente) VALUES (?, ?, ?, ?);";
-                        sqlite3_stmt *stmt_v;
-                        if (sqlite3_prepare_v2(app->db, sql_vendita, -1, &stmt_v, NULL) == SQLITE_OK) {
-                            // Data corrente
-                            time_t t = time(NULL);
-                            struct tm *tm_info = localtime(&t);
-                            char data_str[11];
-                            strftime(data_str, 11, "%Y-%m-%d", tm_info);
-
-                            sqlite3_bind_int(stmt_v, 1, articolo_id);
-                            sqlite3_bind_text(stmt_v, 2, data_str, -1, SQLITE_TRANSIENT);
-                            sqlite3_bind_double(stmt_v, 3, atof(prezzo_str));
-                            sqlite3_bind_text(stmt_v, 4, cliente, -1, SQLITE_TRANSIENT);
-
-                            if (sqlite3_step(stmt_v) == SQLITE_DONE) {
-                                GtkWidget *info = gtk_message_dialog_new(GTK_WINDOW(app->window),
-                                                                         GTK_DIALOG_MODAL,
-                                                           
\ No newline at end of file
+            // Data corrente
+            time_t t = time(NULL);
+            struct tm *tm_info = localtime(&t);
+            char data_str[11];
+            strftime(data_str, 11, "%Y-%m-%d", tm_info);
+
+            OperazioneDB *op = nuova_operazione(app, app->btn_vendi);
+            op->articolo_id = articolo_id;
+            op->prezzo = prezzo;
+            op->cliente = g_strdup(cliente);
+            op->data = g_strdup(data_str);
+            coda_lavori_scrivi(app->coda, lavoro_vendi, vendi_completato, op);
+        }
+    }
+
+    gtk_widget_destroy(dialog);
+}
+
+// Sceglie un file CSV o JSON e lo importa nel thread di scrittura: la
+// finestra resta utilizzabile anche con file molto grandi
+static void on_btn_importa_clicked(GtkButton *button, AppData *app) {
+    GtkWidget *dialog = gtk_file_chooser_dialog_new("Importa Articoli",
+                                                    GTK_WINDOW(app->window),
+                                                    GTK_FILE_CHOOSER_ACTION_OPEN,
+                                                    "Annulla", GTK_RESPONSE_CANCEL,
+                                                    "Importa", GTK_RESPONSE_ACCEPT,
+                                                    NULL);
+    GtkFileFilter *filtro = gtk_file_filter_new();
+    gtk_file_filter_set_name(filtro, "CSV o JSON");
+    gtk_file_filter_add_pattern(filtro, "*.csv");
+    gtk_file_filter_add_pattern(filtro, "*.tsv");
+    gtk_file_filter_add_pattern(filtro, "*.json");
+    gtk_file_filter_add_pattern(filtro, "*.jsonl");
+    gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(dialog), filtro);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        OperazioneDB *op = nuova_operazione(app, app->btn_importa);
+        op->percorso = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+        coda_lavori_scrivi(app->coda, lavoro_importa, importa_completato, op);
+    }
+
+    gtk_widget_destroy(dialog);
+}
+
+// Sceglie cosa esportare e in quale file
+static void on_btn_esporta_clicked(GtkButton *button, AppData *app) {
+    GtkWidget *dialog = gtk_dialog_new_with_buttons("Esporta",
+                                                    GTK_WINDOW(app->window),
+                                                    GTK_DIALOG_MODAL,
+                                                    "Avanti", GTK_RESPONSE_OK,
+                                                    "Annulla", GTK_RESPONSE_CANCEL,
+                                                    NULL);
+
+    GtkWidget *content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    GtkWidget *grid = gtk_grid_new();
+    gtk_grid_set_column_spacing(GTK_GRID(grid), 10);
+    gtk_grid_set_row_spacing(GTK_GRID(grid), 10);
+    gtk_container_set_border_width(GTK_CONTAINER(grid), 10);
+    gtk_container_add(GTK_CONTAINER(content), grid);
+
+    GtkWidget *label = gtk_label_new("Dati");
+    gtk_widget_set_halign(label, GTK_ALIGN_START);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 0, 1, 1);
+    GtkWidget *combo_dati = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo_dati), "Vendite");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo_dati), "Articoli");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(combo_dati), 0);
+    gtk_grid_attach(GTK_GRID(grid), combo_dati, 1, 0, 1, 1);
+
+    label = gtk_label_new("Formato");
+    gtk_widget_set_halign(label, GTK_ALIGN_START);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, 1, 1, 1);
+    GtkWidget *combo_formato = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo_formato), "CSV");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo_formato), "Binario a colonne");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(combo_formato), 0);
+    gtk_grid_attach(GTK_GRID(grid), combo_formato, 1, 1, 1, 1);
+
+    GtkWidget *entry_dal = create_labeled_entry("Dal (YYYY-MM-DD)", grid, 2);
+    GtkWidget *entry_al = create_labeled_entry("Al (YYYY-MM-DD)", grid, 3);
+
+    gtk_widget_show_all(dialog);
+
+    gboolean conferma = FALSE;
+    DatiEsportazione dati = ESPORTA_VENDITE;
+    FormatoEsportazione formato = ESPORTA_CSV;
+    gchar dal[11], al[11];
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK) {
+        const char *errore = NULL;
+        if (!valida_data(gtk_entry_get_text(GTK_ENTRY(entry_dal)), dal, &errore) ||
+            !valida_data(gtk_entry_get_text(GTK_ENTRY(entry_al)), al, &errore)) {
+            GtkWidget *warn = gtk_message_dialog_new(GTK_WINDOW(app->window),
+                                                     GTK_DIALOG_MODAL,
+                                                     GTK_MESSAGE_WARNING,
+                                                     GTK_BUTTONS_OK,
+                                                     "Valore non valido: %s.", errore);
+            gtk_dialog_run(GTK_DIALOG(warn));
+            gtk_widget_destroy(warn);
+        } else {
+            conferma = TRUE;
+            if (gtk_combo_box_get_active(GTK_COMBO_BOX(combo_dati)) == 1) {
+                dati = ESPORTA_ARTICOLI;
+            }
+            if (gtk_combo_box_get_active(GTK_COMBO_BOX(combo_formato)) == 1) {
+                formato = ESPORTA_COLONNE;
+            }
+        }
+    }
+    gtk_widget_destroy(dialog);
+    if (!conferma) {
+        return;
+    }
+
+    GtkWidget *chooser = gtk_file_chooser_dialog_new("Salva Esportazione",
+                                                     GTK_WINDOW(app->window),
+                                                     GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                     "Annulla", GTK_RESPONSE_CANCEL,
+                                                     "Salva", GTK_RESPONSE_ACCEPT,
+                                                     NULL);
+    gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(chooser), TRUE);
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(chooser),
+                                      dati == ESPORTA_VENDITE
+                                      ? (formato == ESPORTA_CSV ? "vendite.csv" : "vendite.colonne")
+                                      : (formato == ESPORTA_CSV ? "articoli.csv" : "articoli.colonne"));
+
+    if (gtk_dialog_run(GTK_DIALOG(chooser)) == GTK_RESPONSE_ACCEPT) {
+        OperazioneDB *op = nuova_operazione(app, app->btn_esporta);
+        op->esporta = dati;
+        op->formato = formato;
+        g_strlcpy(op->dal, dal, sizeof(op->dal));
+        g_strlcpy(op->al, al, sizeof(op->al));
+        op->percorso = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+        coda_lavori_leggi(app->coda, lavoro_esporta, esporta_completato, op, NULL);
+    }
+    gtk_widget_destroy(chooser);
+}
+
+// Salva una copia del database con data e ora nel nome
+static void on_btn_backup_clicked(GtkButton *button, AppData *app) {
+    GtkWidget *chooser = gtk_file_chooser_dialog_new("Salva Backup",
+                                                     GTK_WINDOW(app->window),
+                                                     GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                     "Annulla", GTK_RESPONSE_CANCEL,
+                                                     "Salva", GTK_RESPONSE_ACCEPT,
+                                                     NULL);
+    gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(chooser), TRUE);
+    GDateTime *adesso = g_date_time_new_now_local();
+    gchar *nome = g_date_time_format(adesso, "magazzino_arte-%Y%m%d-%H%M.db");
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(chooser), nome);
+    g_free(nome);
+    g_date_time_unref(adesso);
+
+    if (gtk_dialog_run(GTK_DIALOG(chooser)) == GTK_RESPONSE_ACCEPT) {
+        OperazioneDB *op = nuova_operazione(app, app->btn_backup);
+        op->percorso = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+        coda_lavori_leggi(app->coda, lavoro_backup, backup_completato, op, NULL);
+    }
+    gtk_widget_destroy(chooser);
+}
+
+// Riepilogo di vendite e magazzino. I totali sono tenuti aggiornati dal
+// database a ogni vendita: aprire la finestra legge solo una riga per gruppo.
+static void on_btn_statistiche_clicked(GtkButton *button, AppData *app) {
+    GtkWidget *dialog = gtk_dialog_new_with_buttons("Statistiche",
+                                                    GTK_WINDOW(app->window),
+                                                    GTK_DIALOG_MODAL,
+                                                    "Chiudi", GTK_RESPONSE_CLOSE,
+                                                    NULL);
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 700, 500);
+
+    GtkWidget *content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 10);
+    gtk_container_set_border_width(GTK_CONTAINER(vbox), 10);
+    gtk_box_pack_start(GTK_BOX(content), vbox, TRUE, TRUE, 0);
+
+    GtkWidget *label_valore = gtk_label_new("Lettura in corso…");
+    gtk_widget_set_halign(label_valore, GTK_ALIGN_START);
+    gtk_box_pack_start(GTK_BOX(vbox), label_valore, FALSE, FALSE, 0);
+
+    GtkWidget *combo = gtk_combo_box_text_new();
+    // Stesso ordine di DimensioneStatistica
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "Per giorno");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "Per mese");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "Per artista");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "Per periodo");
+    gtk_widget_set_halign(combo, GTK_ALIGN_START);
+    gtk_box_pack_start(GTK_BOX(vbox), combo, FALSE, FALSE, 0);
+
+    GtkListStore *store = gtk_list_store_new(STAT_N_COLONNE, G_TYPE_STRING, G_TYPE_INT, G_TYPE_STRING,
+                                             G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+    GtkWidget *treeview = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+    const char *titoli[] = {"Gruppo", "Pezzi", "Ricavo", "Costo", "Margine", "Margine %"};
+    for (int i = 0; i < STAT_N_COLONNE; i++) {
+        GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+        if (i > STAT_COL_GRUPPO) {
+            g_object_set(renderer, "xalign", 1.0, NULL);
+        }
+        GtkTreeViewColumn *col = gtk_tree_view_column_new_with_attributes(titoli[i], renderer, "text", i, NULL);
+        gtk_tree_view_column_set_resizable(col, TRUE);
+        gtk_tree_view_append_column(GTK_TREE_VIEW(treeview), col);
+    }
+    GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
+    gtk_container_add(GTK_CONTAINER(scrolled), treeview);
+    gtk_box_pack_start(GTK_BOX(vbox), scrolled, TRUE, TRUE, 0);
+
+    FinestraStatistiche finestra = { app, store, label_valore, NULL };
+    g_signal_connect(combo, "changed", G_CALLBACK(on_dimensione_statistiche_cambiata), &finestra);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(combo), STATISTICA_MESE);
+
+    gtk_widget_show_all(dialog);
+    gtk_dialog_run(GTK_DIALOG(dialog));
+
+    // Una lettura ancora in corso finisce senza toccare la finestra
+    g_signal_handlers_disconnect_by_data(combo, &finestra);
+    g_cancellable_cancel(finestra.annulla);
+    g_object_unref(finestra.annulla);
+    g_object_unref(store);
+    gtk_widget_destroy(dialog);
+}
+
+// Crea una riga etichetta + campo di testo nella griglia di un dialogo
+static GtkWidget* create_labeled_entry(const char *label_text, GtkWidget *grid, int row) {
+    GtkWidget *label = gtk_label_new(label_text);
+    gtk_widget_set_halign(label, GTK_ALIGN_START);
+    gtk_grid_attach(GTK_GRID(grid), label, 0, row, 1, 1);
+
+    GtkWidget *entry = gtk_entry_new();
+    gtk_widget_set_hexpand(entry, TRUE);
+    gtk_grid_attach(GTK_GRID(grid), entry, 1, row, 1, 1);
+    return entry;
+}
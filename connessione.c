@@ -0,0 +1,137 @@
+#include "connessione.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct PoolLetture {
+    pthread_mutex_t lock;
+    pthread_cond_t libera;
+    sqlite3 **connessioni;
+    int n;
+    sqlite3 **libere;       // pila delle connessioni non in uso
+    int n_libere;
+};
+
+void db_config_predefinita(ConfigDB *config, const char *percorso) {
+    config->percorso = percorso;
+    config->wal = 1;
+    config->synchronous_normal = 1;
+    config->mmap_size = 256LL * 1024 * 1024;
+    config->cache_kib = 16 * 1024;
+    config->busy_timeout_ms = 5000;
+}
+
+// Pragma comuni a tutte le connessioni
+static int imposta_pragma(sqlite3 *db, const ConfigDB *config) {
+    char sql[256];
+    snprintf(sql, sizeof(sql),
+             "PRAGMA cache_size = -%d;"
+             "PRAGMA mmap_size = %lld;"
+             "PRAGMA temp_store = MEMORY;",
+             config->cache_kib, (long long)config->mmap_size);
+
+    sqlite3_busy_timeout(db, config->busy_timeout_ms);
+    char *err_msg = NULL;
+    int rc = sqlite3_exec(db, sql, 0, 0, &err_msg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Errore impostazione pragma: %s\n", err_msg);
+        sqlite3_free(err_msg);
+    }
+    return rc;
+}
+
+static int apri(const ConfigDB *config, int flags, sqlite3 **db) {
+    int rc = sqlite3_open_v2(config->percorso, db, flags | SQLITE_OPEN_NOMUTEX, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Errore di connessione al DB: %s\n", sqlite3_errmsg(*db));
+        sqlite3_close(*db);
+        *db = NULL;
+    }
+    return rc;
+}
+
+int db_apri_scrittura(const ConfigDB *config, sqlite3 **db) {
+    int rc = apri(config, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, db);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    // journal_mode è persistente nel file: i lettori aperti dopo lo trovano già attivo
+    char *err_msg = NULL;
+    const char *journal = config->wal ? "PRAGMA journal_mode = WAL;" : "PRAGMA journal_mode = DELETE;";
+    if (sqlite3_exec(*db, journal, 0, 0, &err_msg) != SQLITE_OK) {
+        fprintf(stderr, "Errore impostazione journal: %s\n", err_msg);
+        sqlite3_free(err_msg);
+    }
+    if (config->synchronous_normal) {
+        sqlite3_exec(*db, "PRAGMA synchronous = NORMAL;", 0, 0, NULL);
+    }
+    imposta_pragma(*db, config);
+    return SQLITE_OK;
+}
+
+int db_apri_lettura(const ConfigDB *config, sqlite3 **db) {
+    int rc = apri(config, SQLITE_OPEN_READONLY, db);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    imposta_pragma(*db, config);
+    sqlite3_exec(*db, "PRAGMA query_only = 1;", 0, 0, NULL);
+    return SQLITE_OK;
+}
+
+PoolLetture *pool_letture_new(const ConfigDB *config, int n) {
+    PoolLetture *pool = calloc(1, sizeof(PoolLetture));
+    if (!pool) {
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->libera, NULL);
+    pool->connessioni = calloc(n, sizeof(sqlite3*));
+    pool->libere = calloc(n, sizeof(sqlite3*));
+    if (!pool->connessioni || !pool->libere) {
+        pool_letture_free(pool);
+        return NULL;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (db_apri_lettura(config, &pool->connessioni[i]) != SQLITE_OK) {
+            pool_letture_free(pool);
+            return NULL;
+        }
+        pool->n++;
+        pool->libere[pool->n_libere++] = pool->connessioni[i];
+    }
+    return pool;
+}
+
+void pool_letture_free(PoolLetture *pool) {
+    if (!pool) {
+        return;
+    }
+    for (int i = 0; i < pool->n; i++) {
+        sqlite3_close(pool->connessioni[i]);
+    }
+    free(pool->connessioni);
+    free(pool->libere);
+    pthread_cond_destroy(&pool->libera);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+sqlite3 *pool_letture_prendi(PoolLetture *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->n_libere == 0) {
+        pthread_cond_wait(&pool->libera, &pool->lock);
+    }
+    sqlite3 *db = pool->libere[--pool->n_libere];
+    pthread_mutex_unlock(&pool->lock);
+    return db;
+}
+
+void pool_letture_rilascia(PoolLetture *pool, sqlite3 *db) {
+    pthread_mutex_lock(&pool->lock);
+    pool->libere[pool->n_libere++] = db;
+    pthread_cond_signal(&pool->libera);
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,36 @@
+#ifndef CONNESSIONE_H
+#define CONNESSIONE_H
+
+#include <sqlite3.h>
+
+// Parametri delle connessioni al database
+typedef struct {
+    const char *percorso;
+    int wal;                   // journal in modalità WAL: i lettori non bloccano lo scrittore
+    int synchronous_normal;    // con WAL basta un fsync per checkpoint, non per commit
+    sqlite3_int64 mmap_size;   // byte del file letti tramite mmap (0 = disattivato)
+    int cache_kib;             // cache delle pagine per connessione, in KiB
+    int busy_timeout_ms;       // attesa su un lock prima di SQLITE_BUSY
+} ConfigDB;
+
+// Valori predefiniti per il file indicato
+void db_config_predefinita(ConfigDB *config, const char *percorso);
+
+// Apre la connessione di scrittura (crea il file se manca) e imposta i pragma
+int db_apri_scrittura(const ConfigDB *config, sqlite3 **db);
+
+// Apre una connessione in sola lettura sullo stesso file
+int db_apri_lettura(const ConfigDB *config, sqlite3 **db);
+
+// Gruppo di connessioni in sola lettura condivise tra più thread: ogni
+// connessione viene usata da un solo thread alla volta
+typedef struct PoolLetture PoolLetture;
+
+PoolLetture *pool_letture_new(const ConfigDB *config, int n);
+void pool_letture_free(PoolLetture *pool);
+
+// Prende una connessione libera, attendendo se sono tutte in uso
+sqlite3 *pool_letture_prendi(PoolLetture *pool);
+void pool_letture_rilascia(PoolLetture *pool, sqlite3 *db);
+
+#endif
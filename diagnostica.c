@@ -0,0 +1,228 @@
+#include "diagnostica.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "traccia.h"
+
+// Intervallo del battito che rileva i blocchi del ciclo GTK
+#define STALLO_INTERVALLO_MS 20
+// Ritardo del battito oltre il quale il ciclo è considerato bloccato
+#define STALLO_SOGLIA_MS 100
+// Aggiornamento della tabella mentre la finestra è aperta
+#define DIAGNOSTICA_AGGIORNA_MS 1000
+
+enum {
+    DIAG_COL_CATEGORIA,
+    DIAG_COL_NOME,
+    DIAG_COL_N,
+    DIAG_COL_TOTALE,
+    DIAG_COL_P50,
+    DIAG_COL_P99,
+    DIAG_COL_MAX,
+    DIAG_COL_RIGHE,
+    DIAG_N_COLONNE
+};
+
+typedef struct {
+    GtkWidget *finestra;
+    GtkListStore *store;
+    GtkWidget *check_attiva;
+    guint aggiorna;           // sorgente dell'aggiornamento periodico
+} FinestraDiagnostica;
+
+static FinestraDiagnostica *aperta;   // al massimo una finestra
+static guint sorgente_battito;
+static guint64 ultimo_battito;
+
+// Se tra due battiti passa molto più dell'intervallo, il ciclo GTK è
+// rimasto occupato: il blocco viene registrato con la sua durata
+static gboolean battito(gpointer user_data) {
+    guint64 adesso = traccia_adesso();
+    guint64 intervallo = STALLO_INTERVALLO_MS * G_GUINT64_CONSTANT(1000000);
+    guint64 trascorso = adesso - ultimo_battito;
+    if (trascorso > intervallo + STALLO_SOGLIA_MS * G_GUINT64_CONSTANT(1000000)) {
+        EventoTraccia evento = { "ciclo", "stallo", ultimo_battito + intervallo,
+                                 trascorso - intervallo, -1, 0, 0 };
+        traccia_evento(&evento);
+    }
+    ultimo_battito = adesso;
+    return G_SOURCE_CONTINUE;
+}
+
+// Il battito gira solo con la registrazione attiva: spenta non costa nulla
+static void imposta_registrazione(gboolean attiva) {
+    traccia_abilita(attiva);
+    if (attiva && !sorgente_battito) {
+        ultimo_battito = traccia_adesso();
+        sorgente_battito = g_timeout_add_full(G_PRIORITY_HIGH, STALLO_INTERVALLO_MS, battito, NULL, NULL);
+    } else if (!attiva && sorgente_battito) {
+        g_source_remove(sorgente_battito);
+        sorgente_battito = 0;
+    }
+}
+
+void diagnostica_avvia(void) {
+    traccia_nome_thread("interfaccia");
+    if (g_getenv("GESTIONALE_TRACCIA")) {
+        imposta_registrazione(TRUE);
+    }
+}
+
+void diagnostica_termina(void) {
+    const gchar *percorso = g_getenv("GESTIONALE_TRACCIA");
+    if (!percorso || !*percorso || g_strcmp0(percorso, "1") == 0) {
+        return;
+    }
+    char errore[512];
+    if (traccia_scrivi_chrome(percorso, errore, sizeof(errore)) != 0) {
+        fprintf(stderr, "Impossibile salvare la traccia: %s\n", errore);
+    }
+}
+
+static void aggiorna_tabella(FinestraDiagnostica *diag) {
+    RiepilogoTraccia *righe;
+    long n = traccia_riepiloga(&righe);
+    gtk_list_store_clear(diag->store);
+    for (long i = 0; i < n; i++) {
+        RiepilogoTraccia *r = &righe[i];
+        gchar totale[32], p50[32], p99[32], max[32];
+        g_snprintf(totale, sizeof(totale), "%.1f", r->totale_ms);
+        g_snprintf(p50, sizeof(p50), "%.3f", r->p50_ms);
+        g_snprintf(p99, sizeof(p99), "%.3f", r->p99_ms);
+        g_snprintf(max, sizeof(max), "%.3f", r->max_ms);
+        gtk_list_store_insert_with_values(diag->store, NULL, -1,
+                                          DIAG_COL_CATEGORIA, r->categoria,
+                                          DIAG_COL_NOME, r->nome,
+                                          DIAG_COL_N, (gint64)r->n,
+                                          DIAG_COL_TOTALE, totale,
+                                          DIAG_COL_P50, p50,
+                                          DIAG_COL_P99, p99,
+                                          DIAG_COL_MAX, max,
+                                          DIAG_COL_RIGHE, (gint64)r->righe,
+                                          -1);
+    }
+    free(righe);
+}
+
+static gboolean aggiorna_periodico(gpointer user_data) {
+    FinestraDiagnostica *diag = user_data;
+    if (traccia_attiva()) {
+        aggiorna_tabella(diag);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void on_attiva_toggled(GtkToggleButton *check, FinestraDiagnostica *diag) {
+    imposta_registrazione(gtk_toggle_button_get_active(check));
+}
+
+static void on_azzera_clicked(GtkButton *button, FinestraDiagnostica *diag) {
+    traccia_azzera();
+    aggiorna_tabella(diag);
+}
+
+static void on_salva_clicked(GtkButton *button, FinestraDiagnostica *diag) {
+    GtkWidget *chooser = gtk_file_chooser_dialog_new("Salva Traccia",
+                                                     GTK_WINDOW(diag->finestra),
+                                                     GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                     "Annulla", GTK_RESPONSE_CANCEL,
+                                                     "Salva", GTK_RESPONSE_ACCEPT,
+                                                     NULL);
+    gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(chooser), TRUE);
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(chooser), "traccia.json");
+
+    if (gtk_dialog_run(GTK_DIALOG(chooser)) == GTK_RESPONSE_ACCEPT) {
+        gchar *percorso = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+        char errore[512];
+        if (traccia_scrivi_chrome(percorso, errore, sizeof(errore)) != 0) {
+            GtkWidget *msg = gtk_message_dialog_new(GTK_WINDOW(diag->finestra),
+                                                    GTK_DIALOG_MODAL,
+                                                    GTK_MESSAGE_ERROR,
+                                                    GTK_BUTTONS_OK,
+                                                    "Impossibile salvare la traccia: %s", errore);
+            gtk_dialog_run(GTK_DIALOG(msg));
+            gtk_widget_destroy(msg);
+        }
+        g_free(percorso);
+    }
+    gtk_widget_destroy(chooser);
+}
+
+static void on_finestra_destroy(GtkWidget *widget, FinestraDiagnostica *diag) {
+    g_source_remove(diag->aggiorna);
+    g_object_unref(diag->store);
+    g_free(diag);
+    aperta = NULL;
+}
+
+static void apri_finestra(GtkWidget *principale) {
+    if (aperta) {
+        gtk_window_present(GTK_WINDOW(aperta->finestra));
+        return;
+    }
+    FinestraDiagnostica *diag = g_new0(FinestraDiagnostica, 1);
+    diag->finestra = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(diag->finestra), "Diagnostica Prestazioni");
+    gtk_window_set_transient_for(GTK_WINDOW(diag->finestra), GTK_WINDOW(principale));
+    gtk_window_set_default_size(GTK_WINDOW(diag->finestra), 800, 500);
+
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_container_set_border_width(GTK_CONTAINER(vbox), 10);
+    gtk_container_add(GTK_CONTAINER(diag->finestra), vbox);
+
+    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
+
+    diag->check_attiva = gtk_check_button_new_with_label("Registrazione attiva");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(diag->check_attiva), traccia_attiva());
+    gtk_box_pack_start(GTK_BOX(hbox), diag->check_attiva, FALSE, FALSE, 5);
+    g_signal_connect(diag->check_attiva, "toggled", G_CALLBACK(on_attiva_toggled), diag);
+
+    GtkWidget *btn_azzera = gtk_button_new_with_label("Azzera");
+    gtk_box_pack_start(GTK_BOX(hbox), btn_azzera, FALSE, FALSE, 5);
+    g_signal_connect(btn_azzera, "clicked", G_CALLBACK(on_azzera_clicked), diag);
+
+    GtkWidget *btn_salva = gtk_button_new_with_label("Salva Traccia…");
+    gtk_box_pack_start(GTK_BOX(hbox), btn_salva, FALSE, FALSE, 5);
+    g_signal_connect(btn_salva, "clicked", G_CALLBACK(on_salva_clicked), diag);
+
+    // Tempi in millisecondi; "stallo" è un blocco del ciclo GTK oltre la soglia
+    diag->store = gtk_list_store_new(DIAG_N_COLONNE, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT64,
+                                     G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+                                     G_TYPE_INT64);
+    GtkWidget *treeview = gtk_tree_view_new_with_model(GTK_TREE_MODEL(diag->store));
+    const char *titoli[] = {"Categoria", "Operazione", "Volte", "Totale ms", "p50 ms", "p99 ms", "Max ms", "Righe"};
+    for (int i = 0; i < DIAG_N_COLONNE; i++) {
+        GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+        if (i > DIAG_COL_NOME) {
+            g_object_set(renderer, "xalign", 1.0, NULL);
+        }
+        GtkTreeViewColumn *col = gtk_tree_view_column_new_with_attributes(titoli[i], renderer, "text", i, NULL);
+        gtk_tree_view_column_set_resizable(col, TRUE);
+        gtk_tree_view_append_column(GTK_TREE_VIEW(treeview), col);
+    }
+    GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
+    gtk_container_add(GTK_CONTAINER(scrolled), treeview);
+    gtk_box_pack_start(GTK_BOX(vbox), scrolled, TRUE, TRUE, 0);
+
+    diag->aggiorna = g_timeout_add(DIAGNOSTICA_AGGIORNA_MS, aggiorna_periodico, diag);
+    g_signal_connect(diag->finestra, "destroy", G_CALLBACK(on_finestra_destroy), diag);
+    aperta = diag;
+
+    aggiorna_tabella(diag);
+    gtk_widget_show_all(diag->finestra);
+}
+
+static gboolean on_tasto_premuto(GtkWidget *widget, GdkEventKey *evento, gpointer user_data) {
+    GdkModifierType modificatori = evento->state & gtk_accelerator_get_default_mod_mask();
+    if (modificatori == (GDK_CONTROL_MASK | GDK_SHIFT_MASK) &&
+        gdk_keyval_to_lower(evento->keyval) == GDK_KEY_d) {
+        apri_finestra(widget);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void diagnostica_installa(GtkWidget *finestra_principale) {
+    g_signal_connect(finestra_principale, "key-press-event", G_CALLBACK(on_tasto_premuto), NULL);
+}
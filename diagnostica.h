@@ -0,0 +1,28 @@
+#ifndef DIAGNOSTICA_H
+#define DIAGNOSTICA_H
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+// Finestra di diagnostica delle prestazioni, nascosta: si apre con
+// Ctrl+Maiusc+D dalla finestra principale. Mostra i tempi raccolti da
+// traccia.c (query, aggiornamenti della lista, blocchi del ciclo GTK) e li
+// salva nel formato JSON di Chrome per chrome://tracing o Perfetto.
+//
+// Con la variabile d'ambiente GESTIONALE_TRACCIA la registrazione è attiva
+// fin dall'avvio; se il valore non è "1" è il file in cui salvare la
+// traccia all'uscita.
+
+// Da chiamare all'avvio, prima di aprire il database
+void diagnostica_avvia(void);
+
+// Collega la scorciatoia alla finestra principale
+void diagnostica_installa(GtkWidget *finestra_principale);
+
+// Da chiamare all'uscita: salva la traccia se richiesto da GESTIONALE_TRACCIA
+void diagnostica_termina(void);
+
+G_END_DECLS
+
+#endif
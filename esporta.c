@@ -0,0 +1,398 @@
+#include "esporta.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Buffer di scrittura del file: poche chiamate di sistema anche per milioni di righe
+#define ESPORTA_BUFFER (1024 * 1024)
+#define ESPORTA_MAX_COLONNE 16
+
+typedef struct {
+    const char *nome;
+    int tipo;
+} Colonna;
+
+static const Colonna colonne_vendite[] = {
+    {"vendita_id", ESPORTA_TIPO_INTERO},
+    {"data_vendita", ESPORTA_TIPO_DATA},
+    {"articolo_id", ESPORTA_TIPO_INTERO},
+    {"nome", ESPORTA_TIPO_TESTO},
+    {"artista", ESPORTA_TIPO_TESTO},
+    {"periodo", ESPORTA_TIPO_TESTO},
+    {"prezzo_acquisto", ESPORTA_TIPO_REALE},
+    {"prezzo_vendita", ESPORTA_TIPO_REALE},
+    {"nome_cliente", ESPORTA_TIPO_TESTO},
+};
+
+static const Colonna colonne_articoli[] = {
+    {"articolo_id", ESPORTA_TIPO_INTERO},
+    {"nome", ESPORTA_TIPO_TESTO},
+    {"descrizione", ESPORTA_TIPO_TESTO},
+    {"artista", ESPORTA_TIPO_TESTO},
+    {"periodo", ESPORTA_TIPO_TESTO},
+    {"misure", ESPORTA_TIPO_TESTO},
+    {"data_acquisizione", ESPORTA_TIPO_DATA},
+    {"prezzo_acquisto", ESPORTA_TIPO_REALE},
+    {"quantita", ESPORTA_TIPO_INTERO},
+};
+
+// Valore di una cella; le date usano il campo testo
+typedef struct {
+    sqlite3_int64 intero;
+    double reale;
+    const char *testo;
+} Valore;
+
+// Dati di una colonna del gruppo di righe in corso
+typedef struct {
+    unsigned char *dati;
+    size_t usati;
+    size_t capacita;
+} Buffer;
+
+typedef struct {
+    FILE *file;
+    FormatoEsportazione formato;
+    const Colonna *colonne;
+    int n_colonne;
+    long righe;
+    int errore_io;
+    // Solo formato a colonne
+    Buffer dati[ESPORTA_MAX_COLONNE];
+    sqlite3_int64 precedente[ESPORTA_MAX_COLONNE];
+    long righe_gruppo;
+} Esportatore;
+
+// --- Buffer e codifiche ---
+
+static int buffer_aggiungi(Buffer *b, const void *dati, size_t n) {
+    if (b->usati + n > b->capacita) {
+        size_t capacita = b->capacita ? b->capacita : 4096;
+        while (b->usati + n > capacita) {
+            capacita *= 2;
+        }
+        unsigned char *nuovi = realloc(b->dati, capacita);
+        if (!nuovi) {
+            return 0;
+        }
+        b->dati = nuovi;
+        b->capacita = capacita;
+    }
+    memcpy(b->dati + b->usati, dati, n);
+    b->usati += n;
+    return 1;
+}
+
+static int aggiungi_varint(Buffer *b, uint64_t valore) {
+    unsigned char byte[10];
+    size_t n = 0;
+    do {
+        byte[n] = valore & 0x7F;
+        valore >>= 7;
+        if (valore) {
+            byte[n] |= 0x80;
+        }
+        n++;
+    } while (valore);
+    return buffer_aggiungi(b, byte, n);
+}
+
+// Zigzag: i numeri piccoli, anche negativi, occupano pochi byte
+static uint64_t zigzag(sqlite3_int64 valore) {
+    return ((uint64_t)valore << 1) ^ (uint64_t)(valore >> 63);
+}
+
+static int aggiungi_reale(Buffer *b, double valore) {
+    uint64_t bit;
+    memcpy(&bit, &valore, sizeof(bit));
+    unsigned char byte[8];
+    for (int i = 0; i < 8; i++) {
+        byte[i] = (unsigned char)(bit >> (8 * i));
+    }
+    return buffer_aggiungi(b, byte, 8);
+}
+
+// "AAAA-MM-GG" come intero AAAAMMGG; 0 se assente o in un altro formato
+static sqlite3_int64 data_numerica(const char *data) {
+    if (!data || strlen(data) != 10 || data[4] != '-' || data[7] != '-') {
+        return 0;
+    }
+    sqlite3_int64 valore = 0;
+    for (int i = 0; i < 10; i++) {
+        if (i == 4 || i == 7) {
+            continue;
+        }
+        if (data[i] < '0' || data[i] > '9') {
+            return 0;
+        }
+        valore = valore * 10 + (data[i] - '0');
+    }
+    return valore;
+}
+
+static void scrivi_u32(Esportatore *esp, uint32_t valore) {
+    unsigned char byte[4];
+    for (int i = 0; i < 4; i++) {
+        byte[i] = (unsigned char)(valore >> (8 * i));
+    }
+    fwrite(byte, 1, 4, esp->file);
+}
+
+static void scrivi_u64(Esportatore *esp, uint64_t valore) {
+    unsigned char byte[8];
+    for (int i = 0; i < 8; i++) {
+        byte[i] = (unsigned char)(valore >> (8 * i));
+    }
+    fwrite(byte, 1, 8, esp->file);
+}
+
+// --- CSV ---
+
+static void scrivi_testo_csv(FILE *file, const char *testo) {
+    if (!testo) {
+        return;
+    }
+    if (strpbrk(testo, ",\"\r\n") == NULL) {
+        fputs(testo, file);
+        return;
+    }
+    fputc('"', file);
+    for (const char *c = testo; *c; c++) {
+        if (*c == '"') {
+            fputc('"', file);
+        }
+        fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static void scrivi_intestazione_csv(Esportatore *esp) {
+    for (int i = 0; i < esp->n_colonne; i++) {
+        if (i > 0) {
+            fputc(',', esp->file);
+        }
+        fputs(esp->colonne[i].nome, esp->file);
+    }
+    fputc('\n', esp->file);
+}
+
+static void scrivi_riga_csv(Esportatore *esp, const Valore *valori) {
+    for (int i = 0; i < esp->n_colonne; i++) {
+        if (i > 0) {
+            fputc(',', esp->file);
+        }
+        switch (esp->colonne[i].tipo) {
+        case ESPORTA_TIPO_INTERO:
+            fprintf(esp->file, "%lld", (long long)valori[i].intero);
+            break;
+        case ESPORTA_TIPO_REALE:
+            fprintf(esp->file, "%.2f", valori[i].reale);
+            break;
+        default:
+            scrivi_testo_csv(esp->file, valori[i].testo);
+            break;
+        }
+    }
+    fputc('\n', esp->file);
+}
+
+// --- Formato a colonne ---
+
+static void scrivi_intestazione_colonne(Esportatore *esp) {
+    fwrite(ESPORTA_MAGIC, 1, 8, esp->file);
+    fputc(esp->n_colonne, esp->file);
+    for (int i = 0; i < esp->n_colonne; i++) {
+        size_t lunghezza = strlen(esp->colonne[i].nome);
+        fputc(esp->colonne[i].tipo, esp->file);
+        fputc((int)lunghezza, esp->file);
+        fwrite(esp->colonne[i].nome, 1, lunghezza, esp->file);
+    }
+}
+
+static void scrivi_gruppo(Esportatore *esp) {
+    if (esp->righe_gruppo == 0) {
+        return;
+    }
+    scrivi_u32(esp, (uint32_t)esp->righe_gruppo);
+    for (int i = 0; i < esp->n_colonne; i++) {
+        scrivi_u32(esp, (uint32_t)esp->dati[i].usati);
+        fwrite(esp->dati[i].dati, 1, esp->dati[i].usati, esp->file);
+        esp->dati[i].usati = 0;
+        esp->precedente[i] = 0;
+    }
+    esp->righe_gruppo = 0;
+}
+
+static int aggiungi_riga_colonne(Esportatore *esp, const Valore *valori) {
+    for (int i = 0; i < esp->n_colonne; i++) {
+        Buffer *b = &esp->dati[i];
+        int ok;
+        switch (esp->colonne[i].tipo) {
+        case ESPORTA_TIPO_INTERO:
+        case ESPORTA_TIPO_DATA: {
+            sqlite3_int64 valore = esp->colonne[i].tipo == ESPORTA_TIPO_DATA
+                ? data_numerica(valori[i].testo) : valori[i].intero;
+            ok = aggiungi_varint(b, zigzag(valore - esp->precedente[i]));
+            esp->precedente[i] = valore;
+            break;
+        }
+        case ESPORTA_TIPO_REALE:
+            ok = aggiungi_reale(b, valori[i].reale);
+            break;
+        default:
+            if (!valori[i].testo) {
+                ok = aggiungi_varint(b, 0);
+            } else {
+                size_t lunghezza = strlen(valori[i].testo);
+                ok = aggiungi_varint(b, lunghezza + 1) && buffer_aggiungi(b, valori[i].testo, lunghezza);
+            }
+            break;
+        }
+        if (!ok) {
+            return 0;
+        }
+    }
+    if (++esp->righe_gruppo == ESPORTA_RIGHE_PER_GRUPPO) {
+        scrivi_gruppo(esp);
+    }
+    return 1;
+}
+
+// --- Righe ---
+
+// Scrive una riga; 0 se la scrittura non è riuscita e la lettura va fermata
+static int scrivi_riga(Esportatore *esp, const Valore *valori) {
+    if (esp->formato == ESPORTA_CSV) {
+        scrivi_riga_csv(esp, valori);
+    } else if (!aggiungi_riga_colonne(esp, valori)) {
+        esp->errore_io = 1;
+        return 0;
+    }
+    esp->righe++;
+    if (ferror(esp->file)) {
+        esp->errore_io = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static int on_vendita(const RigaVendita *riga, void *user_data) {
+    Valore valori[] = {
+        {.intero = riga->vendita_id},
+        {.testo = riga->data_vendita},
+        {.intero = riga->articolo_id},
+        {.testo = riga->nome},
+        {.testo = riga->artista},
+        {.testo = riga->periodo},
+        {.reale = riga->prezzo_acquisto},
+        {.reale = riga->prezzo_vendita},
+        {.testo = riga->nome_cliente},
+    };
+    return scrivi_riga(user_data, valori);
+}
+
+static int on_articolo(const RigaArticolo *riga, void *user_data) {
+    Valore valori[] = {
+        {.intero = riga->articolo_id},
+        {.testo = riga->nome},
+        {.testo = riga->descrizione},
+        {.testo = riga->artista},
+        {.testo = riga->periodo},
+        {.testo = riga->misure},
+        {.testo = riga->data_acquisizione},
+        {.reale = riga->prezzo_acquisto},
+        {.intero = riga->quantita},
+    };
+    return scrivi_riga(user_data, valori);
+}
+
+// --- Ingresso ---
+
+int esporta_file(Repository *repo, DatiEsportazione dati, FormatoEsportazione formato,
+                 const char *dal, const char *al, const char *percorso,
+                 long *righe, char *errore, size_t dim_errore) {
+    *righe = 0;
+    errore[0] = '\0';
+
+    size_t lunghezza = strlen(percorso);
+    char *temporaneo = malloc(lunghezza + 5);
+    if (!temporaneo) {
+        snprintf(errore, dim_errore, "Memoria esaurita");
+        return SQLITE_NOMEM;
+    }
+    memcpy(temporaneo, percorso, lunghezza);
+    memcpy(temporaneo + lunghezza, ".tmp", 5);
+
+    Esportatore esp;
+    memset(&esp, 0, sizeof(esp));
+    esp.formato = formato;
+    esp.colonne = dati == ESPORTA_VENDITE ? colonne_vendite : colonne_articoli;
+    esp.n_colonne = dati == ESPORTA_VENDITE
+        ? (int)(sizeof(colonne_vendite) / sizeof(colonne_vendite[0]))
+        : (int)(sizeof(colonne_articoli) / sizeof(colonne_articoli[0]));
+    esp.file = fopen(temporaneo, formato == ESPORTA_CSV ? "w" : "wb");
+    if (!esp.file) {
+        snprintf(errore, dim_errore, "Impossibile creare %s", temporaneo);
+        free(temporaneo);
+        return SQLITE_CANTOPEN;
+    }
+    setvbuf(esp.file, NULL, _IOFBF, ESPORTA_BUFFER);
+
+    if (formato == ESPORTA_CSV) {
+        scrivi_intestazione_csv(&esp);
+    } else {
+        scrivi_intestazione_colonne(&esp);
+    }
+
+    int lette = dati == ESPORTA_VENDITE
+        ? repo_esporta_vendite(repo, dal, al, on_vendita, &esp)
+        : repo_esporta_articoli(repo, dal, al, on_articolo, &esp);
+
+    int rc = SQLITE_OK;
+    if (lette < 0) {
+        rc = sqlite3_errcode(repo_db(repo));
+        if (rc == SQLITE_INTERRUPT) {
+            snprintf(errore, dim_errore, "Esportazione annullata");
+        } else {
+            snprintf(errore, dim_errore, "Errore lettura dal database: %s", sqlite3_errmsg(repo_db(repo)));
+            if (rc == SQLITE_OK) {
+                rc = SQLITE_ERROR;
+            }
+        }
+    }
+
+    if (rc == SQLITE_OK && formato == ESPORTA_COLONNE && !esp.errore_io) {
+        scrivi_gruppo(&esp);
+        scrivi_u32(&esp, 0);
+        scrivi_u64(&esp, (uint64_t)esp.righe);
+        fwrite(ESPORTA_MAGIC, 1, 8, esp.file);
+    }
+    // Il file rinominato deve essere già tutto su disco
+    if (fflush(esp.file) != 0 || ferror(esp.file) || fsync(fileno(esp.file)) != 0) {
+        esp.errore_io = 1;
+    }
+    if (fclose(esp.file) != 0) {
+        esp.errore_io = 1;
+    }
+    if (rc == SQLITE_OK && esp.errore_io) {
+        snprintf(errore, dim_errore, "Errore di scrittura su %s", temporaneo);
+        rc = SQLITE_IOERR;
+    }
+    if (rc == SQLITE_OK && rename(temporaneo, percorso) != 0) {
+        snprintf(errore, dim_errore, "Impossibile rinominare %s in %s", temporaneo, percorso);
+        rc = SQLITE_IOERR;
+    }
+    if (rc != SQLITE_OK) {
+        unlink(temporaneo);
+    } else {
+        *righe = esp.righe;
+    }
+
+    for (int i = 0; i < esp.n_colonne; i++) {
+        free(esp.dati[i].dati);
+    }
+    free(temporaneo);
+    return rc;
+}
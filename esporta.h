@@ -0,0 +1,60 @@
+#ifndef ESPORTA_H
+#define ESPORTA_H
+
+#include <stddef.h>
+
+#include "repository.h"
+
+// Esportazione di vendite e articoli su file. Le righe vengono scritte man
+// mano che la query le legge, attraverso un buffer: la memoria usata non
+// dipende dal numero di righe. Il file viene scritto con un nome temporaneo
+// e rinominato solo a esportazione conclusa, quindi chi lo legge (ad esempio
+// uno script lanciato da cron) non trova mai un file a metà.
+
+typedef enum {
+    ESPORTA_VENDITE,     // vendite con i dati dell'articolo, per data di vendita
+    ESPORTA_ARTICOLI     // catalogo completo, per ID
+} DatiEsportazione;
+
+typedef enum {
+    ESPORTA_CSV,         // testo UTF-8 con intestazione, separatore virgola
+    ESPORTA_COLONNE      // binario a colonne, descritto sotto
+} FormatoEsportazione;
+
+// Formato a colonne (tutti gli interi in little endian):
+//
+//   "MAGCOL01"
+//   u8 numero colonne; per ogni colonna: u8 tipo, u8 lunghezza, nome
+//   gruppi di righe: u32 righe del gruppo (> 0), poi per ogni colonna
+//                    u32 byte dei dati seguiti dai dati della colonna
+//   fine:            u32 0, u64 righe totali, "MAGCOL01"
+//
+// Dati di una colonna in un gruppo, per tipo:
+//   ESPORTA_TIPO_INTERO  differenza dal valore precedente del gruppo
+//                        (il primo da 0), zigzag + varint
+//   ESPORTA_TIPO_DATA    come intero, con la data nella forma AAAAMMGG
+//                        (0 se assente)
+//   ESPORTA_TIPO_REALE   double IEEE 754, 8 byte
+//   ESPORTA_TIPO_TESTO   varint lunghezza+1 (0 = NULL) seguita dai byte UTF-8
+//
+// Ogni colonna di un gruppo si può leggere o saltare senza decodificare le altre.
+#define ESPORTA_MAGIC "MAGCOL01"
+#define ESPORTA_TIPO_INTERO 1
+#define ESPORTA_TIPO_REALE  2
+#define ESPORTA_TIPO_TESTO  3
+#define ESPORTA_TIPO_DATA   4
+
+// Righe tenute in memoria per gruppo nel formato a colonne
+#define ESPORTA_RIGHE_PER_GRUPPO 65536
+
+// Esporta con un repository qualsiasi (basta una connessione in lettura).
+// dal e al (AAAA-MM-GG, inclusi, NULL = senza limite) filtrano le vendite
+// per data di vendita e gli articoli per data di acquisizione.
+// Restituisce SQLITE_OK e in *righe le righe scritte, altrimenti un codice
+// SQLite e la descrizione in "errore"; in caso di errore il file di
+// destinazione non viene toccato.
+int esporta_file(Repository *repo, DatiEsportazione dati, FormatoEsportazione formato,
+                 const char *dal, const char *al, const char *percorso,
+                 long *righe, char *errore, size_t dim_errore);
+
+#endif
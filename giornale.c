@@ -0,0 +1,645 @@
+#include "giornale.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "traccia.h"
+
+// --- CRC-32 (polinomio di zlib) ---
+
+static uint32_t tabella_crc[256];
+static pthread_once_t tabella_crc_pronta = PTHREAD_ONCE_INIT;
+
+static void prepara_tabella_crc(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        tabella_crc[i] = c;
+    }
+}
+
+// Prosegue il CRC "crc" con i byte indicati, come crc32() di zlib
+static uint32_t crc32_prosegui(uint32_t crc, const char *dati, size_t n) {
+    pthread_once(&tabella_crc_pronta, prepara_tabella_crc);
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) {
+        crc = tabella_crc[(crc ^ (unsigned char)dati[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// --- Lettura del file ---
+
+// Una voce letta; i testi puntano dentro la riga
+typedef struct {
+    sqlite3_int64 sequenza;
+    const char *istante;
+    const char *tipo;
+    const char *dati;
+} VoceGiornale;
+
+// Fin dove il file è stato letto e verificato
+typedef struct {
+    uint32_t crc;               // dell'ultima riga valida
+    sqlite3_int64 ultima;       // sequenza dell'ultima riga valida, 0 se nessuna
+    off_t fine;                 // byte fino alla fine dell'ultima riga valida
+    long righe;
+} PosizioneGiornale;
+
+typedef enum {
+    LETTURA_FINE,               // tutte le righe valide
+    LETTURA_TRONCATA,           // l'ultima riga è incompleta o errata: scrittura interrotta
+    LETTURA_DANNEGGIATA,        // una riga errata seguita da altre
+    LETTURA_INTERROTTA,         // fermata dalla funzione chiamata per ogni voce
+    LETTURA_ERRORE              // errore di lettura del file
+} EsitoLettura;
+
+// Chiamata per ogni voce valida; se restituisce 0 la lettura si ferma
+typedef int (*VoceFunc)(const VoceGiornale *voce, void *user_data);
+
+// Verifica una riga (con il '\n' finale) e ne separa i campi, modificandola
+static int separa_riga(char *riga, size_t n, uint32_t crc_precedente, uint32_t *crc, VoceGiornale *voce) {
+    if (n < 10 || riga[n - 1] != '\n') {
+        return 0;
+    }
+    // "TAB crc\n": otto cifre esadecimali dopo l'ultimo TAB
+    char *tab_crc = riga + n - 10;
+    if (*tab_crc != '\t') {
+        return 0;
+    }
+    char *fine;
+    unsigned long letto = strtoul(tab_crc + 1, &fine, 16);
+    if (fine != riga + n - 1) {
+        return 0;
+    }
+    *crc = crc32_prosegui(crc_precedente, riga, (size_t)(tab_crc + 1 - riga));
+    if (letto != *crc) {
+        return 0;
+    }
+    *tab_crc = '\0';
+
+    char *campi[3];
+    char *p = riga;
+    for (int i = 0; i < 3; i++) {
+        char *tab = strchr(p, '\t');
+        if (!tab) {
+            return 0;
+        }
+        *tab = '\0';
+        campi[i] = p;
+        p = tab + 1;
+    }
+    voce->sequenza = strtoll(campi[0], &fine, 10);
+    voce->istante = campi[1];
+    voce->tipo = campi[2];
+    voce->dati = p;
+    return *fine == '\0' && voce->sequenza > 0;
+}
+
+// Legge le righe da "f", già posizionato a pos->fine, aggiornando pos a
+// ogni riga valida
+static EsitoLettura leggi_voci(FILE *f, PosizioneGiornale *pos, VoceFunc funzione, void *user_data) {
+    char *riga = NULL;
+    size_t capacita = 0;
+    ssize_t n;
+    EsitoLettura esito = LETTURA_FINE;
+    while ((n = getline(&riga, &capacita, f)) > 0) {
+        uint32_t crc;
+        VoceGiornale voce;
+        if (!separa_riga(riga, (size_t)n, pos->crc, &crc, &voce) || voce.sequenza <= pos->ultima) {
+            // Una riga errata in fondo al file è una scrittura interrotta
+            esito = getline(&riga, &capacita, f) > 0 ? LETTURA_DANNEGGIATA : LETTURA_TRONCATA;
+            break;
+        }
+        if (funzione && !funzione(&voce, user_data)) {
+            esito = LETTURA_INTERROTTA;
+            break;
+        }
+        pos->crc = crc;
+        pos->ultima = voce.sequenza;
+        pos->fine += n;
+        pos->righe++;
+    }
+    if (esito == LETTURA_FINE && ferror(f)) {
+        esito = LETTURA_ERRORE;
+    }
+    free(riga);
+    return esito;
+}
+
+// --- Trascrizione ---
+
+struct Giornale {
+    sqlite3 *db;
+    sqlite3_stmt *leggi;
+    sqlite3_stmt *togli;
+    char *percorso;
+    int fd;
+    PosizioneGiornale pos;
+    sqlite3_int64 tolte;        // voci fino a questa sequenza già tolte dal database
+    char *buffer;               // righe da aggiungere al file
+    size_t usati, capacita;
+    int errore_segnalato;       // per non ripetere lo stesso errore a ogni giro
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t sveglia;
+    int fermo;
+};
+
+// Ultima sequenza assegnata nel database, anche se la voce è già stata tolta
+static sqlite3_int64 ultima_nel_database(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    sqlite3_int64 ultima = -1;
+    if (sqlite3_prepare_v2(db,
+                           "SELECT MAX(IFNULL((SELECT seq FROM sqlite_sequence WHERE name = 'giornale'), 0), "
+                           "IFNULL((SELECT MAX(sequenza) FROM giornale), 0));",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        ultima = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return ultima;
+}
+
+static int aggiungi(Giornale *g, const char *testo, size_t n) {
+    if (g->usati + n > g->capacita) {
+        size_t capacita = g->capacita ? g->capacita : 64 * 1024;
+        while (capacita < g->usati + n) {
+            capacita *= 2;
+        }
+        char *buffer = realloc(g->buffer, capacita);
+        if (!buffer) {
+            return 0;
+        }
+        g->buffer = buffer;
+        g->capacita = capacita;
+    }
+    memcpy(g->buffer + g->usati, testo, n);
+    g->usati += n;
+    return 1;
+}
+
+// Legge le righe aggiunte al file da un altro processo dopo l'ultima lettura
+static EsitoLettura rileggi_file(Giornale *g) {
+    struct stat st;
+    if (fstat(g->fd, &st) != 0) {
+        return LETTURA_ERRORE;
+    }
+    if (st.st_size == g->pos.fine) {
+        return LETTURA_FINE;
+    }
+    if (st.st_size < g->pos.fine) {
+        memset(&g->pos, 0, sizeof(g->pos));
+    }
+    FILE *f = fopen(g->percorso, "r");
+    if (!f) {
+        return LETTURA_ERRORE;
+    }
+    EsitoLettura esito = fseeko(f, g->pos.fine, SEEK_SET) == 0 ? leggi_voci(f, &g->pos, NULL, NULL)
+                                                               : LETTURA_ERRORE;
+    fclose(f);
+    // Una scrittura interrotta da un altro processo: la riga a metà si toglie
+    if (esito == LETTURA_TRONCATA && (ftruncate(g->fd, g->pos.fine) != 0 || fsync(g->fd) != 0)) {
+        esito = LETTURA_ERRORE;
+    }
+    return esito == LETTURA_TRONCATA ? LETTURA_FINE : esito;
+}
+
+static int scrivi_tutto(int fd, const char *dati, size_t n) {
+    while (n > 0) {
+        ssize_t scritti = write(fd, dati, n);
+        if (scritti < 0 && errno == EINTR) {
+            continue;
+        }
+        if (scritti <= 0) {
+            return 0;
+        }
+        dati += scritti;
+        n -= (size_t)scritti;
+    }
+    return 1;
+}
+
+static void segnala(Giornale *g, const char *messaggio) {
+    if (!g->errore_segnalato) {
+        fprintf(stderr, "Giornale %s: %s\n", g->percorso, messaggio);
+        g->errore_segnalato = 1;
+    }
+}
+
+// Aggiunge al file le voci del database che non ci sono ancora, lo
+// sincronizza e poi le toglie dal database. Restituisce le voci
+// trascritte, -1 in caso di errore.
+static int trascrivi(Giornale *g) {
+    if (flock(g->fd, LOCK_EX) != 0) {
+        segnala(g, strerror(errno));
+        return -1;
+    }
+    uint64_t t = traccia_inizio();
+    int voci = 0;
+    EsitoLettura esito = rileggi_file(g);
+    if (esito != LETTURA_FINE) {
+        segnala(g, esito == LETTURA_DANNEGGIATA ? "file danneggiato" : "errore di lettura");
+        voci = -1;
+    }
+
+    PosizioneGiornale nuova = g->pos;
+    g->usati = 0;
+    int rc = SQLITE_DONE;
+    if (voci == 0) {
+        sqlite3_bind_int64(g->leggi, 1, g->pos.ultima);
+        sqlite3_bind_int(g->leggi, 2, GIORNALE_VOCI_PER_SCRITTURA);
+        while ((rc = sqlite3_step(g->leggi)) == SQLITE_ROW) {
+            char inizio[64];
+            int n = snprintf(inizio, sizeof(inizio), "%lld\t%s\t%s\t",
+                             (long long)sqlite3_column_int64(g->leggi, 0),
+                             (const char *)sqlite3_column_text(g->leggi, 1),
+                             (const char *)sqlite3_column_text(g->leggi, 2));
+            const char *dati = (const char *)sqlite3_column_text(g->leggi, 3);
+            size_t inizio_riga = g->usati;
+            if (n < 0 || n >= (int)sizeof(inizio) || !aggiungi(g, inizio, (size_t)n) ||
+                !aggiungi(g, dati, strlen(dati)) || !aggiungi(g, "\t", 1)) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            nuova.crc = crc32_prosegui(nuova.crc, g->buffer + inizio_riga, g->usati - inizio_riga);
+            char fine[16];
+            snprintf(fine, sizeof(fine), "%08" PRIx32 "\n", nuova.crc);
+            if (!aggiungi(g, fine, 9)) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            nuova.ultima = sqlite3_column_int64(g->leggi, 0);
+            nuova.fine += (off_t)(g->usati - inizio_riga);
+            nuova.righe++;
+            voci++;
+        }
+        sqlite3_reset(g->leggi);
+        if (rc != SQLITE_DONE) {
+            segnala(g, rc == SQLITE_NOMEM ? "memoria esaurita" : sqlite3_errmsg(g->db));
+            voci = -1;
+        }
+    }
+
+    if (voci > 0) {
+        if (scrivi_tutto(g->fd, g->buffer, g->usati) && fdatasync(g->fd) == 0) {
+            g->pos = nuova;
+        } else {
+            // Il file torna com'era: le voci restano nel database per il prossimo giro
+            segnala(g, strerror(errno));
+            if (ftruncate(g->fd, g->pos.fine) != 0) {
+                memset(&g->pos, 0, sizeof(g->pos));
+            }
+            voci = -1;
+        }
+    }
+    // Solo le voci già al sicuro nel file lasciano il database
+    if (voci >= 0 && g->pos.ultima > g->tolte) {
+        sqlite3_bind_int64(g->togli, 1, g->pos.ultima);
+        if (sqlite3_step(g->togli) == SQLITE_DONE) {
+            g->tolte = g->pos.ultima;
+        }
+        sqlite3_reset(g->togli);
+    }
+    flock(g->fd, LOCK_UN);
+    if (voci > 0) {
+        g->errore_segnalato = 0;
+        traccia_fine("giornale", "trascrivi", t, voci, 0);
+    }
+    return voci;
+}
+
+static void *ciclo_giornale(void *dati) {
+    Giornale *g = dati;
+    traccia_nome_thread("giornale");
+    pthread_mutex_lock(&g->lock);
+    while (!g->fermo) {
+        struct timespec scadenza;
+        clock_gettime(CLOCK_REALTIME, &scadenza);
+        scadenza.tv_sec += GIORNALE_INTERVALLO_MS / 1000;
+        scadenza.tv_nsec += (long)(GIORNALE_INTERVALLO_MS % 1000) * 1000000;
+        if (scadenza.tv_nsec >= 1000000000) {
+            scadenza.tv_sec++;
+            scadenza.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&g->sveglia, &g->lock, &scadenza);
+        if (g->fermo) {
+            break;
+        }
+        pthread_mutex_unlock(&g->lock);
+        // Dopo un'importazione le voci possono essere molte: si trascrivono
+        // tutte, un blocco alla volta
+        while (trascrivi(g) == GIORNALE_VOCI_PER_SCRITTURA) {
+        }
+        pthread_mutex_lock(&g->lock);
+    }
+    pthread_mutex_unlock(&g->lock);
+    while (trascrivi(g) == GIORNALE_VOCI_PER_SCRITTURA) {
+    }
+    return NULL;
+}
+
+static void libera(Giornale *g) {
+    sqlite3_finalize(g->leggi);
+    sqlite3_finalize(g->togli);
+    sqlite3_close(g->db);
+    if (g->fd >= 0) {
+        close(g->fd);
+    }
+    free(g->percorso);
+    free(g->buffer);
+    free(g);
+}
+
+// Apre il file e lo legge tutto, togliendo una riga finale interrotta
+static int apri_file(Giornale *g, char *errore, size_t dim_errore) {
+    g->fd = open(g->percorso, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (g->fd < 0) {
+        snprintf(errore, dim_errore, "Impossibile aprire %s: %s", g->percorso, strerror(errno));
+        return 0;
+    }
+    memset(&g->pos, 0, sizeof(g->pos));
+    EsitoLettura esito = rileggi_file(g);
+    if (esito == LETTURA_DANNEGGIATA) {
+        snprintf(errore, dim_errore, "Il giornale %s è danneggiato dopo la riga %ld: va controllato e "
+                 "spostato, le modifiche restano nel database", g->percorso, g->pos.righe);
+        return 0;
+    }
+    if (esito != LETTURA_FINE) {
+        snprintf(errore, dim_errore, "Errore di lettura di %s", g->percorso);
+        return 0;
+    }
+    return 1;
+}
+
+Giornale *giornale_avvia(const ConfigDB *config, char *errore, size_t dim_errore) {
+    Giornale *g = calloc(1, sizeof(Giornale));
+    if (!g) {
+        snprintf(errore, dim_errore, "Memoria esaurita");
+        return NULL;
+    }
+    g->fd = -1;
+    g->percorso = malloc(strlen(config->percorso) + sizeof(GIORNALE_ESTENSIONE));
+    if (!g->percorso) {
+        snprintf(errore, dim_errore, "Memoria esaurita");
+        libera(g);
+        return NULL;
+    }
+    sprintf(g->percorso, "%s%s", config->percorso, GIORNALE_ESTENSIONE);
+
+    if (db_apri_scrittura(config, &g->db) != SQLITE_OK ||
+        sqlite3_prepare_v3(g->db, "SELECT sequenza, istante, tipo, dati FROM giornale "
+                           "WHERE sequenza > ?1 ORDER BY sequenza LIMIT ?2;",
+                           -1, SQLITE_PREPARE_PERSISTENT, &g->leggi, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v3(g->db, "DELETE FROM giornale WHERE sequenza <= ?1;",
+                           -1, SQLITE_PREPARE_PERSISTENT, &g->togli, NULL) != SQLITE_OK) {
+        snprintf(errore, dim_errore, "%s", g->db ? sqlite3_errmsg(g->db) : "Impossibile aprire il database");
+        libera(g);
+        return NULL;
+    }
+    if (!apri_file(g, errore, dim_errore)) {
+        libera(g);
+        return NULL;
+    }
+
+    // Un file che va oltre il database appartiene a un'altra storia (il
+    // database è stato ripristinato da una copia): si conserva a parte
+    sqlite3_int64 ultima = ultima_nel_database(g->db);
+    if (ultima >= 0 && g->pos.ultima > ultima) {
+        char *precedente = malloc(strlen(g->percorso) + 32);
+        if (!precedente) {
+            snprintf(errore, dim_errore, "Memoria esaurita");
+            libera(g);
+            return NULL;
+        }
+        sprintf(precedente, "%s.%lld", g->percorso, (long long)g->pos.ultima);
+        if (rename(g->percorso, precedente) != 0) {
+            snprintf(errore, dim_errore, "Impossibile rinominare %s in %s", g->percorso, precedente);
+            free(precedente);
+            libera(g);
+            return NULL;
+        }
+        fprintf(stderr, "Il giornale %s va oltre il database: spostato in %s\n", g->percorso, precedente);
+        free(precedente);
+        close(g->fd);
+        if (!apri_file(g, errore, dim_errore)) {
+            libera(g);
+            return NULL;
+        }
+    }
+
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->sveglia, NULL);
+    if (pthread_create(&g->thread, NULL, ciclo_giornale, g) != 0) {
+        snprintf(errore, dim_errore, "Impossibile avviare il thread del giornale");
+        pthread_mutex_destroy(&g->lock);
+        pthread_cond_destroy(&g->sveglia);
+        libera(g);
+        return NULL;
+    }
+    return g;
+}
+
+void giornale_ferma(Giornale *giornale) {
+    if (!giornale) {
+        return;
+    }
+    pthread_mutex_lock(&giornale->lock);
+    giornale->fermo = 1;
+    pthread_cond_signal(&giornale->sveglia);
+    pthread_mutex_unlock(&giornale->lock);
+    pthread_join(giornale->thread, NULL);
+    pthread_mutex_destroy(&giornale->lock);
+    pthread_cond_destroy(&giornale->sveglia);
+    libera(giornale);
+}
+
+// --- Ripristino ---
+
+#define JSON(campo) "json_extract(?1, '$." campo "')"
+
+// Voci del giornale e query che le riapplicano. Gli articoli e le foto
+// tornano con lo stesso ID, così le voci successive li ritrovano.
+static const struct {
+    const char *tipo;
+    const char *sql;
+} riapplica_voce[] = {
+    { "articolo",
+      "INSERT INTO articoli (articolo_id, nome, descrizione, artista, periodo, misure, "
+      "data_acquisizione, prezzo_acquisto, quantita) "
+      "VALUES (" JSON("articolo_id") ", " JSON("nome") ", " JSON("descrizione") ", " JSON("artista") ", "
+      JSON("periodo") ", " JSON("misure") ", " JSON("data_acquisizione") ", "
+      JSON("prezzo_acquisto") ", " JSON("quantita") ") "
+      "ON CONFLICT (articolo_id) DO UPDATE SET "
+      "nome = excluded.nome, descrizione = excluded.descrizione, artista = excluded.artista, "
+      "periodo = excluded.periodo, misure = excluded.misure, "
+      "data_acquisizione = excluded.data_acquisizione, "
+      "prezzo_acquisto = excluded.prezzo_acquisto, quantita = excluded.quantita;" },
+    { "elimina",
+      "DELETE FROM articoli WHERE articolo_id = " JSON("articolo_id") ";" },
+    { "vendita",
+      "INSERT INTO vendite (vendita_id, articolo_id, data_vendita, prezzo_vendita, nome_cliente) "
+      "VALUES (" JSON("vendita_id") ", " JSON("articolo_id") ", " JSON("data_vendita") ", "
+      JSON("prezzo_vendita") ", " JSON("nome_cliente") ") "
+      "ON CONFLICT DO NOTHING;" },
+    { "foto",
+      "INSERT INTO foto (foto_id, articolo_id, hash, dimensione, posizione) "
+      "VALUES (" JSON("foto_id") ", " JSON("articolo_id") ", " JSON("hash") ", "
+      JSON("dimensione") ", " JSON("posizione") ") "
+      "ON CONFLICT DO NOTHING;" },
+};
+
+#define N_VOCI (int)(sizeof(riapplica_voce) / sizeof(riapplica_voce[0]))
+
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *stmt[N_VOCI];
+    sqlite3_int64 nel_database;  // ultima voce già contenuta nel database
+    sqlite3_int64 ultima;        // ultima voce riapplicata
+    const char *fino_a;
+    size_t lunghezza_fino_a;
+    long applicate;
+    int rc;
+    char *errore;
+    size_t dim_errore;
+} Ripristino;
+
+static int on_voce_ripristino(const VoceGiornale *voce, void *user_data) {
+    Ripristino *r = user_data;
+    if (voce->sequenza <= r->nel_database) {
+        return 1;
+    }
+    if (r->fino_a && strncmp(voce->istante, r->fino_a, r->lunghezza_fino_a) > 0) {
+        return 0;
+    }
+    // Le sequenze confermate sono consecutive: un salto vuol dire che una
+    // parte delle modifiche manca dal file (o il database è più vecchio
+    // dell'inizio del giornale)
+    if (voce->sequenza != r->ultima + 1) {
+        snprintf(r->errore, r->dim_errore, "Mancano le voci del giornale dalla %lld alla %lld",
+                 (long long)r->ultima + 1, (long long)voce->sequenza - 1);
+        r->rc = SQLITE_CORRUPT;
+        return 0;
+    }
+    int i = 0;
+    while (i < N_VOCI && strcmp(riapplica_voce[i].tipo, voce->tipo) != 0) {
+        i++;
+    }
+    if (i == N_VOCI) {
+        snprintf(r->errore, r->dim_errore, "Voce %lld di tipo sconosciuto: %s",
+                 (long long)voce->sequenza, voce->tipo);
+        r->rc = SQLITE_CORRUPT;
+        return 0;
+    }
+    sqlite3_bind_text(r->stmt[i], 1, voce->dati, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(r->stmt[i]);
+    sqlite3_reset(r->stmt[i]);
+    if (rc != SQLITE_DONE) {
+        snprintf(r->errore, r->dim_errore, "Voce %lld: %s", (long long)voce->sequenza, sqlite3_errmsg(r->db));
+        r->rc = rc;
+        return 0;
+    }
+    r->ultima = voce->sequenza;
+    r->applicate++;
+    return 1;
+}
+
+// Le voci scritte dai trigger durante il ripristino sono copie di quelle
+// già nel file: si tolgono, e la sequenza riparte dall'ultima riapplicata
+static int chiudi_ripristino(Ripristino *r) {
+    sqlite3_stmt *stmt;
+    int rc = sqlite3_prepare_v2(r->db, "DELETE FROM giornale WHERE sequenza > ?1;", -1, &stmt, NULL);
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, r->nel_database);
+        rc = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : sqlite3_errcode(r->db);
+        sqlite3_finalize(stmt);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_prepare_v2(r->db, "UPDATE sqlite_sequence SET seq = ?1 WHERE name = 'giornale';",
+                                -1, &stmt, NULL);
+    }
+    if (rc == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, r->ultima);
+        rc = sqlite3_step(stmt) == SQLITE_DONE ? SQLITE_OK : sqlite3_errcode(r->db);
+        sqlite3_finalize(stmt);
+    }
+    if (rc != SQLITE_OK) {
+        snprintf(r->errore, r->dim_errore, "%s", sqlite3_errmsg(r->db));
+    }
+    return rc;
+}
+
+int giornale_riapplica(sqlite3 *db, const char *percorso, const char *fino_a,
+                       long *applicate, char *errore, size_t dim_errore) {
+    *applicate = 0;
+    FILE *f = fopen(percorso, "r");
+    if (!f) {
+        snprintf(errore, dim_errore, "Impossibile aprire %s: %s", percorso, strerror(errno));
+        return SQLITE_CANTOPEN;
+    }
+    // Il programma può aggiungere righe intanto: si legge a scrittura conclusa
+    flock(fileno(f), LOCK_SH);
+
+    Ripristino r;
+    memset(&r, 0, sizeof(r));
+    r.db = db;
+    r.fino_a = fino_a;
+    r.lunghezza_fino_a = fino_a ? strlen(fino_a) : 0;
+    r.errore = errore;
+    r.dim_errore = dim_errore;
+    r.nel_database = ultima_nel_database(db);
+    r.ultima = r.nel_database;
+    if (r.nel_database < 0) {
+        snprintf(errore, dim_errore, "%s", sqlite3_errmsg(db));
+        fclose(f);
+        return SQLITE_ERROR;
+    }
+
+    int rc = sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, NULL, NULL);
+    for (int i = 0; i < N_VOCI && rc == SQLITE_OK; i++) {
+        rc = sqlite3_prepare_v2(db, riapplica_voce[i].sql, -1, &r.stmt[i], NULL);
+    }
+    if (rc != SQLITE_OK) {
+        snprintf(errore, dim_errore, "%s", sqlite3_errmsg(db));
+    } else {
+        PosizioneGiornale pos;
+        memset(&pos, 0, sizeof(pos));
+        EsitoLettura esito = leggi_voci(f, &pos, on_voce_ripristino, &r);
+        rc = r.rc;
+        if (esito == LETTURA_DANNEGGIATA || esito == LETTURA_ERRORE) {
+            snprintf(errore, dim_errore, "Il giornale %s è %s dopo la riga %ld", percorso,
+                     esito == LETTURA_ERRORE ? "illeggibile" : "danneggiato", pos.righe);
+            rc = SQLITE_CORRUPT;
+        }
+        if (rc == SQLITE_OK && r.applicate > 0) {
+            rc = chiudi_ripristino(&r);
+        }
+    }
+    for (int i = 0; i < N_VOCI; i++) {
+        sqlite3_finalize(r.stmt[i]);
+    }
+    if (rc == SQLITE_OK && sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK) {
+        snprintf(errore, dim_errore, "%s", sqlite3_errmsg(db));
+        rc = sqlite3_errcode(db);
+    }
+    if (rc != SQLITE_OK) {
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+    } else {
+        *applicate = r.applicate;
+    }
+    fclose(f);
+    return rc;
+}
@@ -0,0 +1,59 @@
+#ifndef GIORNALE_H
+#define GIORNALE_H
+
+#include <stddef.h>
+#include <sqlite3.h>
+
+#include "connessione.h"
+
+// Giornale delle modifiche: un file di testo accanto al database a cui si
+// aggiungono soltanto righe, una per ogni modifica confermata (articoli
+// inseriti, modificati ed eliminati, vendite, foto), in ordine. Insieme a
+// una copia del database (backup.h) permette di ricostruire i dati fino a
+// un istante qualsiasi successivo alla copia.
+//
+// Le modifiche vengono scritte dai trigger nella tabella giornale, nella
+// stessa transazione (schema 7); un thread le trascrive nel file, lo
+// sincronizza su disco e solo dopo le toglie dal database. Se il programma
+// si interrompe a metà le righe mancanti sono ancora nel database e
+// vengono trascritte al riavvio. Più processi sullo stesso database (il
+// programma e un'importazione da terminale) si alternano con un lock sul file.
+//
+//   sequenza TAB istante TAB tipo TAB dati TAB crc
+//
+// "istante" è l'ora locale AAAA-MM-GG HH:MM:SS.SSS, "tipo" è articolo,
+// elimina, vendita o foto e "dati" l'immagine della riga in JSON. "crc" è il
+// CRC-32 (8 cifre esadecimali) della riga fino al TAB che lo precede,
+// proseguendo quello della riga precedente: una riga modificata, tolta o
+// spostata non torna più. Una riga finale incompleta (scrittura interrotta)
+// viene tolta all'avvio.
+
+#define GIORNALE_ESTENSIONE ".giornale"
+// Ogni quanto il thread trascrive le nuove modifiche
+#define GIORNALE_INTERVALLO_MS 1000
+// Voci trascritte al massimo per ogni scrittura sul file
+#define GIORNALE_VOCI_PER_SCRITTURA 10000
+
+typedef struct Giornale Giornale;
+
+// Apre il file del giornale del database (percorso + GIORNALE_ESTENSIONE) e
+// avvia il thread, con una connessione di scrittura propria. Se il file
+// arriva oltre il database (ad esempio dopo un ripristino) viene messo da
+// parte con la sequenza finale nel nome e se ne inizia uno nuovo. NULL con
+// la descrizione in "errore"; le modifiche restano comunque nel database.
+Giornale *giornale_avvia(const ConfigDB *config, char *errore, size_t dim_errore);
+
+// Trascrive le ultime modifiche, ferma il thread e chiude il file
+void giornale_ferma(Giornale *giornale);
+
+// Riapplica a "db" le voci del file "percorso" successive all'ultima che il
+// database contiene già (tipicamente db è appena stato copiato da un
+// backup), fino a "fino_a" incluso: un inizio di istante come "2026-03-14"
+// o "2026-03-14 17:30", NULL per tutte. Tutto in una transazione.
+// Restituisce SQLITE_OK e in *applicate le voci riapplicate; SQLITE_CORRUPT
+// se il file è danneggiato o non parte da dove arriva il database, con la
+// descrizione in "errore" (e niente modificato).
+int giornale_riapplica(sqlite3 *db, const char *percorso, const char *fino_a,
+                       long *applicate, char *errore, size_t dim_errore);
+
+#endif
@@ -0,0 +1,848 @@
+#include "importa.h"
+#include "schema.h"
+#include "validazione.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Ogni quanti byte letti le pagine del file già elaborate vengono
+// restituite al sistema
+#define IMPORTA_BLOCCO_RILASCIO (64L * 1024 * 1024)
+// Colonne massime lette da un'intestazione CSV
+#define IMPORTA_MAX_COLONNE 64
+
+enum {
+    CAMPO_IGNOTO = -1,
+    CAMPO_NOME,
+    CAMPO_DESCRIZIONE,
+    CAMPO_ARTISTA,
+    CAMPO_PERIODO,
+    CAMPO_MISURE,
+    CAMPO_DATA,
+    CAMPO_PREZZO,
+    CAMPO_QUANTITA,
+    N_CAMPI
+};
+
+// Nomi accettati per colonne CSV e chiavi JSON (senza distinzione di maiuscole)
+static const struct {
+    const char *nome;
+    int campo;
+} nomi_campi[] = {
+    {"nome", CAMPO_NOME},
+    {"descrizione", CAMPO_DESCRIZIONE},
+    {"artista", CAMPO_ARTISTA},
+    {"periodo", CAMPO_PERIODO},
+    {"misure", CAMPO_MISURE},
+    {"data_acquisizione", CAMPO_DATA},
+    {"prezzo_acquisto", CAMPO_PREZZO},
+    {"prezzo", CAMPO_PREZZO},
+    {"quantita", CAMPO_QUANTITA},
+    {"quantità", CAMPO_QUANTITA},
+};
+
+// Testo dei campi del record corrente, riutilizzato da un record all'altro
+typedef struct {
+    char *dati;
+    size_t usati;
+    size_t capacita;
+} Buffer;
+
+typedef struct {
+    Buffer testo;
+    long inizio[N_CAMPI];   // posizione del campo nel testo, -1 se assente
+    long riga;              // riga del file in cui inizia il record
+    const char *errore;     // valore non valido trovato durante la lettura
+    int numerico[N_CAMPI];  // 1 se il valore JSON era un numero, letto in numero[]
+    double numero[N_CAMPI];
+} Record;
+
+// File mappato in memoria e posizione di lettura
+typedef struct {
+    const char *dati;
+    size_t dimensione;
+    size_t pos;
+    size_t rilasciati;      // byte iniziali già restituiti al sistema
+    long riga;
+} Lettore;
+
+typedef struct {
+    Repository *repo;
+    ImportaErroreCallback on_errore;
+    void *user_data;
+    EsitoImportazione *esito;
+    int in_transazione;
+    long in_sospeso;        // righe inserite nella transazione aperta
+    sqlite3_int64 ultimo_id;    // ultimo articolo presente prima del blocco
+    int errore_db;          // il database ha rifiutato una scrittura
+} Importazione;
+
+// --- Buffer ---
+
+static int buffer_aggiungi(Buffer *b, const char *testo, size_t n) {
+    if (b->usati + n + 1 > b->capacita) {
+        size_t capacita = b->capacita ? b->capacita : 4096;
+        while (b->usati + n + 1 > capacita) {
+            capacita *= 2;
+        }
+        char *dati = realloc(b->dati, capacita);
+        if (!dati) {
+            return 0;
+        }
+        b->dati = dati;
+        b->capacita = capacita;
+    }
+    memcpy(b->dati + b->usati, testo, n);
+    b->usati += n;
+    return 1;
+}
+
+// Chiude il campo corrente con il terminatore
+static int buffer_chiudi(Buffer *b) {
+    return buffer_aggiungi(b, "", 1);
+}
+
+static void record_azzera(Record *rec, long riga) {
+    rec->testo.usati = 0;
+    for (int i = 0; i < N_CAMPI; i++) {
+        rec->inizio[i] = -1;
+        rec->numerico[i] = 0;
+    }
+    rec->riga = riga;
+    rec->errore = NULL;
+}
+
+static int trova_campo(const char *nome) {
+    for (size_t i = 0; i < sizeof(nomi_campi) / sizeof(nomi_campi[0]); i++) {
+        if (strcasecmp(nome, nomi_campi[i].nome) == 0) {
+            return nomi_campi[i].campo;
+        }
+    }
+    return CAMPO_IGNOTO;
+}
+
+// --- Lettura del file ---
+
+static int fine_file(const Lettore *l) {
+    return l->pos >= l->dimensione;
+}
+
+// Restituisce al sistema le pagine già elaborate: la mappatura resta, ma
+// la memoria occupata non cresce con la dimensione del file
+static void rilascia_letti(Lettore *l) {
+    if (l->pos - l->rilasciati < (size_t)IMPORTA_BLOCCO_RILASCIO) {
+        return;
+    }
+    size_t pagina = (size_t)sysconf(_SC_PAGESIZE);
+    size_t fino = l->pos / pagina * pagina;
+    madvise((void *)(l->dati + l->rilasciati), fino - l->rilasciati, MADV_DONTNEED);
+    l->rilasciati = fino;
+}
+
+static void salta_bom(Lettore *l) {
+    if (l->dimensione >= 3 && memcmp(l->dati, "\xEF\xBB\xBF", 3) == 0) {
+        l->pos = 3;
+    }
+}
+
+// --- Importazione dei record ---
+
+static void segnala(Importazione *imp, long riga, const char *messaggio) {
+    imp->esito->righe_scartate++;
+    if (imp->on_errore) {
+        imp->on_errore(riga, messaggio, imp->user_data);
+    }
+}
+
+// Conferma la transazione aperta; le righe contano come importate solo dopo il commit
+static int conferma(Importazione *imp) {
+    if (!imp->in_transazione) {
+        return SQLITE_OK;
+    }
+    imp->in_transazione = 0;
+    // Il blocco viene indicizzato per la ricerca in una sola passata
+    int rc = schema_riprendi_ricerca(repo_db(imp->repo), imp->ultimo_id);
+    rc = repo_termina_transazione(imp->repo, rc == SQLITE_OK);
+    if (rc == SQLITE_OK) {
+        imp->esito->righe_importate += imp->in_sospeso;
+    }
+    imp->in_sospeso = 0;
+    return rc;
+}
+
+static const char *testo_o_null(const Record *rec, int campo) {
+    if (rec->inizio[campo] < 0) {
+        return NULL;
+    }
+    const char *testo = rec->testo.dati + rec->inizio[campo];
+    return *testo ? testo : NULL;
+}
+
+// Prezzo e quantità arrivano come testo dai CSV e come testo o numero dal
+// JSON: i numeri JSON (anche 1e3 o 2.0) sono già convertiti da strtod
+static int prezzo_record(const Record *rec, double *prezzo, const char **errore) {
+    if (!rec->numerico[CAMPO_PREZZO]) {
+        return valida_prezzo(testo_o_null(rec, CAMPO_PREZZO), prezzo, errore);
+    }
+    double valore = rec->numero[CAMPO_PREZZO];
+    if (valore < 0) {
+        *errore = "prezzo negativo";
+        return 0;
+    }
+    *prezzo = valore;
+    return 1;
+}
+
+static int quantita_record(const Record *rec, int *quantita, const char **errore) {
+    if (!rec->numerico[CAMPO_QUANTITA]) {
+        return valida_quantita(testo_o_null(rec, CAMPO_QUANTITA), 1, quantita, errore);
+    }
+    double valore = rec->numero[CAMPO_QUANTITA];
+    if (valore < 0 || valore != floor(valore)) {
+        *errore = "quantità non valida (serve un numero intero non negativo)";
+        return 0;
+    }
+    if (valore > INT_MAX) {
+        *errore = "quantità troppo grande";
+        return 0;
+    }
+    *quantita = (int)valore;
+    return 1;
+}
+
+// Valida il record e lo inserisce; restituisce un codice SQLite solo per
+// errori del database, i record non validi vengono segnalati e saltati
+static int salva_record(Importazione *imp, const Record *rec) {
+    imp->esito->righe_lette++;
+    if (rec->errore) {
+        segnala(imp, rec->riga, rec->errore);
+        return SQLITE_OK;
+    }
+
+    NuovoArticolo articolo = {
+        .nome = testo_o_null(rec, CAMPO_NOME),
+        .descrizione = testo_o_null(rec, CAMPO_DESCRIZIONE),
+        .artista = testo_o_null(rec, CAMPO_ARTISTA),
+        .periodo = testo_o_null(rec, CAMPO_PERIODO),
+        .misure = testo_o_null(rec, CAMPO_MISURE),
+    };
+    char data[11];
+    const char *errore = NULL;
+    if (!prezzo_record(rec, &articolo.prezzo_acquisto, &errore) ||
+        !quantita_record(rec, &articolo.quantita, &errore) ||
+        !valida_data(testo_o_null(rec, CAMPO_DATA), data, &errore)) {
+        segnala(imp, rec->riga, errore);
+        return SQLITE_OK;
+    }
+    articolo.data_acquisizione = data[0] ? data : NULL;
+    if (!valida_articolo(&articolo, &errore)) {
+        segnala(imp, rec->riga, errore);
+        return SQLITE_OK;
+    }
+
+    if (!imp->in_transazione) {
+        int rc = repo_inizia_transazione(imp->repo);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        imp->in_transazione = 1;
+        rc = schema_sospendi_ricerca(repo_db(imp->repo), &imp->ultimo_id);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+    }
+    // Sempre la stessa insert preparata, con un commit ogni blocco di righe
+    int rc = repo_insert_articolo(imp->repo, &articolo, NULL);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (++imp->in_sospeso >= IMPORTA_RIGHE_PER_TRANSAZIONE) {
+        return conferma(imp);
+    }
+    return SQLITE_OK;
+}
+
+// --- CSV ---
+
+// Sceglie il separatore più frequente nella riga di intestazione
+static char trova_separatore(const Lettore *l) {
+    int conteggi[3] = {0, 0, 0};
+    const char candidati[3] = {',', ';', '\t'};
+    int tra_virgolette = 0;
+    for (size_t i = l->pos; i < l->dimensione && (tra_virgolette || l->dati[i] != '\n'); i++) {
+        char c = l->dati[i];
+        if (c == '"') {
+            tra_virgolette = !tra_virgolette;
+        }
+        for (int k = 0; k < 3 && !tra_virgolette; k++) {
+            conteggi[k] += (c == candidati[k]);
+        }
+    }
+    int migliore = 0;
+    for (int k = 1; k < 3; k++) {
+        if (conteggi[k] > conteggi[migliore]) {
+            migliore = k;
+        }
+    }
+    return candidati[migliore];
+}
+
+// Legge un campo e lo aggiunge al buffer già terminato. Restituisce il
+// carattere che lo chiude (separatore, '\n', oppure 0 a fine file) o -1 per
+// virgolette non chiuse o memoria esaurita.
+static int leggi_campo_csv(Lettore *l, char separatore, Buffer *b) {
+    const char *d = l->dati;
+    size_t n = l->dimensione;
+
+    if (l->pos < n && d[l->pos] == '"') {
+        l->pos++;
+        for (;;) {
+            const char *virgolette = memchr(d + l->pos, '"', n - l->pos);
+            if (!virgolette) {
+                return -1;
+            }
+            size_t fine = (size_t)(virgolette - d);
+            for (size_t i = l->pos; i < fine; i++) {
+                l->riga += (d[i] == '\n');
+            }
+            if (!buffer_aggiungi(b, d + l->pos, fine - l->pos)) {
+                return -1;
+            }
+            l->pos = fine + 1;
+            // "" dentro un campo tra virgolette è una virgoletta
+            if (l->pos < n && d[l->pos] == '"') {
+                if (!buffer_aggiungi(b, "\"", 1)) {
+                    return -1;
+                }
+                l->pos++;
+                continue;
+            }
+            break;
+        }
+    }
+
+    // Parte senza virgolette (o testo dopo la virgoletta di chiusura)
+    size_t inizio = l->pos;
+    while (l->pos < n && d[l->pos] != separatore && d[l->pos] != '\n') {
+        l->pos++;
+    }
+    size_t fine = l->pos;
+    int chiusura = l->pos < n ? d[l->pos] : 0;
+    if (chiusura == '\n' && fine > inizio && d[fine - 1] == '\r') {
+        fine--;
+    }
+    if (!buffer_aggiungi(b, d + inizio, fine - inizio) || !buffer_chiudi(b)) {
+        return -1;
+    }
+    if (chiusura) {
+        l->pos++;
+        l->riga += (chiusura == '\n');
+    }
+    return chiusura;
+}
+
+// Legge un record mettendo nel Record solo le colonne riconosciute.
+// Restituisce 1 se ha letto un record, 0 a fine file, -1 in caso di errore.
+static int leggi_record_csv(Lettore *l, char separatore, const int *colonne, int n_colonne, Record *rec) {
+    // Le righe vuote non sono record
+    while (!fine_file(l) && (l->dati[l->pos] == '\n' || l->dati[l->pos] == '\r')) {
+        l->riga += (l->dati[l->pos] == '\n');
+        l->pos++;
+    }
+    if (fine_file(l)) {
+        return 0;
+    }
+
+    record_azzera(rec, l->riga);
+    for (int c = 0;; c++) {
+        size_t inizio = rec->testo.usati;
+        int chiusura = leggi_campo_csv(l, separatore, &rec->testo);
+        if (chiusura < 0) {
+            return -1;
+        }
+        int campo = c < n_colonne ? colonne[c] : CAMPO_IGNOTO;
+        if (campo == CAMPO_IGNOTO) {
+            rec->testo.usati = inizio;
+        } else {
+            rec->inizio[campo] = (long)inizio;
+        }
+        if (chiusura != separatore) {
+            return 1;
+        }
+    }
+}
+
+static int importa_csv(Importazione *imp, Lettore *l, char *errore, size_t dim_errore) {
+    char separatore = trova_separatore(l);
+    Record rec = {0};
+    int colonne[IMPORTA_MAX_COLONNE];
+    int n_colonne = 0;
+    int rc = SQLITE_OK;
+
+    // Intestazione: ogni colonna viene letta e associata a un campo. Dopo
+    // IMPORTA_MAX_COLONNE la riga si legge fino in fondo senza registrarle:
+    // nei record quelle colonne vengono ignorate
+    record_azzera(&rec, l->riga);
+    int n_intestazione = 0;
+    for (int chiusura = separatore; chiusura == separatore; ) {
+        rec.testo.usati = 0;
+        chiusura = leggi_campo_csv(l, separatore, &rec.testo);
+        if (chiusura < 0) {
+            snprintf(errore, dim_errore, "Intestazione CSV non valida");
+            free(rec.testo.dati);
+            return SQLITE_ERROR;
+        }
+        if (rec.testo.usati > 1 || chiusura == separatore || n_intestazione > 0) {
+            if (n_intestazione++ >= IMPORTA_MAX_COLONNE) {
+                continue;
+            }
+            const char *nome = rec.testo.dati;
+            while (*nome == ' ') {
+                nome++;
+            }
+            char *fine = rec.testo.dati + rec.testo.usati - 1;
+            while (fine > nome && fine[-1] == ' ') {
+                *--fine = '\0';
+            }
+            colonne[n_colonne++] = trova_campo(nome);
+        }
+    }
+
+    int ha_nome = 0, ha_prezzo = 0;
+    for (int c = 0; c < n_colonne; c++) {
+        ha_nome |= colonne[c] == CAMPO_NOME;
+        ha_prezzo |= colonne[c] == CAMPO_PREZZO;
+    }
+    if (!ha_nome || !ha_prezzo) {
+        snprintf(errore, dim_errore, "Il file deve avere almeno le colonne \"nome\" e \"prezzo_acquisto\"");
+        free(rec.testo.dati);
+        return SQLITE_ERROR;
+    }
+
+    int letto;
+    while (rc == SQLITE_OK && (letto = leggi_record_csv(l, separatore, colonne, n_colonne, &rec)) > 0) {
+        rc = salva_record(imp, &rec);
+        rilascia_letti(l);
+    }
+    if (rc == SQLITE_OK && letto < 0) {
+        snprintf(errore, dim_errore, "Virgolette non chiuse nel record che inizia alla riga %ld", rec.riga);
+        rc = SQLITE_ERROR;
+    } else if (rc != SQLITE_OK) {
+        imp->errore_db = 1;
+        snprintf(errore, dim_errore, "Errore del database alla riga %ld: %s", rec.riga, repo_errmsg(imp->repo));
+    }
+    free(rec.testo.dati);
+    return rc;
+}
+
+// --- JSON ---
+
+static void salta_spazi_json(Lettore *l) {
+    while (!fine_file(l)) {
+        char c = l->dati[l->pos];
+        if (c == '\n') {
+            l->riga++;
+        } else if (c != ' ' && c != '\t' && c != '\r') {
+            break;
+        }
+        l->pos++;
+    }
+}
+
+static int cifra_esadecimale(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int leggi_codice_json(Lettore *l, unsigned int *codice) {
+    if (l->dimensione - l->pos < 4) {
+        return 0;
+    }
+    *codice = 0;
+    for (int i = 0; i < 4; i++) {
+        int cifra = cifra_esadecimale(l->dati[l->pos++]);
+        if (cifra < 0) {
+            return 0;
+        }
+        *codice = (*codice << 4) | (unsigned int)cifra;
+    }
+    return 1;
+}
+
+static int aggiungi_utf8(Buffer *b, unsigned int codice) {
+    char utf8[4];
+    size_t n;
+    if (codice < 0x80) {
+        utf8[0] = (char)codice;
+        n = 1;
+    } else if (codice < 0x800) {
+        utf8[0] = (char)(0xC0 | (codice >> 6));
+        utf8[1] = (char)(0x80 | (codice & 0x3F));
+        n = 2;
+    } else if (codice < 0x10000) {
+        utf8[0] = (char)(0xE0 | (codice >> 12));
+        utf8[1] = (char)(0x80 | ((codice >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (codice & 0x3F));
+        n = 3;
+    } else {
+        utf8[0] = (char)(0xF0 | (codice >> 18));
+        utf8[1] = (char)(0x80 | ((codice >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((codice >> 6) & 0x3F));
+        utf8[3] = (char)(0x80 | (codice & 0x3F));
+        n = 4;
+    }
+    return buffer_aggiungi(b, utf8, n);
+}
+
+// Legge una stringa JSON (posizione sulle virgolette iniziali) togliendo gli
+// escape e la aggiunge al buffer terminata. 0 se la sintassi non è valida.
+static int leggi_stringa_json(Lettore *l, Buffer *b) {
+    const char *d = l->dati;
+    l->pos++;
+    for (;;) {
+        size_t inizio = l->pos;
+        while (l->pos < l->dimensione && d[l->pos] != '"' && d[l->pos] != '\\' && d[l->pos] != '\n') {
+            l->pos++;
+        }
+        if (fine_file(l) || d[l->pos] == '\n' || !buffer_aggiungi(b, d + inizio, l->pos - inizio)) {
+            return 0;
+        }
+        if (d[l->pos++] == '"') {
+            return buffer_chiudi(b);
+        }
+
+        // Sequenza di escape
+        if (fine_file(l)) {
+            return 0;
+        }
+        char c = d[l->pos++];
+        const char *sostituto = NULL;
+        switch (c) {
+        case '"': sostituto = "\""; break;
+        case '\\': sostituto = "\\"; break;
+        case '/': sostituto = "/"; break;
+        case 'b': sostituto = "\b"; break;
+        case 'f': sostituto = "\f"; break;
+        case 'n': sostituto = "\n"; break;
+        case 'r': sostituto = "\r"; break;
+        case 't': sostituto = "\t"; break;
+        case 'u': {
+            unsigned int codice;
+            if (!leggi_codice_json(l, &codice)) {
+                return 0;
+            }
+            // Coppia di surrogati UTF-16 per i caratteri oltre U+FFFF
+            if (codice >= 0xD800 && codice <= 0xDBFF) {
+                unsigned int basso;
+                if (l->dimensione - l->pos < 2 || d[l->pos] != '\\' || d[l->pos + 1] != 'u') {
+                    return 0;
+                }
+                l->pos += 2;
+                if (!leggi_codice_json(l, &basso) || basso < 0xDC00 || basso > 0xDFFF) {
+                    return 0;
+                }
+                codice = 0x10000 + ((codice - 0xD800) << 10) + (basso - 0xDC00);
+            } else if (codice >= 0xDC00 && codice <= 0xDFFF) {
+                return 0;
+            }
+            if (!aggiungi_utf8(b, codice)) {
+                return 0;
+            }
+            continue;
+        }
+        default:
+            return 0;
+        }
+        if (!buffer_aggiungi(b, sostituto, 1)) {
+            return 0;
+        }
+    }
+}
+
+// Salta un valore qualsiasi, anche annidato. 0 se la sintassi non è valida.
+static int salta_valore_json(Lettore *l, Buffer *appoggio) {
+    int profondita = 0;
+    do {
+        salta_spazi_json(l);
+        if (fine_file(l)) {
+            return 0;
+        }
+        char c = l->dati[l->pos];
+        if (c == '"') {
+            size_t usati = appoggio->usati;
+            int ok = leggi_stringa_json(l, appoggio);
+            appoggio->usati = usati;
+            if (!ok) {
+                return 0;
+            }
+        } else if (c == '{' || c == '[') {
+            profondita++;
+            l->pos++;
+        } else if (c == '}' || c == ']') {
+            if (--profondita < 0) {
+                return 0;
+            }
+            l->pos++;
+        } else if (c == ',' || c == ':') {
+            if (profondita == 0) {
+                return 0;
+            }
+            l->pos++;
+        } else {
+            // Numero o parola chiave
+            size_t inizio = l->pos;
+            while (!fine_file(l) && strchr(",:]} \t\r\n", l->dati[l->pos]) == NULL) {
+                l->pos++;
+            }
+            if (l->pos == inizio) {
+                return 0;
+            }
+        }
+    } while (profondita > 0);
+    return 1;
+}
+
+// Legge un oggetto JSON (posizione sulla graffa iniziale) nel record.
+// 0 se la sintassi non è valida; i valori di tipo sbagliato vengono
+// registrati in rec->errore e l'oggetto viene letto comunque fino in fondo.
+static int leggi_oggetto_json(Lettore *l, Record *rec) {
+    record_azzera(rec, l->riga);
+    l->pos++;
+    salta_spazi_json(l);
+    if (!fine_file(l) && l->dati[l->pos] == '}') {
+        l->pos++;
+        return 1;
+    }
+
+    for (;;) {
+        salta_spazi_json(l);
+        if (fine_file(l) || l->dati[l->pos] != '"') {
+            return 0;
+        }
+        size_t chiave = rec->testo.usati;
+        if (!leggi_stringa_json(l, &rec->testo)) {
+            return 0;
+        }
+        int campo = trova_campo(rec->testo.dati + chiave);
+        rec->testo.usati = chiave;
+
+        salta_spazi_json(l);
+        if (fine_file(l) || l->dati[l->pos] != ':') {
+            return 0;
+        }
+        l->pos++;
+        salta_spazi_json(l);
+        if (fine_file(l)) {
+            return 0;
+        }
+
+        char c = l->dati[l->pos];
+        if (campo == CAMPO_IGNOTO) {
+            if (!salta_valore_json(l, &rec->testo)) {
+                return 0;
+            }
+        } else if (c == '"') {
+            rec->inizio[campo] = (long)rec->testo.usati;
+            rec->numerico[campo] = 0;
+            if (!leggi_stringa_json(l, &rec->testo)) {
+                return 0;
+            }
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            // Il numero viene copiato come testo (per i campi di testo) e
+            // convertito con strtod: prezzo e quantità usano il valore
+            size_t inizio = l->pos;
+            while (!fine_file(l) && strchr("+-.eE0123456789", l->dati[l->pos]) != NULL) {
+                l->pos++;
+            }
+            rec->inizio[campo] = (long)rec->testo.usati;
+            if (!buffer_aggiungi(&rec->testo, l->dati + inizio, l->pos - inizio) || !buffer_chiudi(&rec->testo)) {
+                return 0;
+            }
+            const char *testo = rec->testo.dati + rec->inizio[campo];
+            char *fine;
+            errno = 0;
+            double valore = strtod(testo, &fine);
+            if (*fine != '\0' || fine == testo || errno == ERANGE || !isfinite(valore)) {
+                if (!rec->errore) {
+                    rec->errore = "numero non valido";
+                }
+            } else {
+                rec->numerico[campo] = 1;
+                rec->numero[campo] = valore;
+            }
+        } else if (l->dimensione - l->pos >= 4 && memcmp(l->dati + l->pos, "null", 4) == 0) {
+            l->pos += 4;
+        } else {
+            if (!salta_valore_json(l, &rec->testo)) {
+                return 0;
+            }
+            if (!rec->errore) {
+                rec->errore = "valore non ammesso (servono testo o numeri)";
+            }
+        }
+
+        salta_spazi_json(l);
+        if (fine_file(l)) {
+            return 0;
+        }
+        c = l->dati[l->pos++];
+        if (c == '}') {
+            return 1;
+        }
+        if (c != ',') {
+            return 0;
+        }
+    }
+}
+
+static int importa_json(Importazione *imp, Lettore *l, char *errore, size_t dim_errore) {
+    Record rec = {0};
+    int rc = SQLITE_OK;
+    int sintassi = 1;
+
+    salta_spazi_json(l);
+    int array = !fine_file(l) && l->dati[l->pos] == '[';
+    if (array) {
+        l->pos++;
+    }
+
+    while (rc == SQLITE_OK) {
+        salta_spazi_json(l);
+        if (fine_file(l)) {
+            // Un array deve essere chiuso
+            sintassi = !array;
+            break;
+        }
+        if (array && l->dati[l->pos] == ']') {
+            l->pos++;
+            break;
+        }
+
+        long riga = l->riga;
+        if (l->dati[l->pos] != '{' || !leggi_oggetto_json(l, &rec)) {
+            if (array) {
+                // In un array non si può riprendere la lettura dopo un errore
+                sintassi = 0;
+                rec.riga = riga;
+                break;
+            }
+            // JSON Lines: si scarta la riga e si prosegue con la successiva
+            imp->esito->righe_lette++;
+            segnala(imp, riga, "JSON non valido");
+            const char *a_capo = memchr(l->dati + l->pos, '\n', l->dimensione - l->pos);
+            l->pos = a_capo ? (size_t)(a_capo - l->dati) : l->dimensione;
+            l->riga = riga;
+            continue;
+        }
+        rc = salva_record(imp, &rec);
+        rilascia_letti(l);
+
+        if (array) {
+            salta_spazi_json(l);
+            if (!fine_file(l) && l->dati[l->pos] == ',') {
+                l->pos++;
+            } else if (fine_file(l) || l->dati[l->pos] != ']') {
+                sintassi = 0;
+                rec.riga = l->riga;
+                break;
+            }
+        }
+    }
+
+    if (rc != SQLITE_OK) {
+        imp->errore_db = 1;
+        snprintf(errore, dim_errore, "Errore del database alla riga %ld: %s", rec.riga, repo_errmsg(imp->repo));
+    } else if (!sintassi) {
+        snprintf(errore, dim_errore, "JSON non valido alla riga %ld", rec.riga);
+        rc = SQLITE_ERROR;
+    }
+    free(rec.testo.dati);
+    return rc;
+}
+
+// --- Ingresso ---
+
+static FormatoImportazione riconosci_formato(const char *percorso, const Lettore *l) {
+    const char *estensione = strrchr(percorso, '.');
+    if (estensione) {
+        if (strcasecmp(estensione, ".json") == 0 || strcasecmp(estensione, ".jsonl") == 0 ||
+            strcasecmp(estensione, ".ndjson") == 0) {
+            return IMPORTA_JSON;
+        }
+        if (strcasecmp(estensione, ".csv") == 0 || strcasecmp(estensione, ".tsv") == 0 ||
+            strcasecmp(estensione, ".txt") == 0) {
+            return IMPORTA_CSV;
+        }
+    }
+    for (size_t i = l->pos; i < l->dimensione; i++) {
+        char c = l->dati[i];
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            return (c == '[' || c == '{') ? IMPORTA_JSON : IMPORTA_CSV;
+        }
+    }
+    return IMPORTA_CSV;
+}
+
+int importa_file(Repository *repo, const char *percorso, FormatoImportazione formato,
+                 ImportaErroreCallback on_errore, void *user_data,
+                 EsitoImportazione *esito, char *errore, size_t dim_errore) {
+    memset(esito, 0, sizeof(*esito));
+    errore[0] = '\0';
+
+    int fd = open(percorso, O_RDONLY);
+    if (fd < 0) {
+        snprintf(errore, dim_errore, "Impossibile aprire %s", percorso);
+        return SQLITE_CANTOPEN;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        snprintf(errore, dim_errore, "Il file %s è vuoto", percorso);
+        close(fd);
+        return SQLITE_ERROR;
+    }
+    void *mappa = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mappa == MAP_FAILED) {
+        snprintf(errore, dim_errore, "Impossibile leggere %s", percorso);
+        return SQLITE_IOERR;
+    }
+    // Lettura dall'inizio alla fine: il kernel può leggere in anticipo
+    madvise(mappa, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+    Lettore lettore = { mappa, (size_t)info.st_size, 0, 0, 1 };
+    salta_bom(&lettore);
+    if (formato == IMPORTA_AUTO) {
+        formato = riconosci_formato(percorso, &lettore);
+    }
+
+    Importazione imp = { repo, on_errore, user_data, esito, 0, 0, 0, 0 };
+    int rc = formato == IMPORTA_JSON
+        ? importa_json(&imp, &lettore, errore, dim_errore)
+        : importa_csv(&imp, &lettore, errore, dim_errore);
+
+    // Il blocco in corso viene confermato anche dopo un errore di formato:
+    // le righe lette fin lì erano valide
+    if (imp.in_transazione) {
+        if (!imp.errore_db) {
+            int rc_commit = conferma(&imp);
+            if (rc_commit != SQLITE_OK) {
+                snprintf(errore, dim_errore, "Errore del database: %s", repo_errmsg(repo));
+                rc = rc_commit;
+            }
+        } else {
+            repo_termina_transazione(repo, 0);
+        }
+    }
+    munmap(mappa, (size_t)info.st_size);
+    return rc;
+}
@@ -0,0 +1,46 @@
+#ifndef IMPORTA_H
+#define IMPORTA_H
+
+#include <stddef.h>
+
+#include "repository.h"
+
+// Importazione massiva del catalogo da file CSV o JSON. Il file viene letto
+// in memoria mappata un record alla volta, quindi la memoria usata non
+// dipende dalla sua dimensione.
+//
+// CSV: la prima riga contiene i nomi delle colonne (nome, descrizione,
+// artista, periodo, misure, data_acquisizione, prezzo_acquisto, quantita);
+// separatore virgola, punto e virgola o tabulazione, riconosciuto
+// dall'intestazione. Le colonne sconosciute vengono ignorate.
+// JSON: un array di oggetti oppure un oggetto per riga (JSON Lines), con
+// le stesse chiavi delle colonne CSV.
+
+typedef enum {
+    IMPORTA_AUTO,      // dall'estensione o dal contenuto del file
+    IMPORTA_CSV,
+    IMPORTA_JSON
+} FormatoImportazione;
+
+// Righe per transazione: abbastanza da ammortizzare il commit, senza perdere
+// tutto il lavoro fatto se il database fallisce a metà
+#define IMPORTA_RIGHE_PER_TRANSAZIONE 50000
+
+typedef struct {
+    long righe_lette;       // record trovati nel file, intestazione esclusa
+    long righe_importate;   // record salvati nel database
+    long righe_scartate;    // record non validi, segnalati al callback
+} EsitoImportazione;
+
+// Chiamata per ogni record scartato; riga è la riga del file in cui inizia
+typedef void (*ImportaErroreCallback)(long riga, const char *messaggio, void *user_data);
+
+// Importa il file con il repository di scrittura. I record non validi
+// vengono saltati e segnalati a on_errore (può essere NULL). Restituisce
+// SQLITE_OK se il file è stato letto fino in fondo; altrimenti un codice
+// SQLite e la descrizione in "errore" (i blocchi già confermati restano).
+int importa_file(Repository *repo, const char *percorso, FormatoImportazione formato,
+                 ImportaErroreCallback on_errore, void *user_data,
+                 EsitoImportazione *esito, char *errore, size_t dim_errore);
+
+#endif
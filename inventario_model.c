@@ -0,0 +1,971 @@
+#include "inventario_model.h"
+#include "traccia.h"
+
+// Le letture del model avvengono nei thread della CodaLavori: il thread
+// principale chiede le pagine e applica i risultati quando arrivano, senza
+// mai attendere il database. Ogni cambiamento della struttura della lista
+// incrementa "generazione" e i risultati delle richieste precedenti vengono
+// scartati.
+
+// Cursore da cui leggere una pagina (il testo è una copia del model)
+typedef struct {
+    gboolean noto;
+    CursoreLista cursore;
+} CursorePagina;
+
+// Modifica di un articolo accumulata dal registro: stato prima della prima
+// modifica e dopo l'ultima (ha_* = FALSE se la riga non esisteva)
+typedef struct {
+    gint64 id;
+    gboolean ha_vecchio;
+    gint vecchio_venduto;
+    gboolean ha_nuovo;
+    gint nuovo_venduto;
+    gint posizione;
+} Modifica;
+
+// Nelle righe in cache i testi NULL sono vuoti, come la chiave di
+// ordinamento (vedi repo_cursore_riga); foto resta NULL se non ce ne sono
+typedef struct {
+    gint indice;
+    gint n_righe;
+    gint64 versione;       // versione del registro modifiche al momento della lettura
+    RigaInventario righe[INV_PAGINA_RIGHE];
+    GStringChunk *testi;   // tutte le stringhe della pagina, liberate insieme
+    GList lru;             // nodo nella coda LRU (data = pagina)
+} Pagina;
+
+struct _InventarioModel {
+    GObject parent_instance;
+
+    CodaLavori *coda;
+
+    gint stamp;
+    gint n_righe;
+    gint64 versione;       // ultima versione del registro modifiche già applicata
+    guint generazione;
+
+    GHashTable *pagine;    // indice pagina -> Pagina*
+    GQueue lru;            // in testa la pagina usata più di recente
+    GArray *cursori;       // cursori[p] = CursorePagina che precede la prima riga della pagina p
+    GHashTable *posizioni; // articolo_id -> indice di riga, per le righe in cache
+    GHashTable *richieste; // pagine in caricamento
+
+    GCancellable *annulla_aggiornamento;  // ricarica o modifiche in corso
+    GCancellable *annulla_pagine;         // pagine richieste nella generazione attuale
+    gint in_corso;                        // letture in corso
+
+    CriteriLista criteri;      // ordinamento e filtri, con i testi copiati
+    gchar *ricerca;            // testo cercato, NULL per la lista completa
+    gboolean ricerca_ordinata; // risultati per rilevanza o colonna, non dai più recenti
+    gboolean attende_conteggio; // modalità cambiata, conteggio non ancora arrivato
+
+    gint finestra_prima;
+    gint finestra_ultima;
+};
+
+enum {
+    SEGNALE_CARICAMENTO,
+    N_SEGNALI
+};
+static guint segnali[N_SEGNALI];
+
+static void inventario_model_tree_model_init(GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(InventarioModel, inventario_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, inventario_model_tree_model_init))
+
+static const GType tipi_colonne[INV_N_COLONNE] = {
+    G_TYPE_INT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+    G_TYPE_STRING, G_TYPE_INT, G_TYPE_DOUBLE, G_TYPE_STRING, G_TYPE_STRING
+};
+
+// --- Letture in corso ---
+
+static void inizia_lettura(InventarioModel *model) {
+    if (model->in_corso++ == 0) {
+        g_signal_emit(model, segnali[SEGNALE_CARICAMENTO], 0, TRUE);
+    }
+}
+
+static void fine_lettura(InventarioModel *model) {
+    if (--model->in_corso == 0) {
+        g_signal_emit(model, segnali[SEGNALE_CARICAMENTO], 0, FALSE);
+    }
+}
+
+// --- Gestione della cache delle pagine ---
+
+static void pagina_free(gpointer data) {
+    Pagina *pagina = data;
+    g_string_chunk_free(pagina->testi);
+    g_free(pagina);
+}
+
+static void svuota_cache(InventarioModel *model) {
+    // I nodi della coda sono dentro le pagine: basta reinizializzarla
+    g_queue_init(&model->lru);
+    g_hash_table_remove_all(model->pagine);
+    g_hash_table_remove_all(model->posizioni);
+    g_hash_table_remove_all(model->richieste);
+}
+
+static gint n_pagine(InventarioModel *model) {
+    return (model->n_righe + INV_PAGINA_RIGHE - 1) / INV_PAGINA_RIGHE;
+}
+
+// --- Criteri e cursori ---
+
+static void copia_criteri(CriteriLista *copia, const CriteriLista *criteri) {
+    *copia = *criteri;
+    copia->artista = g_strdup(criteri->artista);
+    copia->periodo = g_strdup(criteri->periodo);
+}
+
+static void libera_criteri(CriteriLista *criteri) {
+    g_free((gchar *)criteri->artista);
+    g_free((gchar *)criteri->periodo);
+}
+
+static gboolean criteri_uguali(const CriteriLista *a, const CriteriLista *b) {
+    return a->ordine == b->ordine && !a->decrescente == !b->decrescente &&
+           a->venduto == b->venduto &&
+           g_strcmp0(a->artista, b->artista) == 0 && g_strcmp0(a->periodo, b->periodo) == 0 &&
+           a->prezzo_min == b->prezzo_min && a->prezzo_max == b->prezzo_max;
+}
+
+// Lista completa nell'ordine predefinito: l'unica in cui le posizioni delle
+// righe cambiate si ricavano dal registro delle modifiche
+static gboolean lista_predefinita(InventarioModel *model) {
+    return model->criteri.ordine == ORDINE_STATO && !model->criteri.decrescente &&
+           !repo_criteri_filtrano(&model->criteri);
+}
+
+static void cursore_pagina_clear(gpointer data) {
+    CursorePagina *c = data;
+    g_free((gchar *)c->cursore.testo);
+    c->cursore.testo = NULL;
+}
+
+// Dimensiona l'array dei cursori e li segna tutti come ignoti tranne il primo
+static void azzera_cursori(InventarioModel *model) {
+    g_array_set_size(model->cursori, 0);
+    g_array_set_size(model->cursori, n_pagine(model) + 1);
+    CursorePagina *primo = &g_array_index(model->cursori, CursorePagina, 0);
+    primo->noto = TRUE;
+    primo->cursore.inizio = 1;
+}
+
+// Cursore della pagina p dalla riga che la precede o, se "prima_della_riga",
+// dalla sua prima riga: l'ID viene spostato di uno indietro nell'ordine,
+// così la lettura riparte proprio da quella riga
+static void imposta_cursore(InventarioModel *model, gint p, const RigaInventario *riga,
+                            gboolean prima_della_riga) {
+    if (p < 0 || (guint)p >= model->cursori->len) {
+        return;
+    }
+    CursorePagina *c = &g_array_index(model->cursori, CursorePagina, p);
+    cursore_pagina_clear(c);
+    gboolean decrescente = model->criteri.decrescente;
+    if (model->ricerca) {
+        repo_cursore_ricerca(&model->criteri, model->ricerca_ordinata, riga, &c->cursore);
+        decrescente = repo_ricerca_decrescente(&model->criteri, model->ricerca_ordinata);
+    } else {
+        repo_cursore_riga(&model->criteri, riga, &c->cursore);
+    }
+    c->cursore.testo = g_strdup(c->cursore.testo);
+    if (prima_della_riga) {
+        c->cursore.articolo_id += decrescente ? 1 : -1;
+    }
+    c->noto = TRUE;
+}
+
+// Cambia la struttura della lista: cache e richieste in corso non valgono più
+static void nuova_generazione(InventarioModel *model) {
+    model->generazione++;
+    svuota_cache(model);
+    azzera_cursori(model);
+
+    if (model->annulla_pagine) {
+        g_cancellable_cancel(model->annulla_pagine);
+        g_object_unref(model->annulla_pagine);
+    }
+    model->annulla_pagine = g_cancellable_new();
+}
+
+// --- Caricamento asincrono delle pagine ---
+
+typedef struct {
+    InventarioModel *model;
+    guint generazione;
+    gint indice;
+    CriteriLista criteri;
+    CursoreLista cursore;
+    gint salta;
+    gchar *ricerca;            // se impostato la pagina viene dai risultati della ricerca
+    gboolean ricerca_ordinata;
+} RichiestaPagina;
+
+static void richiesta_pagina_free(RichiestaPagina *richiesta) {
+    libera_criteri(&richiesta->criteri);
+    g_free((gchar *)richiesta->cursore.testo);
+    g_free(richiesta->ricerca);
+    g_free(richiesta);
+}
+
+static const gchar *copia_testo(GStringChunk *testi, const char *testo) {
+    return testo ? g_string_chunk_insert(testi, testo) : "";
+}
+
+static void aggiungi_riga(const RigaInventario *letta, void *user_data) {
+    Pagina *pagina = user_data;
+    if (pagina->n_righe >= INV_PAGINA_RIGHE) {
+        return;
+    }
+    RigaInventario *riga = &pagina->righe[pagina->n_righe++];
+    riga->articolo_id = letta->articolo_id;
+    riga->nome = copia_testo(pagina->testi, letta->nome);
+    riga->artista = copia_testo(pagina->testi, letta->artista);
+    riga->periodo = copia_testo(pagina->testi, letta->periodo);
+    riga->misure = copia_testo(pagina->testi, letta->misure);
+    riga->quantita = letta->quantita;
+    riga->prezzo_acquisto = letta->prezzo_acquisto;
+    riga->venduto = letta->venduto;
+    riga->foto = letta->foto ? g_string_chunk_insert_const(pagina->testi, letta->foto) : NULL;
+    riga->rilevanza = letta->rilevanza;
+}
+
+// Thread di lavoro: legge la pagina partendo dal cursore indicato
+static gpointer lavoro_pagina(Repository *repo, gpointer dati, GCancellable *annulla) {
+    RichiestaPagina *richiesta = dati;
+    Pagina *pagina = g_new0(Pagina, 1);
+    pagina->indice = richiesta->indice;
+    pagina->testi = g_string_chunk_new(4096);
+    pagina->lru.data = pagina;
+
+    if (richiesta->ricerca) {
+        repo_cerca_pagina(repo, richiesta->ricerca, &richiesta->criteri, richiesta->ricerca_ordinata,
+                          &richiesta->cursore, richiesta->salta, INV_PAGINA_RIGHE,
+                          aggiungi_riga, pagina);
+    } else {
+        // La versione letta insieme alle righe dice se la pagina comprende
+        // già modifiche non ancora applicate al model
+        repo_inizia_snapshot(repo);
+        repo_query_page(repo, &richiesta->criteri, &richiesta->cursore,
+                        richiesta->salta, INV_PAGINA_RIGHE, aggiungi_riga, pagina);
+        pagina->versione = repo_versione_modifiche(repo);
+        repo_chiudi_snapshot(repo);
+    }
+    return pagina;
+}
+
+static void inserisci_pagina(InventarioModel *model, Pagina *pagina) {
+    gint p = pagina->indice;
+
+    if (g_hash_table_size(model->pagine) >= INV_PAGINE_CACHE) {
+        GList *vecchia = g_queue_pop_tail_link(&model->lru);
+        Pagina *da_togliere = vecchia->data;
+        for (gint i = 0; i < da_togliere->n_righe; i++) {
+            g_hash_table_remove(model->posizioni, GINT_TO_POINTER(da_togliere->righe[i].articolo_id));
+        }
+        g_hash_table_remove(model->pagine, GINT_TO_POINTER(da_togliere->indice));
+    }
+    g_hash_table_insert(model->pagine, GINT_TO_POINTER(p), pagina);
+    g_queue_push_head_link(&model->lru, &pagina->lru);
+
+    for (gint i = 0; i < pagina->n_righe; i++) {
+        g_hash_table_insert(model->posizioni, GINT_TO_POINTER(pagina->righe[i].articolo_id),
+                            GINT_TO_POINTER(p * INV_PAGINA_RIGHE + i));
+    }
+
+    // I bordi della pagina diventano cursori per le pagine vicine
+    if (pagina->n_righe > 0) {
+        if (p > 0) {
+            imposta_cursore(model, p, &pagina->righe[0], TRUE);
+        }
+        imposta_cursore(model, p + 1, &pagina->righe[pagina->n_righe - 1], FALSE);
+    }
+}
+
+static void emetti_cambiate(InventarioModel *model, gint da, gint a) {
+    GtkTreeIter iter;
+    for (gint i = MAX(da, 0); i <= MIN(a, model->n_righe - 1); i++) {
+        iter.stamp = model->stamp;
+        iter.user_data = GINT_TO_POINTER(i);
+        GtkTreePath *path = gtk_tree_path_new_from_indices(i, -1);
+        gtk_tree_model_row_changed(GTK_TREE_MODEL(model), path, &iter);
+        gtk_tree_path_free(path);
+    }
+}
+
+static void pagina_caricata(gpointer risultato, gboolean annullato, gpointer dati) {
+    RichiestaPagina *richiesta = dati;
+    InventarioModel *model = richiesta->model;
+    Pagina *pagina = risultato;
+
+    if (!annullato && pagina && richiesta->generazione == model->generazione) {
+        guint64 inizio = traccia_inizio();
+        g_hash_table_remove(model->richieste, GINT_TO_POINTER(richiesta->indice));
+        inserisci_pagina(model, pagina);
+        // Le righe mostrate come "in caricamento" vanno ridisegnate
+        emetti_cambiate(model, richiesta->indice * INV_PAGINA_RIGHE,
+                        richiesta->indice * INV_PAGINA_RIGHE + pagina->n_righe - 1);
+        traccia_fine("ui", "pagina_inserita", inizio, pagina->n_righe, 0);
+    } else if (pagina) {
+        pagina_free(pagina);
+    }
+
+    fine_lettura(model);
+    g_object_unref(model);
+    richiesta_pagina_free(richiesta);
+}
+
+// Chiede al thread di lavoro la pagina p, se non è già in caricamento
+static void richiedi_pagina(InventarioModel *model, gint p) {
+    if (model->attende_conteggio || g_hash_table_contains(model->richieste, GINT_TO_POINTER(p))) {
+        return;
+    }
+    g_hash_table_add(model->richieste, GINT_TO_POINTER(p));
+
+    // Parte dal cursore noto più vicino e salta le pagine intermedie
+    // (durante l'emissione dei segnali i cursori possono essere meno delle pagine)
+    gint q = MIN(p, (gint)model->cursori->len - 1);
+    while (q > 0 && !g_array_index(model->cursori, CursorePagina, q).noto) {
+        q--;
+    }
+
+    RichiestaPagina *richiesta = g_new0(RichiestaPagina, 1);
+    richiesta->model = g_object_ref(model);
+    richiesta->generazione = model->generazione;
+    richiesta->indice = p;
+    copia_criteri(&richiesta->criteri, &model->criteri);
+    richiesta->cursore = g_array_index(model->cursori, CursorePagina, q).cursore;
+    richiesta->cursore.testo = g_strdup(richiesta->cursore.testo);
+    richiesta->salta = (p - q) * INV_PAGINA_RIGHE;
+    richiesta->ricerca = g_strdup(model->ricerca);
+    richiesta->ricerca_ordinata = model->ricerca_ordinata;
+
+    inizia_lettura(model);
+    coda_lavori_leggi(model->coda, lavoro_pagina, pagina_caricata, richiesta, model->annulla_pagine);
+}
+
+// Restituisce la pagina p se in cache, altrimenti ne chiede il caricamento
+static Pagina *trova_pagina(InventarioModel *model, gint p) {
+    Pagina *pagina = g_hash_table_lookup(model->pagine, GINT_TO_POINTER(p));
+    if (pagina) {
+        g_queue_unlink(&model->lru, &pagina->lru);
+        g_queue_push_head_link(&model->lru, &pagina->lru);
+        return pagina;
+    }
+    richiedi_pagina(model, p);
+    return NULL;
+}
+
+static RigaInventario *trova_riga(InventarioModel *model, gint indice) {
+    if (indice < 0 || indice >= model->n_righe) {
+        return NULL;
+    }
+    Pagina *pagina = trova_pagina(model, indice / INV_PAGINA_RIGHE);
+    if (!pagina) {
+        return NULL;
+    }
+    gint offset = indice % INV_PAGINA_RIGHE;
+    // La tabella può essere cambiata da un altro processo dopo il conteggio
+    return offset < pagina->n_righe ? &pagina->righe[offset] : NULL;
+}
+
+static gboolean chiave_minore(gint venduto_a, gint64 id_a, gint venduto_b, gint64 id_b) {
+    return venduto_a < venduto_b || (venduto_a == venduto_b && id_a < id_b);
+}
+
+// --- Interfaccia GtkTreeModel ---
+
+static gboolean iter_valido(InventarioModel *model, GtkTreeIter *iter) {
+    return iter->stamp == model->stamp;
+}
+
+static void imposta_iter(InventarioModel *model, GtkTreeIter *iter, gint indice) {
+    iter->stamp = model->stamp;
+    iter->user_data = GINT_TO_POINTER(indice);
+    iter->user_data2 = NULL;
+    iter->user_data3 = NULL;
+}
+
+static GtkTreeModelFlags inv_get_flags(GtkTreeModel *tree_model) {
+    return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint inv_get_n_columns(GtkTreeModel *tree_model) {
+    return INV_N_COLONNE;
+}
+
+static GType inv_get_column_type(GtkTreeModel *tree_model, gint index) {
+    g_return_val_if_fail(index >= 0 && index < INV_N_COLONNE, G_TYPE_INVALID);
+    return tipi_colonne[index];
+}
+
+static gboolean inv_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path) {
+    InventarioModel *model = INVENTARIO_MODEL(tree_model);
+    if (gtk_tree_path_get_depth(path) != 1) {
+        return FALSE;
+    }
+    gint indice = gtk_tree_path_get_indices(path)[0];
+    if (indice < 0 || indice >= model->n_righe) {
+        return FALSE;
+    }
+    imposta_iter(model, iter, indice);
+    return TRUE;
+}
+
+static GtkTreePath *inv_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    g_return_val_if_fail(iter_valido(INVENTARIO_MODEL(tree_model), iter), NULL);
+    return gtk_tree_path_new_from_indices(GPOINTER_TO_INT(iter->user_data), -1);
+}
+
+static void inv_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value) {
+    InventarioModel *model = INVENTARIO_MODEL(tree_model);
+    g_return_if_fail(column >= 0 && column < INV_N_COLONNE);
+    g_value_init(value, tipi_colonne[column]);
+
+    if (!iter_valido(model, iter)) {
+        return;
+    }
+    RigaInventario *riga = trova_riga(model, GPOINTER_TO_INT(iter->user_data));
+    if (!riga) {
+        // Pagina in caricamento: la riga verrà ridisegnata quando arriva
+        if (column == INV_COL_NOME) {
+            g_value_set_static_string(value, "…");
+        }
+        return;
+    }
+
+    switch (column) {
+    case INV_COL_ID:       g_value_set_int(value, riga->articolo_id); break;
+    case INV_COL_NOME:     g_value_set_string(value, riga->nome); break;
+    case INV_COL_ARTISTA:  g_value_set_string(value, riga->artista); break;
+    case INV_COL_PERIODO:  g_value_set_string(value, riga->periodo); break;
+    case INV_COL_MISURE:   g_value_set_string(value, riga->misure); break;
+    case INV_COL_QUANTITA: g_value_set_int(value, riga->quantita); break;
+    case INV_COL_PREZZO:   g_value_set_double(value, riga->prezzo_acquisto); break;
+    case INV_COL_STATO:    g_value_set_static_string(value, riga->venduto ? "Venduto" : "Disponibile"); break;
+    case INV_COL_FOTO:     g_value_set_string(value, riga->foto); break;
+    }
+}
+
+static gboolean inv_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    InventarioModel *model = INVENTARIO_MODEL(tree_model);
+    gint indice = GPOINTER_TO_INT(iter->user_data) + 1;
+    if (!iter_valido(model, iter) || indice >= model->n_righe) {
+        iter->stamp = 0;
+        return FALSE;
+    }
+    iter->user_data = GINT_TO_POINTER(indice);
+    return TRUE;
+}
+
+static gboolean inv_iter_previous(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    InventarioModel *model = INVENTARIO_MODEL(tree_model);
+    gint indice = GPOINTER_TO_INT(iter->user_data) - 1;
+    if (!iter_valido(model, iter) || indice < 0) {
+        iter->stamp = 0;
+        return FALSE;
+    }
+    iter->user_data = GINT_TO_POINTER(indice);
+    return TRUE;
+}
+
+static gboolean inv_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent) {
+    InventarioModel *model = INVENTARIO_MODEL(tree_model);
+    if (parent || model->n_righe == 0) {
+        return FALSE;
+    }
+    imposta_iter(model, iter, 0);
+    return TRUE;
+}
+
+static gboolean inv_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    return FALSE;
+}
+
+static gint inv_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    return iter ? 0 : INVENTARIO_MODEL(tree_model)->n_righe;
+}
+
+static gboolean inv_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n) {
+    InventarioModel *model = INVENTARIO_MODEL(tree_model);
+    if (parent || n < 0 || n >= model->n_righe) {
+        return FALSE;
+    }
+    imposta_iter(model, iter, n);
+    return TRUE;
+}
+
+static gboolean inv_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child) {
+    return FALSE;
+}
+
+static void inventario_model_tree_model_init(GtkTreeModelIface *iface) {
+    iface->get_flags = inv_get_flags;
+    iface->get_n_columns = inv_get_n_columns;
+    iface->get_column_type = inv_get_column_type;
+    iface->get_iter = inv_get_iter;
+    iface->get_path = inv_get_path;
+    iface->get_value = inv_get_value;
+    iface->iter_next = inv_iter_next;
+    iface->iter_previous = inv_iter_previous;
+    iface->iter_children = inv_iter_children;
+    iface->iter_has_child = inv_iter_has_child;
+    iface->iter_n_children = inv_iter_n_children;
+    iface->iter_nth_child = inv_iter_nth_child;
+    iface->iter_parent = inv_iter_parent;
+}
+
+// --- Ciclo di vita dell'oggetto ---
+
+static void inventario_model_finalize(GObject *object) {
+    InventarioModel *model = INVENTARIO_MODEL(object);
+    svuota_cache(model);
+    g_hash_table_destroy(model->pagine);
+    g_hash_table_destroy(model->posizioni);
+    g_hash_table_destroy(model->richieste);
+    g_array_free(model->cursori, TRUE);
+    g_clear_object(&model->annulla_aggiornamento);
+    g_clear_object(&model->annulla_pagine);
+    libera_criteri(&model->criteri);
+    g_free(model->ricerca);
+    G_OBJECT_CLASS(inventario_model_parent_class)->finalize(object);
+}
+
+static void inventario_model_class_init(InventarioModelClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = inventario_model_finalize;
+
+    segnali[SEGNALE_CARICAMENTO] =
+        g_signal_new("caricamento", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_LAST,
+                     0, NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+}
+
+static void inventario_model_init(InventarioModel *model) {
+    model->stamp = g_random_int();
+    model->pagine = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, pagina_free);
+    g_queue_init(&model->lru);
+    model->cursori = g_array_new(FALSE, TRUE, sizeof(CursorePagina));
+    g_array_set_clear_func(model->cursori, cursore_pagina_clear);
+    repo_criteri_predefiniti(&model->criteri);
+    model->posizioni = g_hash_table_new(g_direct_hash, g_direct_equal);
+    model->richieste = g_hash_table_new(g_direct_hash, g_direct_equal);
+    model->finestra_prima = 0;
+    model->finestra_ultima = -1;
+}
+
+// --- Conteggio completo ---
+
+typedef struct {
+    InventarioModel *model;
+    CriteriLista criteri;
+    gchar *ricerca;           // testo cercato, NULL per contare tutta la lista
+} RichiestaConteggio;
+
+typedef struct {
+    gint n_righe;
+    gint64 versione;
+} Conteggio;
+
+// Legge numero di righe e versione del registro dallo stesso snapshot,
+// così le modifiche successive vengono applicate una volta sola
+static gpointer lavoro_conteggio(Repository *repo, gpointer dati, GCancellable *annulla) {
+    RichiestaConteggio *richiesta = dati;
+    Conteggio *conteggio = g_new0(Conteggio, 1);
+    repo_inizia_snapshot(repo);
+    if (richiesta->ricerca) {
+        conteggio->n_righe = repo_conta_ricerca(repo, richiesta->ricerca, &richiesta->criteri);
+    } else {
+        conteggio->n_righe = repo_conta_lista(repo, &richiesta->criteri);
+    }
+    conteggio->versione = repo_versione_modifiche(repo);
+    repo_chiudi_snapshot(repo);
+    return conteggio;
+}
+
+InventarioModel *inventario_model_new(CodaLavori *coda) {
+    InventarioModel *model = g_object_new(INVENTARIO_TYPE_MODEL, NULL);
+    model->coda = coda;
+
+    // Il primo conteggio è sincrono: la finestra non è ancora visibile
+    RichiestaConteggio richiesta = { model, model->criteri, NULL };
+    Conteggio *conteggio = coda_lavori_leggi_sincrono(coda, lavoro_conteggio, &richiesta);
+    model->n_righe = conteggio->n_righe;
+    model->versione = conteggio->versione;
+    g_free(conteggio);
+
+    nuova_generazione(model);
+    return model;
+}
+
+static void emetti_riga(InventarioModel *model, gint indice, gboolean inserita) {
+    GtkTreeIter iter;
+    GtkTreePath *path = gtk_tree_path_new_from_indices(indice, -1);
+    if (inserita) {
+        imposta_iter(model, &iter, indice);
+        gtk_tree_model_row_inserted(GTK_TREE_MODEL(model), path, &iter);
+    } else {
+        gtk_tree_model_row_deleted(GTK_TREE_MODEL(model), path);
+    }
+    gtk_tree_path_free(path);
+}
+
+// Notifica solo le righe visibili, le altre verranno lette allo scorrimento
+static void notifica_finestra(InventarioModel *model) {
+    emetti_cambiate(model, model->finestra_prima, model->finestra_ultima);
+}
+
+// Annulla l'aggiornamento in corso, superato da quello nuovo
+static GCancellable *nuovo_aggiornamento(InventarioModel *model) {
+    if (model->annulla_aggiornamento) {
+        g_cancellable_cancel(model->annulla_aggiornamento);
+        g_object_unref(model->annulla_aggiornamento);
+    }
+    model->annulla_aggiornamento = g_cancellable_new();
+    return model->annulla_aggiornamento;
+}
+
+static void conteggio_completato(gpointer risultato, gboolean annullato, gpointer dati) {
+    RichiestaConteggio *richiesta = dati;
+    InventarioModel *model = richiesta->model;
+    Conteggio *conteggio = risultato;
+
+    if (!annullato && conteggio) {
+        guint64 inizio = traccia_inizio();
+        gint vecchio = model->n_righe;
+        gint nuovo = conteggio->n_righe;
+        model->versione = conteggio->versione;
+        // Con troppi risultati l'ordinamento per rilevanza o per colonna
+        // costerebbe una valutazione di tutti i risultati per ogni pagina
+        model->ricerca_ordinata = nuovo <= INV_RICERCA_MAX_ORDINATI;
+        model->attende_conteggio = FALSE;
+        nuova_generazione(model);
+
+        // Il TreeView vede solo la differenza di righe in coda; il contenuto
+        // delle righe restanti viene riletto quando vengono ridisegnate.
+        for (gint i = vecchio - 1; i >= nuovo; i--) {
+            model->n_righe = i;
+            emetti_riga(model, i, FALSE);
+        }
+        for (gint i = vecchio; i < nuovo; i++) {
+            model->n_righe = i + 1;
+            emetti_riga(model, i, TRUE);
+        }
+        model->n_righe = nuovo;
+        azzera_cursori(model);
+        notifica_finestra(model);
+        // Righe notificate al TreeView: differenza più la finestra visibile
+        traccia_fine("ui", "ricostruzione_lista", inizio,
+                     ABS(nuovo - vecchio) + MAX(model->finestra_ultima - model->finestra_prima + 1, 0), 0);
+    }
+
+    g_free(conteggio);
+    fine_lettura(model);
+    g_object_unref(model);
+    libera_criteri(&richiesta->criteri);
+    g_free(richiesta->ricerca);
+    g_free(richiesta);
+}
+
+void inventario_model_ricarica(InventarioModel *model) {
+    g_return_if_fail(INVENTARIO_IS_MODEL(model));
+    RichiestaConteggio *richiesta = g_new0(RichiestaConteggio, 1);
+    richiesta->model = g_object_ref(model);
+    copia_criteri(&richiesta->criteri, &model->criteri);
+    richiesta->ricerca = g_strdup(model->ricerca);
+
+    GCancellable *annulla = nuovo_aggiornamento(model);
+    inizia_lettura(model);
+    coda_lavori_leggi(model->coda, lavoro_conteggio, conteggio_completato, richiesta, annulla);
+}
+
+void inventario_model_imposta_ricerca(InventarioModel *model, const gchar *testo) {
+    g_return_if_fail(INVENTARIO_IS_MODEL(model));
+    gchar *ricerca = g_strstrip(g_strdup(testo ? testo : ""));
+    if (g_utf8_strlen(ricerca, -1) < INV_RICERCA_MIN_CARATTERI) {
+        g_free(ricerca);
+        ricerca = NULL;
+    }
+    if (g_strcmp0(ricerca, model->ricerca) == 0) {
+        g_free(ricerca);
+        return;
+    }
+
+    g_free(model->ricerca);
+    model->ricerca = ricerca;
+    // Le pagine della modalità precedente non servono più; le nuove vengono
+    // chieste quando arriva il conteggio, che annulla quello della ricerca
+    // precedente se ancora in corso
+    model->attende_conteggio = TRUE;
+    nuova_generazione(model);
+    inventario_model_ricarica(model);
+}
+
+void inventario_model_imposta_criteri(InventarioModel *model, const CriteriLista *criteri) {
+    g_return_if_fail(INVENTARIO_IS_MODEL(model));
+    if (criteri_uguali(criteri, &model->criteri)) {
+        return;
+    }
+    // I testi possono essere quelli dei criteri attuali: si copiano prima
+    CriteriLista nuovi;
+    copia_criteri(&nuovi, criteri);
+    libera_criteri(&model->criteri);
+    model->criteri = nuovi;
+    // Come per la ricerca: si riconta e si leggono solo le pagine visibili,
+    // ognuna con una ricerca sull'indice della nuova colonna
+    model->attende_conteggio = TRUE;
+    nuova_generazione(model);
+    inventario_model_ricarica(model);
+}
+
+const CriteriLista *inventario_model_criteri(InventarioModel *model) {
+    g_return_val_if_fail(INVENTARIO_IS_MODEL(model), NULL);
+    return &model->criteri;
+}
+
+void inventario_model_imposta_finestra(InventarioModel *model, gint prima, gint ultima) {
+    g_return_if_fail(INVENTARIO_IS_MODEL(model));
+    model->finestra_prima = prima;
+    model->finestra_ultima = ultima;
+
+    if (model->n_righe == 0) {
+        return;
+    }
+    gint da = MAX(prima - INV_MARGINE_PREFETCH, 0) / INV_PAGINA_RIGHE;
+    gint a = MIN(ultima + INV_MARGINE_PREFETCH, model->n_righe - 1) / INV_PAGINA_RIGHE;
+    for (gint p = da; p <= a; p++) {
+        trova_pagina(model, p);
+    }
+}
+
+// --- Aggiornamento incrementale dal registro delle modifiche ---
+
+typedef struct {
+    InventarioModel *model;
+    gint64 versione;          // versione da cui leggere il registro
+    GHashTable *posizioni;    // articolo_id -> indice, solo righe lette prima delle modifiche
+} RichiestaModifiche;
+
+typedef struct {
+    gint64 versione;          // ultima versione letta
+    gboolean ricarica;        // troppe modifiche: serve un conteggio completo
+    GArray *rimozioni;        // indici da togliere, in ordine decrescente
+    GArray *inserimenti;      // indici da aggiungere, in ordine crescente
+    gint n_righe;             // righe attese dopo le modifiche
+} RisultatoModifiche;
+
+typedef struct {
+    RisultatoModifiche *risultato;
+    GHashTable *modifiche;    // articolo_id -> Modifica
+} LetturaModifiche;
+
+static void accumula_modifica(sqlite3_int64 versione, int articolo_id,
+                              int ha_vecchio, int vecchio_venduto,
+                              int ha_nuovo, int nuovo_venduto,
+                              void *user_data) {
+    LetturaModifiche *lettura = user_data;
+    gint64 id = articolo_id;
+    lettura->risultato->versione = versione;
+
+    Modifica *m = g_hash_table_lookup(lettura->modifiche, &id);
+    if (!m) {
+        m = g_new0(Modifica, 1);
+        m->id = id;
+        m->ha_vecchio = ha_vecchio;
+        m->vecchio_venduto = vecchio_venduto;
+        g_hash_table_insert(lettura->modifiche, &m->id, m);
+    }
+    m->ha_nuovo = ha_nuovo;
+    m->nuovo_venduto = nuovo_venduto;
+}
+
+static gint confronta_posizione_desc(gconstpointer a, gconstpointer b) {
+    return (*(Modifica * const *)b)->posizione - (*(Modifica * const *)a)->posizione;
+}
+
+static gint confronta_posizione_asc(gconstpointer a, gconstpointer b) {
+    return (*(Modifica * const *)a)->posizione - (*(Modifica * const *)b)->posizione;
+}
+
+// Thread di lavoro: legge il registro, accorpa le modifiche per articolo e
+// calcola gli indici da togliere e aggiungere nella lista
+static gpointer lavoro_modifiche(Repository *repo, gpointer dati, GCancellable *annulla) {
+    RichiestaModifiche *richiesta = dati;
+    RisultatoModifiche *risultato = g_new0(RisultatoModifiche, 1);
+    risultato->versione = richiesta->versione;
+    risultato->rimozioni = g_array_new(FALSE, FALSE, sizeof(gint));
+    risultato->inserimenti = g_array_new(FALSE, FALSE, sizeof(gint));
+
+    LetturaModifiche lettura;
+    lettura.risultato = risultato;
+    lettura.modifiche = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, g_free);
+
+    repo_inizia_snapshot(repo);
+    repo_leggi_modifiche(repo, richiesta->versione, accumula_modifica, &lettura);
+
+    if (g_hash_table_size(lettura.modifiche) > INV_MAX_MODIFICHE) {
+        // Troppe modifiche (es. importazione esterna): conviene ricaricare
+        risultato->ricarica = TRUE;
+        repo_chiudi_snapshot(repo);
+        g_hash_table_destroy(lettura.modifiche);
+        return risultato;
+    }
+
+    GPtrArray *rimosse = g_ptr_array_new();
+    GPtrArray *inserite = g_ptr_array_new();
+    GHashTableIter it;
+    gpointer valore;
+    g_hash_table_iter_init(&it, lettura.modifiche);
+    while (g_hash_table_iter_next(&it, NULL, &valore)) {
+        Modifica *m = valore;
+        // Se la chiave non cambia la riga resta al suo posto: basta ridisegnarla
+        if (m->ha_vecchio && m->ha_nuovo && m->vecchio_venduto == m->nuovo_venduto) {
+            continue;
+        }
+        if (m->ha_vecchio) {
+            g_ptr_array_add(rimosse, m);
+        }
+        if (m->ha_nuovo) {
+            g_ptr_array_add(inserite, m);
+        }
+    }
+
+    // Posizione prima delle modifiche: dalla cache se la riga era stata
+    // letta prima delle modifiche, altrimenti dal conteggio attuale
+    // corretto con le righe spostate
+    for (guint i = 0; i < rimosse->len; i++) {
+        Modifica *m = g_ptr_array_index(rimosse, i);
+        gpointer pos;
+        if (g_hash_table_lookup_extended(richiesta->posizioni, GINT_TO_POINTER((gint)m->id), NULL, &pos)) {
+            m->posizione = GPOINTER_TO_INT(pos);
+            continue;
+        }
+        gint n = repo_conta_precedenti(repo, m->vecchio_venduto, m->id);
+        for (guint j = 0; j < inserite->len; j++) {
+            Modifica *a = g_ptr_array_index(inserite, j);
+            if (chiave_minore(a->nuovo_venduto, a->id, m->vecchio_venduto, m->id)) {
+                n--;
+            }
+        }
+        for (guint j = 0; j < rimosse->len; j++) {
+            Modifica *r = g_ptr_array_index(rimosse, j);
+            if (chiave_minore(r->vecchio_venduto, r->id, m->vecchio_venduto, m->id)) {
+                n++;
+            }
+        }
+        m->posizione = n;
+    }
+    // Le rimozioni vanno dal fondo così gli indici restanti non si spostano
+    g_ptr_array_sort(rimosse, confronta_posizione_desc);
+    for (guint i = 0; i < rimosse->len; i++) {
+        Modifica *m = g_ptr_array_index(rimosse, i);
+        g_array_append_val(risultato->rimozioni, m->posizione);
+    }
+
+    // Posizione dopo le modifiche, inserite in ordine crescente
+    for (guint i = 0; i < inserite->len; i++) {
+        Modifica *m = g_ptr_array_index(inserite, i);
+        m->posizione = repo_conta_precedenti(repo, m->nuovo_venduto, m->id);
+    }
+    g_ptr_array_sort(inserite, confronta_posizione_asc);
+    for (guint i = 0; i < inserite->len; i++) {
+        Modifica *m = g_ptr_array_index(inserite, i);
+        g_array_append_val(risultato->inserimenti, m->posizione);
+    }
+
+    risultato->n_righe = repo_conta_articoli(repo);
+    repo_chiudi_snapshot(repo);
+
+    g_ptr_array_free(rimosse, TRUE);
+    g_ptr_array_free(inserite, TRUE);
+    g_hash_table_destroy(lettura.modifiche);
+    return risultato;
+}
+
+static void risultato_modifiche_free(RisultatoModifiche *risultato) {
+    if (!risultato) {
+        return;
+    }
+    g_array_free(risultato->rimozioni, TRUE);
+    g_array_free(risultato->inserimenti, TRUE);
+    g_free(risultato);
+}
+
+static void modifiche_completate(gpointer dati_risultato, gboolean annullato, gpointer dati) {
+    RichiestaModifiche *richiesta = dati;
+    RisultatoModifiche *risultato = dati_risultato;
+    InventarioModel *model = richiesta->model;
+
+    if (annullato || !risultato) {
+        // Superato da un aggiornamento più recente
+    } else if (richiesta->versione != model->versione) {
+        // Nel frattempo è stato applicato un altro aggiornamento: si ricomincia
+        inventario_model_applica_modifiche(model);
+    } else if (risultato->ricarica) {
+        inventario_model_ricarica(model);
+    } else {
+        guint64 inizio = traccia_inizio();
+        for (guint i = 0; i < risultato->rimozioni->len && model->n_righe > 0; i++) {
+            gint pos = g_array_index(risultato->rimozioni, gint, i);
+            model->n_righe--;
+            emetti_riga(model, CLAMP(pos, 0, model->n_righe), FALSE);
+        }
+        for (guint i = 0; i < risultato->inserimenti->len; i++) {
+            gint pos = g_array_index(risultato->inserimenti, gint, i);
+            model->n_righe++;
+            emetti_riga(model, CLAMP(pos, 0, model->n_righe - 1), TRUE);
+        }
+        model->versione = risultato->versione;
+        nuova_generazione(model);
+
+        if (risultato->n_righe != model->n_righe) {
+            // Registro incompleto (es. potato): si riallinea con un conteggio completo
+            inventario_model_ricarica(model);
+        } else {
+            notifica_finestra(model);
+        }
+        traccia_fine("ui", "modifiche_applicate", inizio,
+                     risultato->rimozioni->len + risultato->inserimenti->len, 0);
+    }
+
+    risultato_modifiche_free(risultato);
+    g_hash_table_destroy(richiesta->posizioni);
+    g_free(richiesta);
+    fine_lettura(model);
+    g_object_unref(model);
+}
+
+void inventario_model_applica_modifiche(InventarioModel *model) {
+    g_return_if_fail(INVENTARIO_IS_MODEL(model));
+
+    // Le posizioni dei risultati di una ricerca o di una lista ordinata per
+    // un'altra colonna o filtrata non si possono calcolare dal registro:
+    // si riconta
+    if (model->ricerca || model->attende_conteggio || !lista_predefinita(model)) {
+        inventario_model_ricarica(model);
+        return;
+    }
+
+    RichiestaModifiche *richiesta = g_new0(RichiestaModifiche, 1);
+    richiesta->model = g_object_ref(model);
+    richiesta->versione = model->versione;
+    richiesta->posizioni = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GHashTableIter it;
+    gpointer chiave, valore;
+    g_hash_table_iter_init(&it, model->posizioni);
+    while (g_hash_table_iter_next(&it, &chiave, &valore)) {
+        // Una pagina letta dopo una modifica può avere già l'ordine nuovo
+        Pagina *pagina = g_hash_table_lookup(model->pagine,
+                                             GINT_TO_POINTER(GPOINTER_TO_INT(valore) / INV_PAGINA_RIGHE));
+        if (pagina && pagina->versione <= model->versione) {
+            g_hash_table_insert(richiesta->posizioni, chiave, valore);
+        }
+    }
+
+    GCancellable *annulla = nuovo_aggiornamento(model);
+    inizia_lettura(model);
+    coda_lavori_leggi(model->coda, lavoro_modifiche, modifiche_completate, richiesta, annulla);
+}
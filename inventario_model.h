@@ -0,0 +1,72 @@
+#ifndef INVENTARIO_MODEL_H
+#define INVENTARIO_MODEL_H
+
+#include <gtk/gtk.h>
+
+#include "lavori.h"
+
+G_BEGIN_DECLS
+
+// Colonne esposte dal model (stesso ordine delle colonne di testo del
+// TreeView); INV_COL_FOTO è l'hash della foto principale, NULL se manca
+enum {
+    INV_COL_ID,
+    INV_COL_NOME,
+    INV_COL_ARTISTA,
+    INV_COL_PERIODO,
+    INV_COL_MISURE,
+    INV_COL_QUANTITA,
+    INV_COL_PREZZO,
+    INV_COL_STATO,
+    INV_COL_FOTO,
+    INV_N_COLONNE
+};
+
+// Righe caricate per ogni pagina e numero massimo di pagine in cache
+#define INV_PAGINA_RIGHE   256
+#define INV_PAGINE_CACHE   16
+// Righe extra caricate sopra e sotto la parte visibile
+#define INV_MARGINE_PREFETCH 128
+// Oltre questo numero di articoli modificati si ricarica tutta la lista
+#define INV_MAX_MODIFICHE 512
+// Oltre questo numero di risultati la ricerca li mostra dal più recente
+// invece che per rilevanza o per la colonna scelta
+#define INV_RICERCA_MAX_ORDINATI 10000
+// Lunghezza minima del testo cercato
+#define INV_RICERCA_MIN_CARATTERI 2
+
+#define INVENTARIO_TYPE_MODEL (inventario_model_get_type())
+G_DECLARE_FINAL_TYPE(InventarioModel, inventario_model, INVENTARIO, MODEL, GObject)
+
+// Crea un model virtuale sulla tabella articoli: le righe vengono lette
+// dal DB a pagine solo quando il TreeView le richiede, nei thread della
+// coda. Finché una pagina non arriva le sue righe sono vuote.
+// Il segnale "caricamento" (gboolean) indica se ci sono letture in corso.
+InventarioModel *inventario_model_new(CodaLavori *coda);
+
+// Ricalcola il numero di righe e svuota la cache delle pagine.
+// Annulla la ricarica o l'aggiornamento precedente ancora in corso.
+void inventario_model_ricarica(InventarioModel *model);
+
+// Applica al TreeView solo gli articoli cambiati dall'ultima lettura,
+// leggendo il registro articoli_modifiche tenuto dai trigger
+void inventario_model_applica_modifiche(InventarioModel *model);
+
+// Mostra solo gli articoli che contengono tutte le parole del testo (anche
+// come inizio di parola) in nome, descrizione, artista o periodo. Un testo
+// più corto di INV_RICERCA_MIN_CARATTERI o NULL torna alla lista completa.
+void inventario_model_imposta_ricerca(InventarioModel *model, const gchar *testo);
+
+// Ordina e filtra la lista (e i risultati della ricerca) con i criteri
+// indicati, copiati dal model: si rilegge il conteggio e poi solo le pagine
+// visibili. Con criteri diversi da quelli predefiniti ogni aggiornamento
+// riconta invece di applicare le singole modifiche.
+void inventario_model_imposta_criteri(InventarioModel *model, const CriteriLista *criteri);
+const CriteriLista *inventario_model_criteri(InventarioModel *model);
+
+// Precarica le pagine che coprono le righe [prima, ultima] più il margine
+void inventario_model_imposta_finestra(InventarioModel *model, gint prima, gint ultima);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,181 @@
+#include "lavori.h"
+#include "traccia.h"
+
+// Istruzioni della VM di SQLite tra due controlli di annullamento
+#define PASSI_CONTROLLO_ANNULLA 1000
+
+struct CodaLavori {
+    GThreadPool *letture;
+    GThreadPool *scritture;
+    Repository *scrittura;
+    PoolLetture *pool;
+    GAsyncQueue *repo_liberi;   // repository delle connessioni di lettura non in uso
+    GPtrArray *repo_letture;    // tutti i repository di lettura, per la chiusura
+    GCancellable *chiusura;     // attivato da coda_lavori_free
+};
+
+typedef struct {
+    CodaLavori *coda;
+    LavoroFunc esegui;
+    LavoroCompletato completato;
+    gpointer dati;
+    GCancellable *annulla;
+    gpointer risultato;
+    guint64 accodato;        // istanti per la traccia, 0 se non attiva
+    guint64 pronto;
+} Lavoro;
+
+// Annullato dal chiamante o dalla chiusura della coda
+static gboolean lavoro_annullato(Lavoro *lavoro) {
+    return (lavoro->annulla && g_cancellable_is_cancelled(lavoro->annulla)) ||
+           g_cancellable_is_cancelled(lavoro->coda->chiusura);
+}
+
+static gboolean completa_lavoro(gpointer user_data) {
+    Lavoro *lavoro = user_data;
+    gboolean annullato = lavoro_annullato(lavoro);
+    // Attesa del risultato nel ciclo GTK: cresce quando il thread principale è occupato
+    traccia_fine("coda", "attesa_completamento", lavoro->pronto, -1, 0);
+    guint64 inizio = traccia_inizio();
+    if (lavoro->completato) {
+        lavoro->completato(lavoro->risultato, annullato, lavoro->dati);
+    }
+    traccia_fine("lavoro", "completamento", inizio, -1, 0);
+    g_clear_object(&lavoro->annulla);
+    g_free(lavoro);
+    return G_SOURCE_REMOVE;
+}
+
+// Callback di avanzamento di SQLite: un valore non nullo interrompe la query
+static int controlla_annullamento(void *user_data) {
+    return lavoro_annullato(user_data);
+}
+
+static void esegui_lettura(gpointer data, gpointer user_data) {
+    Lavoro *lavoro = data;
+    CodaLavori *coda = user_data;
+    traccia_nome_thread("lettura");
+    traccia_fine("coda", "attesa_lettura", lavoro->accodato, -1, 0);
+    guint64 inizio = traccia_inizio();
+
+    if (!lavoro_annullato(lavoro)) {
+        Repository *repo = g_async_queue_pop(coda->repo_liberi);
+        sqlite3 *db = repo_db(repo);
+        // Anche le letture senza "annulla" si interrompono alla chiusura
+        sqlite3_progress_handler(db, PASSI_CONTROLLO_ANNULLA, controlla_annullamento, lavoro);
+        lavoro->risultato = lavoro->esegui(repo, lavoro->dati, lavoro->annulla);
+        sqlite3_progress_handler(db, 0, NULL, NULL);
+        g_async_queue_push(coda->repo_liberi, repo);
+    }
+    traccia_fine("lavoro", "lettura", inizio, -1, 0);
+    lavoro->pronto = traccia_inizio();
+    g_idle_add(completa_lavoro, lavoro);
+}
+
+static void esegui_scrittura(gpointer data, gpointer user_data) {
+    Lavoro *lavoro = data;
+    CodaLavori *coda = user_data;
+    traccia_nome_thread("scrittura");
+    traccia_fine("coda", "attesa_scrittura", lavoro->accodato, -1, 0);
+    guint64 inizio = traccia_inizio();
+    // Le modifiche accodate vengono eseguite anche durante la chiusura; i
+    // lavori lunghi (importazione) controllano "chiusura" e si fermano
+    lavoro->risultato = lavoro->esegui(coda->scrittura, lavoro->dati, coda->chiusura);
+    traccia_fine("lavoro", "scrittura", inizio, -1, 0);
+    lavoro->pronto = traccia_inizio();
+    g_idle_add(completa_lavoro, lavoro);
+}
+
+CodaLavori *coda_lavori_new(Repository *scrittura, PoolLetture *letture, gint n_lettori) {
+    CodaLavori *coda = g_new0(CodaLavori, 1);
+    coda->scrittura = scrittura;
+    coda->pool = letture;
+    coda->repo_liberi = g_async_queue_new();
+    coda->repo_letture = g_ptr_array_new();
+    coda->chiusura = g_cancellable_new();
+
+    for (gint i = 0; i < n_lettori; i++) {
+        sqlite3 *db = pool_letture_prendi(letture);
+        Repository *repo = repo_apri(db);
+        if (!repo) {
+            pool_letture_rilascia(letture, db);
+            break;
+        }
+        g_ptr_array_add(coda->repo_letture, repo);
+        g_async_queue_push(coda->repo_liberi, repo);
+    }
+
+    // Thread esclusivi: restano attivi per tutta la vita della coda
+    gint n = MAX((gint)coda->repo_letture->len, 1);
+    coda->letture = g_thread_pool_new(esegui_lettura, coda, n, TRUE, NULL);
+    coda->scritture = g_thread_pool_new(esegui_scrittura, coda, 1, TRUE, NULL);
+    return coda;
+}
+
+void coda_lavori_free(CodaLavori *coda) {
+    if (!coda) {
+        return;
+    }
+    // Le letture non ancora iniziate vengono saltate e quelle in corso
+    // interrotte; le modifiche accodate vengono comunque salvate
+    g_cancellable_cancel(coda->chiusura);
+    g_thread_pool_free(coda->letture, FALSE, TRUE);
+    g_thread_pool_free(coda->scritture, FALSE, TRUE);
+    coda->letture = NULL;
+    coda->scritture = NULL;
+    // Il ciclo GTK è già terminato: i completamenti in attesa (che liberano
+    // dati e risultati) si eseguono qui, annullati. Quelli che accodano
+    // altri lavori li vedono completati subito, nello stesso ciclo.
+    while (g_main_context_iteration(NULL, FALSE)) {
+    }
+
+    for (guint i = 0; i < coda->repo_letture->len; i++) {
+        Repository *repo = g_ptr_array_index(coda->repo_letture, i);
+        sqlite3 *db = repo_db(repo);
+        repo_chiudi(repo);
+        pool_letture_rilascia(coda->pool, db);
+    }
+    g_ptr_array_free(coda->repo_letture, TRUE);
+    g_async_queue_unref(coda->repo_liberi);
+    g_object_unref(coda->chiusura);
+    g_free(coda);
+}
+
+static Lavoro *nuovo_lavoro(CodaLavori *coda, LavoroFunc esegui, LavoroCompletato completato,
+                            gpointer dati, GCancellable *annulla) {
+    Lavoro *lavoro = g_new0(Lavoro, 1);
+    lavoro->coda = coda;
+    lavoro->esegui = esegui;
+    lavoro->completato = completato;
+    lavoro->dati = dati;
+    lavoro->annulla = annulla ? g_object_ref(annulla) : NULL;
+    lavoro->accodato = traccia_inizio();
+    return lavoro;
+}
+
+// Dopo la chiusura dei thread il lavoro non viene eseguito: si completa
+// soltanto, come annullato
+static void accoda(CodaLavori *coda, GThreadPool *pool, Lavoro *lavoro) {
+    if (g_cancellable_is_cancelled(coda->chiusura) || !pool) {
+        g_idle_add(completa_lavoro, lavoro);
+    } else {
+        g_thread_pool_push(pool, lavoro, NULL);
+    }
+}
+
+void coda_lavori_leggi(CodaLavori *coda, LavoroFunc esegui, LavoroCompletato completato,
+                       gpointer dati, GCancellable *annulla) {
+    accoda(coda, coda->letture, nuovo_lavoro(coda, esegui, completato, dati, annulla));
+}
+
+void coda_lavori_scrivi(CodaLavori *coda, LavoroFunc esegui, LavoroCompletato completato,
+                        gpointer dati) {
+    accoda(coda, coda->scritture, nuovo_lavoro(coda, esegui, completato, dati, NULL));
+}
+
+gpointer coda_lavori_leggi_sincrono(CodaLavori *coda, LavoroFunc esegui, gpointer dati) {
+    Repository *repo = g_async_queue_pop(coda->repo_liberi);
+    gpointer risultato = esegui(repo, dati, NULL);
+    g_async_queue_push(coda->repo_liberi, repo);
+    return risultato;
+}
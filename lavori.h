@@ -0,0 +1,49 @@
+#ifndef LAVORI_H
+#define LAVORI_H
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "connessione.h"
+#include "repository.h"
+
+G_BEGIN_DECLS
+
+// Coda dei lavori sul database: le query girano in thread dedicati, ognuno
+// con la propria connessione, e il risultato torna al thread principale
+// tramite g_idle_add. Le scritture passano da un solo thread (e dall'unica
+// connessione di scrittura), le letture da un gruppo di thread.
+typedef struct CodaLavori CodaLavori;
+
+// Eseguita in un thread di lavoro con il repository della sua connessione
+typedef gpointer (*LavoroFunc)(Repository *repo, gpointer dati, GCancellable *annulla);
+
+// Eseguita nel thread principale a lavoro finito, anche se annullato
+// (in quel caso risultato può essere incompleto). Libera dati e risultato.
+typedef void (*LavoroCompletato)(gpointer risultato, gboolean annullato, gpointer dati);
+
+// Usa "scrittura" per le modifiche e prende n_lettori connessioni dal pool
+CodaLavori *coda_lavori_new(Repository *scrittura, PoolLetture *letture, gint n_lettori);
+
+// Chiamata alla chiusura, dopo il ciclo GTK: interrompe le letture, esegue
+// le modifiche già accodate (con "annulla" attivo, vedi sotto), completa
+// tutti i lavori come annullati e restituisce le connessioni al pool
+void coda_lavori_free(CodaLavori *coda);
+
+// Accoda una lettura; se "annulla" viene attivato la query in corso si interrompe
+void coda_lavori_leggi(CodaLavori *coda, LavoroFunc esegui, LavoroCompletato completato,
+                       gpointer dati, GCancellable *annulla);
+
+// Accoda una modifica; le modifiche vengono eseguite una alla volta, in
+// ordine. Il loro "annulla" si attiva alla chiusura della coda: i lavori
+// lunghi lo controllano per terminare prima.
+void coda_lavori_scrivi(CodaLavori *coda, LavoroFunc esegui, LavoroCompletato completato,
+                        gpointer dati);
+
+// Esegue una lettura nel thread chiamante con una delle connessioni di
+// lettura (es. all'avvio, prima di mostrare la finestra)
+gpointer coda_lavori_leggi_sincrono(CodaLavori *coda, LavoroFunc esegui, gpointer dati);
+
+G_END_DECLS
+
+#endif
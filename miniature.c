@@ -0,0 +1,190 @@
+#include "miniature.h"
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+
+// Thread che convertono gli originali in miniature
+#define N_THREAD_MINIATURE 2
+
+typedef struct {
+    gchar *hash;
+    GdkPixbuf *pixbuf;        // NULL se l'immagine non si legge
+    GList collegamento;       // posizione nella coda LRU
+} VoceMiniatura;
+
+struct CacheMiniature {
+    ArchivioFoto *archivio;
+    gint lato;
+    guint capacita;
+    MiniaturaPronta pronta;
+    gpointer user_data;
+    GHashTable *voci;         // hash -> VoceMiniatura
+    GQueue recenti;           // voci dalla più usata di recente
+    GHashTable *in_caricamento;
+    GThreadPool *thread;
+    gint sequenza;            // numero dell'ultima richiesta
+    gint chiusa;
+    gint riferimenti;         // la cache più le richieste non ancora consegnate
+};
+
+typedef struct {
+    CacheMiniature *cache;
+    gchar *hash;
+    gint sequenza;
+    gboolean scartata;
+    GdkPixbuf *pixbuf;
+} RichiestaMiniatura;
+
+static void libera_voce(gpointer data) {
+    VoceMiniatura *voce = data;
+    g_free(voce->hash);
+    g_clear_object(&voce->pixbuf);
+    g_free(voce);
+}
+
+static void rilascia_cache(CacheMiniature *cache) {
+    if (!g_atomic_int_dec_and_test(&cache->riferimenti)) {
+        return;
+    }
+    g_hash_table_destroy(cache->voci);
+    g_hash_table_destroy(cache->in_caricamento);
+    g_free(cache);
+}
+
+// Scrive la miniatura con un nome temporaneo e la rinomina, così un'altra
+// esecuzione non trova mai un file a metà
+static void salva_miniatura(GdkPixbuf *pixbuf, const gchar *percorso) {
+    gchar *cartella = g_path_get_dirname(percorso);
+    gchar *temporaneo = g_strconcat(percorso, ".tmp", NULL);
+    GError *errore = NULL;
+    if (g_mkdir_with_parents(cartella, 0755) != 0 ||
+        !gdk_pixbuf_save(pixbuf, temporaneo, "png", &errore, NULL) ||
+        g_rename(temporaneo, percorso) != 0) {
+        // Non è grave: la miniatura verrà ricalcolata la prossima volta
+        fprintf(stderr, "Impossibile salvare la miniatura %s: %s\n",
+                percorso, errore ? errore->message : g_strerror(errno));
+        g_unlink(temporaneo);
+    }
+    g_clear_error(&errore);
+    g_free(temporaneo);
+    g_free(cartella);
+}
+
+static GdkPixbuf *prepara_miniatura(CacheMiniature *cache, const gchar *hash) {
+    gchar *percorso = archivio_foto_percorso_miniatura(cache->archivio, hash, cache->lato);
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file(percorso, NULL);
+    if (!pixbuf) {
+        // Il decodificatore riduce l'immagine mentre la legge: per le JPEG
+        // grandi non viene mai allocato l'originale a piena risoluzione
+        gchar *originale = archivio_foto_percorso(cache->archivio, hash);
+        GdkPixbuf *letto = gdk_pixbuf_new_from_file_at_scale(originale, cache->lato, cache->lato, TRUE, NULL);
+        if (letto) {
+            // Le foto da fotocamera o telefono sono spesso ruotate via EXIF
+            pixbuf = gdk_pixbuf_apply_embedded_orientation(letto);
+            g_object_unref(letto);
+            salva_miniatura(pixbuf, percorso);
+        }
+        g_free(originale);
+    }
+    g_free(percorso);
+    return pixbuf;
+}
+
+static gboolean consegna_miniatura(gpointer user_data) {
+    RichiestaMiniatura *richiesta = user_data;
+    CacheMiniature *cache = richiesta->cache;
+
+    if (!g_atomic_int_get(&cache->chiusa)) {
+        g_hash_table_remove(cache->in_caricamento, richiesta->hash);
+        if (!richiesta->scartata) {
+            VoceMiniatura *voce = g_new0(VoceMiniatura, 1);
+            voce->hash = g_strdup(richiesta->hash);
+            voce->pixbuf = g_steal_pointer(&richiesta->pixbuf);
+            voce->collegamento.data = voce;
+            g_hash_table_replace(cache->voci, voce->hash, voce);
+            g_queue_push_head_link(&cache->recenti, &voce->collegamento);
+
+            while (cache->recenti.length > cache->capacita) {
+                GList *vecchia = g_queue_pop_tail_link(&cache->recenti);
+                g_hash_table_remove(cache->voci, ((VoceMiniatura *)vecchia->data)->hash);
+            }
+            cache->pronta(cache->user_data);
+        }
+    }
+    g_clear_object(&richiesta->pixbuf);
+    g_free(richiesta->hash);
+    g_free(richiesta);
+    rilascia_cache(cache);
+    return G_SOURCE_REMOVE;
+}
+
+static void carica_miniatura(gpointer data, gpointer user_data) {
+    RichiestaMiniatura *richiesta = data;
+    CacheMiniature *cache = user_data;
+
+    // Dopo più di "capacita" richieste più recenti la riga non è più sullo
+    // schermo: se torna visibile verrà richiesta di nuovo
+    gint successive = g_atomic_int_get(&cache->sequenza) - richiesta->sequenza;
+    if (g_atomic_int_get(&cache->chiusa) || successive > (gint)cache->capacita) {
+        richiesta->scartata = TRUE;
+    } else {
+        richiesta->pixbuf = prepara_miniatura(cache, richiesta->hash);
+    }
+    g_idle_add(consegna_miniatura, richiesta);
+}
+
+// Prima le richieste più recenti: sono le righe visibili adesso
+static gint confronta_richieste(gconstpointer a, gconstpointer b, gpointer user_data) {
+    const RichiestaMiniatura *x = a, *y = b;
+    return y->sequenza - x->sequenza;
+}
+
+CacheMiniature *cache_miniature_new(ArchivioFoto *archivio, gint lato, guint capacita,
+                                    MiniaturaPronta pronta, gpointer user_data) {
+    CacheMiniature *cache = g_new0(CacheMiniature, 1);
+    cache->archivio = archivio;
+    cache->lato = lato;
+    cache->capacita = MAX(capacita, 1);
+    cache->pronta = pronta;
+    cache->user_data = user_data;
+    cache->riferimenti = 1;
+    // La chiave è la stringa della voce stessa
+    cache->voci = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, libera_voce);
+    cache->in_caricamento = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_queue_init(&cache->recenti);
+    cache->thread = g_thread_pool_new(carica_miniatura, cache, N_THREAD_MINIATURE, FALSE, NULL);
+    g_thread_pool_set_sort_function(cache->thread, confronta_richieste, NULL);
+    return cache;
+}
+
+void cache_miniature_free(CacheMiniature *cache) {
+    if (!cache) {
+        return;
+    }
+    // Le richieste ancora in coda escono subito senza leggere l'immagine;
+    // quelle già consegnate al ciclo GTK liberano la cache per ultime
+    g_atomic_int_set(&cache->chiusa, TRUE);
+    g_thread_pool_free(cache->thread, FALSE, TRUE);
+    rilascia_cache(cache);
+}
+
+GdkPixbuf *cache_miniature_trova(CacheMiniature *cache, const gchar *hash) {
+    VoceMiniatura *voce = g_hash_table_lookup(cache->voci, hash);
+    if (voce) {
+        g_queue_unlink(&cache->recenti, &voce->collegamento);
+        g_queue_push_head_link(&cache->recenti, &voce->collegamento);
+        return voce->pixbuf;
+    }
+    if (g_hash_table_contains(cache->in_caricamento, hash)) {
+        return NULL;
+    }
+    g_hash_table_add(cache->in_caricamento, g_strdup(hash));
+
+    RichiestaMiniatura *richiesta = g_new0(RichiestaMiniatura, 1);
+    richiesta->cache = cache;
+    richiesta->hash = g_strdup(hash);
+    richiesta->sequenza = g_atomic_int_add(&cache->sequenza, 1) + 1;
+    g_atomic_int_inc(&cache->riferimenti);
+    g_thread_pool_push(cache->thread, richiesta, NULL);
+    return NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef MINIATURE_H
+#define MINIATURE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "archivio_foto.h"
+
+G_BEGIN_DECLS
+
+// Cache delle miniature mostrate nella lista. Una miniatura viene preparata
+// solo quando una riga visibile la chiede: la prima volta viene ricavata
+// dall'originale in un thread a parte e salvata nell'archivio, le volte
+// successive viene letta già pronta. In memoria restano le ultime
+// "capacita" miniature usate; le richieste più recenti hanno la precedenza,
+// e quelle rimaste indietro durante uno scorrimento veloce vengono scartate.
+typedef struct CacheMiniature CacheMiniature;
+
+// Chiamata nel thread principale quando una miniatura richiesta è pronta
+// (es. per ridisegnare il TreeView)
+typedef void (*MiniaturaPronta)(gpointer user_data);
+
+CacheMiniature *cache_miniature_new(ArchivioFoto *archivio, gint lato, guint capacita,
+                                    MiniaturaPronta pronta, gpointer user_data);
+
+// Attende le conversioni in corso; quelle ancora in coda vengono scartate
+void cache_miniature_free(CacheMiniature *cache);
+
+// Miniatura dell'immagine "hash" se è già in memoria (il riferimento resta
+// alla cache). Altrimenti restituisce NULL e ne avvia il caricamento: a
+// caricamento finito viene chiamata "pronta". Anche le immagini che non si
+// riescono a leggere restituiscono sempre NULL, senza nuovi tentativi.
+GdkPixbuf *cache_miniature_trova(CacheMiniature *cache, const gchar *hash);
+
+G_END_DECLS
+
+#endif
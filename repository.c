@@ -0,0 +1,1388 @@
+#include "repository.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "traccia.h"
+
+// Tentativi di avvio/commit di una transazione di scrittura ancora occupata
+#define REPO_TENTATIVI 5
+// Query della lista composte dai criteri (ordinamento e filtri) tenute
+// preparate: le combinazioni usate di recente
+#define REPO_QUERY_COMPOSTE 32
+
+// Hash della foto principale dell'articolo della riga, dall'indice idx_foto_articolo
+#define SQL_FOTO_PRINCIPALE(tabella) \
+    "(SELECT f.hash FROM foto f WHERE f.articolo_id = " tabella ".articolo_id " \
+    "ORDER BY f.posizione LIMIT 1) AS foto"
+
+// Colonne e join dell'esportazione delle vendite, seguite dal WHERE
+#define SQL_ESPORTA_VENDITE \
+    "SELECT v.vendita_id, v.data_vendita, v.articolo_id, IFNULL(a.nome, e.nome), " \
+    "IFNULL(a.artista, e.artista), IFNULL(a.periodo, e.periodo), " \
+    "IFNULL(a.prezzo_acquisto, e.prezzo_acquisto), v.prezzo_vendita, v.nome_cliente " \
+    "FROM vendite v LEFT JOIN articoli a ON a.articolo_id = v.articolo_id " \
+    "LEFT JOIN articoli_eliminati e ON a.articolo_id IS NULL AND e.articolo_id = v.articolo_id "
+
+// Query usate dall'applicazione, preparate una sola volta
+enum {
+    Q_INSERT_ARTICOLO,
+    Q_QUANTITA,
+    Q_DECREMENTA,
+    Q_INSERT_VENDITA,
+    Q_ELIMINA,
+    Q_CONTA,
+    Q_PRECEDENTI,
+    Q_VERSIONE,
+    Q_MODIFICHE,
+    Q_ESPORTA_VENDITE,
+    Q_ESPORTA_ARTICOLI,
+    Q_STATISTICHE,
+    Q_VALORE_MAGAZZINO,
+    Q_INSERT_FOTO,
+    Q_FOTO_USATA,
+    Q_VALORI_ARTISTA,
+    Q_VALORI_PERIODO,
+    Q_VERSIONE_MINIMA,
+    Q_DELTA_ARTICOLI,
+    Q_ARTICOLI_DA,
+    Q_VENDITE_DA,
+    Q_REPLICA_ARTICOLO,
+    Q_REPLICA_ELIMINA_TRA,
+    Q_REPLICA_VENDITA,
+    Q_REPLICA_SVUOTA_VENDITE,
+    Q_REPLICA_SVUOTA_STATISTICHE,
+    Q_LEGGI_SYNC,
+    Q_SCRIVI_SYNC,
+    Q_CREA_IDENTIFICATIVO,
+    Q_BEGIN,
+    Q_COMMIT,
+    Q_ROLLBACK,
+    Q_SAVEPOINT,
+    Q_RELEASE,
+    Q_ROLLBACK_TO,
+    Q_SNAPSHOT,
+    Q_FINE_SNAPSHOT,
+    N_QUERY
+};
+
+static const char *sql_query[N_QUERY] = {
+    [Q_INSERT_ARTICOLO] =
+        "INSERT INTO articoli (nome, descrizione, artista, periodo, misure, data_acquisizione, prezzo_acquisto, quantita) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?);",
+    [Q_QUANTITA] =
+        "SELECT quantita FROM articoli WHERE articolo_id = ?;",
+    // La condizione sulla quantità rende la verifica e l'aggiornamento un
+    // solo passo: due casse non possono vendere lo stesso ultimo pezzo
+    [Q_DECREMENTA] =
+        "UPDATE articoli SET quantita = quantita - 1 WHERE articolo_id = ? AND quantita > 0;",
+    [Q_INSERT_VENDITA] =
+        "INSERT INTO vendite (articolo_id, data_vendita, prezzo_vendita, nome_cliente) VALUES (?, ?, ?, ?);",
+    [Q_ELIMINA] =
+        "DELETE FROM articoli WHERE articolo_id = ?;",
+    [Q_CONTA] =
+        "SELECT COUNT(*) FROM articoli;",
+    // Posizione di una riga nell'ordine predefinito della lista (vedi
+    // chiavi_ordine), per gli aggiornamenti dal registro
+    [Q_PRECEDENTI] =
+        "SELECT (SELECT COUNT(*) FROM articoli WHERE (quantita IS 0) < ?1) + "
+        "(SELECT COUNT(*) FROM articoli WHERE (quantita IS 0) = ?1 AND articolo_id < ?2);",
+    [Q_VERSIONE] =
+        "SELECT COALESCE(MAX(versione), 0) FROM articoli_modifiche;",
+    [Q_MODIFICHE] =
+        "SELECT versione, articolo_id, vecchio_venduto, nuovo_venduto "
+        "FROM articoli_modifiche WHERE versione > ? ORDER BY versione;",
+    // Esportazioni: una sola lettura dall'inizio alla fine, riga per riga.
+    // Le vendite seguono idx_vendite_data; i dati di un articolo eliminato
+    // vengono da articoli_eliminati (schema 7). Le vendite senza data
+    // (contate sotto '' nelle statistiche) escono per prime se manca la data
+    // iniziale: con UNION ALL le due ricerche sull'indice si fondono in
+    // ordine, un OR richiederebbe di ordinare tutto il risultato.
+    [Q_ESPORTA_VENDITE] =
+        SQL_ESPORTA_VENDITE "WHERE ?1 = '' AND v.data_vendita IS NULL "
+        "UNION ALL "
+        SQL_ESPORTA_VENDITE "WHERE v.data_vendita >= ?1 AND v.data_vendita <= ?2 "
+        "ORDER BY 2, 1;",
+    [Q_ESPORTA_ARTICOLI] =
+        "SELECT articolo_id, nome, descrizione, artista, periodo, misure, data_acquisizione, "
+        "prezzo_acquisto, quantita "
+        "FROM articoli "
+        "WHERE (?1 IS NULL OR data_acquisizione >= ?1) AND (?2 IS NULL OR data_acquisizione <= ?2) "
+        "ORDER BY articolo_id;",
+    // Riepiloghi tenuti dai trigger (schema 3): una riga per gruppo
+    [Q_STATISTICHE] =
+        "SELECT chiave, pezzi, ricavo, costo FROM statistiche_vendite "
+        "WHERE dimensione = ?1 AND chiave >= ?2 AND (?3 IS NULL OR chiave <= ?3) "
+        "ORDER BY chiave;",
+    [Q_VALORE_MAGAZZINO] =
+        "SELECT articoli, pezzi, valore FROM valore_magazzino WHERE id = 1;",
+    // La foto va in coda a quelle dell'articolo; se è già collegata o
+    // l'articolo non esiste non viene inserito nulla
+    [Q_INSERT_FOTO] =
+        "INSERT INTO foto (articolo_id, hash, dimensione, posizione) "
+        "SELECT ?1, ?2, ?3, (SELECT IFNULL(MAX(posizione) + 1, 0) FROM foto WHERE articolo_id = ?1) "
+        "WHERE EXISTS (SELECT 1 FROM articoli WHERE articolo_id = ?1) "
+        "ON CONFLICT (articolo_id, hash) DO NOTHING;",
+    [Q_FOTO_USATA] =
+        "SELECT EXISTS (SELECT 1 FROM foto WHERE hash = ?);",
+    // Valori dei filtri della lista, uno per gruppo di maiuscole/minuscole,
+    // dal solo indice della colonna (schema 6)
+    [Q_VALORI_ARTISTA] =
+        "SELECT IFNULL(artista, '') COLLATE NOCASE AS valore FROM articoli "
+        "GROUP BY valore HAVING valore <> '' ORDER BY valore;",
+    [Q_VALORI_PERIODO] =
+        "SELECT IFNULL(periodo, '') COLLATE NOCASE AS valore FROM articoli "
+        "GROUP BY valore HAVING valore <> '' ORDER BY valore;",
+    // Sincronizzazione tra terminali (schema 5). Il server invia le modifiche
+    // nell'ordine del registro, ognuna con lo stato attuale dell'articolo
+    // (colonne NULL se è stato eliminato): un articolo modificato più volte
+    // può arrivare più volte, ma applicarlo di nuovo non cambia nulla.
+    [Q_VERSIONE_MINIMA] =
+        "SELECT COALESCE(MIN(versione), 0) FROM articoli_modifiche;",
+    [Q_DELTA_ARTICOLI] =
+        "SELECT m.versione, m.articolo_id, a.articolo_id IS NOT NULL, a.nome, a.descrizione, "
+        "a.artista, a.periodo, a.misure, a.data_acquisizione, a.prezzo_acquisto, a.quantita "
+        "FROM articoli_modifiche m LEFT JOIN articoli a ON a.articolo_id = m.articolo_id "
+        "WHERE m.versione > ?1 "
+        "ORDER BY m.versione "
+        "LIMIT ?2;",
+    [Q_ARTICOLI_DA] =
+        "SELECT articolo_id, nome, descrizione, artista, periodo, misure, data_acquisizione, "
+        "prezzo_acquisto, quantita "
+        "FROM articoli "
+        "WHERE articolo_id > ?1 "
+        "ORDER BY articolo_id "
+        "LIMIT ?2;",
+    [Q_VENDITE_DA] =
+        "SELECT vendita_id, articolo_id, data_vendita, prezzo_vendita, nome_cliente "
+        "FROM vendite "
+        "WHERE vendita_id > ?1 "
+        "ORDER BY vendita_id "
+        "LIMIT ?2;",
+    // Una riga identica a quella presente non viene riscritta: niente voce
+    // nel registro locale né reindicizzazione del testo
+    [Q_REPLICA_ARTICOLO] =
+        "INSERT INTO articoli (articolo_id, nome, descrizione, artista, periodo, misure, "
+        "data_acquisizione, prezzo_acquisto, quantita) "
+        "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9) "
+        "ON CONFLICT (articolo_id) DO UPDATE SET "
+        "nome = excluded.nome, descrizione = excluded.descrizione, artista = excluded.artista, "
+        "periodo = excluded.periodo, misure = excluded.misure, "
+        "data_acquisizione = excluded.data_acquisizione, "
+        "prezzo_acquisto = excluded.prezzo_acquisto, quantita = excluded.quantita "
+        "WHERE (nome, descrizione, artista, periodo, misure, data_acquisizione, prezzo_acquisto, quantita) "
+        "IS NOT (excluded.nome, excluded.descrizione, excluded.artista, excluded.periodo, "
+        "excluded.misure, excluded.data_acquisizione, excluded.prezzo_acquisto, excluded.quantita);",
+    [Q_REPLICA_ELIMINA_TRA] =
+        "DELETE FROM articoli WHERE articolo_id > ?1 AND articolo_id < ?2;",
+    [Q_REPLICA_VENDITA] =
+        "INSERT INTO vendite (vendita_id, articolo_id, data_vendita, prezzo_vendita, nome_cliente) "
+        "VALUES (?1, ?2, ?3, ?4, ?5) "
+        "ON CONFLICT (vendita_id) DO NOTHING;",
+    [Q_REPLICA_SVUOTA_VENDITE] =
+        "DELETE FROM vendite;",
+    [Q_REPLICA_SVUOTA_STATISTICHE] =
+        "DELETE FROM statistiche_vendite;",
+    [Q_LEGGI_SYNC] =
+        "SELECT valore FROM sincronizzazione WHERE chiave = ?;",
+    [Q_SCRIVI_SYNC] =
+        "INSERT INTO sincronizzazione (chiave, valore) VALUES (?1, ?2) "
+        "ON CONFLICT (chiave) DO UPDATE SET valore = excluded.valore;",
+    // Numero casuale positivo, creato una volta sola per database
+    [Q_CREA_IDENTIFICATIVO] =
+        "INSERT INTO sincronizzazione (chiave, valore) "
+        "VALUES ('identificativo', (random() & 0x7fffffffffffffff) | 1) "
+        "ON CONFLICT (chiave) DO NOTHING;",
+    // Il lock di scrittura viene preso subito, così la transazione non
+    // fallisce a metà se un'altra cassa sta scrivendo
+    [Q_BEGIN] = "BEGIN IMMEDIATE;",
+    [Q_COMMIT] = "COMMIT;",
+    [Q_ROLLBACK] = "ROLLBACK;",
+    // Scritture dentro una transazione già aperta (es. il blocco di
+    // richieste del server di sincronizzazione): ognuna può essere annullata
+    // da sola senza perdere le altre
+    [Q_SAVEPOINT] = "SAVEPOINT scrittura;",
+    [Q_RELEASE] = "RELEASE scrittura;",
+    [Q_ROLLBACK_TO] = "ROLLBACK TO scrittura;",
+    // Più letture viste nello stesso stato del database
+    [Q_SNAPSHOT] = "SAVEPOINT snapshot_repo;",
+    [Q_FINE_SNAPSHOT] = "RELEASE snapshot_repo;",
+};
+
+// Nomi delle query negli eventi di traccia
+static const char *nome_query[N_QUERY] = {
+    [Q_INSERT_ARTICOLO] = "inserisci_articolo",
+    [Q_QUANTITA] = "quantita",
+    [Q_DECREMENTA] = "decrementa",
+    [Q_INSERT_VENDITA] = "inserisci_vendita",
+    [Q_ELIMINA] = "elimina",
+    [Q_CONTA] = "conta",
+    [Q_PRECEDENTI] = "precedenti",
+    [Q_VERSIONE] = "versione",
+    [Q_MODIFICHE] = "modifiche",
+    [Q_ESPORTA_VENDITE] = "esporta_vendite",
+    [Q_ESPORTA_ARTICOLI] = "esporta_articoli",
+    [Q_STATISTICHE] = "statistiche",
+    [Q_VALORE_MAGAZZINO] = "valore_magazzino",
+    [Q_INSERT_FOTO] = "inserisci_foto",
+    [Q_FOTO_USATA] = "foto_usata",
+    [Q_VALORI_ARTISTA] = "valori_artista",
+    [Q_VALORI_PERIODO] = "valori_periodo",
+    [Q_VERSIONE_MINIMA] = "versione_minima",
+    [Q_DELTA_ARTICOLI] = "delta_articoli",
+    [Q_ARTICOLI_DA] = "articoli_da",
+    [Q_VENDITE_DA] = "vendite_da",
+    [Q_REPLICA_ARTICOLO] = "replica_articolo",
+    [Q_REPLICA_ELIMINA_TRA] = "replica_elimina_tra",
+    [Q_REPLICA_VENDITA] = "replica_vendita",
+    [Q_REPLICA_SVUOTA_VENDITE] = "replica_svuota_vendite",
+    [Q_REPLICA_SVUOTA_STATISTICHE] = "replica_svuota_statistiche",
+    [Q_LEGGI_SYNC] = "leggi_sync",
+    [Q_SCRIVI_SYNC] = "scrivi_sync",
+    [Q_CREA_IDENTIFICATIVO] = "crea_identificativo",
+    [Q_BEGIN] = "begin",
+    [Q_COMMIT] = "commit",
+    [Q_ROLLBACK] = "rollback",
+    [Q_SAVEPOINT] = "savepoint",
+    [Q_RELEASE] = "release",
+    [Q_ROLLBACK_TO] = "rollback_to",
+    [Q_SNAPSHOT] = "snapshot",
+    [Q_FINE_SNAPSHOT] = "fine_snapshot",
+};
+
+// Query composta, preparata al primo uso con il suo testo
+typedef struct {
+    char *sql;
+    sqlite3_stmt *stmt;
+    unsigned long uso;  // ultimo utilizzo, la meno recente viene sostituita
+} QueryComposta;
+
+struct Repository {
+    sqlite3 *db;
+    sqlite3_stmt *stmt[N_QUERY];
+    QueryComposta composte[REPO_QUERY_COMPOSTE];
+    unsigned long usi;
+    char errore[256];   // ultimo errore, conservato anche dopo un ROLLBACK
+    int livello;        // transazioni di scrittura aperte, le interne sono savepoint
+    // Misura della query in corso, se la traccia è attiva (vedi traccia.h)
+    const char *traccia_nome;
+    uint64_t traccia_inizio;
+    uint64_t traccia_sqlite_ns;
+    int64_t traccia_righe;
+};
+
+static sqlite3_stmt *prepara_uso(Repository *repo, sqlite3_stmt *stmt, const char *nome) {
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    repo->traccia_nome = nome;
+    repo->traccia_inizio = traccia_inizio();
+    repo->traccia_sqlite_ns = 0;
+    repo->traccia_righe = 0;
+    return stmt;
+}
+
+// Restituisce la query pronta per un nuovo utilizzo
+static sqlite3_stmt *usa(Repository *repo, int query) {
+    return prepara_uso(repo, repo->stmt[query], nome_query[query]);
+}
+
+// Come usa() per una query composta: la prepara se non è tra quelle tenute,
+// al posto di quella usata meno di recente. NULL in caso di errore.
+static sqlite3_stmt *usa_composta(Repository *repo, const char *sql, const char *nome) {
+    QueryComposta *q = &repo->composte[0];
+    for (int i = 0; i < REPO_QUERY_COMPOSTE; i++) {
+        QueryComposta *c = &repo->composte[i];
+        if (c->sql && strcmp(c->sql, sql) == 0) {
+            q = c;
+            break;
+        }
+        if (!c->sql || c->uso < q->uso) {
+            q = c;
+        }
+    }
+    if (!q->sql || strcmp(q->sql, sql) != 0) {
+        uint64_t t = traccia_inizio();
+        sqlite3_finalize(q->stmt);
+        free(q->sql);
+        q->stmt = NULL;
+        q->sql = NULL;
+        if (sqlite3_prepare_v3(repo->db, sql, -1, SQLITE_PREPARE_PERSISTENT, &q->stmt, NULL) != SQLITE_OK) {
+            fprintf(stderr, "Errore preparazione query: %s\n%s\n", sqlite3_errmsg(repo->db), sql);
+            return NULL;
+        }
+        q->sql = strdup(sql);
+        if (!q->sql) {
+            sqlite3_finalize(q->stmt);
+            q->stmt = NULL;
+            return NULL;
+        }
+        traccia_fine("sql_prepare", nome, t, -1, 0);
+    }
+    q->uso = ++repo->usi;
+    return prepara_uso(repo, q->stmt, nome);
+}
+
+// sqlite3_step con la misura del tempo e delle righe lette
+static int passo(Repository *repo, sqlite3_stmt *stmt) {
+    if (!repo->traccia_inizio) {
+        return sqlite3_step(stmt);
+    }
+    uint64_t t = traccia_adesso();
+    int rc = sqlite3_step(stmt);
+    repo->traccia_sqlite_ns += traccia_adesso() - t;
+    if (rc == SQLITE_ROW) {
+        repo->traccia_righe++;
+    }
+    return rc;
+}
+
+// Fine di un utilizzo della query: reset e registrazione della misura
+static void rilascia(Repository *repo, sqlite3_stmt *stmt) {
+    sqlite3_reset(stmt);
+    if (repo->traccia_inizio) {
+        traccia_fine("sql", repo->traccia_nome, repo->traccia_inizio,
+                     repo->traccia_righe, repo->traccia_sqlite_ns);
+        repo->traccia_inizio = 0;
+    }
+}
+
+// Esegue una query che restituisce un solo intero
+static sqlite3_int64 leggi_intero(Repository *repo, sqlite3_stmt *stmt) {
+    sqlite3_int64 n = 0;
+    int rc = passo(repo, stmt);
+    if (rc == SQLITE_ROW) {
+        n = sqlite3_column_int64(stmt, 0);
+    } else if (rc != SQLITE_INTERRUPT) {
+        // SQLITE_INTERRUPT: lettura annullata, non è un errore
+        fprintf(stderr, "Errore lettura dal DB: %s\n", sqlite3_errmsg(repo->db));
+    }
+    rilascia(repo, stmt);
+    return n;
+}
+
+// Esegue una query di modifica e restituisce SQLITE_OK o il codice di errore
+static int esegui(Repository *repo, sqlite3_stmt *stmt) {
+    int rc = passo(repo, stmt);
+    rilascia(repo, stmt);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+static int segna_errore(Repository *repo, int rc) {
+    if (rc != SQLITE_OK) {
+        snprintf(repo->errore, sizeof(repo->errore), "%s", sqlite3_errmsg(repo->db));
+    }
+    return rc;
+}
+
+// Esegue BEGIN/COMMIT riprovando con attese crescenti finché il DB è occupato
+static int esegui_con_tentativi(Repository *repo, int query) {
+    int rc = SQLITE_BUSY;
+    for (int tentativo = 0; tentativo < REPO_TENTATIVI; tentativo++) {
+        rc = esegui(repo, usa(repo, query));
+        if (rc != SQLITE_BUSY && rc != SQLITE_LOCKED) {
+            break;
+        }
+        sqlite3_sleep(10 << tentativo);
+    }
+    return segna_errore(repo, rc);
+}
+
+static int inizia_scrittura(Repository *repo) {
+    int rc = repo->livello > 0 ? segna_errore(repo, esegui(repo, usa(repo, Q_SAVEPOINT)))
+                               : esegui_con_tentativi(repo, Q_BEGIN);
+    if (rc == SQLITE_OK) {
+        repo->livello++;
+    }
+    return rc;
+}
+
+// Conferma la transazione se ok, altrimenti (o se il COMMIT fallisce) la
+// annulla. Una transazione interna annulla solo le proprie modifiche.
+static int termina_scrittura(Repository *repo, int ok) {
+    repo->livello--;
+    if (repo->livello > 0) {
+        if (!ok) {
+            esegui(repo, usa(repo, Q_ROLLBACK_TO));
+        }
+        int rc = segna_errore(repo, esegui(repo, usa(repo, Q_RELEASE)));
+        return ok ? rc : SQLITE_ABORT;
+    }
+    int rc = ok ? esegui_con_tentativi(repo, Q_COMMIT) : SQLITE_ABORT;
+    if (rc != SQLITE_OK && !sqlite3_get_autocommit(repo->db)) {
+        esegui(repo, usa(repo, Q_ROLLBACK));
+    }
+    return rc;
+}
+
+Repository *repo_apri(sqlite3 *db) {
+    Repository *repo = calloc(1, sizeof(Repository));
+    if (!repo) {
+        return NULL;
+    }
+    repo->db = db;
+
+    for (int i = 0; i < N_QUERY; i++) {
+        uint64_t t = traccia_inizio();
+        if (sqlite3_prepare_v3(db, sql_query[i], -1, SQLITE_PREPARE_PERSISTENT, &repo->stmt[i], NULL) != SQLITE_OK) {
+            fprintf(stderr, "Errore preparazione query: %s\n%s\n", sqlite3_errmsg(db), sql_query[i]);
+            repo_chiudi(repo);
+            return NULL;
+        }
+        traccia_fine("sql_prepare", nome_query[i], t, -1, 0);
+    }
+    return repo;
+}
+
+void repo_chiudi(Repository *repo) {
+    if (!repo) {
+        return;
+    }
+    for (int i = 0; i < N_QUERY; i++) {
+        uint64_t t = traccia_inizio();
+        sqlite3_finalize(repo->stmt[i]);
+        traccia_fine("sql_finalize", nome_query[i], t, -1, 0);
+    }
+    for (int i = 0; i < REPO_QUERY_COMPOSTE; i++) {
+        sqlite3_finalize(repo->composte[i].stmt);
+        free(repo->composte[i].sql);
+    }
+    free(repo);
+}
+
+sqlite3 *repo_db(Repository *repo) {
+    return repo->db;
+}
+
+const char *repo_errmsg(Repository *repo) {
+    return repo->errore;
+}
+
+int repo_insert_articolo(Repository *repo, const NuovoArticolo *articolo, int *nuovo_id) {
+    sqlite3_stmt *stmt = usa(repo, Q_INSERT_ARTICOLO);
+    sqlite3_bind_text(stmt, 1, articolo->nome, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, articolo->descrizione, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 3, articolo->artista, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 4, articolo->periodo, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 5, articolo->misure, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 6, articolo->data_acquisizione, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_double(stmt, 7, articolo->prezzo_acquisto);
+    sqlite3_bind_int(stmt, 8, articolo->quantita);
+
+    int rc = segna_errore(repo, esegui(repo, stmt));
+    if (rc == SQLITE_OK && nuovo_id) {
+        *nuovo_id = (int)sqlite3_last_insert_rowid(repo->db);
+    }
+    return rc;
+}
+
+// Vende un pezzo dentro la transazione già aperta
+static EsitoVendita vendi_pezzo(Repository *repo, int articolo_id, double prezzo_vendita,
+                                const char *nome_cliente, const char *data_vendita) {
+    sqlite3_stmt *stmt = usa(repo, Q_DECREMENTA);
+    sqlite3_bind_int(stmt, 1, articolo_id);
+    if (segna_errore(repo, esegui(repo, stmt)) != SQLITE_OK) {
+        return VENDITA_ERRORE;
+    }
+
+    if (sqlite3_changes(repo->db) == 0) {
+        // Nessuna riga aggiornata: l'articolo non esiste o è esaurito
+        stmt = usa(repo, Q_QUANTITA);
+        sqlite3_bind_int(stmt, 1, articolo_id);
+        int rc = passo(repo, stmt);
+        rilascia(repo, stmt);
+        if (rc == SQLITE_ROW) {
+            return VENDITA_ESAURITO;
+        }
+        if (rc == SQLITE_DONE) {
+            return VENDITA_NON_TROVATO;
+        }
+        segna_errore(repo, rc);
+        return VENDITA_ERRORE;
+    }
+
+    stmt = usa(repo, Q_INSERT_VENDITA);
+    sqlite3_bind_int(stmt, 1, articolo_id);
+    sqlite3_bind_text(stmt, 2, data_vendita, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_double(stmt, 3, prezzo_vendita);
+    sqlite3_bind_text(stmt, 4, nome_cliente, -1, SQLITE_TRANSIENT);
+    return segna_errore(repo, esegui(repo, stmt)) == SQLITE_OK ? VENDITA_OK : VENDITA_ERRORE;
+}
+
+EsitoVendita repo_registra_vendita(Repository *repo, int articolo_id, double prezzo_vendita,
+                                   const char *nome_cliente, const char *data_vendita) {
+    if (inizia_scrittura(repo) != SQLITE_OK) {
+        return VENDITA_ERRORE;
+    }
+    EsitoVendita esito = vendi_pezzo(repo, articolo_id, prezzo_vendita, nome_cliente, data_vendita);
+    if (termina_scrittura(repo, esito == VENDITA_OK) != SQLITE_OK && esito == VENDITA_OK) {
+        esito = VENDITA_ERRORE;
+    }
+    return esito;
+}
+
+int repo_vendi_carrello(Repository *repo, RigaCarrello *righe, int n, const char *data_vendita) {
+    if (inizia_scrittura(repo) != SQLITE_OK) {
+        return -1;
+    }
+
+    int vendute = 0;
+    for (int i = 0; i < n; i++) {
+        righe[i].esito = vendi_pezzo(repo, righe[i].articolo_id, righe[i].prezzo_vendita,
+                                     righe[i].nome_cliente, data_vendita);
+        if (righe[i].esito == VENDITA_ERRORE) {
+            termina_scrittura(repo, 0);
+            return -1;
+        }
+        if (righe[i].esito == VENDITA_OK) {
+            vendute++;
+        }
+    }
+
+    if (termina_scrittura(repo, 1) != SQLITE_OK) {
+        return -1;
+    }
+    return vendute;
+}
+
+int repo_inizia_transazione(Repository *repo) {
+    return inizia_scrittura(repo);
+}
+
+int repo_termina_transazione(Repository *repo, int ok) {
+    return termina_scrittura(repo, ok);
+}
+
+int repo_aggiungi_foto(Repository *repo, int articolo_id, const char *hash, sqlite3_int64 dimensione) {
+    sqlite3_stmt *stmt = usa(repo, Q_INSERT_FOTO);
+    sqlite3_bind_int(stmt, 1, articolo_id);
+    sqlite3_bind_text(stmt, 2, hash, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 3, dimensione);
+    return segna_errore(repo, esegui(repo, stmt));
+}
+
+int repo_foto_usata(Repository *repo, const char *hash) {
+    sqlite3_stmt *stmt = usa(repo, Q_FOTO_USATA);
+    sqlite3_bind_text(stmt, 1, hash, -1, SQLITE_TRANSIENT);
+    int rc = passo(repo, stmt);
+    int usata = rc == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+    if (rc != SQLITE_ROW) {
+        segna_errore(repo, rc);
+    }
+    rilascia(repo, stmt);
+    return usata;
+}
+
+int repo_elimina_articolo(Repository *repo, int articolo_id) {
+    sqlite3_stmt *stmt = usa(repo, Q_ELIMINA);
+    sqlite3_bind_int(stmt, 1, articolo_id);
+    return segna_errore(repo, esegui(repo, stmt));
+}
+
+// --- Lista: ordinamento, filtri e paginazione per chiave ---
+
+// Chiave di ordinamento di ogni colonna. Le espressioni coincidono con
+// quelle degli indici (schema 1 e 6), così ogni ordinamento e ogni filtro
+// su artista e periodo diventano una ricerca su indice. I NULL valgono come
+// nella lista (testo vuoto, 0): la chiave non è mai NULL e ogni riga può
+// fare da cursore. I testi si ordinano senza distinguere le maiuscole.
+static const struct {
+    const char *espressione;
+    int testo;              // chiave di testo, altrimenti numerica
+    int intera;
+} chiavi_ordine[N_ORDINI] = {
+    [ORDINE_STATO]    = { "(a.quantita IS 0)", 0, 1 },
+    [ORDINE_ID]       = { "a.articolo_id", 0, 1 },
+    [ORDINE_NOME]     = { "a.nome COLLATE NOCASE", 1, 0 },
+    [ORDINE_ARTISTA]  = { "IFNULL(a.artista, '') COLLATE NOCASE", 1, 0 },
+    [ORDINE_PERIODO]  = { "IFNULL(a.periodo, '') COLLATE NOCASE", 1, 0 },
+    [ORDINE_QUANTITA] = { "IFNULL(a.quantita, 0)", 0, 1 },
+    [ORDINE_PREZZO]   = { "IFNULL(a.prezzo_acquisto, 0)", 0, 0 },
+};
+
+static const CriteriLista criteri_predefiniti = { ORDINE_STATO, 0, -1, NULL, NULL, -1, -1 };
+
+#define SQL_COLONNE_LISTA \
+    "SELECT a.articolo_id, a.nome, a.artista, a.periodo, a.misure, a.quantita, a.prezzo_acquisto, " \
+    "(a.quantita IS 0) AS venduto, " SQL_FOTO_PRINCIPALE("a") " "
+
+// Parametri delle query composte: ?1 e ?2 cursore, ?3 righe, ?5 testo
+// cercato, ?6-?10 filtri
+enum {
+    P_VALORE = 1,
+    P_ID,
+    P_LIMITE,
+    P_RICERCA = 5,
+    P_VENDUTO,
+    P_ARTISTA,
+    P_PERIODO,
+    P_PREZZO_MIN,
+    P_PREZZO_MAX
+};
+
+// Testo di una query composta
+typedef struct {
+    char testo[2048];
+    size_t n;
+    int condizioni;
+} Sql;
+
+static void sql_aggiungi(Sql *sql, const char *parte) {
+    size_t len = strlen(parte);
+    if (sql->n + len < sizeof(sql->testo)) {
+        memcpy(sql->testo + sql->n, parte, len + 1);
+        sql->n += len;
+    }
+}
+
+// Aggiunge una condizione al WHERE, aprendolo alla prima
+static void sql_condizione(Sql *sql, const char *condizione) {
+    sql_aggiungi(sql, sql->condizioni++ ? " AND " : " WHERE ");
+    sql_aggiungi(sql, condizione);
+}
+
+static void sql_filtri(Sql *sql, const CriteriLista *criteri) {
+    if (criteri->venduto >= 0) {
+        sql_condizione(sql, "(a.quantita IS 0) = ?6");
+    }
+    if (criteri->artista) {
+        sql_condizione(sql, "IFNULL(a.artista, '') COLLATE NOCASE = ?7");
+    }
+    if (criteri->periodo) {
+        sql_condizione(sql, "IFNULL(a.periodo, '') COLLATE NOCASE = ?8");
+    }
+    if (criteri->prezzo_min >= 0) {
+        sql_condizione(sql, "IFNULL(a.prezzo_acquisto, 0) >= ?9");
+    }
+    if (criteri->prezzo_max >= 0) {
+        sql_condizione(sql, "IFNULL(a.prezzo_acquisto, 0) <= ?10");
+    }
+}
+
+static void lega_filtri(sqlite3_stmt *stmt, const CriteriLista *criteri) {
+    if (criteri->venduto >= 0) {
+        sqlite3_bind_int(stmt, P_VENDUTO, criteri->venduto != 0);
+    }
+    if (criteri->artista) {
+        sqlite3_bind_text(stmt, P_ARTISTA, criteri->artista, -1, SQLITE_TRANSIENT);
+    }
+    if (criteri->periodo) {
+        sqlite3_bind_text(stmt, P_PERIODO, criteri->periodo, -1, SQLITE_TRANSIENT);
+    }
+    if (criteri->prezzo_min >= 0) {
+        sqlite3_bind_double(stmt, P_PREZZO_MIN, criteri->prezzo_min);
+    }
+    if (criteri->prezzo_max >= 0) {
+        sqlite3_bind_double(stmt, P_PREZZO_MAX, criteri->prezzo_max);
+    }
+}
+
+// Confronto con il cursore nel verso dell'ordinamento: "espressione > ?n"
+static void sql_dopo(Sql *sql, const char *espressione, const char *parametro, int decrescente) {
+    char condizione[128];
+    snprintf(condizione, sizeof(condizione), "%s %s %s", espressione, decrescente ? "<" : ">", parametro);
+    sql_condizione(sql, condizione);
+}
+
+static void sql_ordine(Sql *sql, const CriteriLista *criteri, int solo_id) {
+    const char *verso = criteri->decrescente ? " DESC" : "";
+    sql_aggiungi(sql, " ORDER BY ");
+    if (!solo_id) {
+        sql_aggiungi(sql, chiavi_ordine[criteri->ordine].espressione);
+        sql_aggiungi(sql, verso);
+        sql_aggiungi(sql, ", ");
+    }
+    sql_aggiungi(sql, "a.articolo_id");
+    sql_aggiungi(sql, verso);
+}
+
+static void lega_cursore(sqlite3_stmt *stmt, const CriteriLista *criteri, const CursoreLista *cursore) {
+    if (chiavi_ordine[criteri->ordine].testo) {
+        sqlite3_bind_text(stmt, P_VALORE, cursore->testo ? cursore->testo : "", -1, SQLITE_TRANSIENT);
+    } else if (chiavi_ordine[criteri->ordine].intera) {
+        sqlite3_bind_int64(stmt, P_VALORE, (sqlite3_int64)cursore->numero);
+    } else {
+        sqlite3_bind_double(stmt, P_VALORE, cursore->numero);
+    }
+    sqlite3_bind_int64(stmt, P_ID, cursore->articolo_id);
+}
+
+static int criteri_validi(const CriteriLista *criteri) {
+    return criteri->ordine >= 0 && criteri->ordine < N_ORDINI;
+}
+
+void repo_criteri_predefiniti(CriteriLista *criteri) {
+    *criteri = criteri_predefiniti;
+}
+
+int repo_criteri_filtrano(const CriteriLista *criteri) {
+    return criteri->venduto >= 0 || criteri->artista || criteri->periodo ||
+           criteri->prezzo_min >= 0 || criteri->prezzo_max >= 0;
+}
+
+void repo_cursore_riga(const CriteriLista *criteri, const RigaInventario *riga, CursoreLista *cursore) {
+    if (!criteri) {
+        criteri = &criteri_predefiniti;
+    }
+    cursore->inizio = 0;
+    cursore->testo = NULL;
+    cursore->numero = 0;
+    cursore->articolo_id = riga->articolo_id;
+    switch (criteri->ordine) {
+    case ORDINE_STATO:    cursore->numero = riga->venduto; break;
+    case ORDINE_NOME:     cursore->testo = riga->nome; break;
+    case ORDINE_ARTISTA:  cursore->testo = riga->artista; break;
+    case ORDINE_PERIODO:  cursore->testo = riga->periodo; break;
+    case ORDINE_QUANTITA: cursore->numero = riga->quantita; break;
+    case ORDINE_PREZZO:   cursore->numero = riga->prezzo_acquisto; break;
+    default: break;
+    }
+    if (chiavi_ordine[criteri->ordine].testo && !cursore->testo) {
+        cursore->testo = "";
+    }
+}
+
+// Legge le righe di una delle query di pagina: le prime *salta vengono
+// scorse senza leggerne le colonne, poi al massimo *limite vanno al callback
+static int leggi_righe(Repository *repo, sqlite3_stmt *stmt, int *salta, int *limite,
+                       RepoRigaCallback callback, void *user_data) {
+    int con_rilevanza = sqlite3_column_count(stmt) > 9;
+    int rc = SQLITE_DONE;
+    while (*limite > 0 && (rc = passo(repo, stmt)) == SQLITE_ROW) {
+        if (*salta > 0) {
+            (*salta)--;
+            continue;
+        }
+        RigaInventario riga;
+        riga.articolo_id = sqlite3_column_int(stmt, 0);
+        riga.nome = (const char*)sqlite3_column_text(stmt, 1);
+        riga.artista = (const char*)sqlite3_column_text(stmt, 2);
+        riga.periodo = (const char*)sqlite3_column_text(stmt, 3);
+        riga.misure = (const char*)sqlite3_column_text(stmt, 4);
+        riga.quantita = sqlite3_column_int(stmt, 5);
+        riga.prezzo_acquisto = sqlite3_column_double(stmt, 6);
+        riga.venduto = sqlite3_column_int(stmt, 7);
+        riga.foto = (const char*)sqlite3_column_text(stmt, 8);
+        riga.rilevanza = con_rilevanza ? sqlite3_column_double(stmt, 9) : 0;
+        callback(&riga, user_data);
+        (*limite)--;
+    }
+    if (*limite > 0 && rc != SQLITE_DONE) {
+        if (rc != SQLITE_INTERRUPT) {
+            fprintf(stderr, "Errore lettura pagina: %s\n", sqlite3_errmsg(repo->db));
+        }
+        rilascia(repo, stmt);
+        return -1;
+    }
+    rilascia(repo, stmt);
+    return 0;
+}
+
+// Una pagina è il resto del gruppo del cursore (stesso valore della chiave,
+// ID successivi) seguito dai gruppi dopo: due query separate perché
+// ognuna diventa una ricerca sull'indice della colonna, mentre la
+// condizione con OR scorrerebbe il gruppo dall'inizio. Per ID il gruppo
+// è la riga stessa e basta la seconda.
+int repo_query_page(Repository *repo, const CriteriLista *criteri, const CursoreLista *cursore,
+                    int salta, int limite, RepoRigaCallback callback, void *user_data) {
+    if (!criteri) {
+        criteri = &criteri_predefiniti;
+    }
+    if (!criteri_validi(criteri)) {
+        return -1;
+    }
+    const char *chiave = chiavi_ordine[criteri->ordine].espressione;
+    int per_id = criteri->ordine == ORDINE_ID;
+    int resto = limite;
+
+    if (!cursore->inizio && !per_id) {
+        Sql sql = {0};
+        sql_aggiungi(&sql, SQL_COLONNE_LISTA "FROM articoli a");
+        char condizione[128];
+        snprintf(condizione, sizeof(condizione), "%s = ?1", chiave);
+        sql_condizione(&sql, condizione);
+        sql_dopo(&sql, "a.articolo_id", "?2", criteri->decrescente);
+        sql_filtri(&sql, criteri);
+        sql_ordine(&sql, criteri, 1);
+        sql_aggiungi(&sql, " LIMIT ?3;");
+
+        sqlite3_stmt *stmt = usa_composta(repo, sql.testo, "pagina_gruppo");
+        if (!stmt) {
+            return -1;
+        }
+        lega_cursore(stmt, criteri, cursore);
+        lega_filtri(stmt, criteri);
+        sqlite3_bind_int(stmt, P_LIMITE, salta + limite);
+        if (leggi_righe(repo, stmt, &salta, &resto, callback, user_data) < 0) {
+            return -1;
+        }
+    }
+
+    // Se la pagina non è piena prosegue con i gruppi successivi
+    if (resto > 0) {
+        Sql sql = {0};
+        sql_aggiungi(&sql, SQL_COLONNE_LISTA "FROM articoli a");
+        if (!cursore->inizio) {
+            sql_dopo(&sql, per_id ? "a.articolo_id" : chiave, per_id ? "?2" : "?1", criteri->decrescente);
+        }
+        sql_filtri(&sql, criteri);
+        sql_ordine(&sql, criteri, per_id);
+        sql_aggiungi(&sql, " LIMIT ?3;");
+
+        sqlite3_stmt *stmt = usa_composta(repo, sql.testo, "pagina_seguenti");
+        if (!stmt) {
+            return -1;
+        }
+        if (!cursore->inizio) {
+            lega_cursore(stmt, criteri, cursore);
+        }
+        lega_filtri(stmt, criteri);
+        sqlite3_bind_int(stmt, P_LIMITE, salta + resto);
+        if (leggi_righe(repo, stmt, &salta, &resto, callback, user_data) < 0) {
+            return -1;
+        }
+    }
+    return limite - resto;
+}
+
+int repo_conta_lista(Repository *repo, const CriteriLista *criteri) {
+    if (!criteri) {
+        criteri = &criteri_predefiniti;
+    }
+    Sql sql = {0};
+    sql_aggiungi(&sql, "SELECT COUNT(*) FROM articoli a");
+    sql_filtri(&sql, criteri);
+    sql_aggiungi(&sql, ";");
+    sqlite3_stmt *stmt = usa_composta(repo, sql.testo, "conta_lista");
+    if (!stmt) {
+        return 0;
+    }
+    lega_filtri(stmt, criteri);
+    return (int)leggi_intero(repo, stmt);
+}
+
+int repo_valori_filtro(Repository *repo, OrdineLista colonna,
+                       RepoValoreCallback callback, void *user_data) {
+    if (colonna != ORDINE_ARTISTA && colonna != ORDINE_PERIODO) {
+        return -1;
+    }
+    sqlite3_stmt *stmt = usa(repo, colonna == ORDINE_ARTISTA ? Q_VALORI_ARTISTA : Q_VALORI_PERIODO);
+    int righe = 0;
+    int rc;
+    while ((rc = passo(repo, stmt)) == SQLITE_ROW) {
+        callback((const char*)sqlite3_column_text(stmt, 0), user_data);
+        righe++;
+    }
+    rilascia(repo, stmt);
+    if (rc != SQLITE_DONE) {
+        if (rc != SQLITE_INTERRUPT) {
+            fprintf(stderr, "Errore lettura valori dei filtri: %s\n", sqlite3_errmsg(repo->db));
+        }
+        return -1;
+    }
+    return righe;
+}
+
+static int separatore(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Trasforma il testo digitato in una query FTS5: ogni parola diventa un
+// prefisso tra virgolette ("vaso"* "cin"*), così apici, trattini e parole
+// chiave come OR o NEAR non vengono interpretati. Le parole di una sola
+// lettera vengono ignorate: come prefisso corrispondono a quasi tutto il
+// catalogo. NULL se non restano parole.
+static char *componi_ricerca(const char *testo) {
+    size_t n = strlen(testo);
+    // Caso peggiore: ogni carattere è una virgoletta (raddoppiata) o una parola
+    char *query = malloc(n * 4 + 1);
+    if (!query) {
+        return NULL;
+    }
+    char *out = query;
+    const char *p = testo;
+    while (*p) {
+        while (separatore(*p)) {
+            p++;
+        }
+        const char *inizio = p;
+        while (*p && !separatore(*p)) {
+            p++;
+        }
+        if (p - inizio < 2) {
+            continue;
+        }
+        if (out != query) {
+            *out++ = ' ';
+        }
+        *out++ = '"';
+        for (const char *c = inizio; c < p; c++) {
+            if (*c == '"') {
+                *out++ = '"';
+            }
+            *out++ = *c;
+        }
+        *out++ = '"';
+        *out++ = '*';
+    }
+    *out = '\0';
+    if (out == query) {
+        free(query);
+        return NULL;
+    }
+    return query;
+}
+
+// Senza filtri il conteggio legge solo l'indice di ricerca
+int repo_conta_ricerca(Repository *repo, const char *testo, const CriteriLista *criteri) {
+    if (!criteri) {
+        criteri = &criteri_predefiniti;
+    }
+    char *query = componi_ricerca(testo);
+    if (!query) {
+        return 0;
+    }
+    Sql sql = {0};
+    if (repo_criteri_filtrano(criteri)) {
+        sql_aggiungi(&sql, "SELECT COUNT(*) FROM articoli_fts JOIN articoli a ON a.articolo_id = articoli_fts.rowid");
+        sql_filtri(&sql, criteri);
+    } else {
+        sql_aggiungi(&sql, "SELECT COUNT(*) FROM articoli_fts");
+    }
+    sql_condizione(&sql, "articoli_fts MATCH ?5");
+    sql_aggiungi(&sql, ";");
+    sqlite3_stmt *stmt = usa_composta(repo, sql.testo, "cerca_conta");
+    if (!stmt) {
+        free(query);
+        return 0;
+    }
+    sqlite3_bind_text(stmt, P_RICERCA, query, -1, SQLITE_TRANSIENT);
+    lega_filtri(stmt, criteri);
+    int n = (int)leggi_intero(repo, stmt);
+    free(query);
+    return n;
+}
+
+// Ordine per rilevanza: i criteri indicano l'ordine predefinito
+static int ricerca_per_rilevanza(const CriteriLista *criteri, int ordina) {
+    return ordina && criteri->ordine == ORDINE_STATO && !criteri->decrescente;
+}
+
+void repo_cursore_ricerca(const CriteriLista *criteri, int ordina, const RigaInventario *riga,
+                          CursoreLista *cursore) {
+    if (!criteri) {
+        criteri = &criteri_predefiniti;
+    }
+    repo_cursore_riga(criteri, riga, cursore);
+    if (ricerca_per_rilevanza(criteri, ordina)) {
+        cursore->numero = riga->rilevanza;
+    }
+}
+
+int repo_ricerca_decrescente(const CriteriLista *criteri, int ordina) {
+    if (!criteri) {
+        criteri = &criteri_predefiniti;
+    }
+    return !ordina || criteri->decrescente;
+}
+
+// L'ordinamento per rilevanza (pesi impostati nella tabella articoli_fts) o
+// per colonna richiede di valutare tutti i risultati, ma con il cursore
+// l'ordinamento tiene solo le righe della pagina; quello per ID segue
+// l'indice di ricerca dal cursore e si ferma alla pagina. A parità di
+// rilevanza le righe seguono l'ID.
+int repo_cerca_pagina(Repository *repo, const char *testo, const CriteriLista *criteri, int ordina,
+                      const CursoreLista *cursore, int salta, int limite,
+                      RepoRigaCallback callback, void *user_data) {
+    if (!criteri) {
+        criteri = &criteri_predefiniti;
+    }
+    if (!criteri_validi(criteri)) {
+        return -1;
+    }
+    char *query = componi_ricerca(testo);
+    if (!query) {
+        return 0;
+    }
+    int rilevanza = ricerca_per_rilevanza(criteri, ordina);
+    Sql sql = {0};
+    sql_aggiungi(&sql, SQL_COLONNE_LISTA);
+    if (rilevanza) {
+        sql_aggiungi(&sql, ", rank ");
+    }
+    sql_aggiungi(&sql, "FROM articoli_fts JOIN articoli a ON a.articolo_id = articoli_fts.rowid");
+    sql_condizione(&sql, "articoli_fts MATCH ?5");
+    if (!cursore->inizio) {
+        if (!ordina) {
+            sql_condizione(&sql, "articoli_fts.rowid < ?2");
+        } else if (criteri->ordine == ORDINE_ID) {
+            sql_dopo(&sql, "a.articolo_id", "?2", criteri->decrescente);
+        } else {
+            // Nessun indice da seguire: basta un confronto sulla coppia
+            char chiave[96];
+            snprintf(chiave, sizeof(chiave), "(%s, a.articolo_id)",
+                     rilevanza ? "rank" : chiavi_ordine[criteri->ordine].espressione);
+            sql_dopo(&sql, chiave, "(?1, ?2)", criteri->decrescente);
+        }
+    }
+    sql_filtri(&sql, criteri);
+    if (!ordina) {
+        sql_aggiungi(&sql, " ORDER BY articoli_fts.rowid DESC");
+    } else if (rilevanza) {
+        sql_aggiungi(&sql, " ORDER BY rank, a.articolo_id");
+    } else {
+        sql_ordine(&sql, criteri, criteri->ordine == ORDINE_ID);
+    }
+    sql_aggiungi(&sql, " LIMIT ?3;");
+
+    sqlite3_stmt *stmt = usa_composta(repo, sql.testo, ordina ? "cerca_ordinata" : "cerca_recenti");
+    if (!stmt) {
+        free(query);
+        return -1;
+    }
+    sqlite3_bind_text(stmt, P_RICERCA, query, -1, SQLITE_TRANSIENT);
+    if (!cursore->inizio) {
+        lega_cursore(stmt, criteri, cursore);
+        if (rilevanza) {
+            sqlite3_bind_double(stmt, P_VALORE, cursore->numero);
+        }
+    }
+    lega_filtri(stmt, criteri);
+    sqlite3_bind_int(stmt, P_LIMITE, salta + limite);
+    free(query);
+
+    int resto = limite;
+    if (leggi_righe(repo, stmt, &salta, &resto, callback, user_data) < 0) {
+        return -1;
+    }
+    return limite - resto;
+}
+
+// Conclude una lettura completa: -1 se si è interrotta per un errore
+static int fine_esportazione(Repository *repo, sqlite3_stmt *stmt, int rc, int righe) {
+    rilascia(repo, stmt);
+    if (rc != SQLITE_DONE && rc != SQLITE_ROW) {
+        if (rc != SQLITE_INTERRUPT) {
+            fprintf(stderr, "Errore lettura esportazione: %s\n", sqlite3_errmsg(repo->db));
+        }
+        return -1;
+    }
+    return righe;
+}
+
+int repo_esporta_vendite(Repository *repo, const char *dal, const char *al,
+                         RepoVenditaCallback callback, void *user_data) {
+    sqlite3_stmt *stmt = usa(repo, Q_ESPORTA_VENDITE);
+    // Senza estremi l'intervallo copre tutte le date
+    sqlite3_bind_text(stmt, 1, dal ? dal : "", -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, al ? al : "9999-12-31", -1, SQLITE_TRANSIENT);
+
+    int righe = 0;
+    int rc;
+    while ((rc = passo(repo, stmt)) == SQLITE_ROW) {
+        RigaVendita riga;
+        riga.vendita_id = sqlite3_column_int64(stmt, 0);
+        riga.data_vendita = (const char*)sqlite3_column_text(stmt, 1);
+        riga.articolo_id = sqlite3_column_int(stmt, 2);
+        riga.nome = (const char*)sqlite3_column_text(stmt, 3);
+        riga.artista = (const char*)sqlite3_column_text(stmt, 4);
+        riga.periodo = (const char*)sqlite3_column_text(stmt, 5);
+        riga.prezzo_acquisto = sqlite3_column_double(stmt, 6);
+        riga.prezzo_vendita = sqlite3_column_double(stmt, 7);
+        riga.nome_cliente = (const char*)sqlite3_column_text(stmt, 8);
+        righe++;
+        if (!callback(&riga, user_data)) {
+            break;
+        }
+    }
+    return fine_esportazione(repo, stmt, rc, righe);
+}
+
+int repo_esporta_articoli(Repository *repo, const char *dal, const char *al,
+                          RepoArticoloCallback callback, void *user_data) {
+    sqlite3_stmt *stmt = usa(repo, Q_ESPORTA_ARTICOLI);
+    if (dal) {
+        sqlite3_bind_text(stmt, 1, dal, -1, SQLITE_TRANSIENT);
+    }
+    if (al) {
+        sqlite3_bind_text(stmt, 2, al, -1, SQLITE_TRANSIENT);
+    }
+
+    int righe = 0;
+    int rc;
+    while ((rc = passo(repo, stmt)) == SQLITE_ROW) {
+        RigaArticolo riga;
+        riga.articolo_id = sqlite3_column_int(stmt, 0);
+        riga.nome = (const char*)sqlite3_column_text(stmt, 1);
+        riga.descrizione = (const char*)sqlite3_column_text(stmt, 2);
+        riga.artista = (const char*)sqlite3_column_text(stmt, 3);
+        riga.periodo = (const char*)sqlite3_column_text(stmt, 4);
+        riga.misure = (const char*)sqlite3_column_text(stmt, 5);
+        riga.data_acquisizione = (const char*)sqlite3_column_text(stmt, 6);
+        riga.prezzo_acquisto = sqlite3_column_double(stmt, 7);
+        riga.quantita = sqlite3_column_int(stmt, 8);
+        righe++;
+        if (!callback(&riga, user_data)) {
+            break;
+        }
+    }
+    return fine_esportazione(repo, stmt, rc, righe);
+}
+
+int repo_leggi_statistiche(Repository *repo, DimensioneStatistica dimensione,
+                           const char *dal, const char *al,
+                           RepoStatisticaCallback callback, void *user_data) {
+    static const char *nomi[] = {
+        [STATISTICA_GIORNO] = "giorno",
+        [STATISTICA_MESE] = "mese",
+        [STATISTICA_ARTISTA] = "artista",
+        [STATISTICA_PERIODO] = "periodo",
+    };
+    sqlite3_stmt *stmt = usa(repo, Q_STATISTICHE);
+    sqlite3_bind_text(stmt, 1, nomi[dimensione], -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, dal ? dal : "", -1, SQLITE_TRANSIENT);
+    if (al) {
+        sqlite3_bind_text(stmt, 3, al, -1, SQLITE_TRANSIENT);
+    }
+
+    int righe = 0;
+    int rc;
+    while ((rc = passo(repo, stmt)) == SQLITE_ROW) {
+        RigaStatistica riga;
+        riga.chiave = (const char*)sqlite3_column_text(stmt, 0);
+        riga.pezzi = sqlite3_column_int(stmt, 1);
+        riga.ricavo = sqlite3_column_double(stmt, 2);
+        riga.costo = sqlite3_column_double(stmt, 3);
+        riga.margine = riga.ricavo - riga.costo;
+        callback(&riga, user_data);
+        righe++;
+    }
+    rilascia(repo, stmt);
+    if (rc != SQLITE_DONE) {
+        if (rc != SQLITE_INTERRUPT) {
+            fprintf(stderr, "Errore lettura statistiche: %s\n", sqlite3_errmsg(repo->db));
+        }
+        return -1;
+    }
+    return righe;
+}
+
+int repo_valore_magazzino(Repository *repo, ValoreMagazzino *valore) {
+    sqlite3_stmt *stmt = usa(repo, Q_VALORE_MAGAZZINO);
+    memset(valore, 0, sizeof(*valore));
+    int rc = passo(repo, stmt);
+    if (rc == SQLITE_ROW) {
+        valore->articoli = sqlite3_column_int(stmt, 0);
+        valore->pezzi = sqlite3_column_int64(stmt, 1);
+        valore->valore = sqlite3_column_double(stmt, 2);
+        rc = SQLITE_OK;
+    } else if (rc != SQLITE_INTERRUPT) {
+        fprintf(stderr, "Errore lettura valore magazzino: %s\n", sqlite3_errmsg(repo->db));
+    }
+    rilascia(repo, stmt);
+    return rc;
+}
+
+int repo_conta_articoli(Repository *repo) {
+    return (int)leggi_intero(repo, usa(repo, Q_CONTA));
+}
+
+int repo_conta_precedenti(Repository *repo, int venduto, sqlite3_int64 articolo_id) {
+    sqlite3_stmt *stmt = usa(repo, Q_PRECEDENTI);
+    sqlite3_bind_int(stmt, 1, venduto);
+    sqlite3_bind_int64(stmt, 2, articolo_id);
+    return (int)leggi_intero(repo, stmt);
+}
+
+sqlite3_int64 repo_versione_modifiche(Repository *repo) {
+    return leggi_intero(repo, usa(repo, Q_VERSIONE));
+}
+
+int repo_leggi_modifiche(Repository *repo, sqlite3_int64 dopo_versione,
+                         RepoModificaCallback callback, void *user_data) {
+    sqlite3_stmt *stmt = usa(repo, Q_MODIFICHE);
+    sqlite3_bind_int64(stmt, 1, dopo_versione);
+
+    int n = 0;
+    int rc;
+    while ((rc = passo(repo, stmt)) == SQLITE_ROW) {
+        callback(sqlite3_column_int64(stmt, 0),
+                 sqlite3_column_int(stmt, 1),
+                 sqlite3_column_type(stmt, 2) != SQLITE_NULL, sqlite3_column_int(stmt, 2),
+                 sqlite3_column_type(stmt, 3) != SQLITE_NULL, sqlite3_column_int(stmt, 3),
+                 user_data);
+        n++;
+    }
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Errore lettura registro modifiche: %s\n", sqlite3_errmsg(repo->db));
+        n = -1;
+    }
+    rilascia(repo, stmt);
+    return n;
+}
+
+void repo_inizia_snapshot(Repository *repo) {
+    esegui(repo, usa(repo, Q_SNAPSHOT));
+}
+
+void repo_chiudi_snapshot(Repository *repo) {
+    esegui(repo, usa(repo, Q_FINE_SNAPSHOT));
+}
+
+sqlite3_int64 repo_versione_minima(Repository *repo) {
+    return leggi_intero(repo, usa(repo, Q_VERSIONE_MINIMA));
+}
+
+// Colonne di un articolo completo a partire dalla colonna "da"
+static void leggi_articolo(sqlite3_stmt *stmt, int da, RigaArticolo *riga) {
+    riga->articolo_id = sqlite3_column_int(stmt, da);
+    riga->nome = (const char*)sqlite3_column_text(stmt, da + 1);
+    riga->descrizione = (const char*)sqlite3_column_text(stmt, da + 2);
+    riga->artista = (const char*)sqlite3_column_text(stmt, da + 3);
+    riga->periodo = (const char*)sqlite3_column_text(stmt, da + 4);
+    riga->misure = (const char*)sqlite3_column_text(stmt, da + 5);
+    riga->data_acquisizione = (const char*)sqlite3_column_text(stmt, da + 6);
+    riga->prezzo_acquisto = sqlite3_column_double(stmt, da + 7);
+    riga->quantita = sqlite3_column_int(stmt, da + 8);
+}
+
+static int fine_lettura_sync(Repository *repo, sqlite3_stmt *stmt, int rc, int righe) {
+    if (rc != SQLITE_DONE && rc != SQLITE_ROW) {
+        segna_errore(repo, rc);
+        righe = -1;
+    }
+    rilascia(repo, stmt);
+    return righe;
+}
+
+int repo_articoli_modificati(Repository *repo, sqlite3_int64 dopo_versione, int limite,
+                             RepoReplicaCallback callback, void *user_data) {
+    sqlite3_stmt *stmt = usa(repo, Q_DELTA_ARTICOLI);
+    sqlite3_bind_int64(stmt, 1, dopo_versione);
+    sqlite3_bind_int(stmt, 2, limite);
+
+    int righe = 0;
+    int rc;
+    while ((rc = passo(repo, stmt)) == SQLITE_ROW) {
+        RigaArticolo riga;
+        int presente = sqlite3_column_int(stmt, 2);
+        if (presente) {
+            // Dopo l'ID c'è il flag: le altre colonne partono dalla 3
+            leggi_articolo(stmt, 2, &riga);
+            riga.articolo_id = sqlite3_column_int(stmt, 1);
+        }
+        righe++;
+        if (!callback(sqlite3_column_int64(stmt, 0), sqlite3_column_int(stmt, 1),
+                      presente ? &riga : NULL, user_data)) {
+            break;
+        }
+    }
+    return fine_lettura_sync(repo, stmt, rc, righe);
+}
+
+int repo_articoli_da(Repository *repo, int dopo_id, int limite,
+                     RepoArticoloCallback callback, void *user_data) {
+    sqlite3_stmt *stmt = usa(repo, Q_ARTICOLI_DA);
+    sqlite3_bind_int(stmt, 1, dopo_id);
+    sqlite3_bind_int(stmt, 2, limite);
+
+    int righe = 0;
+    int rc;
+    while ((rc = passo(repo, stmt)) == SQLITE_ROW) {
+        RigaArticolo riga;
+        leggi_articolo(stmt, 0, &riga);
+        righe++;
+        if (!callback(&riga, user_data)) {
+            break;
+        }
+    }
+    return fine_lettura_sync(repo, stmt, rc, righe);
+}
+
+int repo_vendite_da(Repository *repo, sqlite3_int64 dopo_id, int limite,
+                    RepoVenditaCallback callback, void *user_data) {
+    sqlite3_stmt *stmt = usa(repo, Q_VENDITE_DA);
+    sqlite3_bind_int64(stmt, 1, dopo_id);
+    sqlite3_bind_int(stmt, 2, limite);
+
+    int righe = 0;
+    int rc;
+    while ((rc = passo(repo, stmt)) == SQLITE_ROW) {
+        RigaVendita riga;
+        memset(&riga, 0, sizeof(riga));
+        riga.vendita_id = sqlite3_column_int64(stmt, 0);
+        riga.articolo_id = sqlite3_column_int(stmt, 1);
+        riga.data_vendita = (const char*)sqlite3_column_text(stmt, 2);
+        riga.prezzo_vendita = sqlite3_column_double(stmt, 3);
+        riga.nome_cliente = (const char*)sqlite3_column_text(stmt, 4);
+        righe++;
+        if (!callback(&riga, user_data)) {
+            break;
+        }
+    }
+    return fine_lettura_sync(repo, stmt, rc, righe);
+}
+
+int repo_replica_articolo(Repository *repo, const RigaArticolo *riga) {
+    sqlite3_stmt *stmt = usa(repo, Q_REPLICA_ARTICOLO);
+    sqlite3_bind_int(stmt, 1, riga->articolo_id);
+    sqlite3_bind_text(stmt, 2, riga->nome, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 3, riga->descrizione, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 4, riga->artista, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 5, riga->periodo, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 6, riga->misure, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 7, riga->data_acquisizione, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_double(stmt, 8, riga->prezzo_acquisto);
+    sqlite3_bind_int(stmt, 9, riga->quantita);
+    return segna_errore(repo, esegui(repo, stmt));
+}
+
+int repo_replica_elimina_tra(Repository *repo, int dopo_id, int prima_di) {
+    sqlite3_stmt *stmt = usa(repo, Q_REPLICA_ELIMINA_TRA);
+    sqlite3_bind_int(stmt, 1, dopo_id);
+    sqlite3_bind_int(stmt, 2, prima_di);
+    return segna_errore(repo, esegui(repo, stmt));
+}
+
+int repo_replica_vendita(Repository *repo, const RigaVendita *riga) {
+    sqlite3_stmt *stmt = usa(repo, Q_REPLICA_VENDITA);
+    sqlite3_bind_int64(stmt, 1, riga->vendita_id);
+    sqlite3_bind_int(stmt, 2, riga->articolo_id);
+    sqlite3_bind_text(stmt, 3, riga->data_vendita, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_double(stmt, 4, riga->prezzo_vendita);
+    sqlite3_bind_text(stmt, 5, riga->nome_cliente, -1, SQLITE_TRANSIENT);
+    return segna_errore(repo, esegui(repo, stmt));
+}
+
+// I riepiloghi si azzerano con le vendite: vengono ricalcolati dai trigger
+// man mano che le vendite del server arrivano
+int repo_replica_svuota_vendite(Repository *repo) {
+    int rc = segna_errore(repo, esegui(repo, usa(repo, Q_REPLICA_SVUOTA_VENDITE)));
+    if (rc == SQLITE_OK) {
+        rc = segna_errore(repo, esegui(repo, usa(repo, Q_REPLICA_SVUOTA_STATISTICHE)));
+    }
+    return rc;
+}
+
+int repo_stato_sync(Repository *repo, const char *chiave, sqlite3_int64 *valore) {
+    sqlite3_stmt *stmt = usa(repo, Q_LEGGI_SYNC);
+    sqlite3_bind_text(stmt, 1, chiave, -1, SQLITE_STATIC);
+    int rc = passo(repo, stmt);
+    *valore = rc == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+    rilascia(repo, stmt);
+    return segna_errore(repo, rc == SQLITE_ROW || rc == SQLITE_DONE ? SQLITE_OK : rc);
+}
+
+int repo_imposta_stato_sync(Repository *repo, const char *chiave, sqlite3_int64 valore) {
+    sqlite3_stmt *stmt = usa(repo, Q_SCRIVI_SYNC);
+    sqlite3_bind_text(stmt, 1, chiave, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, valore);
+    return segna_errore(repo, esegui(repo, stmt));
+}
+
+sqlite3_int64 repo_identificativo_sync(Repository *repo) {
+    sqlite3_int64 identificativo = 0;
+    if (segna_errore(repo, esegui(repo, usa(repo, Q_CREA_IDENTIFICATIVO))) == SQLITE_OK) {
+        repo_stato_sync(repo, "identificativo", &identificativo);
+    }
+    return identificativo;
+}
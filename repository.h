@@ -0,0 +1,329 @@
+#ifndef REPOSITORY_H
+#define REPOSITORY_H
+
+#include <sqlite3.h>
+
+// Accesso ai dati del magazzino: tutte le query vengono preparate una volta
+// in repo_apri() e riusate con sqlite3_reset/sqlite3_clear_bindings.
+// Non dipende da GTK, quindi può essere usato anche senza interfaccia.
+typedef struct Repository Repository;
+
+// Dati di un nuovo articolo (le stringhe possono essere NULL)
+typedef struct {
+    const char *nome;
+    const char *descrizione;
+    const char *artista;
+    const char *periodo;
+    const char *misure;
+    const char *data_acquisizione;
+    double prezzo_acquisto;
+    int quantita;
+} NuovoArticolo;
+
+// Riga della lista del magazzino; le stringhe sono valide solo durante la callback
+typedef struct {
+    int articolo_id;
+    const char *nome;
+    const char *artista;
+    const char *periodo;
+    const char *misure;
+    int quantita;
+    double prezzo_acquisto;
+    int venduto;
+    const char *foto;       // hash della foto principale, NULL se non ce ne sono
+    double rilevanza;       // nei risultati della ricerca per rilevanza, altrimenti 0
+} RigaInventario;
+
+typedef enum {
+    VENDITA_OK,
+    VENDITA_NON_TROVATO,
+    VENDITA_ESAURITO,
+    VENDITA_ERRORE
+} EsitoVendita;
+
+// Riga di un carrello di vendite; "esito" viene compilato da repo_vendi_carrello
+typedef struct {
+    int articolo_id;
+    double prezzo_vendita;
+    const char *nome_cliente;
+    EsitoVendita esito;
+} RigaCarrello;
+
+// Vendita con i dati dell'articolo venduto (NULL se l'articolo è stato eliminato)
+typedef struct {
+    sqlite3_int64 vendita_id;
+    const char *data_vendita;
+    int articolo_id;
+    const char *nome;
+    const char *artista;
+    const char *periodo;
+    double prezzo_acquisto;
+    double prezzo_vendita;
+    const char *nome_cliente;
+} RigaVendita;
+
+// Articolo completo, per le esportazioni
+typedef struct {
+    int articolo_id;
+    const char *nome;
+    const char *descrizione;
+    const char *artista;
+    const char *periodo;
+    const char *misure;
+    const char *data_acquisizione;
+    double prezzo_acquisto;
+    int quantita;
+} RigaArticolo;
+
+typedef void (*RepoRigaCallback)(const RigaInventario *riga, void *user_data);
+
+// Colonne per cui si può ordinare la lista
+typedef enum {
+    ORDINE_STATO,           // disponibili prima dei venduti (ordine predefinito)
+    ORDINE_ID,
+    ORDINE_NOME,
+    ORDINE_ARTISTA,
+    ORDINE_PERIODO,
+    ORDINE_QUANTITA,
+    ORDINE_PREZZO,
+    N_ORDINI
+} OrdineLista;
+
+// Ordinamento e filtri della lista. A parità di valore le righe seguono
+// l'ID, nello stesso verso. Artista e periodo si confrontano senza
+// distinguere le maiuscole ("" = articoli senza); i campi NULL o negativi
+// non filtrano.
+typedef struct {
+    OrdineLista ordine;
+    int decrescente;
+    int venduto;            // 0 solo disponibili, 1 solo venduti
+    const char *artista;
+    const char *periodo;
+    double prezzo_min;      // prezzo di acquisto, estremi compresi
+    double prezzo_max;
+} CriteriLista;
+
+// Posizione nella lista per la paginazione per chiave: la lettura riprende
+// dopo la riga con questo valore della colonna di ordinamento e questo ID.
+// Il valore è quello mostrato nella riga: testo per nome, artista e
+// periodo, numero per le altre colonne (vedi repo_cursore_riga).
+typedef struct {
+    int inizio;             // 1 = dalla prima riga, il resto è ignorato
+    const char *testo;
+    double numero;
+    sqlite3_int64 articolo_id;
+} CursoreLista;
+
+typedef void (*RepoValoreCallback)(const char *valore, void *user_data);
+
+// Raggruppamenti dei riepiloghi di vendita
+typedef enum {
+    STATISTICA_GIORNO,      // chiave AAAA-MM-GG
+    STATISTICA_MESE,        // chiave AAAA-MM
+    STATISTICA_ARTISTA,     // chiave vuota per gli articoli senza artista
+    STATISTICA_PERIODO
+} DimensioneStatistica;
+
+// Totali delle vendite di un gruppo; costo è la somma dei prezzi di acquisto
+typedef struct {
+    const char *chiave;
+    int pezzi;
+    double ricavo;
+    double costo;
+    double margine;         // ricavo - costo
+} RigaStatistica;
+
+// Articoli disponibili, pezzi in magazzino e loro valore d'acquisto
+typedef struct {
+    int articoli;
+    sqlite3_int64 pezzi;
+    double valore;
+} ValoreMagazzino;
+
+typedef void (*RepoStatisticaCallback)(const RigaStatistica *riga, void *user_data);
+
+// Callback delle esportazioni: restituiscono 0 per interrompere la lettura
+typedef int (*RepoVenditaCallback)(const RigaVendita *riga, void *user_data);
+typedef int (*RepoArticoloCallback)(const RigaArticolo *riga, void *user_data);
+
+// Callback per il registro modifiche: ha_vecchio/ha_nuovo sono 0 se la riga
+// non esisteva prima o non esiste più dopo la modifica
+typedef void (*RepoModificaCallback)(sqlite3_int64 versione, int articolo_id,
+                                     int ha_vecchio, int vecchio_venduto,
+                                     int ha_nuovo, int nuovo_venduto,
+                                     void *user_data);
+
+// Callback per le modifiche da replicare: riga è NULL se l'articolo è stato
+// eliminato. Restituisce 0 per interrompere la lettura.
+typedef int (*RepoReplicaCallback)(sqlite3_int64 versione, int articolo_id,
+                                   const RigaArticolo *riga, void *user_data);
+
+// Prepara tutte le query sulla connessione; NULL in caso di errore
+Repository *repo_apri(sqlite3 *db);
+void repo_chiudi(Repository *repo);
+
+sqlite3 *repo_db(Repository *repo);
+// Messaggio dell'ultimo errore di scrittura
+const char *repo_errmsg(Repository *repo);
+
+// Inserisce un articolo; restituisce un codice SQLite e, se richiesto, il nuovo ID
+int repo_insert_articolo(Repository *repo, const NuovoArticolo *articolo, int *nuovo_id);
+
+// Registra la vendita di un pezzo dell'articolo con la data indicata (YYYY-MM-DD)
+// in un'unica transazione: il pezzo viene scalato solo se ancora disponibile
+EsitoVendita repo_registra_vendita(Repository *repo, int articolo_id, double prezzo_vendita,
+                                   const char *nome_cliente, const char *data_vendita);
+
+// Registra tutte le righe del carrello con un solo commit. Le righe non
+// trovate o esaurite vengono saltate (vedi righe[i].esito); un errore del DB
+// annulla l'intero carrello. Restituisce le vendite registrate o -1.
+int repo_vendi_carrello(Repository *repo, RigaCarrello *righe, int n, const char *data_vendita);
+
+// Transazione di scrittura esplicita per le operazioni massive (es.
+// importazione): le insert eseguite nel mezzo vengono confermate con un solo
+// commit. termina con ok = 0 annulla tutto. Restituiscono un codice SQLite.
+// Le operazioni che aprono una propria transazione (vendite, carrello) dentro
+// una transazione esplicita usano un savepoint: se falliscono annullano solo
+// le proprie modifiche.
+int repo_inizia_transazione(Repository *repo);
+int repo_termina_transazione(Repository *repo, int ok);
+
+// Collega all'articolo una foto già salvata nell'archivio (vedi
+// archivio_foto.h), dopo quelle che ha già. Se la foto è già collegata o
+// l'articolo non esiste non fa nulla. Restituisce un codice SQLite.
+int repo_aggiungi_foto(Repository *repo, int articolo_id, const char *hash, sqlite3_int64 dimensione);
+
+// 1 se qualche articolo usa la foto con questo hash, 0 se nessuno, -1 in caso di errore
+int repo_foto_usata(Repository *repo, const char *hash);
+
+// Elimina un articolo (e i collegamenti alle sue foto); restituisce un codice SQLite
+int repo_elimina_articolo(Repository *repo, int articolo_id);
+
+// Criteri della lista completa in ordine predefinito (anche con criteri NULL)
+void repo_criteri_predefiniti(CriteriLista *criteri);
+// 1 se i criteri escludono qualche articolo
+int repo_criteri_filtrano(const CriteriLista *criteri);
+
+// Cursore che riparte dopo la riga indicata; il testo punta nella riga
+void repo_cursore_riga(const CriteriLista *criteri, const RigaInventario *riga, CursoreLista *cursore);
+
+// Come repo_cursore_riga per una riga dei risultati di repo_cerca_pagina
+// letti con lo stesso valore di "ordina"
+void repo_cursore_ricerca(const CriteriLista *criteri, int ordina, const RigaInventario *riga,
+                          CursoreLista *cursore);
+
+// 1 se i risultati di repo_cerca_pagina seguono gli ID in ordine
+// decrescente (a parità di chiave)
+int repo_ricerca_decrescente(const CriteriLista *criteri, int ordina);
+
+// Legge fino a "limite" righe della lista nell'ordine e con i filtri dei
+// criteri, successive al cursore, saltandone "salta". Ogni ordinamento
+// segue un indice: una pagina costa le sole righe lette, a qualunque
+// punto della lista. Restituisce le righe lette o -1.
+int repo_query_page(Repository *repo, const CriteriLista *criteri, const CursoreLista *cursore,
+                    int salta, int limite, RepoRigaCallback callback, void *user_data);
+
+// Numero totale di articoli
+int repo_conta_articoli(Repository *repo);
+
+// Numero di righe della lista con i filtri dei criteri
+int repo_conta_lista(Repository *repo, const CriteriLista *criteri);
+
+// Numero di righe della lista in ordine predefinito e senza filtri che
+// precedono la chiave (venduto, articolo_id)
+int repo_conta_precedenti(Repository *repo, int venduto, sqlite3_int64 articolo_id);
+
+// Valori distinti di artista o periodo (ORDINE_ARTISTA, ORDINE_PERIODO) in
+// ordine alfabetico, per i filtri. Restituisce i valori letti o -1.
+int repo_valori_filtro(Repository *repo, OrdineLista colonna,
+                       RepoValoreCallback callback, void *user_data);
+
+// Ultima versione del registro articoli_modifiche
+sqlite3_int64 repo_versione_modifiche(Repository *repo);
+
+// Scorre il registro delle modifiche successive a "dopo_versione", in ordine
+int repo_leggi_modifiche(Repository *repo, sqlite3_int64 dopo_versione,
+                         RepoModificaCallback callback, void *user_data);
+
+// Numero di articoli trovati dalla ricerca a testo pieno su nome,
+// descrizione, artista e periodo, tra quelli dei filtri dei criteri. Ogni
+// parola del testo è cercata come inizio di parola; tutte devono esserci.
+int repo_conta_ricerca(Repository *repo, const char *testo, const CriteriLista *criteri);
+
+// Legge una pagina dei risultati della ricerca: con ordina = 1 dai più
+// pertinenti o, se i criteri indicano una colonna diversa dall'ordine
+// predefinito, in quell'ordine; con ordina = 0 dai più recenti (molto più
+// veloce con tanti risultati). Come repo_query_page riprende dopo il
+// cursore (vedi repo_cursore_ricerca) saltando "salta" righe.
+// Restituisce le righe lette o -1.
+int repo_cerca_pagina(Repository *repo, const char *testo, const CriteriLista *criteri, int ordina,
+                      const CursoreLista *cursore, int salta, int limite,
+                      RepoRigaCallback callback, void *user_data);
+
+// Scorre le vendite con data nell'intervallo [dal, al] (AAAA-MM-GG, NULL =
+// senza limite) in ordine di data, una riga alla volta senza caricarle
+// tutte. Restituisce le righe passate alla callback o -1.
+int repo_esporta_vendite(Repository *repo, const char *dal, const char *al,
+                         RepoVenditaCallback callback, void *user_data);
+
+// Come sopra per gli articoli, filtrati per data di acquisizione e in ordine di ID
+int repo_esporta_articoli(Repository *repo, const char *dal, const char *al,
+                          RepoArticoloCallback callback, void *user_data);
+
+// Scorre i totali di vendita di una dimensione in ordine di chiave, con
+// chiave compresa tra dal e al (NULL = senza limite). I totali sono tenuti
+// aggiornati dai trigger a ogni vendita: la lettura costa una riga per
+// gruppo, non per vendita. Restituisce le righe lette o -1.
+int repo_leggi_statistiche(Repository *repo, DimensioneStatistica dimensione,
+                           const char *dal, const char *al,
+                           RepoStatisticaCallback callback, void *user_data);
+
+// Valore attuale del magazzino; restituisce un codice SQLite
+int repo_valore_magazzino(Repository *repo, ValoreMagazzino *valore);
+
+// --- Sincronizzazione tra terminali (vedi sincronizzazione.h) ---
+
+// Versione più vecchia ancora nel registro delle modifiche (0 se è vuoto):
+// chi è rimasto più indietro deve rileggere tutti gli articoli
+sqlite3_int64 repo_versione_minima(Repository *repo);
+
+// Lato server: al massimo "limite" modifiche del registro dopo
+// dopo_versione, ognuna con lo stato attuale dell'articolo. Restituisce le
+// righe lette o -1.
+int repo_articoli_modificati(Repository *repo, sqlite3_int64 dopo_versione, int limite,
+                             RepoReplicaCallback callback, void *user_data);
+
+// Lato server: articoli con ID maggiore di dopo_id, in ordine di ID
+int repo_articoli_da(Repository *repo, int dopo_id, int limite,
+                     RepoArticoloCallback callback, void *user_data);
+
+// Lato server: vendite con ID maggiore di dopo_id; dei dati dell'articolo
+// in RigaVendita è compilato solo articolo_id
+int repo_vendite_da(Repository *repo, sqlite3_int64 dopo_id, int limite,
+                    RepoVenditaCallback callback, void *user_data);
+
+// Lato terminale: applica alla copia locale un articolo ricevuto dal server
+// (inserito o aggiornato con lo stesso ID), elimina gli articoli con ID
+// compreso tra dopo_id e prima_di esclusi, aggiunge una vendita con il suo
+// ID. Restituiscono un codice SQLite.
+int repo_replica_articolo(Repository *repo, const RigaArticolo *riga);
+int repo_replica_elimina_tra(Repository *repo, int dopo_id, int prima_di);
+int repo_replica_vendita(Repository *repo, const RigaVendita *riga);
+
+// Lato terminale: toglie tutte le vendite e i loro riepiloghi, prima di
+// rileggerle da un server diverso
+int repo_replica_svuota_vendite(Repository *repo);
+
+// Valori della tabella sincronizzazione (0 se la chiave non c'è)
+int repo_stato_sync(Repository *repo, const char *chiave, sqlite3_int64 *valore);
+int repo_imposta_stato_sync(Repository *repo, const char *chiave, sqlite3_int64 valore);
+
+// Lato server: numero casuale che identifica il database, creato al primo
+// uso. Un terminale che lo vede cambiare rilegge tutto. 0 in caso di errore.
+sqlite3_int64 repo_identificativo_sync(Repository *repo);
+
+// Letture coerenti su più query: tutte vedono lo stesso stato del DB
+void repo_inizia_snapshot(Repository *repo);
+void repo_chiudi_snapshot(Repository *repo);
+
+#endif
@@ -0,0 +1,358 @@
+#include "riga_comando.h"
+#include <signal.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "backup.h"
+#include "connessione.h"
+#include "esporta.h"
+#include "giornale.h"
+#include "importa.h"
+#include "repository.h"
+#include "schema.h"
+#include "sincronizzazione.h"
+#include "validazione.h"
+
+// Righe scartate mostrate per intero; le altre vengono solo contate
+#define MAX_ERRORI_MOSTRATI 100
+
+// Opzioni lette dalla riga di comando
+typedef struct {
+    const char *percorso_db;
+    const char *file_importa;
+    const char *dati_esporta;
+    const char *file_esporta;
+    const char *formato;
+    char dal[11];
+    char al[11];
+    const char *porta_server;
+    const char *indirizzo;
+    const char *file_backup;
+    const char *copia_ripristino;
+    const char *destinazione_ripristino;
+    const char *file_giornale;
+    char fino_a[20];
+} Opzioni;
+
+static void uso(const char *programma) {
+    fprintf(stderr,
+            "Uso: %s --importa FILE [--formato csv|json] [--db PERCORSO]\n"
+            "     %s --esporta vendite|articoli FILE [--formato csv|colonne]\n"
+            "        [--dal AAAA-MM-GG] [--al AAAA-MM-GG] [--db PERCORSO]\n"
+            "     %s --server PORTA [--indirizzo IP] [--db PERCORSO]\n"
+            "     %s --backup FILE [--db PERCORSO]\n"
+            "     %s --ripristina COPIA DESTINAZIONE [--fino-a \"AAAA-MM-GG HH:MM:SS\"]\n"
+            "        [--giornale FILE] [--db PERCORSO]\n"
+            "Senza argomenti apre l'interfaccia grafica.\n",
+            programma, programma, programma, programma, programma);
+}
+
+int riga_comando_richiesta(int argc, char **argv) {
+    return argc > 1 && strncmp(argv[1], "--", 2) == 0;
+}
+
+static void on_errore_importazione(long riga, const char *messaggio, void *user_data) {
+    long *mostrati = user_data;
+    if (++*mostrati <= MAX_ERRORI_MOSTRATI) {
+        fprintf(stderr, "Riga %ld scartata: %s\n", riga, messaggio);
+    } else if (*mostrati == MAX_ERRORI_MOSTRATI + 1) {
+        fprintf(stderr, "Altre righe scartate non vengono mostrate.\n");
+    }
+}
+
+static int importa(Repository *repo, const Opzioni *opzioni) {
+    FormatoImportazione formato = IMPORTA_AUTO;
+    if (opzioni->formato && strcmp(opzioni->formato, "csv") == 0) {
+        formato = IMPORTA_CSV;
+    } else if (opzioni->formato && strcmp(opzioni->formato, "json") == 0) {
+        formato = IMPORTA_JSON;
+    } else if (opzioni->formato) {
+        fprintf(stderr, "Formato di importazione sconosciuto: %s\n", opzioni->formato);
+        return 2;
+    }
+
+    EsitoImportazione esito;
+    char errore[512];
+    long mostrati = 0;
+    int rc = importa_file(repo, opzioni->file_importa, formato, on_errore_importazione, &mostrati,
+                          &esito, errore, sizeof(errore));
+    printf("Righe lette: %ld, importate: %ld, scartate: %ld\n",
+           esito.righe_lette, esito.righe_importate, esito.righe_scartate);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Importazione interrotta: %s\n", errore);
+        return 1;
+    }
+    return 0;
+}
+
+static int esporta(Repository *repo, const Opzioni *opzioni) {
+    DatiEsportazione dati;
+    if (strcmp(opzioni->dati_esporta, "vendite") == 0) {
+        dati = ESPORTA_VENDITE;
+    } else if (strcmp(opzioni->dati_esporta, "articoli") == 0) {
+        dati = ESPORTA_ARTICOLI;
+    } else {
+        fprintf(stderr, "Dati da esportare sconosciuti: %s\n", opzioni->dati_esporta);
+        return 2;
+    }
+    FormatoEsportazione formato = ESPORTA_CSV;
+    if (opzioni->formato && strcmp(opzioni->formato, "colonne") == 0) {
+        formato = ESPORTA_COLONNE;
+    } else if (opzioni->formato && strcmp(opzioni->formato, "csv") != 0) {
+        fprintf(stderr, "Formato di esportazione sconosciuto: %s\n", opzioni->formato);
+        return 2;
+    }
+
+    long righe;
+    char errore[512];
+    int rc = esporta_file(repo, dati, formato,
+                          opzioni->dal[0] ? opzioni->dal : NULL,
+                          opzioni->al[0] ? opzioni->al : NULL,
+                          opzioni->file_esporta, &righe, errore, sizeof(errore));
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Esportazione non riuscita: %s\n", errore);
+        return 1;
+    }
+    printf("Righe esportate: %ld\n", righe);
+    return 0;
+}
+
+// Legge le opzioni; 0 se non sono valide
+static int leggi_opzioni(int argc, char **argv, Opzioni *opzioni) {
+    for (int i = 1; i < argc; i++) {
+        const char *opzione = argv[i];
+        if (i + 1 >= argc) {
+            return 0;
+        }
+        const char *valore = argv[++i];
+        const char *errore = NULL;
+        if (strcmp(opzione, "--importa") == 0) {
+            opzioni->file_importa = valore;
+        } else if (strcmp(opzione, "--esporta") == 0 && i + 1 < argc) {
+            opzioni->dati_esporta = valore;
+            opzioni->file_esporta = argv[++i];
+        } else if (strcmp(opzione, "--backup") == 0) {
+            opzioni->file_backup = valore;
+        } else if (strcmp(opzione, "--ripristina") == 0 && i + 1 < argc) {
+            opzioni->copia_ripristino = valore;
+            opzioni->destinazione_ripristino = argv[++i];
+        } else if (strcmp(opzione, "--giornale") == 0) {
+            opzioni->file_giornale = valore;
+        } else if (strcmp(opzione, "--fino-a") == 0) {
+            if (!valida_istante(valore, opzioni->fino_a, &errore)) {
+                fprintf(stderr, "%s %s: %s\n", opzione, valore, errore);
+                return 0;
+            }
+        } else if (strcmp(opzione, "--server") == 0) {
+            opzioni->porta_server = valore;
+        } else if (strcmp(opzione, "--indirizzo") == 0) {
+            opzioni->indirizzo = valore;
+        } else if (strcmp(opzione, "--db") == 0) {
+            opzioni->percorso_db = valore;
+        } else if (strcmp(opzione, "--formato") == 0) {
+            opzioni->formato = valore;
+        } else if (strcmp(opzione, "--dal") == 0 || strcmp(opzione, "--al") == 0) {
+            char *data = opzione[2] == 'd' ? opzioni->dal : opzioni->al;
+            if (!valida_data(valore, data, &errore)) {
+                fprintf(stderr, "%s %s: %s\n", opzione, valore, errore);
+                return 0;
+            }
+        } else {
+            return 0;
+        }
+    }
+    // Una sola operazione per volta
+    return (opzioni->file_importa != NULL) + (opzioni->file_esporta != NULL) +
+           (opzioni->porta_server != NULL) + (opzioni->file_backup != NULL) +
+           (opzioni->copia_ripristino != NULL) == 1;
+}
+
+// Server di sincronizzazione in primo piano, fino a Ctrl+C o SIGTERM
+static int servi(const ConfigDB *config, const Opzioni *opzioni) {
+    char *fine;
+    long porta = strtol(opzioni->porta_server, &fine, 10);
+    if (*fine || porta <= 0 || porta > 65535) {
+        fprintf(stderr, "Porta non valida: %s\n", opzioni->porta_server);
+        return 2;
+    }
+
+    // I segnali vengono bloccati prima di creare il thread del server, che
+    // li eredita bloccati: li riceve solo sigwait
+    sigset_t segnali;
+    sigemptyset(&segnali);
+    sigaddset(&segnali, SIGINT);
+    sigaddset(&segnali, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &segnali, NULL);
+
+    char errore[256];
+    const char *indirizzo = opzioni->indirizzo ? opzioni->indirizzo : "0.0.0.0";
+    ServerSync *server = server_sync_avvia(config, indirizzo, (int)porta, errore, sizeof(errore));
+    if (!server) {
+        fprintf(stderr, "%s\n", errore);
+        return 1;
+    }
+    // Il server è l'unico a modificare il database: è lui a tenere il giornale
+    Giornale *giornale = giornale_avvia(config, errore, sizeof(errore));
+    if (!giornale) {
+        fprintf(stderr, "Giornale delle modifiche non disponibile: %s\n", errore);
+    }
+    printf("Server di sincronizzazione su %s:%d, database %s\n",
+           indirizzo, server_sync_porta(server), config->percorso);
+    fflush(stdout);
+
+    int segnale;
+    sigwait(&segnali, &segnale);
+    printf("Arresto del server\n");
+    server_sync_ferma(server);
+    giornale_ferma(giornale);
+    return 0;
+}
+
+static int esegui_backup(sqlite3 *db, const Opzioni *opzioni) {
+    char errore[512];
+    int pagine = 0;
+    if (backup_copia(db, opzioni->file_backup, NULL, NULL, &pagine, errore, sizeof(errore)) != SQLITE_OK) {
+        fprintf(stderr, "Backup non riuscito: %s\n", errore);
+        return 1;
+    }
+    printf("Backup in %s: %d pagine\n", opzioni->file_backup, pagine);
+    return 0;
+}
+
+static void elimina_database(const char *percorso) {
+    char file[1100];
+    unlink(percorso);
+    snprintf(file, sizeof(file), "%s-wal", percorso);
+    unlink(file);
+    snprintf(file, sizeof(file), "%s-shm", percorso);
+    unlink(file);
+}
+
+// Copia la COPIA in DESTINAZIONE (mai sovrascritta), la porta allo schema
+// attuale e le riapplica il giornale; se non riesce DESTINAZIONE viene tolta
+static int ripristina(const Opzioni *opzioni) {
+    const char *destinazione = opzioni->destinazione_ripristino;
+    if (access(destinazione, F_OK) == 0) {
+        fprintf(stderr, "%s esiste già: il ripristino crea un database nuovo.\n", destinazione);
+        return 1;
+    }
+    char errore[512];
+    ConfigDB config_copia;
+    db_config_predefinita(&config_copia, opzioni->copia_ripristino);
+    sqlite3 *copia = NULL;
+    if (db_apri_lettura(&config_copia, &copia) != SQLITE_OK) {
+        fprintf(stderr, "Impossibile aprire la copia %s.\n", opzioni->copia_ripristino);
+        return 1;
+    }
+    int rc = backup_copia(copia, destinazione, NULL, NULL, NULL, errore, sizeof(errore));
+    sqlite3_close(copia);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Ripristino non riuscito: %s\n", errore);
+        return 1;
+    }
+
+    ConfigDB config;
+    db_config_predefinita(&config, destinazione);
+    sqlite3 *db = NULL;
+    if (db_apri_scrittura(&config, &db) != SQLITE_OK || schema_aggiorna(db) != SQLITE_OK) {
+        fprintf(stderr, "Impossibile aggiornare %s.\n", destinazione);
+        sqlite3_close(db);
+        elimina_database(destinazione);
+        return 1;
+    }
+    char giornale[1100];
+    if (opzioni->file_giornale) {
+        snprintf(giornale, sizeof(giornale), "%s", opzioni->file_giornale);
+    } else {
+        snprintf(giornale, sizeof(giornale), "%s%s", opzioni->percorso_db, GIORNALE_ESTENSIONE);
+    }
+    long applicate = 0;
+    rc = giornale_riapplica(db, giornale, opzioni->fino_a[0] ? opzioni->fino_a : NULL,
+                            &applicate, errore, sizeof(errore));
+    // Con un nuovo identificativo i terminali rileggono tutto dal database
+    // ripristinato invece di proseguire dalle loro versioni
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_exec(db, "DELETE FROM sincronizzazione WHERE chiave = 'identificativo';", NULL, NULL, NULL);
+        if (rc != SQLITE_OK) {
+            snprintf(errore, sizeof(errore), "%s", sqlite3_errmsg(db));
+        }
+    }
+    sqlite3_close(db);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Ripristino non riuscito: %s\n", errore);
+        elimina_database(destinazione);
+        return 1;
+    }
+    printf("Database ripristinato in %s: %ld modifiche del giornale riapplicate\n", destinazione, applicate);
+    return 0;
+}
+
+int riga_comando_esegui(int argc, char **argv, const char *db_predefinito) {
+    Opzioni opzioni;
+    memset(&opzioni, 0, sizeof(opzioni));
+    opzioni.percorso_db = db_predefinito;
+    if (!leggi_opzioni(argc, argv, &opzioni)) {
+        uso(argv[0]);
+        return 2;
+    }
+
+    // Stessa configurazione dell'interfaccia: si può lavorare anche mentre
+    // il programma è aperto, le scritture si alternano grazie al busy timeout
+    ConfigDB config;
+    db_config_predefinita(&config, opzioni.percorso_db);
+    if (opzioni.porta_server) {
+        return servi(&config, &opzioni);
+    }
+    if (opzioni.copia_ripristino) {
+        return ripristina(&opzioni);
+    }
+    sqlite3 *db = NULL;
+    if (db_apri_scrittura(&config, &db) != SQLITE_OK || schema_aggiorna(db) != SQLITE_OK) {
+        fprintf(stderr, "Impossibile connettersi al database %s.\n", opzioni.percorso_db);
+        sqlite3_close(db);
+        return 1;
+    }
+    // Esportazione e backup leggono soltanto: usano una connessione in sola
+    // lettura, che non blocca le scritture dell'interfaccia
+    if (opzioni.file_esporta || opzioni.file_backup) {
+        sqlite3_close(db);
+        db = NULL;
+        if (db_apri_lettura(&config, &db) != SQLITE_OK) {
+            fprintf(stderr, "Impossibile connettersi al database %s.\n", opzioni.percorso_db);
+            sqlite3_close(db);
+            return 1;
+        }
+    }
+    if (opzioni.file_backup) {
+        int esito = esegui_backup(db, &opzioni);
+        sqlite3_close(db);
+        return esito;
+    }
+    Repository *repo = repo_apri(db);
+    if (!repo) {
+        sqlite3_close(db);
+        return 1;
+    }
+
+    int esito;
+    if (opzioni.file_importa) {
+        // Le righe importate finiscono subito nel file del giornale, anche
+        // se il programma non è aperto
+        char errore[512];
+        Giornale *giornale = giornale_avvia(&config, errore, sizeof(errore));
+        if (!giornale) {
+            fprintf(stderr, "Giornale delle modifiche non disponibile: %s\n", errore);
+        }
+        esito = importa(repo, &opzioni);
+        giornale_ferma(giornale);
+    } else {
+        esito = esporta(repo, &opzioni);
+    }
+
+    repo_chiudi(repo);
+    sqlite3_close(db);
+    return esito;
+}
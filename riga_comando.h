@@ -0,0 +1,28 @@
+#ifndef RIGA_COMANDO_H
+#define RIGA_COMANDO_H
+
+// Operazioni eseguibili da terminale senza aprire l'interfaccia grafica
+// (anche senza display, ad esempio da cron o via ssh):
+//
+//   gestionale --importa FILE [--formato csv|json] [--db PERCORSO]
+//   gestionale --esporta vendite|articoli FILE [--formato csv|colonne]
+//              [--dal AAAA-MM-GG] [--al AAAA-MM-GG] [--db PERCORSO]
+//   gestionale --server PORTA [--indirizzo IP] [--db PERCORSO]
+//   gestionale --backup FILE [--db PERCORSO]
+//   gestionale --ripristina COPIA DESTINAZIONE [--fino-a ISTANTE]
+//              [--giornale FILE] [--db PERCORSO]
+//
+// --server tiene aperto il database per i terminali collegati in rete
+// (vedi sincronizzazione.h) finché non riceve Ctrl+C o SIGTERM.
+// --backup copia il database anche mentre il programma è aperto (backup.h).
+// --ripristina crea DESTINAZIONE dalla COPIA e le riapplica le modifiche
+// del giornale (giornale.h, predefinito quello di PERCORSO) fino a ISTANTE
+// (AAAA-MM-GG [HH:MM[:SS]], predefinito tutte).
+
+// 1 se gli argomenti chiedono un'operazione da riga di comando
+int riga_comando_richiesta(int argc, char **argv);
+
+// Esegue l'operazione richiesta e restituisce il codice di uscita del programma
+int riga_comando_esegui(int argc, char **argv, const char *db_predefinito);
+
+#endif
@@ -0,0 +1,434 @@
+#include "schema.h"
+#include <stdio.h>
+
+// Schema iniziale (versione 0). Usa IF NOT EXISTS perché il file può essere
+// stato creato dalla versione Python o da una versione precedente senza
+// numero di schema.
+static const char *sql_schema_base =
+    "CREATE TABLE IF NOT EXISTS articoli ("
+    "articolo_id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "nome TEXT NOT NULL,"
+    "descrizione TEXT,"
+    "artista TEXT,"
+    "periodo TEXT,"
+    "misure TEXT,"
+    "data_acquisizione DATE,"
+    "prezzo_acquisto REAL,"
+    "quantita INTEGER DEFAULT 1"
+    ");"
+    "CREATE TABLE IF NOT EXISTS vendite ("
+    "vendita_id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "articolo_id INTEGER,"
+    "data_vendita DATE,"
+    "prezzo_vendita REAL,"
+    "nome_cliente TEXT,"
+    "FOREIGN KEY (articolo_id) REFERENCES articoli(articolo_id)"
+    ");"
+    // Registro delle modifiche agli articoli, tenuto dai trigger: permette di
+    // aggiornare la lista con le sole righe cambiate dall'ultima lettura.
+    // Per ogni modifica registra lo stato venduto prima e dopo (NULL se la
+    // riga non esisteva o è stata eliminata).
+    "CREATE TABLE IF NOT EXISTS articoli_modifiche ("
+    "versione INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "articolo_id INTEGER NOT NULL,"
+    "vecchio_venduto INTEGER,"
+    "nuovo_venduto INTEGER"
+    ");"
+    "CREATE TRIGGER IF NOT EXISTS articoli_modifiche_ins AFTER INSERT ON articoli BEGIN "
+    "INSERT INTO articoli_modifiche (articolo_id, vecchio_venduto, nuovo_venduto) "
+    "VALUES (NEW.articolo_id, NULL, NEW.quantita IS 0); END;"
+    "CREATE TRIGGER IF NOT EXISTS articoli_modifiche_upd AFTER UPDATE ON articoli BEGIN "
+    "INSERT INTO articoli_modifiche (articolo_id, vecchio_venduto, nuovo_venduto) "
+    "VALUES (NEW.articolo_id, OLD.quantita IS 0, NEW.quantita IS 0); END;"
+    "CREATE TRIGGER IF NOT EXISTS articoli_modifiche_del AFTER DELETE ON articoli BEGIN "
+    "INSERT INTO articoli_modifiche (articolo_id, vecchio_venduto, nuovo_venduto) "
+    "VALUES (OLD.articolo_id, OLD.quantita IS 0, NULL); END;";
+
+// Indicizzazione di ogni nuovo articolo (versione 2)
+#define SQL_TRIGGER_FTS_INS \
+    "CREATE TRIGGER IF NOT EXISTS articoli_fts_ins AFTER INSERT ON articoli BEGIN " \
+    "INSERT INTO articoli_fts (rowid, nome, descrizione, artista, periodo) " \
+    "VALUES (NEW.articolo_id, NEW.nome, NEW.descrizione, NEW.artista, NEW.periodo); END;"
+
+// Aggiunge la vendita appena inserita al totale del suo gruppo
+#define SQL_SOMMA_VENDITA(dimensione, chiave) \
+    "INSERT INTO statistiche_vendite (dimensione, chiave, pezzi, ricavo, costo) " \
+    "VALUES ('" dimensione "', " chiave ", 1, IFNULL(NEW.prezzo_vendita, 0), " \
+    "IFNULL((SELECT prezzo_acquisto FROM articoli WHERE articolo_id = NEW.articolo_id), 0)) " \
+    "ON CONFLICT (dimensione, chiave) DO UPDATE SET pezzi = pezzi + 1, " \
+    "ricavo = ricavo + excluded.ricavo, costo = costo + excluded.costo;"
+
+// Calcola i totali di un gruppo dalle vendite esistenti
+#define SQL_RICALCOLA_VENDITE(dimensione, chiave) \
+    "INSERT INTO statistiche_vendite (dimensione, chiave, pezzi, ricavo, costo) " \
+    "SELECT '" dimensione "', " chiave ", COUNT(*), " \
+    "SUM(IFNULL(v.prezzo_vendita, 0)), SUM(IFNULL(a.prezzo_acquisto, 0)) " \
+    "FROM vendite v LEFT JOIN articoli a ON a.articolo_id = v.articolo_id " \
+    "GROUP BY 2;"
+
+// Il giornale non viene scritto nelle copie locali dei terminali (quelle con
+// il server di origine in sincronizzazione): è il server a tenerlo
+#define SQL_GIORNALE_SE_ORIGINALE \
+    "WHEN NOT EXISTS (SELECT 1 FROM sincronizzazione WHERE chiave = 'origine') "
+
+// Immagine completa di un articolo nel giornale
+#define SQL_GIORNALE_ARTICOLO(riga) \
+    "INSERT INTO giornale (tipo, dati) VALUES ('articolo', json_object(" \
+    "'articolo_id', " riga ".articolo_id, 'nome', " riga ".nome, 'descrizione', " riga ".descrizione, " \
+    "'artista', " riga ".artista, 'periodo', " riga ".periodo, 'misure', " riga ".misure, " \
+    "'data_acquisizione', " riga ".data_acquisizione, 'prezzo_acquisto', " riga ".prezzo_acquisto, " \
+    "'quantita', " riga ".quantita)); "
+
+// Migrazioni in ordine di versione: ognuna porta lo schema da versione-1 a
+// versione. Non vanno mai modificate dopo il rilascio, solo aggiunte.
+typedef struct {
+    int versione;
+    const char *descrizione;
+    const char *sql;
+} Migrazione;
+
+static const Migrazione migrazioni[] = {
+    {
+        1, "indici per lista e vendite",
+        // Ordinamento della lista per (venduto, articolo_id) con tutte le
+        // colonne mostrate: pagine e conteggi si leggono dal solo indice.
+        // L'espressione deve coincidere con quella usata nelle query.
+        "CREATE INDEX IF NOT EXISTS idx_articoli_lista ON articoli ("
+        "(quantita IS 0), articolo_id, nome, artista, periodo, misure, quantita, prezzo_acquisto);"
+        // Vendite di un articolo (storico, eliminazione, totali per articolo)
+        "CREATE INDEX IF NOT EXISTS idx_vendite_articolo ON vendite ("
+        "articolo_id, data_vendita, prezzo_vendita);"
+        // Vendite in un intervallo di date (report ed esportazioni)
+        "CREATE INDEX IF NOT EXISTS idx_vendite_data ON vendite ("
+        "data_vendita, articolo_id, prezzo_vendita);"
+    },
+    {
+        2, "ricerca a testo pieno",
+        // Indice sul testo degli articoli senza copiarlo: il contenuto resta
+        // in articoli, l'indice è tenuto allineato dai trigger
+        "CREATE VIRTUAL TABLE IF NOT EXISTS articoli_fts USING fts5 ("
+        "nome, descrizione, artista, periodo, "
+        "content='articoli', content_rowid='articolo_id', "
+        "tokenize='unicode61 remove_diacritics 2', prefix='2 3');"
+        SQL_TRIGGER_FTS_INS
+        "CREATE TRIGGER IF NOT EXISTS articoli_fts_del AFTER DELETE ON articoli BEGIN "
+        "INSERT INTO articoli_fts (articoli_fts, rowid, nome, descrizione, artista, periodo) "
+        "VALUES ('delete', OLD.articolo_id, OLD.nome, OLD.descrizione, OLD.artista, OLD.periodo); END;"
+        // Le vendite cambiano solo la quantità: il testo si reindicizza solo se cambia
+        "CREATE TRIGGER IF NOT EXISTS articoli_fts_upd "
+        "AFTER UPDATE OF nome, descrizione, artista, periodo ON articoli BEGIN "
+        "INSERT INTO articoli_fts (articoli_fts, rowid, nome, descrizione, artista, periodo) "
+        "VALUES ('delete', OLD.articolo_id, OLD.nome, OLD.descrizione, OLD.artista, OLD.periodo); "
+        "INSERT INTO articoli_fts (rowid, nome, descrizione, artista, periodo) "
+        "VALUES (NEW.articolo_id, NEW.nome, NEW.descrizione, NEW.artista, NEW.periodo); END;"
+        // Pesi di rilevanza: nome, descrizione, artista, periodo
+        "INSERT INTO articoli_fts (articoli_fts, rank) VALUES ('rank', 'bm25(10.0, 1.0, 5.0, 2.0)');"
+        // Indicizza gli articoli già presenti
+        "INSERT INTO articoli_fts (articoli_fts) VALUES ('rebuild');"
+    },
+    {
+        3, "statistiche di vendita e valore del magazzino",
+        // Totali delle vendite per giorno, mese, artista e periodo, tenuti
+        // dai trigger nella stessa transazione di ogni vendita: i riepiloghi
+        // leggono una riga per gruppo invece di scorrere tutte le vendite.
+        // Il costo è il prezzo di acquisto dell'articolo al momento della vendita.
+        "CREATE TABLE IF NOT EXISTS statistiche_vendite ("
+        "dimensione TEXT NOT NULL,"
+        "chiave TEXT NOT NULL,"
+        "pezzi INTEGER NOT NULL,"
+        "ricavo REAL NOT NULL,"
+        "costo REAL NOT NULL,"
+        "PRIMARY KEY (dimensione, chiave)"
+        ") WITHOUT ROWID;"
+        "CREATE TRIGGER IF NOT EXISTS statistiche_vendite_ins AFTER INSERT ON vendite BEGIN "
+        SQL_SOMMA_VENDITA("giorno", "IFNULL(NEW.data_vendita, '')")
+        SQL_SOMMA_VENDITA("mese", "IFNULL(substr(NEW.data_vendita, 1, 7), '')")
+        SQL_SOMMA_VENDITA("artista", "IFNULL((SELECT artista FROM articoli WHERE articolo_id = NEW.articolo_id), '')")
+        SQL_SOMMA_VENDITA("periodo", "IFNULL((SELECT periodo FROM articoli WHERE articolo_id = NEW.articolo_id), '')")
+        "END;"
+        // Totali delle vendite già registrate
+        SQL_RICALCOLA_VENDITE("giorno", "IFNULL(v.data_vendita, '')")
+        SQL_RICALCOLA_VENDITE("mese", "IFNULL(substr(v.data_vendita, 1, 7), '')")
+        SQL_RICALCOLA_VENDITE("artista", "IFNULL(a.artista, '')")
+        SQL_RICALCOLA_VENDITE("periodo", "IFNULL(a.periodo, '')")
+        // Pezzi e valore d'acquisto di quanto è in magazzino: una sola riga
+        "CREATE TABLE IF NOT EXISTS valore_magazzino ("
+        "id INTEGER PRIMARY KEY CHECK (id = 1),"
+        "articoli INTEGER NOT NULL,"
+        "pezzi INTEGER NOT NULL,"
+        "valore REAL NOT NULL"
+        ");"
+        "INSERT OR IGNORE INTO valore_magazzino (id, articoli, pezzi, valore) "
+        "SELECT 1, COUNT(*) FILTER (WHERE quantita > 0), "
+        "IFNULL(SUM(MAX(IFNULL(quantita, 0), 0)), 0), "
+        "IFNULL(SUM(MAX(IFNULL(quantita, 0), 0) * IFNULL(prezzo_acquisto, 0)), 0) FROM articoli;"
+        "CREATE TRIGGER IF NOT EXISTS valore_magazzino_ins AFTER INSERT ON articoli BEGIN "
+        "UPDATE valore_magazzino SET "
+        "articoli = articoli + (IFNULL(NEW.quantita, 0) > 0), "
+        "pezzi = pezzi + MAX(IFNULL(NEW.quantita, 0), 0), "
+        "valore = valore + MAX(IFNULL(NEW.quantita, 0), 0) * IFNULL(NEW.prezzo_acquisto, 0) "
+        "WHERE id = 1; END;"
+        "CREATE TRIGGER IF NOT EXISTS valore_magazzino_upd "
+        "AFTER UPDATE OF quantita, prezzo_acquisto ON articoli BEGIN "
+        "UPDATE valore_magazzino SET "
+        "articoli = articoli + (IFNULL(NEW.quantita, 0) > 0) - (IFNULL(OLD.quantita, 0) > 0), "
+        "pezzi = pezzi + MAX(IFNULL(NEW.quantita, 0), 0) - MAX(IFNULL(OLD.quantita, 0), 0), "
+        "valore = valore + MAX(IFNULL(NEW.quantita, 0), 0) * IFNULL(NEW.prezzo_acquisto, 0) "
+        "- MAX(IFNULL(OLD.quantita, 0), 0) * IFNULL(OLD.prezzo_acquisto, 0) "
+        "WHERE id = 1; END;"
+        "CREATE TRIGGER IF NOT EXISTS valore_magazzino_del AFTER DELETE ON articoli BEGIN "
+        "UPDATE valore_magazzino SET "
+        "articoli = articoli - (IFNULL(OLD.quantita, 0) > 0), "
+        "pezzi = pezzi - MAX(IFNULL(OLD.quantita, 0), 0), "
+        "valore = valore - MAX(IFNULL(OLD.quantita, 0), 0) * IFNULL(OLD.prezzo_acquisto, 0) "
+        "WHERE id = 1; END;"
+    },
+    {
+        4, "foto degli articoli",
+        // Le immagini stanno nell'archivio su disco (archivio_foto.c), con
+        // l'hash del contenuto come nome: qui solo il collegamento
+        // all'articolo. La tabella articoli resta piccola e veloce da scorrere.
+        // "posizione" ordina le foto di un articolo, la prima è la principale.
+        "CREATE TABLE IF NOT EXISTS foto ("
+        "foto_id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "articolo_id INTEGER NOT NULL,"
+        "hash TEXT NOT NULL,"
+        "dimensione INTEGER NOT NULL,"
+        "posizione INTEGER NOT NULL,"
+        "UNIQUE (articolo_id, hash),"
+        "FOREIGN KEY (articolo_id) REFERENCES articoli(articolo_id)"
+        ");"
+        // Foto principale di ogni riga della lista, dal solo indice
+        "CREATE INDEX IF NOT EXISTS idx_foto_articolo ON foto (articolo_id, posizione, hash);"
+        // Verifica se un file dell'archivio è ancora usato
+        "CREATE INDEX IF NOT EXISTS idx_foto_hash ON foto (hash);"
+        // I file rimasti senza collegamenti vengono tolti dalla pulizia dell'archivio
+        "CREATE TRIGGER IF NOT EXISTS foto_articolo_del AFTER DELETE ON articoli BEGIN "
+        "DELETE FROM foto WHERE articolo_id = OLD.articolo_id; END;"
+        // Una foto nuova cambia la miniatura della riga: va nel registro
+        // come modifica dell'articolo, con lo stato venduto invariato
+        "CREATE TRIGGER IF NOT EXISTS foto_modifiche_ins AFTER INSERT ON foto BEGIN "
+        "INSERT INTO articoli_modifiche (articolo_id, vecchio_venduto, nuovo_venduto) "
+        "SELECT articolo_id, quantita IS 0, quantita IS 0 FROM articoli "
+        "WHERE articolo_id = NEW.articolo_id; END;"
+    },
+    {
+        5, "sincronizzazione tra terminali",
+        // Stato della sincronizzazione (sincronizzazione.c). Sul server:
+        // l'identificativo del database. Su un terminale: server di origine
+        // e ultime versioni ricevute di articoli e vendite.
+        "CREATE TABLE IF NOT EXISTS sincronizzazione ("
+        "chiave TEXT PRIMARY KEY,"
+        "valore INTEGER NOT NULL"
+        ") WITHOUT ROWID;"
+    },
+    {
+        6, "indici per ordinare e filtrare la lista",
+        // Una chiave per ogni colonna ordinabile (oltre a idx_articoli_lista
+        // per lo stato): il cursore di una pagina diventa una ricerca
+        // sull'indice, che termina con l'ID come secondo criterio. Le
+        // espressioni devono coincidere con chiavi_ordine in repository.c;
+        // artista e periodo servono anche ai filtri.
+        "CREATE INDEX IF NOT EXISTS idx_articoli_nome ON articoli (nome COLLATE NOCASE);"
+        "CREATE INDEX IF NOT EXISTS idx_articoli_artista ON articoli (IFNULL(artista, '') COLLATE NOCASE);"
+        "CREATE INDEX IF NOT EXISTS idx_articoli_periodo ON articoli (IFNULL(periodo, '') COLLATE NOCASE);"
+        "CREATE INDEX IF NOT EXISTS idx_articoli_quantita ON articoli (IFNULL(quantita, 0));"
+        "CREATE INDEX IF NOT EXISTS idx_articoli_prezzo ON articoli (IFNULL(prezzo_acquisto, 0));"
+    },
+    {
+        7, "giornale delle modifiche e articoli eliminati",
+        // Ogni modifica ai dati viene copiata dai trigger nel giornale, nella
+        // stessa transazione: giornale.c la trascrive poi nel file del
+        // giornale e la toglie da qui. Finché non è nel file resta nel
+        // database, quindi nessuna modifica confermata può mancare. I dati
+        // sono l'immagine completa della riga in JSON: riapplicare la stessa
+        // voce più volte dà lo stesso risultato. Le sequenze non vengono mai
+        // riusate (AUTOINCREMENT): l'ultima assegnata, in sqlite_sequence,
+        // dice fin dove arriva una copia del database.
+        "CREATE TABLE IF NOT EXISTS giornale ("
+        "sequenza INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "istante TEXT NOT NULL DEFAULT (strftime('%Y-%m-%d %H:%M:%f', 'now', 'localtime')),"
+        "tipo TEXT NOT NULL,"
+        "dati TEXT NOT NULL"
+        ");"
+        "CREATE TRIGGER IF NOT EXISTS giornale_articoli_ins AFTER INSERT ON articoli "
+        SQL_GIORNALE_SE_ORIGINALE "BEGIN " SQL_GIORNALE_ARTICOLO("NEW") "END;"
+        "CREATE TRIGGER IF NOT EXISTS giornale_articoli_upd AFTER UPDATE ON articoli "
+        SQL_GIORNALE_SE_ORIGINALE "BEGIN " SQL_GIORNALE_ARTICOLO("NEW") "END;"
+        "CREATE TRIGGER IF NOT EXISTS giornale_articoli_del AFTER DELETE ON articoli "
+        SQL_GIORNALE_SE_ORIGINALE "BEGIN "
+        "INSERT INTO giornale (tipo, dati) VALUES ('elimina', json_object('articolo_id', OLD.articolo_id)); END;"
+        "CREATE TRIGGER IF NOT EXISTS giornale_vendite_ins AFTER INSERT ON vendite "
+        SQL_GIORNALE_SE_ORIGINALE "BEGIN "
+        "INSERT INTO giornale (tipo, dati) VALUES ('vendita', json_object("
+        "'vendita_id', NEW.vendita_id, 'articolo_id', NEW.articolo_id, 'data_vendita', NEW.data_vendita, "
+        "'prezzo_vendita', NEW.prezzo_vendita, 'nome_cliente', NEW.nome_cliente)); END;"
+        "CREATE TRIGGER IF NOT EXISTS giornale_foto_ins AFTER INSERT ON foto "
+        SQL_GIORNALE_SE_ORIGINALE "BEGIN "
+        "INSERT INTO giornale (tipo, dati) VALUES ('foto', json_object("
+        "'foto_id', NEW.foto_id, 'articolo_id', NEW.articolo_id, 'hash', NEW.hash, "
+        "'dimensione', NEW.dimensione, 'posizione', NEW.posizione)); END;"
+        // Un articolo eliminato dopo averne venduto dei pezzi resta qui, così
+        // le sue vendite (che lo indicano per ID) mantengono nome, artista e
+        // prezzo d'acquisto nelle esportazioni. Gli articoli mai venduti
+        // non servono: si recuperano comunque dal giornale.
+        "CREATE TABLE IF NOT EXISTS articoli_eliminati ("
+        "articolo_id INTEGER PRIMARY KEY,"
+        "nome TEXT NOT NULL,"
+        "descrizione TEXT,"
+        "artista TEXT,"
+        "periodo TEXT,"
+        "misure TEXT,"
+        "data_acquisizione DATE,"
+        "prezzo_acquisto REAL,"
+        "eliminato TEXT NOT NULL"
+        ");"
+        "CREATE TRIGGER IF NOT EXISTS articoli_eliminati_del AFTER DELETE ON articoli "
+        "WHEN EXISTS (SELECT 1 FROM vendite WHERE articolo_id = OLD.articolo_id) BEGIN "
+        "INSERT OR REPLACE INTO articoli_eliminati (articolo_id, nome, descrizione, artista, periodo, "
+        "misure, data_acquisizione, prezzo_acquisto, eliminato) "
+        "VALUES (OLD.articolo_id, OLD.nome, OLD.descrizione, OLD.artista, OLD.periodo, OLD.misure, "
+        "OLD.data_acquisizione, OLD.prezzo_acquisto, datetime('now', 'localtime')); END;"
+        // Un articolo ripristinato (dal giornale o da una copia) non è più eliminato
+        "CREATE TRIGGER IF NOT EXISTS articoli_eliminati_ins AFTER INSERT ON articoli BEGIN "
+        "DELETE FROM articoli_eliminati WHERE articolo_id = NEW.articolo_id; END;"
+    },
+    {
+        8, "indicizzazione sospendibile senza modificare lo schema",
+        // Le importazioni sospendevano l'indicizzazione togliendo e ricreando
+        // il trigger a ogni blocco: ogni modifica dello schema costringe tutte
+        // le connessioni a ripreparare le query. Ora il trigger resta e salta
+        // gli inserimenti mentre ricerca_sospesa ha una riga, scritta e tolta
+        // nella transazione dell'importazione (vedi schema_sospendi_ricerca).
+        "CREATE TABLE IF NOT EXISTS ricerca_sospesa (ultimo_id INTEGER NOT NULL);"
+        "DROP TRIGGER IF EXISTS articoli_fts_ins;"
+        "CREATE TRIGGER articoli_fts_ins AFTER INSERT ON articoli "
+        "WHEN NOT EXISTS (SELECT 1 FROM ricerca_sospesa) BEGIN "
+        "INSERT INTO articoli_fts (rowid, nome, descrizione, artista, periodo) "
+        "VALUES (NEW.articolo_id, NEW.nome, NEW.descrizione, NEW.artista, NEW.periodo); END;"
+    },
+};
+
+#define N_MIGRAZIONI (int)(sizeof(migrazioni) / sizeof(migrazioni[0]))
+
+static int esegui(sqlite3 *db, const char *sql, const char *contesto) {
+    char *err_msg = NULL;
+    int rc = sqlite3_exec(db, sql, 0, 0, &err_msg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Errore %s: %s\n", contesto, err_msg);
+        sqlite3_free(err_msg);
+    }
+    return rc;
+}
+
+// Legge la versione dall'intestazione del file: non tocca le tabelle
+static int leggi_versione(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    int versione = -1;
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Errore lettura versione schema: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        versione = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return versione;
+}
+
+static int verifica_versione(int versione) {
+    if (versione < 0) {
+        return SQLITE_ERROR;
+    }
+    if (versione > SCHEMA_VERSIONE) {
+        fprintf(stderr, "Il database usa lo schema %d, più recente di quello supportato (%d).\n",
+                versione, SCHEMA_VERSIONE);
+        return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+}
+
+int schema_aggiorna(sqlite3 *db) {
+    int versione = leggi_versione(db);
+    if (versione == SCHEMA_VERSIONE) {
+        return SQLITE_OK;
+    }
+    int rc = verifica_versione(versione);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    rc = esegui(db, "BEGIN IMMEDIATE;", "avvio aggiornamento schema");
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    // Con il lock preso si rilegge: un'altra istanza può averlo già aggiornato
+    versione = leggi_versione(db);
+    rc = verifica_versione(versione);
+
+    if (rc == SQLITE_OK && versione == 0) {
+        rc = esegui(db, sql_schema_base, "creazione schema");
+    }
+    for (int i = 0; i < N_MIGRAZIONI && rc == SQLITE_OK; i++) {
+        if (migrazioni[i].versione > versione) {
+            fprintf(stderr, "Migrazione schema %d: %s\n", migrazioni[i].versione, migrazioni[i].descrizione);
+            rc = esegui(db, migrazioni[i].sql, "migrazione schema");
+        }
+    }
+    if (rc == SQLITE_OK && versione < SCHEMA_VERSIONE) {
+        char sql[64];
+        snprintf(sql, sizeof(sql), "PRAGMA user_version = %d;", SCHEMA_VERSIONE);
+        rc = esegui(db, sql, "aggiornamento versione schema");
+    }
+
+    if (rc == SQLITE_OK) {
+        rc = esegui(db, "COMMIT;", "conferma aggiornamento schema");
+    }
+    if (rc != SQLITE_OK) {
+        sqlite3_exec(db, "ROLLBACK;", 0, 0, NULL);
+    }
+    return rc;
+}
+
+void schema_pota_registro(sqlite3 *db) {
+    esegui(db,
+           "DELETE FROM articoli_modifiche "
+           "WHERE versione <= (SELECT MAX(versione) FROM articoli_modifiche) - 10000;",
+           "pulizia registro modifiche");
+}
+
+int schema_sospendi_ricerca(sqlite3 *db, sqlite3_int64 *ultimo_id) {
+    // Una sola istruzione: legge l'ultimo ID e lo registra come sospensione
+    sqlite3_stmt *stmt;
+    int rc = sqlite3_prepare_v2(db,
+                                "INSERT INTO ricerca_sospesa (ultimo_id) "
+                                "SELECT IFNULL(MAX(articolo_id), 0) FROM articoli RETURNING ultimo_id;",
+                                -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Errore sospensione indice di ricerca: %s\n", sqlite3_errmsg(db));
+        return rc;
+    }
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        *ultimo_id = sqlite3_column_int64(stmt, 0);
+        rc = sqlite3_step(stmt);
+    }
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Errore sospensione indice di ricerca: %s\n", sqlite3_errmsg(db));
+    }
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+int schema_riprendi_ricerca(sqlite3 *db, sqlite3_int64 ultimo_id) {
+    char sql[256];
+    snprintf(sql, sizeof(sql),
+             "INSERT INTO articoli_fts (rowid, nome, descrizione, artista, periodo) "
+             "SELECT articolo_id, nome, descrizione, artista, periodo FROM articoli "
+             "WHERE articolo_id > %lld;", (long long)ultimo_id);
+    int rc = esegui(db, sql, "indicizzazione articoli importati");
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    return esegui(db, "DELETE FROM ricerca_sospesa;", "ripristino indice di ricerca");
+}
@@ -0,0 +1,30 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <sqlite3.h>
+
+// Versione dello schema richiesta da questo programma (PRAGMA user_version).
+// Ogni modifica allo schema aggiunge una migrazione in schema.c e incrementa
+// questo valore.
+#define SCHEMA_VERSIONE 8
+
+// Porta lo schema alla versione attuale sulla connessione di scrittura.
+// Se è già aggiornato costa una sola query; altrimenti crea le tabelle
+// mancanti e applica le migrazioni in sospeso in un'unica transazione.
+int schema_aggiorna(sqlite3 *db);
+
+// Elimina le voci più vecchie del registro delle modifiche: all'avvio la
+// lista viene letta per intero, basta tenere le modifiche recenti
+void schema_pota_registro(sqlite3 *db);
+
+// Inserimenti massivi: nella transazione di scrittura già aperta sospende
+// l'indicizzazione riga per riga (con FTS5 ogni insert svuoterebbe il suo
+// buffer su disco) e ricorda l'ultimo ID presente; riprendi indicizza in una
+// sola passata gli articoli aggiunti dopo e riattiva il trigger. La
+// sospensione è una riga di ricerca_sospesa, non una modifica dello schema:
+// le query preparate dalle altre connessioni restano valide. Vanno chiamate
+// nella stessa transazione, così l'indice non resta mai sospeso.
+int schema_sospendi_ricerca(sqlite3 *db, sqlite3_int64 *ultimo_id);
+int schema_riprendi_ricerca(sqlite3 *db, sqlite3_int64 ultimo_id);
+
+#endif
@@ -0,0 +1,1441 @@
+#include "sincronizzazione.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "schema.h"
+#include "traccia.h"
+
+// Lunghezza massima di un messaggio (dopo il campo lunghezza)
+#define SYNC_MAX_MESSAGGIO (16u * 1024 * 1024)
+// Una risposta smette di aggiungere righe oltre questa dimensione
+#define SYNC_RISPOSTA_PIENA (SYNC_MAX_MESSAGGIO / 2)
+// Risposte non ancora inviate oltre le quali il server smette di leggere le
+// richieste di quel terminale, finché non le riceve
+#define SYNC_MAX_IN_USCITA (4u * 1024 * 1024)
+#define SYNC_MAX_CONNESSIONI 64
+// Richieste al massimo in una transazione del server
+#define SYNC_MAX_BLOCCO 1024
+// Attesa prima di riprovare se il database del server è occupato
+#define SYNC_ATTESA_OCCUPATO_MS 100
+// Attese del terminale: collegamento e singola risposta
+#define SYNC_ATTESA_COLLEGAMENTO_MS 3000
+#define SYNC_ATTESA_RISPOSTA_S 15
+
+// --- Codifica dei messaggi ---
+
+typedef struct {
+    unsigned char *dati;
+    size_t n;
+    size_t capacita;
+    int errore;         // memoria esaurita: il contenuto non è valido
+} Buffer;
+
+// Lettura di un messaggio ricevuto; errore se è più corto del previsto
+typedef struct {
+    const unsigned char *p;
+    size_t resto;
+    int errore;
+} Lettore;
+
+static uint32_t leggi_be32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void scrivi_be32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+// Spazio per altri n byte; 0 se la memoria non basta
+static int riserva(Buffer *b, size_t n) {
+    if (b->errore) {
+        return 0;
+    }
+    if (b->n + n <= b->capacita) {
+        return 1;
+    }
+    size_t capacita = b->capacita ? b->capacita : 4096;
+    while (capacita < b->n + n) {
+        capacita *= 2;
+    }
+    unsigned char *dati = realloc(b->dati, capacita);
+    if (!dati) {
+        b->errore = 1;
+        return 0;
+    }
+    b->dati = dati;
+    b->capacita = capacita;
+    return 1;
+}
+
+static void libera_buffer(Buffer *b) {
+    free(b->dati);
+    memset(b, 0, sizeof(*b));
+}
+
+static void metti_byte(Buffer *b, const void *dati, size_t n) {
+    if (riserva(b, n)) {
+        memcpy(b->dati + b->n, dati, n);
+        b->n += n;
+    }
+}
+
+static void metti_u8(Buffer *b, uint8_t v) {
+    metti_byte(b, &v, 1);
+}
+
+static void metti_u32(Buffer *b, uint32_t v) {
+    unsigned char p[4];
+    scrivi_be32(p, v);
+    metti_byte(b, p, 4);
+}
+
+static void metti_i32(Buffer *b, int32_t v) {
+    metti_u32(b, (uint32_t)v);
+}
+
+static void metti_i64(Buffer *b, int64_t v) {
+    metti_u32(b, (uint32_t)((uint64_t)v >> 32));
+    metti_u32(b, (uint32_t)v);
+}
+
+static void metti_f64(Buffer *b, double v) {
+    uint64_t bit;
+    memcpy(&bit, &v, sizeof(bit));
+    metti_i64(b, (int64_t)bit);
+}
+
+static void metti_testo(Buffer *b, const char *testo) {
+    if (!testo) {
+        metti_u32(b, 0);
+        return;
+    }
+    size_t n = strlen(testo) + 1;
+    metti_u32(b, (uint32_t)n);
+    metti_byte(b, testo, n);
+}
+
+// Inizio di un messaggio: la lunghezza viene scritta da chiudi_messaggio
+static size_t apri_messaggio(Buffer *b, uint32_t id, uint8_t tipo) {
+    size_t inizio = b->n;
+    metti_u32(b, 0);
+    metti_u32(b, id);
+    metti_u8(b, tipo);
+    return inizio;
+}
+
+static void chiudi_messaggio(Buffer *b, size_t inizio) {
+    if (!b->errore) {
+        scrivi_be32(b->dati + inizio, (uint32_t)(b->n - inizio - 4));
+    }
+}
+
+static const unsigned char *prendi(Lettore *l, size_t n) {
+    if (l->errore || l->resto < n) {
+        l->errore = 1;
+        return NULL;
+    }
+    const unsigned char *p = l->p;
+    l->p += n;
+    l->resto -= n;
+    return p;
+}
+
+static uint8_t prendi_u8(Lettore *l) {
+    const unsigned char *p = prendi(l, 1);
+    return p ? p[0] : 0;
+}
+
+static uint32_t prendi_u32(Lettore *l) {
+    const unsigned char *p = prendi(l, 4);
+    return p ? leggi_be32(p) : 0;
+}
+
+static int32_t prendi_i32(Lettore *l) {
+    return (int32_t)prendi_u32(l);
+}
+
+static int64_t prendi_i64(Lettore *l) {
+    uint64_t alto = prendi_u32(l);
+    return (int64_t)(alto << 32 | prendi_u32(l));
+}
+
+static double prendi_f64(Lettore *l) {
+    uint64_t bit = (uint64_t)prendi_i64(l);
+    double v;
+    memcpy(&v, &bit, sizeof(v));
+    return v;
+}
+
+// Il testo non viene copiato: resta valido finché il messaggio è in memoria
+static const char *prendi_testo(Lettore *l) {
+    uint32_t n = prendi_u32(l);
+    if (n == 0) {
+        return NULL;
+    }
+    const unsigned char *p = prendi(l, n);
+    if (!p || p[n - 1] != 0) {
+        l->errore = 1;
+        return NULL;
+    }
+    return (const char*)p;
+}
+
+static void metti_articolo(Buffer *b, sqlite3_int64 versione, int articolo_id, const RigaArticolo *riga) {
+    metti_i32(b, articolo_id);
+    metti_i64(b, versione);
+    metti_u8(b, riga != NULL);
+    if (riga) {
+        metti_testo(b, riga->nome);
+        metti_testo(b, riga->descrizione);
+        metti_testo(b, riga->artista);
+        metti_testo(b, riga->periodo);
+        metti_testo(b, riga->misure);
+        metti_testo(b, riga->data_acquisizione);
+        metti_f64(b, riga->prezzo_acquisto);
+        metti_i32(b, riga->quantita);
+    }
+}
+
+// Restituisce 1 se l'articolo c'è ancora, 0 se è stato eliminato
+static int prendi_articolo(Lettore *l, sqlite3_int64 *versione, RigaArticolo *riga) {
+    memset(riga, 0, sizeof(*riga));
+    riga->articolo_id = prendi_i32(l);
+    *versione = prendi_i64(l);
+    if (!prendi_u8(l)) {
+        return 0;
+    }
+    riga->nome = prendi_testo(l);
+    riga->descrizione = prendi_testo(l);
+    riga->artista = prendi_testo(l);
+    riga->periodo = prendi_testo(l);
+    riga->misure = prendi_testo(l);
+    riga->data_acquisizione = prendi_testo(l);
+    riga->prezzo_acquisto = prendi_f64(l);
+    riga->quantita = prendi_i32(l);
+    return 1;
+}
+
+// --- Server ---
+
+typedef struct {
+    int fd;
+    Buffer in;              // dati ricevuti
+    size_t letti;           // inizio della prima richiesta non ancora eseguita
+    Buffer out;             // risposte da inviare
+    size_t inviati;
+    size_t inizio_blocco;   // out.n all'inizio della transazione in corso
+    int chiusa;
+} ConnessioneSync;
+
+struct ServerSync {
+    sqlite3 *db;
+    Repository *repo;
+    sqlite3_int64 identificativo;
+    int ascolto;
+    int sveglia[2];         // una scrittura ferma il thread
+    int porta;
+    pthread_t thread;
+    ConnessioneSync *connessioni[SYNC_MAX_CONNESSIONI];
+    int n_connessioni;
+};
+
+// Righe di una risposta in costruzione
+typedef struct {
+    Buffer *b;
+    size_t inizio;
+    int32_t n;
+} RispostaSync;
+
+static size_t in_uscita(const ConnessioneSync *conn) {
+    return conn->out.n - conn->inviati;
+}
+
+static int non_bloccante(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int aggiungi_articolo(sqlite3_int64 versione, int articolo_id, const RigaArticolo *riga,
+                             void *user_data) {
+    RispostaSync *risposta = user_data;
+    metti_articolo(risposta->b, versione, articolo_id, riga);
+    risposta->n++;
+    return risposta->b->n - risposta->inizio < SYNC_RISPOSTA_PIENA;
+}
+
+static int aggiungi_articolo_attuale(const RigaArticolo *riga, void *user_data) {
+    return aggiungi_articolo(0, riga->articolo_id, riga, user_data);
+}
+
+static int aggiungi_vendita(const RigaVendita *riga, void *user_data) {
+    RispostaSync *risposta = user_data;
+    metti_i64(risposta->b, riga->vendita_id);
+    metti_i32(risposta->b, riga->articolo_id);
+    metti_testo(risposta->b, riga->data_vendita);
+    metti_f64(risposta->b, riga->prezzo_vendita);
+    metti_testo(risposta->b, riga->nome_cliente);
+    risposta->n++;
+    return risposta->b->n - risposta->inizio < SYNC_RISPOSTA_PIENA;
+}
+
+// Righe per risposta chieste dal terminale, entro i limiti del server
+static int32_t limite_righe(int32_t limite) {
+    return limite < 1 ? 1 : limite > SYNC_RIGHE_PER_RISPOSTA ? SYNC_RIGHE_PER_RISPOSTA : limite;
+}
+
+// Completa una risposta con righe: "n" e "altre" sono stati riservati in
+// posizione_n - 1 e posizione_n. Se la lettura è fallita la risposta
+// diventa un errore.
+static void chiudi_righe(ServerSync *server, Buffer *out, size_t dati, size_t posizione_n,
+                         int letto, int32_t limite, const RispostaSync *risposta) {
+    if (letto < 0) {
+        out->n = dati;
+        metti_i32(out, SQLITE_ERROR);
+        metti_testo(out, repo_errmsg(server->repo));
+        return;
+    }
+    if (!out->errore) {
+        out->dati[posizione_n - 1] = risposta->n >= limite || risposta->b->n - risposta->inizio >= SYNC_RISPOSTA_PIENA;
+        scrivi_be32(out->dati + posizione_n, (uint32_t)risposta->n);
+    }
+}
+
+// Esegue una richiesta e ne accoda la risposta. Una richiesta malformata
+// chiude la connessione.
+static void esegui_richiesta(ServerSync *server, ConnessioneSync *conn,
+                             const unsigned char *messaggio, uint32_t lunghezza) {
+    uint32_t id = leggi_be32(messaggio);
+    uint8_t tipo = messaggio[4];
+    Lettore l = { messaggio + 5, lunghezza - 5, 0 };
+    Buffer *out = &conn->out;
+    size_t inizio = apri_messaggio(out, id, tipo);
+    size_t dati = out->n;
+
+    switch (tipo) {
+    case SYNC_CIAO:
+        if (prendi_u32(&l) != SYNC_VERSIONE_PROTOCOLLO) {
+            metti_i32(out, SQLITE_MISMATCH);
+            metti_testo(out, "versione del protocollo non supportata");
+        } else {
+            metti_i32(out, SQLITE_OK);
+            metti_testo(out, NULL);
+            metti_i64(out, server->identificativo);
+        }
+        break;
+    case SYNC_INSERISCI: {
+        NuovoArticolo articolo;
+        articolo.nome = prendi_testo(&l);
+        articolo.descrizione = prendi_testo(&l);
+        articolo.artista = prendi_testo(&l);
+        articolo.periodo = prendi_testo(&l);
+        articolo.misure = prendi_testo(&l);
+        articolo.data_acquisizione = prendi_testo(&l);
+        articolo.prezzo_acquisto = prendi_f64(&l);
+        articolo.quantita = prendi_i32(&l);
+        if (l.errore) {
+            break;
+        }
+        int nuovo_id = 0;
+        int rc = repo_insert_articolo(server->repo, &articolo, &nuovo_id);
+        metti_i32(out, rc);
+        metti_testo(out, rc == SQLITE_OK ? NULL : repo_errmsg(server->repo));
+        if (rc == SQLITE_OK) {
+            metti_i32(out, nuovo_id);
+        }
+        break;
+    }
+    case SYNC_VENDI: {
+        int articolo_id = prendi_i32(&l);
+        double prezzo = prendi_f64(&l);
+        const char *cliente = prendi_testo(&l);
+        const char *data = prendi_testo(&l);
+        if (l.errore) {
+            break;
+        }
+        // Nella transazione del blocco la vendita usa un savepoint: se
+        // fallisce annulla solo se stessa
+        EsitoVendita esito = repo_registra_vendita(server->repo, articolo_id, prezzo, cliente, data);
+        metti_i32(out, esito);
+        metti_testo(out, esito == VENDITA_ERRORE ? repo_errmsg(server->repo) : NULL);
+        break;
+    }
+    case SYNC_ELIMINA: {
+        int articolo_id = prendi_i32(&l);
+        if (l.errore) {
+            break;
+        }
+        int rc = repo_elimina_articolo(server->repo, articolo_id);
+        metti_i32(out, rc);
+        metti_testo(out, rc == SQLITE_OK ? NULL : repo_errmsg(server->repo));
+        break;
+    }
+    case SYNC_ARTICOLI: {
+        sqlite3_int64 dopo = prendi_i64(&l);
+        int32_t limite = limite_righe(prendi_i32(&l));
+        if (l.errore) {
+            break;
+        }
+        // Il registro è stato potato oltre la versione del terminale, oppure
+        // il terminale è più avanti del server (database ripristinato)
+        int troppo_vecchia = repo_versione_minima(server->repo) > dopo + 1 ||
+                             repo_versione_modifiche(server->repo) < dopo;
+        metti_i32(out, SQLITE_OK);
+        metti_testo(out, NULL);
+        metti_u8(out, troppo_vecchia);
+        metti_u8(out, 0);
+        size_t posizione_n = out->n;
+        metti_i32(out, 0);
+        RispostaSync risposta = { out, out->n, 0 };
+        int letto = troppo_vecchia ? 0 : repo_articoli_modificati(server->repo, dopo, limite,
+                                                                   aggiungi_articolo, &risposta);
+        chiudi_righe(server, out, dati, posizione_n, letto, limite, &risposta);
+        break;
+    }
+    case SYNC_ISTANTANEA: {
+        int dopo = prendi_i32(&l);
+        int32_t limite = limite_righe(prendi_i32(&l));
+        if (l.errore) {
+            break;
+        }
+        metti_i32(out, SQLITE_OK);
+        metti_testo(out, NULL);
+        metti_i64(out, repo_versione_modifiche(server->repo));
+        metti_u8(out, 0);
+        size_t posizione_n = out->n;
+        metti_i32(out, 0);
+        RispostaSync risposta = { out, out->n, 0 };
+        int letto = repo_articoli_da(server->repo, dopo, limite, aggiungi_articolo_attuale, &risposta);
+        chiudi_righe(server, out, dati, posizione_n, letto, limite, &risposta);
+        break;
+    }
+    case SYNC_VENDITE: {
+        sqlite3_int64 dopo = prendi_i64(&l);
+        int32_t limite = limite_righe(prendi_i32(&l));
+        if (l.errore) {
+            break;
+        }
+        metti_i32(out, SQLITE_OK);
+        metti_testo(out, NULL);
+        metti_u8(out, 0);
+        size_t posizione_n = out->n;
+        metti_i32(out, 0);
+        RispostaSync risposta = { out, out->n, 0 };
+        int letto = repo_vendite_da(server->repo, dopo, limite, aggiungi_vendita, &risposta);
+        chiudi_righe(server, out, dati, posizione_n, letto, limite, &risposta);
+        break;
+    }
+    default:
+        l.errore = 1;
+        break;
+    }
+
+    if (l.errore || out->errore) {
+        fprintf(stderr, "Sincronizzazione: richiesta non valida (tipo %d), terminale scollegato\n", tipo);
+        out->n = inizio;
+        conn->chiusa = 1;
+        return;
+    }
+    chiudi_messaggio(out, inizio);
+}
+
+// Lunghezza della prossima richiesta completa da eseguire, 0 se non ce n'è
+static uint32_t richiesta_pronta(ConnessioneSync *conn) {
+    size_t disponibili = conn->in.n - conn->letti;
+    if (conn->chiusa || in_uscita(conn) > SYNC_MAX_IN_USCITA || disponibili < 4) {
+        return 0;
+    }
+    uint32_t lunghezza = leggi_be32(conn->in.dati + conn->letti);
+    if (lunghezza < 5 || lunghezza > SYNC_MAX_MESSAGGIO) {
+        fprintf(stderr, "Sincronizzazione: messaggio non valido, terminale scollegato\n");
+        conn->chiusa = 1;
+        return 0;
+    }
+    return disponibili - 4 >= lunghezza ? lunghezza : 0;
+}
+
+// Esegue in un'unica transazione le richieste arrivate da tutti i
+// terminali, una per terminale a turno. Restituisce l'attesa in ms prima
+// del prossimo blocco (-1 = fino a nuovi dati).
+static int esegui_blocco(ServerSync *server) {
+    uint64_t t = traccia_inizio();
+    int eseguite = 0;
+    int transazione = 0;
+    for (int i = 0; i < server->n_connessioni; i++) {
+        server->connessioni[i]->inizio_blocco = server->connessioni[i]->out.n;
+    }
+
+    int progresso;
+    do {
+        progresso = 0;
+        for (int i = 0; i < server->n_connessioni && eseguite < SYNC_MAX_BLOCCO; i++) {
+            ConnessioneSync *conn = server->connessioni[i];
+            uint32_t lunghezza = richiesta_pronta(conn);
+            if (!lunghezza) {
+                continue;
+            }
+            if (!transazione) {
+                if (repo_inizia_transazione(server->repo) != SQLITE_OK) {
+                    fprintf(stderr, "Sincronizzazione: %s\n", repo_errmsg(server->repo));
+                    return SYNC_ATTESA_OCCUPATO_MS;
+                }
+                transazione = 1;
+            }
+            esegui_richiesta(server, conn, conn->in.dati + conn->letti + 4, lunghezza);
+            conn->letti += 4 + lunghezza;
+            eseguite++;
+            progresso = 1;
+        }
+    } while (progresso && eseguite < SYNC_MAX_BLOCCO);
+
+    if (!transazione) {
+        return -1;
+    }
+    if (repo_termina_transazione(server->repo, 1) != SQLITE_OK) {
+        // Le risposte del blocco annunciavano modifiche annullate: i
+        // terminali coinvolti vengono scollegati e al prossimo collegamento
+        // rileggono lo stato dal server
+        fprintf(stderr, "Sincronizzazione: salvataggio non riuscito: %s\n", repo_errmsg(server->repo));
+        for (int i = 0; i < server->n_connessioni; i++) {
+            ConnessioneSync *conn = server->connessioni[i];
+            if (conn->out.n > conn->inizio_blocco) {
+                conn->out.n = conn->inizio_blocco;
+                conn->chiusa = 1;
+            }
+        }
+    }
+    traccia_fine("sync", "blocco", t, eseguite, 0);
+    return eseguite == SYNC_MAX_BLOCCO ? 0 : -1;
+}
+
+static void ricevi_da(ConnessioneSync *conn) {
+    while (!conn->chiusa && conn->in.n - conn->letti <= SYNC_MAX_MESSAGGIO + 4) {
+        if (!riserva(&conn->in, 64 * 1024)) {
+            conn->chiusa = 1;
+            return;
+        }
+        ssize_t n = recv(conn->fd, conn->in.dati + conn->in.n, conn->in.capacita - conn->in.n, 0);
+        if (n > 0) {
+            conn->in.n += n;
+        } else if (n == 0) {
+            conn->chiusa = 1;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return;
+        } else if (errno != EINTR) {
+            conn->chiusa = 1;
+        }
+    }
+}
+
+static void invia_a(ConnessioneSync *conn) {
+    while (!conn->chiusa && in_uscita(conn) > 0) {
+        ssize_t n = send(conn->fd, conn->out.dati + conn->inviati, in_uscita(conn), MSG_NOSIGNAL);
+        if (n >= 0) {
+            conn->inviati += n;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else if (errno != EINTR) {
+            conn->chiusa = 1;
+        }
+    }
+    if (conn->inviati == conn->out.n) {
+        conn->out.n = conn->inviati = 0;
+    }
+}
+
+// Toglie dai buffer le richieste eseguite e le risposte inviate
+static void compatta(ConnessioneSync *conn) {
+    if (conn->letti > 0) {
+        memmove(conn->in.dati, conn->in.dati + conn->letti, conn->in.n - conn->letti);
+        conn->in.n -= conn->letti;
+        conn->letti = 0;
+    }
+    if (conn->inviati > 0 && conn->inviati >= conn->out.n / 2) {
+        memmove(conn->out.dati, conn->out.dati + conn->inviati, in_uscita(conn));
+        conn->out.n -= conn->inviati;
+        conn->inviati = 0;
+    }
+}
+
+static void chiudi_connessione(ConnessioneSync *conn) {
+    close(conn->fd);
+    libera_buffer(&conn->in);
+    libera_buffer(&conn->out);
+    free(conn);
+}
+
+static void accetta(ServerSync *server) {
+    for (;;) {
+        int fd = accept(server->ascolto, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+        ConnessioneSync *conn = NULL;
+        if (server->n_connessioni < SYNC_MAX_CONNESSIONI) {
+            conn = calloc(1, sizeof(ConnessioneSync));
+        }
+        if (!conn || non_bloccante(fd) != 0) {
+            fprintf(stderr, "Sincronizzazione: troppi terminali collegati\n");
+            free(conn);
+            close(fd);
+            continue;
+        }
+        int uno = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &uno, sizeof(uno));
+        conn->fd = fd;
+        server->connessioni[server->n_connessioni++] = conn;
+    }
+}
+
+static void *ciclo_server(void *user_data) {
+    ServerSync *server = user_data;
+    traccia_nome_thread("sincronizzazione");
+    struct pollfd attese[2 + SYNC_MAX_CONNESSIONI];
+    int attesa_ms = -1;
+
+    for (;;) {
+        attese[0] = (struct pollfd){ .fd = server->sveglia[0], .events = POLLIN };
+        attese[1] = (struct pollfd){ .fd = server->ascolto, .events = POLLIN };
+        int n = server->n_connessioni;
+        for (int i = 0; i < n; i++) {
+            ConnessioneSync *conn = server->connessioni[i];
+            short eventi = 0;
+            if (in_uscita(conn) > 0) {
+                eventi |= POLLOUT;
+            }
+            if (in_uscita(conn) <= SYNC_MAX_IN_USCITA && conn->in.n <= SYNC_MAX_MESSAGGIO + 4) {
+                eventi |= POLLIN;
+            }
+            attese[2 + i] = (struct pollfd){ .fd = conn->fd, .events = eventi };
+        }
+        if (poll(attese, 2 + n, attesa_ms) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Sincronizzazione: %s\n", strerror(errno));
+            break;
+        }
+        if (attese[0].revents) {
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (attese[2 + i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ricevi_da(server->connessioni[i]);
+            }
+        }
+        if (attese[1].revents & POLLIN) {
+            accetta(server);
+        }
+
+        attesa_ms = esegui_blocco(server);
+
+        // Le risposte partono subito: di solito il socket ha spazio e non
+        // serve un altro giro di poll
+        int restano = 0;
+        for (int i = 0; i < server->n_connessioni; i++) {
+            ConnessioneSync *conn = server->connessioni[i];
+            invia_a(conn);
+            if (conn->chiusa) {
+                chiudi_connessione(conn);
+                continue;
+            }
+            compatta(conn);
+            server->connessioni[restano++] = conn;
+        }
+        server->n_connessioni = restano;
+    }
+    return NULL;
+}
+
+static void libera_server(ServerSync *server) {
+    for (int i = 0; i < server->n_connessioni; i++) {
+        chiudi_connessione(server->connessioni[i]);
+    }
+    if (server->ascolto >= 0) {
+        close(server->ascolto);
+    }
+    if (server->sveglia[0] >= 0) {
+        close(server->sveglia[0]);
+        close(server->sveglia[1]);
+    }
+    repo_chiudi(server->repo);
+    sqlite3_close(server->db);
+    free(server);
+}
+
+// Socket in ascolto su indirizzo:porta; -1 con la descrizione in "errore"
+static int apri_ascolto(const char *indirizzo, int porta, char *errore, size_t dim_errore) {
+    char servizio[16];
+    snprintf(servizio, sizeof(servizio), "%d", porta);
+    struct addrinfo suggerimenti = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM,
+                                     .ai_flags = AI_PASSIVE };
+    struct addrinfo *indirizzi;
+    int rc = getaddrinfo(indirizzo, servizio, &suggerimenti, &indirizzi);
+    if (rc != 0) {
+        snprintf(errore, dim_errore, "Indirizzo %s non valido: %s", indirizzo ? indirizzo : "*", gai_strerror(rc));
+        return -1;
+    }
+
+    int fd = -1;
+    int errore_socket = 0;
+    for (struct addrinfo *ai = indirizzi; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            errore_socket = errno;
+            continue;
+        }
+        int uno = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &uno, sizeof(uno));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || listen(fd, 16) != 0 || non_bloccante(fd) != 0) {
+            errore_socket = errno;
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(indirizzi);
+    if (fd < 0) {
+        snprintf(errore, dim_errore, "Impossibile ascoltare sulla porta %d: %s", porta, strerror(errore_socket));
+    }
+    return fd;
+}
+
+ServerSync *server_sync_avvia(const ConfigDB *config, const char *indirizzo, int porta,
+                              char *errore, size_t dim_errore) {
+    ServerSync *server = calloc(1, sizeof(ServerSync));
+    if (!server) {
+        snprintf(errore, dim_errore, "Memoria insufficiente");
+        return NULL;
+    }
+    server->ascolto = -1;
+    server->sveglia[0] = server->sveglia[1] = -1;
+
+    if (db_apri_scrittura(config, &server->db) != SQLITE_OK || schema_aggiorna(server->db) != SQLITE_OK) {
+        snprintf(errore, dim_errore, "Impossibile aprire il database %s", config->percorso);
+        libera_server(server);
+        return NULL;
+    }
+    schema_pota_registro(server->db);
+    server->repo = repo_apri(server->db);
+    if (!server->repo) {
+        snprintf(errore, dim_errore, "Impossibile preparare le query sul database %s", config->percorso);
+        libera_server(server);
+        return NULL;
+    }
+    server->identificativo = repo_identificativo_sync(server->repo);
+    if (!server->identificativo) {
+        snprintf(errore, dim_errore, "Impossibile identificare il database: %s", repo_errmsg(server->repo));
+        libera_server(server);
+        return NULL;
+    }
+
+    server->ascolto = apri_ascolto(indirizzo, porta, errore, dim_errore);
+    if (server->ascolto < 0) {
+        libera_server(server);
+        return NULL;
+    }
+    struct sockaddr_storage locale;
+    socklen_t dim_locale = sizeof(locale);
+    getsockname(server->ascolto, (struct sockaddr*)&locale, &dim_locale);
+    server->porta = locale.ss_family == AF_INET6 ? ntohs(((struct sockaddr_in6*)&locale)->sin6_port)
+                                                 : ntohs(((struct sockaddr_in*)&locale)->sin_port);
+
+    if (pipe(server->sveglia) != 0 ||
+        pthread_create(&server->thread, NULL, ciclo_server, server) != 0) {
+        snprintf(errore, dim_errore, "Impossibile avviare il server: %s", strerror(errno));
+        libera_server(server);
+        return NULL;
+    }
+    return server;
+}
+
+int server_sync_porta(ServerSync *server) {
+    return server->porta;
+}
+
+void server_sync_ferma(ServerSync *server) {
+    if (!server) {
+        return;
+    }
+    if (write(server->sveglia[1], "x", 1) == 1) {
+        pthread_join(server->thread, NULL);
+    }
+    libera_server(server);
+}
+
+// --- Terminale ---
+
+struct ClientSync {
+    char *host;
+    char porta[16];
+    int fd;                     // -1 se non collegato
+    uint32_t ultimo_id;
+    sqlite3_int64 identificativo;   // del database del server
+    Buffer out;                 // richieste da inviare
+    Buffer in;                  // ultima risposta ricevuta
+    char errore[256];
+};
+
+// Posizione della copia locale, salvata nella tabella sincronizzazione
+typedef struct {
+    sqlite3_int64 origine;      // identificativo del server da cui è stata letta
+    sqlite3_int64 versione;     // ultima modifica degli articoli ricevuta
+    sqlite3_int64 vendita;      // ID dell'ultima vendita ricevuta
+    long applicate;
+} CursoriSync;
+
+ClientSync *client_sync_new(const char *indirizzo) {
+    ClientSync *client = calloc(1, sizeof(ClientSync));
+    if (!client) {
+        return NULL;
+    }
+    client->fd = -1;
+    snprintf(client->porta, sizeof(client->porta), "%d", SYNC_PORTA_PREDEFINITA);
+
+    // "host:porta", "[indirizzo IPv6]:porta" o solo l'host
+    const char *inizio = indirizzo;
+    size_t lunghezza = strlen(indirizzo);
+    const char *due_punti = strrchr(indirizzo, ':');
+    if (indirizzo[0] == '[') {
+        const char *chiusa = strchr(indirizzo, ']');
+        inizio = indirizzo + 1;
+        lunghezza = chiusa ? (size_t)(chiusa - inizio) : lunghezza - 1;
+        due_punti = chiusa && chiusa[1] == ':' ? chiusa + 1 : NULL;
+    } else if (due_punti && strchr(indirizzo, ':') == due_punti) {
+        lunghezza = due_punti - indirizzo;
+    } else {
+        due_punti = NULL;
+    }
+    if (due_punti) {
+        snprintf(client->porta, sizeof(client->porta), "%s", due_punti + 1);
+    }
+    client->host = strndup(inizio, lunghezza);
+    if (!client->host) {
+        free(client);
+        return NULL;
+    }
+    return client;
+}
+
+static void scollega(ClientSync *client) {
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+    }
+    client->out.n = 0;
+}
+
+void client_sync_free(ClientSync *client) {
+    if (!client) {
+        return;
+    }
+    scollega(client);
+    libera_buffer(&client->out);
+    libera_buffer(&client->in);
+    free(client->host);
+    free(client);
+}
+
+const char *client_sync_errmsg(ClientSync *client) {
+    return client->errore;
+}
+
+static int errore_rete(ClientSync *client, const char *operazione, int errore) {
+    snprintf(client->errore, sizeof(client->errore), "%s %s:%s: %s",
+             operazione, client->host, client->porta, strerror(errore));
+    scollega(client);
+    return SQLITE_IOERR;
+}
+
+static int errore_protocollo(ClientSync *client) {
+    snprintf(client->errore, sizeof(client->errore), "Risposta non valida dal server %s:%s",
+             client->host, client->porta);
+    scollega(client);
+    return SQLITE_PROTOCOL;
+}
+
+static int errore_locale(ClientSync *client, Repository *replica, int rc) {
+    snprintf(client->errore, sizeof(client->errore), "Copia locale: %s", repo_errmsg(replica));
+    return rc;
+}
+
+static int connetti_con_attesa(int fd, const struct sockaddr *indirizzo, socklen_t dim) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+        return -1;
+    }
+    int rc = connect(fd, indirizzo, dim);
+    if (rc != 0 && errno == EINPROGRESS) {
+        struct pollfd attesa = { .fd = fd, .events = POLLOUT };
+        rc = poll(&attesa, 1, SYNC_ATTESA_COLLEGAMENTO_MS);
+        if (rc == 0) {
+            errno = ETIMEDOUT;
+            rc = -1;
+        } else if (rc > 0) {
+            int errore = 0;
+            socklen_t dim_errore = sizeof(errore);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &errore, &dim_errore);
+            errno = errore;
+            rc = errore ? -1 : 0;
+        }
+    }
+    if (rc == 0) {
+        rc = fcntl(fd, F_SETFL, flags);
+    }
+    return rc;
+}
+
+static int invia(ClientSync *client) {
+    if (client->out.errore) {
+        client->out.errore = 0;
+        snprintf(client->errore, sizeof(client->errore), "Memoria insufficiente");
+        scollega(client);
+        return SQLITE_NOMEM;
+    }
+    size_t inviati = 0;
+    while (inviati < client->out.n) {
+        ssize_t n = send(client->fd, client->out.dati + inviati, client->out.n - inviati, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errore_rete(client, "Invio a", errno);
+        }
+        inviati += n;
+    }
+    client->out.n = 0;
+    return SQLITE_OK;
+}
+
+static int ricevi_tutto(ClientSync *client, unsigned char *dati, size_t n) {
+    while (n > 0) {
+        ssize_t letti = recv(client->fd, dati, n, 0);
+        if (letti > 0) {
+            dati += letti;
+            n -= letti;
+        } else if (letti == 0) {
+            return errore_rete(client, "Collegamento chiuso da", ECONNRESET);
+        } else if (errno != EINTR) {
+            return errore_rete(client, "Nessuna risposta da", errno == EAGAIN ? ETIMEDOUT : errno);
+        }
+    }
+    return SQLITE_OK;
+}
+
+// Riceve la risposta alla richiesta "id": in *codice il suo esito (con il
+// testo in client->errore), in *l il resto dei dati
+static int ricevi(ClientSync *client, uint32_t id, uint8_t tipo, Lettore *l, int *codice) {
+    unsigned char testa[4];
+    int rc = ricevi_tutto(client, testa, sizeof(testa));
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    uint32_t lunghezza = leggi_be32(testa);
+    if (lunghezza < 5 || lunghezza > SYNC_MAX_MESSAGGIO) {
+        return errore_protocollo(client);
+    }
+    client->in.n = 0;
+    client->in.errore = 0;
+    if (!riserva(&client->in, lunghezza)) {
+        snprintf(client->errore, sizeof(client->errore), "Memoria insufficiente");
+        scollega(client);
+        return SQLITE_NOMEM;
+    }
+    rc = ricevi_tutto(client, client->in.dati, lunghezza);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (leggi_be32(client->in.dati) != id || client->in.dati[4] != tipo) {
+        return errore_protocollo(client);
+    }
+
+    *l = (Lettore){ client->in.dati + 5, lunghezza - 5, 0 };
+    *codice = prendi_i32(l);
+    const char *testo = prendi_testo(l);
+    if (l->errore) {
+        return errore_protocollo(client);
+    }
+    if (*codice != 0) {
+        snprintf(client->errore, sizeof(client->errore), "%s", testo ? testo : "errore del server");
+    }
+    return SQLITE_OK;
+}
+
+static int collega(ClientSync *client) {
+    if (client->fd >= 0) {
+        return SQLITE_OK;
+    }
+    struct addrinfo suggerimenti = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *indirizzi;
+    int rc = getaddrinfo(client->host, client->porta, &suggerimenti, &indirizzi);
+    if (rc != 0) {
+        snprintf(client->errore, sizeof(client->errore), "Server %s:%s non trovato: %s",
+                 client->host, client->porta, gai_strerror(rc));
+        return SQLITE_CANTOPEN;
+    }
+    int errore = 0;
+    for (struct addrinfo *ai = indirizzi; ai && client->fd < 0; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connetti_con_attesa(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            client->fd = fd;
+        } else {
+            errore = errno;
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+    freeaddrinfo(indirizzi);
+    if (client->fd < 0) {
+        errore_rete(client, "Impossibile collegarsi a", errore);
+        return SQLITE_CANTOPEN;
+    }
+
+    // Le richieste partono subito anche se piccole; un server che non
+    // risponde non blocca il terminale più di SYNC_ATTESA_RISPOSTA_S
+    int uno = 1;
+    struct timeval attesa = { .tv_sec = SYNC_ATTESA_RISPOSTA_S };
+    setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &uno, sizeof(uno));
+    setsockopt(client->fd, SOL_SOCKET, SO_RCVTIMEO, &attesa, sizeof(attesa));
+    setsockopt(client->fd, SOL_SOCKET, SO_SNDTIMEO, &attesa, sizeof(attesa));
+
+    uint32_t id = ++client->ultimo_id;
+    size_t inizio = apri_messaggio(&client->out, id, SYNC_CIAO);
+    metti_u32(&client->out, SYNC_VERSIONE_PROTOCOLLO);
+    chiudi_messaggio(&client->out, inizio);
+
+    Lettore l;
+    int codice;
+    rc = invia(client);
+    if (rc == SQLITE_OK) {
+        rc = ricevi(client, id, SYNC_CIAO, &l, &codice);
+    }
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (codice != 0) {
+        scollega(client);
+        return codice;
+    }
+    client->identificativo = prendi_i64(&l);
+    return l.errore ? errore_protocollo(client) : SQLITE_OK;
+}
+
+static int leggi_cursori(Repository *replica, CursoriSync *cursori) {
+    cursori->applicate = 0;
+    int rc = repo_stato_sync(replica, "origine", &cursori->origine);
+    if (rc == SQLITE_OK) {
+        rc = repo_stato_sync(replica, "versione", &cursori->versione);
+    }
+    if (rc == SQLITE_OK) {
+        rc = repo_stato_sync(replica, "vendita", &cursori->vendita);
+    }
+    return rc;
+}
+
+static int salva_cursori(Repository *replica, const CursoriSync *cursori) {
+    int rc = repo_imposta_stato_sync(replica, "origine", cursori->origine);
+    if (rc == SQLITE_OK) {
+        rc = repo_imposta_stato_sync(replica, "versione", cursori->versione);
+    }
+    if (rc == SQLITE_OK) {
+        rc = repo_imposta_stato_sync(replica, "vendita", cursori->vendita);
+    }
+    return rc;
+}
+
+// Accoda le richieste delle modifiche successive ai cursori
+static void chiedi_modifiche(ClientSync *client, const CursoriSync *cursori,
+                             uint32_t *id_articoli, uint32_t *id_vendite) {
+    *id_articoli = ++client->ultimo_id;
+    size_t inizio = apri_messaggio(&client->out, *id_articoli, SYNC_ARTICOLI);
+    metti_i64(&client->out, cursori->versione);
+    metti_i32(&client->out, SYNC_RIGHE_PER_RISPOSTA);
+    chiudi_messaggio(&client->out, inizio);
+
+    *id_vendite = ++client->ultimo_id;
+    inizio = apri_messaggio(&client->out, *id_vendite, SYNC_VENDITE);
+    metti_i64(&client->out, cursori->vendita);
+    metti_i32(&client->out, SYNC_RIGHE_PER_RISPOSTA);
+    chiudi_messaggio(&client->out, inizio);
+}
+
+// Rilegge tutti gli articoli del server, a pagine per ID: gli articoli
+// locali che non compaiono più vengono eliminati. Le modifiche fatte sul
+// server durante la lettura arrivano poi con le modifiche successive alla
+// versione della prima pagina.
+static int leggi_istantanea(ClientSync *client, Repository *replica, CursoriSync *cursori) {
+    int dopo = 0;
+    for (int pagina = 0;; pagina++) {
+        uint32_t id = ++client->ultimo_id;
+        size_t inizio = apri_messaggio(&client->out, id, SYNC_ISTANTANEA);
+        metti_i32(&client->out, dopo);
+        metti_i32(&client->out, SYNC_RIGHE_PER_RISPOSTA);
+        chiudi_messaggio(&client->out, inizio);
+
+        Lettore l;
+        int codice;
+        int rc = invia(client);
+        if (rc == SQLITE_OK) {
+            rc = ricevi(client, id, SYNC_ISTANTANEA, &l, &codice);
+        }
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        if (codice != 0) {
+            return codice;
+        }
+        sqlite3_int64 versione = prendi_i64(&l);
+        int altre = prendi_u8(&l);
+        int32_t n = prendi_i32(&l);
+        if (pagina == 0) {
+            cursori->versione = versione;
+        }
+        for (int32_t i = 0; i < n && !l.errore; i++) {
+            RigaArticolo riga;
+            sqlite3_int64 v;
+            if (!prendi_articolo(&l, &v, &riga) || l.errore || riga.articolo_id <= dopo) {
+                return errore_protocollo(client);
+            }
+            rc = repo_replica_elimina_tra(replica, dopo, riga.articolo_id);
+            if (rc == SQLITE_OK) {
+                rc = repo_replica_articolo(replica, &riga);
+            }
+            if (rc != SQLITE_OK) {
+                return errore_locale(client, replica, rc);
+            }
+            dopo = riga.articolo_id;
+            cursori->applicate++;
+        }
+        if (l.errore) {
+            return errore_protocollo(client);
+        }
+        if (!altre) {
+            rc = repo_replica_elimina_tra(replica, dopo, INT_MAX);
+            return rc == SQLITE_OK ? rc : errore_locale(client, replica, rc);
+        }
+    }
+}
+
+static int rileggi_articoli(ClientSync *client, Repository *replica, CursoriSync *cursori) {
+    // Copia vuota (prima sincronizzazione): come nell'importazione, l'indice
+    // di ricerca si costruisce alla fine in una sola passata
+    sqlite3_int64 ultimo_id = 0;
+    int sospesa = repo_conta_articoli(replica) == 0 &&
+                  schema_sospendi_ricerca(repo_db(replica), &ultimo_id) == SQLITE_OK;
+    int rc = leggi_istantanea(client, replica, cursori);
+    if (sospesa && rc == SQLITE_OK) {
+        rc = schema_riprendi_ricerca(repo_db(replica), ultimo_id);
+        if (rc != SQLITE_OK) {
+            snprintf(client->errore, sizeof(client->errore), "Copia locale: %s",
+                     sqlite3_errmsg(repo_db(replica)));
+        }
+    }
+    return rc;
+}
+
+static int ricevi_articoli(ClientSync *client, Repository *replica, uint32_t id,
+                           CursoriSync *cursori, int *altre, int *troppo_vecchia) {
+    Lettore l;
+    int codice;
+    int rc = ricevi(client, id, SYNC_ARTICOLI, &l, &codice);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (codice != 0) {
+        return codice;
+    }
+    *troppo_vecchia = prendi_u8(&l);
+    *altre = prendi_u8(&l);
+    int32_t n = prendi_i32(&l);
+    for (int32_t i = 0; i < n && !l.errore; i++) {
+        RigaArticolo riga;
+        sqlite3_int64 versione;
+        int presente = prendi_articolo(&l, &versione, &riga);
+        if (l.errore) {
+            break;
+        }
+        rc = presente ? repo_replica_articolo(replica, &riga)
+                      : repo_elimina_articolo(replica, riga.articolo_id);
+        if (rc != SQLITE_OK) {
+            return errore_locale(client, replica, rc);
+        }
+        cursori->versione = versione;
+        cursori->applicate++;
+    }
+    return l.errore ? errore_protocollo(client) : SQLITE_OK;
+}
+
+// Con "applica" = 0 la risposta viene letta e scartata
+static int ricevi_vendite(ClientSync *client, Repository *replica, uint32_t id,
+                          CursoriSync *cursori, int applica, int *altre) {
+    Lettore l;
+    int codice;
+    int rc = ricevi(client, id, SYNC_VENDITE, &l, &codice);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (codice != 0) {
+        return codice;
+    }
+    *altre = prendi_u8(&l);
+    int32_t n = prendi_i32(&l);
+    if (!applica) {
+        *altre = 1;
+        return l.errore ? errore_protocollo(client) : SQLITE_OK;
+    }
+    for (int32_t i = 0; i < n && !l.errore; i++) {
+        RigaVendita riga;
+        memset(&riga, 0, sizeof(riga));
+        riga.vendita_id = prendi_i64(&l);
+        riga.articolo_id = prendi_i32(&l);
+        riga.data_vendita = prendi_testo(&l);
+        riga.prezzo_vendita = prendi_f64(&l);
+        riga.nome_cliente = prendi_testo(&l);
+        if (l.errore) {
+            break;
+        }
+        rc = repo_replica_vendita(replica, &riga);
+        if (rc != SQLITE_OK) {
+            return errore_locale(client, replica, rc);
+        }
+        cursori->vendita = riga.vendita_id;
+        cursori->applicate++;
+    }
+    return l.errore ? errore_protocollo(client) : SQLITE_OK;
+}
+
+// Riceve le modifiche già chieste (id_articoli e id_vendite, 0 se non
+// ancora chieste) e continua a chiederne finché la copia non è allineata.
+// Va chiamata in una transazione della copia locale; in caso di errore le
+// risposte ancora in arrivo non servono più e il collegamento viene chiuso.
+static int scarica_modifiche(ClientSync *client, Repository *replica, CursoriSync *cursori,
+                             uint32_t id_articoli, uint32_t id_vendite) {
+    int rc = SQLITE_OK;
+    for (;;) {
+        if (!id_articoli) {
+            chiedi_modifiche(client, cursori, &id_articoli, &id_vendite);
+            rc = invia(client);
+            if (rc != SQLITE_OK) {
+                break;
+            }
+        }
+        int altri_articoli = 0, troppo_vecchia = 0, altre_vendite = 0;
+        rc = ricevi_articoli(client, replica, id_articoli, cursori, &altri_articoli, &troppo_vecchia);
+        if (rc != SQLITE_OK) {
+            break;
+        }
+        // Le vendite si applicano dopo tutti gli articoli a cui si
+        // riferiscono: i riepiloghi per artista e periodo li leggono
+        rc = ricevi_vendite(client, replica, id_vendite, cursori,
+                            !altri_articoli && !troppo_vecchia, &altre_vendite);
+        if (rc != SQLITE_OK) {
+            break;
+        }
+        if (troppo_vecchia) {
+            rc = rileggi_articoli(client, replica, cursori);
+            if (rc != SQLITE_OK) {
+                break;
+            }
+        }
+        if (!altri_articoli && !troppo_vecchia && !altre_vendite) {
+            return SQLITE_OK;
+        }
+        id_articoli = id_vendite = 0;
+    }
+    scollega(client);
+    return rc;
+}
+
+int client_sync_aggiorna(ClientSync *client, Repository *replica, long *applicate) {
+    if (applicate) {
+        *applicate = 0;
+    }
+    int rc = collega(client);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    uint64_t t = traccia_inizio();
+    rc = repo_inizia_transazione(replica);
+    if (rc != SQLITE_OK) {
+        return errore_locale(client, replica, rc);
+    }
+    CursoriSync cursori;
+    rc = leggi_cursori(replica, &cursori);
+    if (rc == SQLITE_OK && cursori.origine != client->identificativo) {
+        // Prima sincronizzazione o server diverso: tutto da rileggere.
+        // L'origine si salva per prima: con l'origine la copia locale non
+        // scrive il giornale delle modifiche (schema 7), lo tiene il server.
+        cursori.vendita = 0;
+        cursori.origine = client->identificativo;
+        rc = repo_imposta_stato_sync(replica, "origine", cursori.origine);
+        if (rc == SQLITE_OK) {
+            rc = repo_replica_svuota_vendite(replica);
+        }
+        if (rc == SQLITE_OK) {
+            rc = rileggi_articoli(client, replica, &cursori);
+        } else {
+            errore_locale(client, replica, rc);
+        }
+    }
+    if (rc == SQLITE_OK) {
+        rc = scarica_modifiche(client, replica, &cursori, 0, 0);
+    }
+    if (rc == SQLITE_OK && (rc = salva_cursori(replica, &cursori)) != SQLITE_OK) {
+        errore_locale(client, replica, rc);
+    }
+    int rc_fine = repo_termina_transazione(replica, rc == SQLITE_OK);
+    if (rc == SQLITE_OK && rc_fine != SQLITE_OK) {
+        rc = errore_locale(client, replica, rc_fine);
+    }
+    if (rc == SQLITE_OK && applicate) {
+        *applicate = cursori.applicate;
+    }
+    traccia_fine("sync", "aggiorna", t, cursori.applicate, 0);
+    return rc;
+}
+
+// Invia la modifica già accodata (richiesta "id") insieme alle richieste
+// delle modifiche per la copia locale: un solo viaggio di andata e ritorno.
+// In *codice l'esito della modifica e in *valore (se non NULL) l'intero
+// che la segue. La copia locale viene aggiornata anche se la modifica è
+// stata rifiutata; se non riesce, ci penserà il prossimo aggiornamento.
+static int modifica(ClientSync *client, Repository *replica, uint32_t id, uint8_t tipo,
+                    int *codice, int32_t *valore) {
+    CursoriSync cursori;
+    uint32_t id_articoli = 0, id_vendite = 0;
+    // Se la copia viene da un altro server va prima riletta per intero
+    int allineata = replica && leggi_cursori(replica, &cursori) == SQLITE_OK &&
+                    cursori.origine == client->identificativo;
+    if (allineata) {
+        chiedi_modifiche(client, &cursori, &id_articoli, &id_vendite);
+    }
+
+    Lettore l;
+    int rc = invia(client);
+    if (rc == SQLITE_OK) {
+        rc = ricevi(client, id, tipo, &l, codice);
+    }
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (*codice == 0 && valore) {
+        *valore = prendi_i32(&l);
+        if (l.errore) {
+            return errore_protocollo(client);
+        }
+    }
+    if (!replica) {
+        return SQLITE_OK;
+    }
+
+    // L'esito della modifica resta in client->errore se non va a buon fine
+    char errore[sizeof(client->errore)];
+    memcpy(errore, client->errore, sizeof(errore));
+    if (!allineata) {
+        rc = client_sync_aggiorna(client, replica, NULL);
+    } else if ((rc = repo_inizia_transazione(replica)) != SQLITE_OK) {
+        errore_locale(client, replica, rc);
+        scollega(client);
+    } else {
+        rc = scarica_modifiche(client, replica, &cursori, id_articoli, id_vendite);
+        if (rc == SQLITE_OK && (rc = salva_cursori(replica, &cursori)) != SQLITE_OK) {
+            errore_locale(client, replica, rc);
+        }
+        int rc_fine = repo_termina_transazione(replica, rc == SQLITE_OK);
+        if (rc == SQLITE_OK && rc_fine != SQLITE_OK) {
+            rc = errore_locale(client, replica, rc_fine);
+        }
+    }
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Aggiornamento della copia locale non riuscito: %s\n", client->errore);
+    }
+    if (*codice != 0) {
+        memcpy(client->errore, errore, sizeof(errore));
+    }
+    return SQLITE_OK;
+}
+
+int client_sync_insert_articolo(ClientSync *client, Repository *replica,
+                                const NuovoArticolo *articolo, int *nuovo_id) {
+    int rc = collega(client);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    uint32_t id = ++client->ultimo_id;
+    size_t inizio = apri_messaggio(&client->out, id, SYNC_INSERISCI);
+    metti_testo(&client->out, articolo->nome);
+    metti_testo(&client->out, articolo->descrizione);
+    metti_testo(&client->out, articolo->artista);
+    metti_testo(&client->out, articolo->periodo);
+    metti_testo(&client->out, articolo->misure);
+    metti_testo(&client->out, articolo->data_acquisizione);
+    metti_f64(&client->out, articolo->prezzo_acquisto);
+    metti_i32(&client->out, articolo->quantita);
+    chiudi_messaggio(&client->out, inizio);
+
+    int codice;
+    int32_t id_server = 0;
+    rc = modifica(client, replica, id, SYNC_INSERISCI, &codice, &id_server);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (codice == SQLITE_OK && nuovo_id) {
+        *nuovo_id = id_server;
+    }
+    return codice;
+}
+
+EsitoVendita client_sync_registra_vendita(ClientSync *client, Repository *replica, int articolo_id,
+                                          double prezzo_vendita, const char *nome_cliente,
+                                          const char *data_vendita) {
+    if (collega(client) != SQLITE_OK) {
+        return VENDITA_ERRORE;
+    }
+    uint32_t id = ++client->ultimo_id;
+    size_t inizio = apri_messaggio(&client->out, id, SYNC_VENDI);
+    metti_i32(&client->out, articolo_id);
+    metti_f64(&client->out, prezzo_vendita);
+    metti_testo(&client->out, nome_cliente);
+    metti_testo(&client->out, data_vendita);
+    chiudi_messaggio(&client->out, inizio);
+
+    int codice;
+    if (modifica(client, replica, id, SYNC_VENDI, &codice, NULL) != SQLITE_OK) {
+        return VENDITA_ERRORE;
+    }
+    return codice >= VENDITA_OK && codice <= VENDITA_ERRORE ? (EsitoVendita)codice : VENDITA_ERRORE;
+}
+
+int client_sync_elimina_articolo(ClientSync *client, Repository *replica, int articolo_id) {
+    int rc = collega(client);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    uint32_t id = ++client->ultimo_id;
+    size_t inizio = apri_messaggio(&client->out, id, SYNC_ELIMINA);
+    metti_i32(&client->out, articolo_id);
+    chiudi_messaggio(&client->out, inizio);
+
+    int codice;
+    rc = modifica(client, replica, id, SYNC_ELIMINA, &codice, NULL);
+    return rc != SQLITE_OK ? rc : codice;
+}
@@ -0,0 +1,105 @@
+#ifndef SINCRONIZZAZIONE_H
+#define SINCRONIZZAZIONE_H
+
+#include <stddef.h>
+
+#include "connessione.h"
+#include "repository.h"
+
+// Sincronizzazione di più terminali (casse, ufficio) sullo stesso magazzino.
+// Il server possiede il database e riceve via TCP tutte le modifiche; ogni
+// terminale tiene una copia locale per lista, ricerca e report e la aggiorna
+// chiedendo al server le modifiche successive all'ultima versione ricevuta
+// (il registro articoli_modifiche per gli articoli, l'ID per le vendite).
+// Le vendite vengono decise solo dal server: due casse non possono vendere
+// lo stesso ultimo pezzo.
+//
+// Protocollo: messaggi binari, interi in big-endian.
+//
+//   messaggio = lunghezza u32 (byte che seguono), id u32, tipo u8, dati
+//   testo     = u32 byte + 1 (0 = NULL), i byte, 0 finale
+//   risposta  = stessi id e tipo della richiesta; i dati iniziano con il
+//               codice i32 (codice SQLite, EsitoVendita per SYNC_VENDI) e il
+//               testo dell'errore, il resto c'è solo se il codice è 0
+//
+// Il client può inviare più richieste senza attendere le risposte, che
+// arrivano nello stesso ordine: una vendita e la richiesta delle modifiche
+// che ne seguono costano un solo viaggio di andata e ritorno. Il server
+// esegue tutte le richieste arrivate insieme, da tutti i terminali, in
+// un'unica transazione (ognuna nel proprio savepoint).
+//
+// Non c'è autenticazione né cifratura: il server va esposto solo sulla rete
+// locale del negozio.
+
+#define SYNC_PORTA_PREDEFINITA 5480
+#define SYNC_VERSIONE_PROTOCOLLO 1
+// Righe al massimo in una risposta con articoli o vendite
+#define SYNC_RIGHE_PER_RISPOSTA 2000
+
+typedef enum {
+    SYNC_CIAO = 1,          // versione u32 -> identificativo i64 del database
+    SYNC_INSERISCI,         // 6 testi, prezzo f64, quantità i32 -> nuovo ID i32
+    SYNC_VENDI,             // articolo i32, prezzo f64, cliente, data -> (esito nel codice)
+    SYNC_ELIMINA,           // articolo i32 -> niente
+    SYNC_ARTICOLI,          // dopo_versione i64, limite i32 -> troppo_vecchia u8, altre u8, n i32, articoli
+    SYNC_ISTANTANEA,        // dopo_id i32, limite i32 -> versione i64, altre u8, n i32, articoli
+    SYNC_VENDITE            // dopo_id i64, limite i32 -> altre u8, n i32, vendite
+} TipoMessaggioSync;
+
+// Un articolo nelle risposte è: ID i32, versione i64, presente u8 e, se
+// presente, nome, descrizione, artista, periodo, misure, data di
+// acquisizione, prezzo f64 e quantità i32. Una vendita è: ID i64,
+// articolo i32, data, prezzo f64, cliente. "altre" è 1 se ci sono altre
+// righe da chiedere; "troppo_vecchia" se il registro delle modifiche non
+// arriva più fino a dopo_versione e gli articoli vanno riletti con
+// SYNC_ISTANTANEA (che ne restituisce anche la versione di partenza).
+
+// --- Server ---
+
+typedef struct ServerSync ServerSync;
+
+// Apre il database (aggiornando lo schema) e inizia ad accettare terminali
+// su indirizzo:porta in un thread dedicato. Con porta 0 ne viene scelta una
+// libera (vedi server_sync_porta). NULL con la descrizione in "errore".
+ServerSync *server_sync_avvia(const ConfigDB *config, const char *indirizzo, int porta,
+                              char *errore, size_t dim_errore);
+
+int server_sync_porta(ServerSync *server);
+
+// Chiude le connessioni, attende il thread e chiude il database
+void server_sync_ferma(ServerSync *server);
+
+// --- Terminale ---
+
+// Collegamento a un server. Va usato da un solo thread alla volta (nel
+// programma, il thread di scrittura della coda dei lavori). La connessione
+// si apre al primo uso e, se cade, viene riaperta alla richiesta successiva.
+typedef struct ClientSync ClientSync;
+
+// "indirizzo" è "host" oppure "host:porta"
+ClientSync *client_sync_new(const char *indirizzo);
+void client_sync_free(ClientSync *client);
+
+// Descrizione dell'ultimo errore
+const char *client_sync_errmsg(ClientSync *client);
+
+// Porta la copia locale allo stato del server: alla prima connessione (o se
+// il server è cambiato) rilegge tutto, poi solo le modifiche. In *applicate
+// (se non NULL) le righe ricevute. Restituisce un codice SQLite:
+// SQLITE_CANTOPEN se il server non è raggiungibile, SQLITE_IOERR se il
+// collegamento cade o il server non risponde.
+int client_sync_aggiorna(ClientSync *client, Repository *replica, long *applicate);
+
+// Le modifiche vengono eseguite dal server; poi le modifiche risultanti
+// (anche quelle degli altri terminali) vengono applicate alla copia locale
+// "replica", se non è NULL. Restituiscono gli stessi codici delle funzioni
+// del repository; se la connessione cade prima della risposta l'esito non è
+// noto, e la copia locale lo mostrerà al prossimo aggiornamento.
+int client_sync_insert_articolo(ClientSync *client, Repository *replica,
+                                const NuovoArticolo *articolo, int *nuovo_id);
+EsitoVendita client_sync_registra_vendita(ClientSync *client, Repository *replica, int articolo_id,
+                                          double prezzo_vendita, const char *nome_cliente,
+                                          const char *data_vendita);
+int client_sync_elimina_articolo(ClientSync *client, Repository *replica, int articolo_id);
+
+#endif
@@ -0,0 +1,302 @@
+#include "traccia.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MASCHERA_EVENTI (TRACCIA_EVENTI_PER_THREAD - 1)
+
+// Anello degli eventi di un thread. Lo scrive solo il thread proprietario;
+// chi legge copia gli eventi e scarta quelli che nel frattempo potrebbero
+// essere stati sovrascritti, confrontando il contatore prima e dopo.
+// Gli anelli non vengono mai liberati: quando un thread termina il suo
+// anello passa al prossimo thread che inizia a registrare.
+typedef struct Anello {
+    struct Anello *successivo;
+    atomic_int in_uso;
+    int thread;
+    _Atomic(const char *) nome;
+    atomic_uint_fast64_t scritti;
+    EventoTraccia eventi[TRACCIA_EVENTI_PER_THREAD];
+} Anello;
+
+atomic_int traccia_stato;
+
+static _Atomic(Anello *) anelli;
+static atomic_int n_anelli;
+static atomic_uint_fast64_t azzerato_ns;
+
+static _Thread_local Anello *anello_thread;
+static _Thread_local const char *nome_thread;
+
+static pthread_once_t chiave_pronta = PTHREAD_ONCE_INIT;
+static pthread_key_t chiave_uscita;
+
+static void rilascia_anello(void *dati) {
+    Anello *anello = dati;
+    atomic_store(&anello->in_uso, 0);
+}
+
+static void crea_chiave(void) {
+    pthread_key_create(&chiave_uscita, rilascia_anello);
+}
+
+// Prima registrazione del thread: riusa l'anello di un thread terminato
+// oppure ne aggiunge uno nuovo in testa alla lista
+static Anello *prendi_anello(void) {
+    pthread_once(&chiave_pronta, crea_chiave);
+
+    Anello *anello;
+    for (anello = atomic_load(&anelli); anello; anello = anello->successivo) {
+        int libero = 0;
+        if (atomic_compare_exchange_strong(&anello->in_uso, &libero, 1)) {
+            break;
+        }
+    }
+    if (!anello) {
+        anello = calloc(1, sizeof(Anello));
+        if (!anello) {
+            return NULL;
+        }
+        atomic_init(&anello->in_uso, 1);
+        anello->thread = atomic_fetch_add(&n_anelli, 1) + 1;
+        anello->successivo = atomic_load(&anelli);
+        while (!atomic_compare_exchange_weak(&anelli, &anello->successivo, anello)) {
+        }
+    }
+    atomic_store(&anello->nome, nome_thread);
+    pthread_setspecific(chiave_uscita, anello);
+    anello_thread = anello;
+    return anello;
+}
+
+void traccia_abilita(int attiva) {
+    atomic_store(&traccia_stato, attiva != 0);
+}
+
+uint64_t traccia_adesso(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+void traccia_evento(const EventoTraccia *evento) {
+    Anello *anello = anello_thread ? anello_thread : prendi_anello();
+    if (!anello) {
+        return;
+    }
+    uint64_t n = atomic_load_explicit(&anello->scritti, memory_order_relaxed);
+    anello->eventi[n & MASCHERA_EVENTI] = *evento;
+    atomic_store_explicit(&anello->scritti, n + 1, memory_order_release);
+}
+
+void traccia_registra(const char *categoria, const char *nome, uint64_t inizio,
+                      int64_t righe, uint64_t sqlite_ns) {
+    EventoTraccia evento = { categoria, nome, inizio, traccia_adesso() - inizio, righe, sqlite_ns, 0 };
+    traccia_evento(&evento);
+}
+
+void traccia_nome_thread(const char *nome) {
+    nome_thread = nome;
+    if (anello_thread) {
+        atomic_store(&anello_thread->nome, nome);
+    }
+}
+
+void traccia_azzera(void) {
+    atomic_store(&azzerato_ns, traccia_adesso());
+}
+
+// Copia in "destinazione" gli eventi validi dell'anello e ne restituisce il numero
+static long copia_anello(Anello *anello, EventoTraccia *destinazione) {
+    uint64_t fine = atomic_load_explicit(&anello->scritti, memory_order_acquire);
+    uint64_t inizio = fine > TRACCIA_EVENTI_PER_THREAD ? fine - TRACCIA_EVENTI_PER_THREAD : 0;
+    for (uint64_t i = inizio; i < fine; i++) {
+        destinazione[i - inizio] = anello->eventi[i & MASCHERA_EVENTI];
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    // Gli eventi fino a quello in scrittura adesso possono essere stati
+    // sovrascritti durante la copia
+    uint64_t dopo = atomic_load_explicit(&anello->scritti, memory_order_relaxed);
+    uint64_t validi = dopo >= TRACCIA_EVENTI_PER_THREAD ? dopo - TRACCIA_EVENTI_PER_THREAD + 1 : 0;
+    uint64_t da = validi > inizio ? validi : inizio;
+    uint64_t soglia = atomic_load(&azzerato_ns);
+
+    long n = 0;
+    for (uint64_t i = da; i < fine; i++) {
+        EventoTraccia *evento = &destinazione[i - inizio];
+        if (evento->inizio_ns >= soglia) {
+            evento->thread = anello->thread;
+            destinazione[n++] = *evento;
+        }
+    }
+    return n;
+}
+
+static int confronta_inizio(const void *a, const void *b) {
+    const EventoTraccia *x = a, *y = b;
+    return (x->inizio_ns > y->inizio_ns) - (x->inizio_ns < y->inizio_ns);
+}
+
+long traccia_raccogli(EventoTraccia **eventi) {
+    *eventi = NULL;
+    size_t capacita = (size_t)atomic_load(&n_anelli) * TRACCIA_EVENTI_PER_THREAD;
+    if (capacita == 0) {
+        return 0;
+    }
+    // Gli anelli aggiunti dopo aver calcolato la capacità non vengono letti
+    EventoTraccia *copia = malloc(capacita * sizeof(EventoTraccia));
+    if (!copia) {
+        return -1;
+    }
+    long n = 0;
+    size_t letti = 0;
+    for (Anello *anello = atomic_load(&anelli); anello; anello = anello->successivo) {
+        if (letti + TRACCIA_EVENTI_PER_THREAD > capacita) {
+            continue;
+        }
+        n += copia_anello(anello, copia + n);
+        letti += TRACCIA_EVENTI_PER_THREAD;
+    }
+    qsort(copia, (size_t)n, sizeof(EventoTraccia), confronta_inizio);
+    *eventi = copia;
+    return n;
+}
+
+static int confronta_gruppo(const void *a, const void *b) {
+    const EventoTraccia *x = a, *y = b;
+    int c = strcmp(x->categoria, y->categoria);
+    if (c == 0) {
+        c = strcmp(x->nome, y->nome);
+    }
+    if (c == 0) {
+        c = (x->durata_ns > y->durata_ns) - (x->durata_ns < y->durata_ns);
+    }
+    return c;
+}
+
+static int confronta_totale(const void *a, const void *b) {
+    const RiepilogoTraccia *x = a, *y = b;
+    return (x->totale_ms < y->totale_ms) - (x->totale_ms > y->totale_ms);
+}
+
+long traccia_riepiloga(RiepilogoTraccia **righe) {
+    *righe = NULL;
+    EventoTraccia *eventi;
+    long n = traccia_raccogli(&eventi);
+    if (n <= 0) {
+        return n;
+    }
+    // Ordinati per gruppo e durata: i percentili sono posizioni nel gruppo
+    qsort(eventi, (size_t)n, sizeof(EventoTraccia), confronta_gruppo);
+
+    RiepilogoTraccia *riepilogo = malloc((size_t)n * sizeof(RiepilogoTraccia));
+    if (!riepilogo) {
+        free(eventi);
+        return -1;
+    }
+    long gruppi = 0;
+    for (long i = 0; i < n; ) {
+        long fine = i + 1;
+        while (fine < n && strcmp(eventi[fine].categoria, eventi[i].categoria) == 0 &&
+               strcmp(eventi[fine].nome, eventi[i].nome) == 0) {
+            fine++;
+        }
+        RiepilogoTraccia *r = &riepilogo[gruppi++];
+        r->categoria = eventi[i].categoria;
+        r->nome = eventi[i].nome;
+        r->n = fine - i;
+        r->totale_ms = 0;
+        r->righe = 0;
+        for (long k = i; k < fine; k++) {
+            r->totale_ms += eventi[k].durata_ns / 1e6;
+            if (eventi[k].righe > 0) {
+                r->righe += eventi[k].righe;
+            }
+        }
+        r->p50_ms = eventi[i + (r->n - 1) * 50 / 100].durata_ns / 1e6;
+        r->p99_ms = eventi[i + (r->n - 1) * 99 / 100].durata_ns / 1e6;
+        r->max_ms = eventi[fine - 1].durata_ns / 1e6;
+        i = fine;
+    }
+    free(eventi);
+    qsort(riepilogo, (size_t)gruppi, sizeof(RiepilogoTraccia), confronta_totale);
+    *righe = riepilogo;
+    return gruppi;
+}
+
+// Stringa JSON; i nomi sono costanti del programma, ma non si sa mai
+static void scrivi_stringa(FILE *f, const char *testo) {
+    fputc('"', f);
+    for (const char *c = testo ? testo : ""; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', f);
+            fputc(*c, f);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(f, "\\u%04x", *c);
+        } else {
+            fputc(*c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+int traccia_scrivi_chrome(const char *percorso, char *errore, size_t dim_errore) {
+    EventoTraccia *eventi;
+    long n = traccia_raccogli(&eventi);
+    if (n < 0) {
+        snprintf(errore, dim_errore, "Memoria insufficiente");
+        return -1;
+    }
+    FILE *f = fopen(percorso, "w");
+    if (!f) {
+        snprintf(errore, dim_errore, "%s: %s", percorso, strerror(errno));
+        free(eventi);
+        return -1;
+    }
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+    int primo = 1;
+    for (Anello *anello = atomic_load(&anelli); anello; anello = anello->successivo) {
+        const char *nome = atomic_load(&anello->nome);
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                primo ? "" : ",\n", anello->thread);
+        scrivi_stringa(f, nome ? nome : "thread");
+        fputs("}}", f);
+        primo = 0;
+    }
+    // Tempi in microsecondi dal primo evento
+    uint64_t origine = n > 0 ? eventi[0].inizio_ns : 0;
+    for (long i = 0; i < n; i++) {
+        EventoTraccia *e = &eventi[i];
+        fputs(primo ? "{\"name\":" : ",\n{\"name\":", f);
+        scrivi_stringa(f, e->nome);
+        fputs(",\"cat\":", f);
+        scrivi_stringa(f, e->categoria);
+        fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+                e->thread, (e->inizio_ns - origine) / 1e3, e->durata_ns / 1e3);
+        if (e->righe >= 0) {
+            fprintf(f, "\"righe\":%lld", (long long)e->righe);
+        }
+        if (e->sqlite_ns > 0) {
+            fprintf(f, "%s\"sqlite_us\":%.3f", e->righe >= 0 ? "," : "", e->sqlite_ns / 1e3);
+        }
+        fputs("}}", f);
+        primo = 0;
+    }
+    fputs("\n]}\n", f);
+    free(eventi);
+
+    int ok = !ferror(f);
+    if (fclose(f) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        snprintf(errore, dim_errore, "Errore di scrittura su %s", percorso);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#ifndef TRACCIA_H
+#define TRACCIA_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Registrazione dei tempi delle operazioni (query, aggiornamenti della
+// lista, blocchi del ciclo GTK), per capire dove va il tempo quando
+// l'applicazione è lenta. Ogni thread scrive in un proprio anello di
+// TRACCIA_EVENTI_PER_THREAD eventi senza lock: quando è pieno i più vecchi
+// vengono sovrascritti. Con la registrazione spenta ogni punto di misura
+// costa una lettura atomica e un salto; gli anelli vengono allocati solo
+// dai thread che registrano qualcosa.
+//
+// Un punto di misura:
+//
+//   uint64_t t = traccia_inizio();
+//   ... operazione ...
+//   traccia_fine("sql", "pagina", t, righe, 0);
+
+// Eventi conservati per thread (potenza di 2)
+#define TRACCIA_EVENTI_PER_THREAD 8192
+
+typedef struct {
+    const char *categoria;   // stringhe statiche: viene salvato solo il puntatore
+    const char *nome;
+    uint64_t inizio_ns;      // CLOCK_MONOTONIC
+    uint64_t durata_ns;
+    int64_t righe;           // righe lette o elaborate, -1 se non significativo
+    uint64_t sqlite_ns;      // parte della durata passata dentro sqlite3_step
+    int thread;              // compilato da traccia_raccogli
+} EventoTraccia;
+
+// Tempi aggregati per categoria e nome
+typedef struct {
+    const char *categoria;
+    const char *nome;
+    long n;
+    double totale_ms;
+    double p50_ms;
+    double p99_ms;
+    double max_ms;
+    int64_t righe;
+} RiepilogoTraccia;
+
+// Non usare direttamente: vedi traccia_attiva()
+extern atomic_int traccia_stato;
+
+static inline int traccia_attiva(void) {
+    return atomic_load_explicit(&traccia_stato, memory_order_relaxed);
+}
+
+void traccia_abilita(int attiva);
+
+// Istante attuale in nanosecondi (CLOCK_MONOTONIC)
+uint64_t traccia_adesso(void);
+
+// Inizio di un punto di misura: 0 se la registrazione è spenta
+static inline uint64_t traccia_inizio(void) {
+    return traccia_attiva() ? traccia_adesso() : 0;
+}
+
+void traccia_registra(const char *categoria, const char *nome, uint64_t inizio,
+                      int64_t righe, uint64_t sqlite_ns);
+
+// Registra un'operazione iniziata a "inizio" (valore di traccia_inizio) e
+// finita adesso; non fa nulla se inizio è 0
+static inline void traccia_fine(const char *categoria, const char *nome, uint64_t inizio,
+                                int64_t righe, uint64_t sqlite_ns) {
+    if (inizio) {
+        traccia_registra(categoria, nome, inizio, righe, sqlite_ns);
+    }
+}
+
+// Registra un evento con inizio e durata già calcolati
+void traccia_evento(const EventoTraccia *evento);
+
+// Nome del thread chiamante nella traccia (stringa statica)
+void traccia_nome_thread(const char *nome);
+
+// Dimentica gli eventi registrati finora
+void traccia_azzera(void);
+
+// Copia gli eventi di tutti i thread in ordine di inizio; restituisce il
+// loro numero (-1 se la memoria non basta). *eventi va liberato con free.
+long traccia_raccogli(EventoTraccia **eventi);
+
+// Aggrega gli eventi per categoria e nome, dal tempo totale maggiore;
+// restituisce il numero di righe (-1 se la memoria non basta). *righe va
+// liberato con free.
+long traccia_riepiloga(RiepilogoTraccia **righe);
+
+// Scrive gli eventi nel formato JSON di Chrome (chrome://tracing, Perfetto).
+// Restituisce 0, oppure -1 con la descrizione in "errore".
+int traccia_scrivi_chrome(const char *percorso, char *errore, size_t dim_errore);
+
+#endif
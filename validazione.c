@@ -0,0 +1,241 @@
+#include "validazione.h"
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Salta gli spazi iniziali e restituisce la lunghezza senza quelli finali
+static const char *togli_spazi(const char *testo, size_t *lunghezza) {
+    while (*testo == ' ' || *testo == '\t') {
+        testo++;
+    }
+    size_t n = strlen(testo);
+    while (n > 0 && (testo[n - 1] == ' ' || testo[n - 1] == '\t')) {
+        n--;
+    }
+    *lunghezza = n;
+    return testo;
+}
+
+int valida_prezzo(const char *testo, double *prezzo, const char **errore) {
+    size_t n;
+    testo = togli_spazi(testo ? testo : "", &n);
+    if (n == 0) {
+        *errore = "prezzo mancante";
+        return 0;
+    }
+
+    // Copia con la virgola decimale convertita in punto; un solo separatore
+    char numero[64];
+    int separatori = 0;
+    if (n >= sizeof(numero)) {
+        *errore = "prezzo non valido";
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        char c = testo[i];
+        if (c == ',' || c == '.') {
+            separatori++;
+            c = '.';
+        } else if ((c < '0' || c > '9') && !(i == 0 && (c == '-' || c == '+'))) {
+            *errore = "prezzo non valido";
+            return 0;
+        }
+        numero[i] = c;
+    }
+    numero[n] = '\0';
+    if (separatori > 1) {
+        *errore = "prezzo non valido (usare un solo separatore decimale)";
+        return 0;
+    }
+
+    char *fine;
+    errno = 0;
+    double valore = strtod(numero, &fine);
+    if (*fine != '\0' || fine == numero || errno == ERANGE || !isfinite(valore)) {
+        *errore = "prezzo non valido";
+        return 0;
+    }
+    if (valore < 0) {
+        *errore = "prezzo negativo";
+        return 0;
+    }
+    *prezzo = valore;
+    return 1;
+}
+
+int valida_quantita(const char *testo, int predefinito, int *quantita, const char **errore) {
+    size_t n;
+    testo = togli_spazi(testo ? testo : "", &n);
+    if (n == 0) {
+        *quantita = predefinito;
+        return 1;
+    }
+
+    long valore = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (testo[i] < '0' || testo[i] > '9') {
+            *errore = "quantità non valida (serve un numero intero non negativo)";
+            return 0;
+        }
+        valore = valore * 10 + (testo[i] - '0');
+        if (valore > INT_MAX) {
+            *errore = "quantità troppo grande";
+            return 0;
+        }
+    }
+    *quantita = (int)valore;
+    return 1;
+}
+
+static int anno_bisestile(int anno) {
+    return (anno % 4 == 0 && anno % 100 != 0) || anno % 400 == 0;
+}
+
+int valida_data(const char *testo, char data[11], const char **errore) {
+    size_t n;
+    testo = togli_spazi(testo ? testo : "", &n);
+    data[0] = '\0';
+    if (n == 0) {
+        return 1;
+    }
+
+    int anno, mese, giorno, letti = 0;
+    char copia[16];
+    if (n >= sizeof(copia)) {
+        *errore = "data non valida (usare AAAA-MM-GG)";
+        return 0;
+    }
+    memcpy(copia, testo, n);
+    copia[n] = '\0';
+    if (sscanf(copia, "%4d-%2d-%2d%n", &anno, &mese, &giorno, &letti) != 3 || letti != (int)n) {
+        letti = 0;
+        if (sscanf(copia, "%2d/%2d/%4d%n", &giorno, &mese, &anno, &letti) != 3 || letti != (int)n) {
+            *errore = "data non valida (usare AAAA-MM-GG)";
+            return 0;
+        }
+    }
+
+    static const int giorni_mese[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (anno < 1 || anno > 9999 || mese < 1 || mese > 12 || giorno < 1 || giorno > 31 ||
+        giorno > giorni_mese[mese - 1] + (mese == 2 && anno_bisestile(anno))) {
+        *errore = "data inesistente";
+        return 0;
+    }
+    snprintf(data, 11, "%04d-%02d-%02d", anno, mese, giorno);
+    return 1;
+}
+
+int valida_istante(const char *testo, char istante[20], const char **errore) {
+    size_t n;
+    testo = togli_spazi(testo ? testo : "", &n);
+    char copia[32];
+    if (n == 0 || n >= sizeof(copia)) {
+        *errore = "istante non valido (usare AAAA-MM-GG HH:MM:SS)";
+        return 0;
+    }
+    memcpy(copia, testo, n);
+    copia[n] = '\0';
+
+    // La data fino al primo spazio, poi l'ora facoltativa
+    char *ora = strchr(copia, ' ');
+    if (ora) {
+        *ora++ = '\0';
+        while (*ora == ' ') {
+            ora++;
+        }
+    }
+    char data[11];
+    if (!valida_data(copia, data, errore)) {
+        return 0;
+    }
+    if (!ora) {
+        snprintf(istante, 20, "%s", data);
+        return 1;
+    }
+    int ore, minuti, secondi = 0, letti = 0;
+    size_t lunghezza_ora = strlen(ora);
+    int campi = sscanf(ora, "%2d:%2d:%2d%n", &ore, &minuti, &secondi, &letti);
+    if (campi != 3 || letti != (int)lunghezza_ora) {
+        letti = 0;
+        if (sscanf(ora, "%2d:%2d%n", &ore, &minuti, &letti) != 2 || letti != (int)lunghezza_ora) {
+            *errore = "istante non valido (usare AAAA-MM-GG HH:MM:SS)";
+            return 0;
+        }
+        campi = 2;
+    }
+    if (ore < 0 || ore > 23 || minuti < 0 || minuti > 59 || secondi < 0 || secondi > 59) {
+        *errore = "ora inesistente";
+        return 0;
+    }
+    if (campi == 3) {
+        snprintf(istante, 20, "%s %02d:%02d:%02d", data, ore, minuti, secondi);
+    } else {
+        snprintf(istante, 20, "%s %02d:%02d", data, ore, minuti);
+    }
+    return 1;
+}
+
+int valida_utf8(const char *testo) {
+    const unsigned char *p = (const unsigned char *)testo;
+    while (*p) {
+        int seguenti;
+        unsigned int minimo;
+        if (*p < 0x80) {
+            p++;
+            continue;
+        } else if ((*p & 0xE0) == 0xC0) {
+            seguenti = 1;
+            minimo = 0x80;
+        } else if ((*p & 0xF0) == 0xE0) {
+            seguenti = 2;
+            minimo = 0x800;
+        } else if ((*p & 0xF8) == 0xF0) {
+            seguenti = 3;
+            minimo = 0x10000;
+        } else {
+            return 0;
+        }
+        unsigned int codice = *p++ & (0x3F >> seguenti);
+        for (int i = 0; i < seguenti; i++, p++) {
+            if ((*p & 0xC0) != 0x80) {
+                return 0;
+            }
+            codice = (codice << 6) | (*p & 0x3F);
+        }
+        // Forme troppo lunghe, surrogati e valori oltre U+10FFFF
+        if (codice < minimo || (codice >= 0xD800 && codice <= 0xDFFF) || codice > 0x10FFFF) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int valida_articolo(const NuovoArticolo *articolo, const char **errore) {
+    size_t n;
+    if (!articolo->nome || (togli_spazi(articolo->nome, &n), n == 0)) {
+        *errore = "nome mancante";
+        return 0;
+    }
+    const char *testi[] = {
+        articolo->nome, articolo->descrizione, articolo->artista,
+        articolo->periodo, articolo->misure, articolo->data_acquisizione
+    };
+    for (size_t i = 0; i < sizeof(testi) / sizeof(testi[0]); i++) {
+        if (testi[i] && !valida_utf8(testi[i])) {
+            *errore = "testo con caratteri non validi (il file deve essere in UTF-8)";
+            return 0;
+        }
+    }
+    if (!isfinite(articolo->prezzo_acquisto) || articolo->prezzo_acquisto < 0) {
+        *errore = "prezzo non valido";
+        return 0;
+    }
+    if (articolo->quantita < 0) {
+        *errore = "quantità negativa";
+        return 0;
+    }
+    return 1;
+}
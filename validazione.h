@@ -0,0 +1,32 @@
+#ifndef VALIDAZIONE_H
+#define VALIDAZIONE_H
+
+#include "repository.h"
+
+// Controlli sui valori inseriti a mano o importati da file. Ogni funzione
+// restituisce 1 se il valore è valido, altrimenti 0 e in *errore un
+// messaggio statico da mostrare all'utente.
+
+// Importo non negativo, con punto o virgola come separatore decimale
+int valida_prezzo(const char *testo, double *prezzo, const char **errore);
+
+// Intero non negativo; se il testo è vuoto vale "predefinito"
+int valida_quantita(const char *testo, int predefinito, int *quantita, const char **errore);
+
+// Data AAAA-MM-GG o GG/MM/AAAA, riscritta in data[] come AAAA-MM-GG.
+// Un testo vuoto è valido e lascia data[] vuota.
+int valida_data(const char *testo, char data[11], const char **errore);
+
+// Istante AAAA-MM-GG, con l'ora HH:MM o HH:MM:SS facoltativa dopo uno
+// spazio (la data anche come GG/MM/AAAA), riscritto in istante[] nella
+// stessa forma con la data AAAA-MM-GG
+int valida_istante(const char *testo, char istante[20], const char **errore);
+
+// Testo UTF-8 valido (i file esportati in Latin-1 non lo sono)
+int valida_utf8(const char *testo);
+
+// Controlla tutti i campi di un articolo; i campi di testo NULL sono ammessi
+// tranne il nome
+int valida_articolo(const NuovoArticolo *articolo, const char **errore);
+
+#endif